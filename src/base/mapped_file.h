@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped on destruction.
+// The mapping is page aligned, so data placed at aligned offsets can be read in place.
+class MappedFile {
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    ~MappedFile();
+
+    // Returns false and fills error if the file cannot be opened or mapped
+    bool open(const std::string& path, std::string* error = nullptr);
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data {nullptr};
+    size_t m_size {0};
+#if defined(_WIN32)
+    void* m_file {nullptr};
+    void* m_mapping {nullptr};
+#endif
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Lock-free multiple producer, single consumer queue.
+// A linked list behind a dummy node: a producer swaps its node in as the new head with one
+// atomic exchange and then links it to the previous head, the consumer follows the links
+// from the tail. Producers never wait on each other or on the consumer. A node whose
+// producer has not linked it yet ends the consumer's view of the queue until the link lands.
+template<typename T>
+class MpscQueue {
+
+public:
+    MpscQueue() : m_head(new Node {}), m_tail(m_head.load(std::memory_order_relaxed)) {}
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+    ~MpscQueue() {
+        while (m_tail) {
+            auto* next = m_tail->next.load(std::memory_order_relaxed);
+            delete m_tail;
+            m_tail = next;
+        }
+    }
+
+    // Any thread
+    void push(T value) {
+        auto* node = new Node {};
+        node->value = std::move(value);
+        auto* previous = m_head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer thread only, returns false when nothing is ready
+    bool pop(T& value) {
+        auto* next = m_tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        // next becomes the dummy, its value is moved out
+        value = std::move(next->value);
+        delete m_tail;
+        m_tail = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next {nullptr};
+        T value {};
+    };
+
+    std::atomic<Node*> m_head;      // Last pushed node
+    Node* m_tail;                   // Dummy in front of the oldest node, owned by the consumer
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy
+// as 1, 2, 3"). Output is a pure function of (key, counter), so any element of a sequence
+// can be computed without generating the ones before it, in any order, on any thread.
+class Philox4x32 {
+
+public:
+    using Block = std::array<uint32_t, 4>;
+
+    static Block generate(Block counter, uint64_t key) {
+        auto key0 = static_cast<uint32_t>(key);
+        auto key1 = static_cast<uint32_t>(key >> 32);
+        for (int round = 0; round < ROUNDS; ++round) {
+            const auto product0 = static_cast<uint64_t>(MULTIPLIER_0) * counter[0];
+            const auto product1 = static_cast<uint64_t>(MULTIPLIER_1) * counter[2];
+            counter = Block {
+                static_cast<uint32_t>(product1 >> 32) ^ counter[1] ^ key0,
+                static_cast<uint32_t>(product1),
+                static_cast<uint32_t>(product0 >> 32) ^ counter[3] ^ key1,
+                static_cast<uint32_t>(product0)
+            };
+            key0 += WEYL_0;
+            key1 += WEYL_1;
+        }
+        return counter;
+    }
+
+private:
+    static constexpr int ROUNDS = 10;
+    static constexpr uint32_t MULTIPLIER_0 = 0xD2511F53;
+    static constexpr uint32_t MULTIPLIER_1 = 0xCD9E8D57;
+    static constexpr uint32_t WEYL_0 = 0x9E3779B9;
+    static constexpr uint32_t WEYL_1 = 0xBB67AE85;
+};
+
+// Independent sequence number stream of a seed, e.g. one per body: the same (seed, stream)
+// always yields the same values no matter which thread draws them or when.
+class PhiloxStream {
+
+public:
+    PhiloxStream(uint64_t seed, uint64_t stream) : m_seed(seed), m_stream(stream) {}
+
+    uint32_t next() {
+        if (m_used == m_block.size()) {
+            m_block = Philox4x32::generate({static_cast<uint32_t>(m_counter), static_cast<uint32_t>(m_counter >> 32),
+                                            static_cast<uint32_t>(m_stream), static_cast<uint32_t>(m_stream >> 32)}, m_seed);
+            ++m_counter;
+            m_used = 0;
+        }
+        return m_block[m_used++];
+    }
+
+    // [0, 1), converted by hand so every standard library agrees
+    float uniform() { return static_cast<float>(next() >> 8) * 0x1.0p-24f; }
+    float uniform(float min, float max) { return min + (max - min) * uniform(); }
+
+private:
+    uint64_t m_seed;
+    uint64_t m_stream;
+    uint64_t m_counter {0};
+    Philox4x32::Block m_block {};
+    size_t m_used {4};
+};
@@ -0,0 +1,205 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    // Ring of the current thread, registered on its first event
+    thread_local void* t_ring = nullptr;
+
+    const auto PROFILER_EPOCH = std::chrono::steady_clock::now();
+
+    bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    // Names are static identifiers, only quotes and backslashes need escaping
+    void writeJsonString(std::FILE* file, const char* text) {
+        std::fputc('"', file);
+        for (const char* c = text; *c != '\0'; ++c) {
+            if (*c == '"' || *c == '\\') {
+                std::fputc('\\', file);
+            }
+            std::fputc(*c, file);
+        }
+        std::fputc('"', file);
+    }
+}
+
+const char* profileCounterName(ProfileCounter counter) {
+    switch (counter) {
+        case ProfileCounter::NodeVisits: return "node_visits";
+        case ProfileCounter::DirectInteractions: return "direct_interactions";
+        case ProfileCounter::ApproximateInteractions: return "approximate_interactions";
+        case ProfileCounter::Count: break;
+    }
+    return "unknown";
+}
+
+const char* profileGaugeName(ProfileGauge gauge) {
+    switch (gauge) {
+        case ProfileGauge::TreeNodes: return "tree_nodes";
+        case ProfileGauge::TreeDepth: return "tree_depth";
+        case ProfileGauge::Count: break;
+    }
+    return "unknown";
+}
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - PROFILER_EPOCH).count());
+}
+
+Profiler::ThreadRing& Profiler::localRing() {
+    if (!t_ring) {
+        auto ring = std::make_unique<ThreadRing>();
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        ring->thread = static_cast<uint32_t>(m_rings.size());
+        ring->name = "thread " + std::to_string(ring->thread);
+        t_ring = ring.get();
+        m_rings.push_back(std::move(ring));
+    }
+    return *static_cast<ThreadRing*>(t_ring);
+}
+
+void Profiler::record(const char* name, uint64_t beginNanoseconds, uint64_t endNanoseconds) {
+    auto& ring = localRing();
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    auto& slot = ring.slots[head % RING_CAPACITY];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin.store(beginNanoseconds, std::memory_order_relaxed);
+    slot.end.store(endNanoseconds, std::memory_order_relaxed);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::setThreadName(const std::string& name) {
+    auto& ring = localRing();
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    ring.name = name;
+}
+
+std::vector<Profiler::Event> Profiler::collectEvents() const {
+    std::vector<Event> events;
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (const auto& ring : m_rings) {
+        const auto head = ring->head.load(std::memory_order_acquire);
+        const auto first = head > RING_CAPACITY ? head - RING_CAPACITY : 0;
+        const auto offset = events.size();
+        for (auto index = first; index < head; ++index) {
+            const auto& slot = ring->slots[index % RING_CAPACITY];
+            events.push_back(Event {slot.name.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed),
+                                    slot.end.load(std::memory_order_relaxed), ring->thread});
+        }
+
+        // The owner kept recording meanwhile, the oldest slots copied may hold newer events now
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const auto headAfter = ring->head.load(std::memory_order_relaxed);
+        const auto firstValid = headAfter > RING_CAPACITY ? headAfter - RING_CAPACITY : 0;
+        const auto overwritten = static_cast<size_t>(std::min(std::max(firstValid, first) - first, head - first));
+        events.erase(events.begin() + static_cast<std::ptrdiff_t>(offset),
+                     events.begin() + static_cast<std::ptrdiff_t>(offset + overwritten));
+    }
+    return events;
+}
+
+std::vector<Profiler::PhaseSummary> Profiler::summarize(uint64_t sinceNanoseconds) const {
+    std::vector<PhaseSummary> summaries;
+    for (const auto& event : collectEvents()) {
+        if (event.endNanoseconds < sinceNanoseconds) {
+            continue;
+        }
+        auto summary = std::find_if(summaries.begin(), summaries.end(), [&event](const PhaseSummary& candidate) {
+            return candidate.name == event.name || std::strcmp(candidate.name, event.name) == 0;
+        });
+        if (summary == summaries.end()) {
+            summaries.push_back(PhaseSummary {event.name});
+            summary = summaries.end() - 1;
+        }
+        const auto milliseconds = static_cast<double>(event.endNanoseconds - event.beginNanoseconds) * 1e-6;
+        // Running mean, so the sum never needs a second pass
+        ++summary->count;
+        summary->meanMilliseconds += (milliseconds - summary->meanMilliseconds) / static_cast<double>(summary->count);
+        summary->maxMilliseconds = std::max(summary->maxMilliseconds, milliseconds);
+    }
+    return summaries;
+}
+
+Profiler::Counters Profiler::getCounters() const {
+    Counters totals {};
+    std::lock_guard<std::mutex> lock(m_ringsMutex);
+    for (const auto& ring : m_rings) {
+        for (size_t c = 0; c < totals.size(); ++c) {
+            totals[c] += ring->counters[c].load(std::memory_order_relaxed);
+        }
+    }
+    return totals;
+}
+
+Profiler::Gauges Profiler::getGauges() const {
+    Gauges values {};
+    for (size_t g = 0; g < values.size(); ++g) {
+        values[g] = m_gauges[g].load(std::memory_order_relaxed);
+    }
+    return values;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path, std::string* error) const {
+    const auto events = collectEvents();
+    std::vector<std::pair<uint32_t, std::string>> threadNames;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        for (const auto& ring : m_rings) {
+            threadNames.emplace_back(ring->thread, ring->name);
+        }
+    }
+
+    auto* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        return fail(error, "cannot create " + path);
+    }
+
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (const auto& [thread, name] : threadNames) {
+        std::fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ", thread);
+        writeJsonString(file, name.c_str());
+        std::fprintf(file, "}},\n");
+    }
+    uint64_t lastEnd = 0;
+    for (const auto& event : events) {
+        std::fprintf(file, "{\"name\": ");
+        writeJsonString(file, event.name);
+        // Microseconds with nanosecond decimals, complete events need no matching end
+        std::fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f},\n", event.thread,
+                     static_cast<double>(event.beginNanoseconds) * 1e-3,
+                     static_cast<double>(event.endNanoseconds - event.beginNanoseconds) * 1e-3);
+        lastEnd = std::max(lastEnd, event.endNanoseconds);
+    }
+
+    const auto counters = getCounters();
+    const auto gauges = getGauges();
+    std::fprintf(file, "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": %.3f, \"args\": {",
+                 static_cast<double>(lastEnd) * 1e-3);
+    for (size_t c = 0; c < counters.size(); ++c) {
+        std::fprintf(file, "%s\"%s\": %llu", c > 0 ? ", " : "", profileCounterName(static_cast<ProfileCounter>(c)),
+                     static_cast<unsigned long long>(counters[c]));
+    }
+    for (size_t g = 0; g < gauges.size(); ++g) {
+        std::fprintf(file, ", \"%s\": %llu", profileGaugeName(static_cast<ProfileGauge>(g)), static_cast<unsigned long long>(gauges[g]));
+    }
+    std::fprintf(file, "}}\n]}\n");
+
+    if (std::fclose(file) != 0) {
+        return fail(error, "cannot write " + path);
+    }
+    return true;
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Tree walk counters cost a thread local add per node, they are only built into debug builds
+// unless the build asks for them explicitly
+#if !defined(GRAVITY_PROFILE_COUNTERS)
+#if defined(NDEBUG)
+#define GRAVITY_PROFILE_COUNTERS 0
+#else
+#define GRAVITY_PROFILE_COUNTERS 1
+#endif
+#endif
+
+enum class ProfileCounter : uint8_t {
+    NodeVisits,                 // Tree nodes looked at by the Barnes-Hut walks
+    DirectInteractions,         // Leaf bodies used as sources: per target in a per body walk,
+                                // per group in a grouped interaction list walk
+    ApproximateInteractions,    // Accepted nodes used as sources, counted the same way
+    Count
+};
+
+// Last value wins, set after each tree build
+enum class ProfileGauge : uint8_t {
+    TreeNodes,
+    TreeDepth,
+    Count
+};
+
+const char* profileCounterName(ProfileCounter counter);
+const char* profileGaugeName(ProfileGauge gauge);
+
+// Process wide recorder of timed scopes and counters.
+// Every thread records into a ring buffer it owns: a slot is written with relaxed stores and
+// published by a release store of the head, so recording never locks or waits. Readers copy the
+// rings and drop the slots the owner overwrote while they were copying. Only the first event of a
+// thread takes a lock, to register its ring.
+class Profiler {
+
+public:
+    // Events kept per thread, older ones are overwritten
+    static constexpr size_t RING_CAPACITY = 16384;
+
+    struct Event {
+        const char* name;           // Static string, events of one phase share the pointer
+        uint64_t beginNanoseconds;  // Since the profiler started
+        uint64_t endNanoseconds;
+        uint32_t thread;
+    };
+
+    struct PhaseSummary {
+        const char* name;
+        uint64_t count {0};
+        double meanMilliseconds {0.0};
+        double maxMilliseconds {0.0};
+    };
+
+    using Counters = std::array<uint64_t, static_cast<size_t>(ProfileCounter::Count)>;
+    using Gauges = std::array<uint64_t, static_cast<size_t>(ProfileGauge::Count)>;
+
+    static Profiler& instance();
+
+    // Timers record nothing while disabled, counters are independent of this
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    static uint64_t now();
+    void record(const char* name, uint64_t beginNanoseconds, uint64_t endNanoseconds);
+    // Label of the calling thread in the trace output
+    void setThreadName(const std::string& name);
+
+    void addCount(ProfileCounter counter, uint64_t amount) {
+        auto& value = localRing().counters[static_cast<size_t>(counter)];
+        // Single writer, no read-modify-write needed
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    void setGauge(ProfileGauge gauge, uint64_t value) { m_gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed); }
+
+    // Recorded events still in the rings, oldest first per thread
+    std::vector<Event> collectEvents() const;
+    // Per phase statistics of the events that ended after sinceNanoseconds, in order of first appearance
+    std::vector<PhaseSummary> summarize(uint64_t sinceNanoseconds) const;
+    // Totals over all threads since the start
+    Counters getCounters() const;
+    Gauges getGauges() const;
+
+    // Chrome trace-event JSON (chrome://tracing, Perfetto): one complete event per recorded scope,
+    // counter totals at the end
+    bool writeChromeTrace(const std::string& path, std::string* error = nullptr) const;
+
+private:
+    struct Slot {
+        std::atomic<const char*> name {nullptr};
+        std::atomic<uint64_t> begin {0};
+        std::atomic<uint64_t> end {0};
+    };
+
+    struct ThreadRing {
+        uint32_t thread {0};
+        std::string name;                   // Guarded by m_ringsMutex
+        std::atomic<uint64_t> head {0};     // Events ever recorded, the next slot is head % RING_CAPACITY
+        std::array<Slot, RING_CAPACITY> slots;
+        std::array<std::atomic<uint64_t>, static_cast<size_t>(ProfileCounter::Count)> counters {};
+    };
+
+    Profiler() = default;
+    ThreadRing& localRing();
+
+    std::atomic_bool m_enabled {false};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(ProfileGauge::Count)> m_gauges {};
+    mutable std::mutex m_ringsMutex;
+    // Rings outlive their threads, so a trace still has the events of a recreated thread pool
+    std::vector<std::unique_ptr<ThreadRing>> m_rings;
+};
+
+// Times the enclosing scope while the profiler is enabled
+class ProfileScope {
+
+public:
+    explicit ProfileScope(const char* name)
+        : m_name(Profiler::instance().isEnabled() ? name : nullptr)
+        , m_begin(m_name ? Profiler::now() : 0) {}
+    ~ProfileScope() {
+        if (m_name) {
+            Profiler::instance().record(m_name, m_begin, Profiler::now());
+        }
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_begin;
+};
+
+#define PROFILE_JOIN_IMPL(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_IMPL(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_JOIN(profileScope, __LINE__)(name)
+
+#if GRAVITY_PROFILE_COUNTERS
+#define PROFILE_COUNT(counter, amount) Profiler::instance().addCount(ProfileCounter::counter, (amount))
+#define PROFILE_GAUGE(gauge, value) Profiler::instance().setGauge(ProfileGauge::gauge, (value))
+#else
+#define PROFILE_COUNT(counter, amount) ((void)0)
+#define PROFILE_GAUGE(gauge, value) ((void)0)
+#endif
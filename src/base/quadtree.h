@@ -4,6 +4,7 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <utility>
 
 // Axis-Aligned Bounding Box
 struct AABB {
@@ -35,14 +36,20 @@ struct AABB {
 };
 
 // Quadtree Node
+// Nodes hold one point; at MAX_DEPTH they stop subdividing and keep further points in an
+// overflow list, so coincident points cannot recurse forever.
 template<typename T, typename Derived>
 class QuadtreeNode {
 public:
+    static constexpr int MAX_DEPTH = 24;
+
     explicit QuadtreeNode(const AABB& boundary);
 
     virtual bool insert(const glm::vec2& point, std::shared_ptr<T> data);
     virtual bool remove(const glm::vec2& point);
     std::vector<std::shared_ptr<T>> queryRange(const AABB& range) const;
+    // Nodes in this subtree and the depth of its deepest node
+    void measure(size_t& nodeCount, int& maxDepth) const;
 
 protected:
     virtual bool insertToChild(const glm::vec2& point, std::shared_ptr<T> data);
@@ -53,7 +60,9 @@ protected:
     AABB m_boundary;
     glm::vec2 m_point;
     std::shared_ptr<T> m_data;
+    std::vector<std::pair<glm::vec2, std::shared_ptr<T>>> m_overflow;   // Only at MAX_DEPTH
     bool m_divided;
+    int m_depth {0};
 
     // Children: NW, NE, SW, SE
     std::unique_ptr<QuadtreeNode> m_nw, m_ne, m_sw, m_se;
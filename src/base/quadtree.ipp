@@ -17,6 +17,12 @@ bool QuadtreeNode<T, Derived>::insert(const glm::vec2& point, std::shared_ptr<T>
         return true;
     }
 
+    // Depth cap reached, keep the point here instead of splitting again
+    if (!m_divided && m_depth >= MAX_DEPTH) {
+        m_overflow.emplace_back(point, data);
+        return true;
+    }
+
     // Need to subdivide if not already divided
     if (!m_divided) {
         subdivide();
@@ -52,8 +58,19 @@ bool QuadtreeNode<T, Derived>::remove(const glm::vec2& point) {
     if (m_data && m_point == point) {
         m_point = {};
         m_data = nullptr;
+        if (!m_overflow.empty()) {
+            m_point = m_overflow.back().first;
+            m_data = m_overflow.back().second;
+            m_overflow.pop_back();
+        }
         return true;
     }
+    for (auto it = m_overflow.begin(); it != m_overflow.end(); ++it) {
+        if (it->first == point) {
+            m_overflow.erase(it);
+            return true;
+        }
+    }
 
     // If no children, point not found
     if (!m_divided) {
@@ -77,6 +94,9 @@ void QuadtreeNode<T, Derived>::subdivide() {
     m_ne = createChildNode(AABB(neCenter, childHalfDim));
     m_sw = createChildNode(AABB(swCenter, childHalfDim));
     m_se = createChildNode(AABB(seCenter, childHalfDim));
+    for (auto* child : {m_nw.get(), m_ne.get(), m_sw.get(), m_se.get()}) {
+        child->m_depth = m_depth + 1;
+    }
 
     m_divided = true;
 }
@@ -104,6 +124,11 @@ void QuadtreeNode<T, Derived>::queryRange(const AABB& range, std::vector<std::sh
     if (m_data && range.containsPoint(m_point)) {
         found.push_back(m_data);
     }
+    for (const auto& [point, data] : m_overflow) {
+        if (range.containsPoint(point)) {
+            found.push_back(data);
+        }
+    }
 
     // No children, return
     if (!m_divided) {
@@ -116,3 +141,15 @@ void QuadtreeNode<T, Derived>::queryRange(const AABB& range, std::vector<std::sh
     m_sw->queryRange(range, found);
     m_se->queryRange(range, found);
 }
+
+template<typename T, typename Derived>
+void QuadtreeNode<T, Derived>::measure(size_t& nodeCount, int& maxDepth) const {
+    ++nodeCount;
+    maxDepth = std::max(maxDepth, m_depth);
+    if (m_divided) {
+        m_nw->measure(nodeCount, maxDepth);
+        m_ne->measure(nodeCount, maxDepth);
+        m_sw->measure(nodeCount, maxDepth);
+        m_se->measure(nodeCount, maxDepth);
+    }
+}
@@ -0,0 +1,196 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+namespace {
+    // Pool and worker index of the current thread, used to detect nested parallelFor calls
+    thread_local const ThreadPool* t_pool = nullptr;
+    thread_local size_t t_workerIndex = 0;
+
+    uint64_t elapsedNanoseconds(std::chrono::steady_clock::time_point since) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - since).count());
+    }
+}
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    threadCount = std::max<size_t>(threadCount, 1);
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    // Start threads only once every deque exists, workers steal from each other right away
+    for (size_t i = 0; i < threadCount; ++i) {
+        m_workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_stopping = true;
+    }
+    m_wakeCondition.notify_all();
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grainSize, const RangeFunction& function) {
+    if (count == 0) {
+        return;
+    }
+
+    grainSize = std::max<size_t>(grainSize, 1);
+    const auto taskCount = (count + grainSize - 1) / grainSize;
+    const auto workerCount = m_workers.size();
+    const auto isWorker = t_pool == this;
+
+    Job job;
+    job.function = &function;
+    job.pending = taskCount;
+
+    // Queue before publishing, so a woken worker never sees a negative count
+    m_queuedTasks += taskCount;
+    for (size_t w = 0; w < workerCount; ++w) {
+        // A worker keeps nested tasks for itself (others steal), an external caller
+        // hands every worker one contiguous block to keep neighbouring tasks together
+        if (isWorker && w != t_workerIndex) {
+            continue;
+        }
+        const auto firstTask = isWorker ? 0 : w * taskCount / workerCount;
+        const auto lastTask = isWorker ? taskCount : (w + 1) * taskCount / workerCount;
+
+        std::lock_guard<std::mutex> lock(m_workers[w]->mutex);
+        for (auto t = firstTask; t < lastTask; ++t) {
+            m_workers[w]->tasks.push_back(Task {&job, t * grainSize, std::min(count, (t + 1) * grainSize)});
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+    }
+    m_wakeCondition.notify_all();
+
+    if (isWorker) {
+        // Run the job's queued tasks here, but only those: an unrelated task picked up here (say,
+        // another whole simulation) would hold the caller up until it ends. Once none are queued
+        // the rest are running on thieves, and the wait below sleeps until they finish
+        Task task;
+        while (popJobTask(t_workerIndex, job, task)) {
+            runTask(t_workerIndex, task);
+        }
+    }
+
+    // The last task signals under the job mutex, so the job outlives every access to it
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.condition.wait(lock, [&job]() { return job.done; });
+}
+
+std::vector<ThreadPool::WorkerStats> ThreadPool::getWorkerStats() const {
+    std::vector<WorkerStats> stats;
+    stats.reserve(m_workers.size());
+    for (const auto& worker : m_workers) {
+        WorkerStats workerStats;
+        workerStats.busySeconds = static_cast<double>(worker->busyNanoseconds.load()) * 1e-9;
+        workerStats.idleSeconds = static_cast<double>(worker->idleNanoseconds.load()) * 1e-9;
+        workerStats.tasks = worker->taskCount.load();
+        workerStats.steals = worker->stealCount.load();
+        stats.push_back(workerStats);
+    }
+    return stats;
+}
+
+void ThreadPool::resetStats() {
+    for (auto& worker : m_workers) {
+        worker->busyNanoseconds = 0;
+        worker->idleNanoseconds = 0;
+        worker->taskCount = 0;
+        worker->stealCount = 0;
+    }
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    t_pool = this;
+    t_workerIndex = index;
+
+    while (true) {
+        Task task;
+        if (popTask(index, task) || stealTask(index, task)) {
+            runTask(index, task);
+            continue;
+        }
+
+        const auto idleStart = std::chrono::steady_clock::now();
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            m_wakeCondition.wait(lock, [this]() { return m_stopping || m_queuedTasks.load() > 0; });
+        }
+        m_workers[index]->idleNanoseconds += elapsedNanoseconds(idleStart);
+
+        if (m_stopping && m_queuedTasks.load() == 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::popTask(size_t index, Task& task) {
+    auto& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    task = worker.tasks.front();
+    worker.tasks.pop_front();
+    --m_queuedTasks;
+    return true;
+}
+
+bool ThreadPool::popJobTask(size_t index, const Job& job, Task& task) {
+    // Nested tasks are usually at the back, but an external parallelFor may have queued behind them
+    auto& worker = *m_workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    const auto found = std::find_if(worker.tasks.rbegin(), worker.tasks.rend(),
+                                    [&job](const Task& queued) { return queued.job == &job; });
+    if (found == worker.tasks.rend()) {
+        return false;
+    }
+    task = *found;
+    worker.tasks.erase(std::next(found).base());
+    --m_queuedTasks;
+    return true;
+}
+
+bool ThreadPool::stealTask(size_t thief, Task& task) {
+    const auto workerCount = m_workers.size();
+    for (size_t offset = 1; offset < workerCount; ++offset) {
+        auto& victim = *m_workers[(thief + offset) % workerCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) {
+            continue;
+        }
+        // Take from the far end, away from where the owner is working
+        task = victim.tasks.back();
+        victim.tasks.pop_back();
+        --m_queuedTasks;
+        ++m_workers[thief]->stealCount;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::runTask(size_t index, const Task& task) {
+    const auto start = std::chrono::steady_clock::now();
+    (*task.job->function)(task.begin, task.end, index);
+    m_workers[index]->busyNanoseconds += elapsedNanoseconds(start);
+    ++m_workers[index]->taskCount;
+
+    auto* job = task.job;
+    if (job->pending.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        job->condition.notify_all();
+    }
+}
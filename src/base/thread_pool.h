@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of workers with one work-stealing deque each.
+// parallelFor() splits an index range into small tasks; a worker drains its own deque
+// front to back and, once empty, steals from the back of the others, so uneven task
+// costs balance out without static partitioning.
+class ThreadPool {
+
+public:
+    // Called with [begin, end) and the index of the worker running the task
+    using RangeFunction = std::function<void(size_t begin, size_t end, size_t worker)>;
+
+    struct WorkerStats {
+        double busySeconds {0.0};
+        double idleSeconds {0.0};
+        uint64_t tasks {0};
+        uint64_t steals {0};
+    };
+
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t getThreadCount() const { return m_workers.size(); }
+
+    // Blocks until every task has run. A worker calling this first runs the tasks of its own
+    // call that nobody stole, then sleeps until the stolen ones finish, so nested calls do not deadlock.
+    void parallelFor(size_t count, size_t grainSize, const RangeFunction& function);
+
+    std::vector<WorkerStats> getWorkerStats() const;
+    void resetStats();
+
+private:
+    struct Job {
+        const RangeFunction* function {nullptr};
+        std::atomic<size_t> pending {0};
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done {false};
+    };
+
+    struct Task {
+        Job* job;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+        std::atomic<uint64_t> busyNanoseconds {0};
+        std::atomic<uint64_t> idleNanoseconds {0};
+        std::atomic<uint64_t> taskCount {0};
+        std::atomic<uint64_t> stealCount {0};
+    };
+
+    void workerLoop(size_t index);
+    bool popTask(size_t index, Task& task);
+    // Latest queued task of the worker that belongs to job
+    bool popJobTask(size_t index, const Job& job, Task& task);
+    bool stealTask(size_t thief, Task& task);
+    void runTask(size_t index, const Task& task);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<size_t> m_queuedTasks {0};
+    std::atomic_bool m_stopping {false};
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+};
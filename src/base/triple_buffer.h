@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer, single consumer triple buffer.
+// The producer fills its private buffer and publishes it with one atomic exchange;
+// the consumer picks up the latest published buffer the same way. Neither side ever
+// blocks, and the consumer always sees a complete buffer.
+template<typename T>
+class TripleBuffer {
+
+public:
+    // Producer side
+    T& getWriteBuffer() { return m_buffers[m_write]; }
+    void publish() {
+        const auto previous = m_shared.exchange(static_cast<uint8_t>(m_write | FRESH_BIT), std::memory_order_acq_rel);
+        m_write = previous & INDEX_MASK;
+    }
+
+    // Consumer side: switch to the newest buffer if one was published, returns true if so
+    bool acquire() {
+        if (!(m_shared.load(std::memory_order_relaxed) & FRESH_BIT)) {
+            return false;
+        }
+        const auto previous = m_shared.exchange(m_read, std::memory_order_acq_rel);
+        m_read = previous & INDEX_MASK;
+        return true;
+    }
+    const T& getReadBuffer() const { return m_buffers[m_read]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH_BIT = 0x4;
+
+    std::array<T, 3> m_buffers;
+    uint8_t m_write {0};                // Owned by the producer
+    uint8_t m_read {1};                 // Owned by the consumer
+    std::atomic<uint8_t> m_shared {2};  // Buffer in between, plus the fresh flag
+};
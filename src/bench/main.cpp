@@ -0,0 +1,786 @@
+#include "physics/distributed_simulation.h"
+#include "physics/nbody_simulation.h"
+#include "io/shared_memory_transport.h"
+#include "utils/scenario_generator.h"
+#include "base/profiler.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    struct BenchConfig {
+        ScenarioConfig scenario;
+        size_t steps {100};
+        size_t warmupSteps {5};
+        size_t threads {0};
+        float dt {0.01f};
+        physics::CollisionPolicy collisions {physics::CollisionPolicy::Ignore};
+        physics::Integrator integrator {physics::Integrator::Leapfrog};
+        uint32_t maxTimeBin {0};
+        float timeStepAccuracy {0.2f};
+        physics::SimulationParameters parameters;
+        physics::ForceEngine engine {physics::ForceEngine::BarnesHut};
+        physics::TreeBackend treeBackend {physics::TreeBackend::Arena};
+        physics::TreeBuildMode treeBuild {physics::TreeBuildMode::MortonBulk};
+        physics::ForceKernel kernel {physics::ForceKernel::Vectorized};
+        physics::TreeUpdateMode treeUpdate {physics::TreeUpdateMode::Rebuild};
+        float refitThreshold {0.1f};
+        size_t accuracySamples {0};
+        bool compareKernels {false};
+        std::vector<float> accuracyThetas;
+        std::string tracePath;
+        int ranks {1};
+        size_t ringBytes {SharedMemoryTransport::DEFAULT_RING_BYTES};
+        float rebalanceThreshold {physics::DistributedSimulation::DEFAULT_REBALANCE_THRESHOLD};
+        bool deterministic {false};
+    };
+
+    // Wall time of one phase over all measured steps
+    struct PhaseStats {
+        double total {0.0};
+        double min {std::numeric_limits<double>::max()};
+        double max {0.0};
+
+        void add(double seconds) {
+            total += seconds;
+            min = std::min(min, seconds);
+            max = std::max(max, seconds);
+        }
+    };
+
+    size_t getPeakRssBytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        rusage usage {};
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#if defined(__APPLE__)
+        return static_cast<size_t>(usage.ru_maxrss);           // bytes
+#else
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;    // kilobytes
+#endif
+#endif
+    }
+
+    // FNV-1a over the final state, equal hashes mean bit-identical runs
+    uint64_t hashBodies(const physics::BodyStore& bodies) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        const auto add = [&hash](const auto& values) {
+            const auto* bytes = reinterpret_cast<const uint8_t*>(values.data());
+            for (size_t i = 0; i < values.size() * sizeof(values[0]); ++i) {
+                hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+            }
+        };
+        for (const auto* values : {&bodies.x, &bodies.y, &bodies.vx, &bodies.vy, &bodies.mass}) {
+            add(*values);
+        }
+        add(bodies.id);
+        return hash;
+    }
+
+    void printUsage(const char* program) {
+        std::fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --bodies N          body count (default 10000)\n"
+            "  --steps N           measured steps (default 100)\n"
+            "  --warmup N          unmeasured steps before timing (default 5)\n"
+            "  --seed N            scenario seed (default 1)\n"
+            "  --distribution D    disk, plummer, galaxies or uniform (default disk)\n"
+            "  --threads N         worker threads, 0 for all cores (default 0)\n"
+            "  --dt F              step size (default 0.01)\n"
+            "  --collisions P      ignore, merge or elastic (default ignore)\n"
+            "  --integrator I      euler, leapfrog or yoshida4 (default leapfrog)\n"
+            "  --time-bins N       leapfrog block time step levels, 0 for a global step (default 0)\n"
+            "  --eta F             block time step accuracy (default 0.2)\n"
+            "  --theta F           opening angle (default 1)\n"
+            "  --opening C         geometric, com-offset or relative (default geometric)\n"
+            "  --alpha F           force accuracy of the relative criterion (default 0.005)\n"
+            "  --order O           monopole or quadrupole (default monopole)\n"
+            "  --softening F       softening added to squared distances (default 0.5)\n"
+            "  --engine E          barnes-hut, fmm or direct (default barnes-hut)\n"
+            "  --multipole-order N fmm expansion order, 1 to 8 (default 4)\n"
+            "  --acceptance F      fmm cell pair acceptance, rA + rB < F * d (default 0.5)\n"
+            "  --bucket N          bodies per Barnes-Hut leaf before it splits (default 8)\n"
+            "  --bounds B          fixed or dynamic root box, fixed retires escaping bodies (default dynamic)\n"
+            "  --backend T         Barnes-Hut tree, pointer or arena (default arena)\n"
+            "  --build M           insert bodies one by one or morton sort and bulk build (default morton)\n"
+            "  --kernel K          arena force pass, scalar walk per body or vectorized lists (default vectorized)\n"
+            "  --tree-update M     rebuild or refit (default rebuild)\n"
+            "  --refit-threshold F fraction of bodies allowed to change leaf before a rebuild (default 0.1)\n"
+            "  --accuracy N        compare N bodies against direct summation after the run (default 0)\n"
+            "  --compare-kernels B 1 to check the SIMD kernel and the vectorized path against scalar forces after the run (default 0)\n"
+            "  --accuracy-sweep L  comma separated theta values, Barnes-Hut against the direct engine on all bodies\n"
+            "  --trace FILE        Chrome trace-event JSON of the measured steps\n"
+            "  --deterministic B   1 for bit-identical results on any thread count, slower direct engine (default 0)\n"
+            "  --ranks N           split the bodies over N forked processes, Barnes-Hut leapfrog only (default 1)\n"
+            "  --ring-bytes N      shared memory buffer per rank pair (default 1048576)\n"
+            "  --rebalance F       force time imbalance that triggers a new split, 0 never (default 0.1)\n",
+            program);
+    }
+
+    bool parseArguments(int argc, char** argv, BenchConfig& config) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (option == "--help" || option == "-h" || i + 1 >= argc) {
+                return false;
+            }
+            const char* value = argv[++i];
+            if (option == "--bodies") {
+                config.scenario.bodyCount = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--steps") {
+                config.steps = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--warmup") {
+                config.warmupSteps = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--seed") {
+                config.scenario.seed = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--threads") {
+                config.threads = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--dt") {
+                config.dt = std::strtof(value, nullptr);
+            }
+            else if (option == "--distribution") {
+                if (!ScenarioGenerator::parseDistribution(value, config.scenario.distribution)) {
+                    std::fprintf(stderr, "unknown distribution '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--collisions") {
+                bool known = false;
+                for (auto policy : {physics::CollisionPolicy::Ignore, physics::CollisionPolicy::Merge, physics::CollisionPolicy::Elastic}) {
+                    if (std::strcmp(value, physics::collisionPolicyName(policy)) == 0) {
+                        config.collisions = policy;
+                        known = true;
+                    }
+                }
+                if (!known) {
+                    std::fprintf(stderr, "unknown collision policy '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--integrator") {
+                bool known = false;
+                for (auto integrator : {physics::Integrator::Euler, physics::Integrator::Leapfrog, physics::Integrator::Yoshida4}) {
+                    if (std::strcmp(value, physics::integratorName(integrator)) == 0) {
+                        config.integrator = integrator;
+                        known = true;
+                    }
+                }
+                if (!known) {
+                    std::fprintf(stderr, "unknown integrator '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--time-bins") {
+                config.maxTimeBin = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (option == "--eta") {
+                config.timeStepAccuracy = std::strtof(value, nullptr);
+            }
+            else if (option == "--theta") {
+                config.parameters.theta = std::strtof(value, nullptr);
+            }
+            else if (option == "--alpha") {
+                config.parameters.forceAccuracy = std::strtof(value, nullptr);
+            }
+            else if (option == "--softening") {
+                config.parameters.softening = std::strtof(value, nullptr);
+            }
+            else if (option == "--opening") {
+                if (!physics::parseOpeningCriterion(value, config.parameters.openingCriterion)) {
+                    std::fprintf(stderr, "unknown opening criterion '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--order") {
+                if (!physics::parseExpansionOrder(value, config.parameters.expansionOrder)) {
+                    std::fprintf(stderr, "unknown expansion order '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--engine") {
+                bool known = false;
+                for (auto engine : {physics::ForceEngine::BarnesHut, physics::ForceEngine::FastMultipole, physics::ForceEngine::Direct}) {
+                    if (std::strcmp(value, physics::forceEngineName(engine)) == 0) {
+                        config.engine = engine;
+                        known = true;
+                    }
+                }
+                if (!known) {
+                    std::fprintf(stderr, "unknown force engine '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--bucket") {
+                config.parameters.leafBucketSize = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (option == "--bounds") {
+                if (!physics::parseBoundaryMode(value, config.parameters.boundaryMode)) {
+                    std::fprintf(stderr, "unknown boundary mode '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--backend") {
+                if (!physics::parseTreeBackend(value, config.treeBackend)) {
+                    std::fprintf(stderr, "unknown tree backend '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--build") {
+                if (!physics::parseTreeBuildMode(value, config.treeBuild)) {
+                    std::fprintf(stderr, "unknown tree build mode '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--kernel") {
+                if (!physics::parseForceKernel(value, config.kernel)) {
+                    std::fprintf(stderr, "unknown force kernel '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--tree-update") {
+                bool known = false;
+                for (auto mode : {physics::TreeUpdateMode::Rebuild, physics::TreeUpdateMode::Refit}) {
+                    if (std::strcmp(value, physics::treeUpdateModeName(mode)) == 0) {
+                        config.treeUpdate = mode;
+                        known = true;
+                    }
+                }
+                if (!known) {
+                    std::fprintf(stderr, "unknown tree update mode '%s'\n", value);
+                    return false;
+                }
+            }
+            else if (option == "--refit-threshold") {
+                config.refitThreshold = std::strtof(value, nullptr);
+            }
+            else if (option == "--multipole-order") {
+                config.parameters.multipoleOrder = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (option == "--acceptance") {
+                config.parameters.multipoleAcceptance = std::strtof(value, nullptr);
+            }
+            else if (option == "--trace") {
+                config.tracePath = value;
+            }
+            else if (option == "--ranks") {
+                config.ranks = std::max(std::atoi(value), 1);
+            }
+            else if (option == "--ring-bytes") {
+                config.ringBytes = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--rebalance") {
+                config.rebalanceThreshold = std::strtof(value, nullptr);
+            }
+            else if (option == "--deterministic") {
+                config.deterministic = std::strtoul(value, nullptr, 10) != 0;
+            }
+            else if (option == "--accuracy") {
+                config.accuracySamples = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--compare-kernels") {
+                config.compareKernels = std::strtoul(value, nullptr, 10) != 0;
+            }
+            else if (option == "--accuracy-sweep") {
+                config.accuracyThetas.clear();
+                for (const char* cursor = value; *cursor != '\0'; ) {
+                    char* next = nullptr;
+                    const auto theta = std::strtof(cursor, &next);
+                    if (next == cursor || theta <= 0.0f) {
+                        std::fprintf(stderr, "invalid theta list '%s'\n", value);
+                        return false;
+                    }
+                    config.accuracyThetas.push_back(theta);
+                    cursor = *next == ',' ? next + 1 : next;
+                }
+            }
+            else {
+                std::fprintf(stderr, "unknown option '%s'\n", option.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void printPhase(const char* name, const PhaseStats& stats, size_t steps, bool last) {
+        const auto mean = steps > 0 ? stats.total / steps : 0.0;
+        const auto min = steps > 0 ? stats.min : 0.0;
+        std::printf("    \"%s\": {\"total_s\": %.6f, \"mean_ms\": %.4f, \"min_ms\": %.4f, \"max_ms\": %.4f}%s\n",
+                    name, stats.total, mean * 1e3, min * 1e3, stats.max * 1e3, last ? "" : ",");
+    }
+
+    // Per rank totals of a distributed run, gathered by rank 0 for the report
+    struct RankSummary {
+        double buildSeconds;
+        double forceSeconds;
+        double exchangeSeconds;
+        double integrateSeconds;
+        uint64_t bodies;
+        uint64_t exportedParticles;
+        uint64_t importedParticles;
+        uint64_t migratedBodies;
+        uint64_t sentBytes;
+    };
+
+    // Gathered forces against a direct sum with the same softened pair force, rank 0 only
+    physics::ForceAccuracy measureGatheredAccuracy(const physics::BodyStore& bodies, const physics::SimulationParameters& parameters,
+                                                   size_t sampleCount, ThreadPool& pool) {
+        physics::ForceAccuracy result;
+        const auto count = bodies.size();
+        result.samples = std::min(sampleCount, count);
+        if (result.samples == 0) {
+            return result;
+        }
+        std::vector<float> errors(result.samples, 0.0f);
+        pool.parallelFor(result.samples, 1, [&](size_t begin, size_t end, size_t) {
+            for (auto s = begin; s < end; ++s) {
+                const auto i = s * count / errors.size();
+                double directX = 0.0, directY = 0.0;
+                for (size_t j = 0; j < count; ++j) {
+                    const double rx = bodies.x[j] - bodies.x[i];
+                    const double ry = bodies.y[j] - bodies.y[i];
+                    const auto distanceSq = rx * rx + ry * ry;
+                    if (distanceSq == 0) continue;
+                    const auto scale = bodies.mass[j] / (distanceSq * std::sqrt(distanceSq + parameters.softening));
+                    directX += scale * rx;
+                    directY += scale * ry;
+                }
+                directX *= parameters.gravity * bodies.mass[i];
+                directY *= parameters.gravity * bodies.mass[i];
+                const auto magnitude = std::hypot(directX, directY);
+                errors[s] = magnitude > 0 ? static_cast<float>(std::hypot(bodies.fx[i] - directX, bodies.fy[i] - directY) / magnitude) : 0.0f;
+            }
+        });
+
+        double sumSq = 0.0;
+        for (const auto error : errors) {
+            result.maxRelativeError = std::max(result.maxRelativeError, error);
+            sumSq += static_cast<double>(error) * error;
+        }
+        result.rmsRelativeError = static_cast<float>(std::sqrt(sumSq / errors.size()));
+        return result;
+    }
+
+    // One rank of a distributed run, rank 0 prints the report
+    int runRank(const BenchConfig& config, Transport& transport) {
+        using Clock = std::chrono::steady_clock;
+        const auto rankCount = transport.getRankCount();
+        // Ranks share the machine, so all cores means a share of them each
+        const auto threads = config.threads > 0 ? config.threads : std::max<size_t>(std::thread::hardware_concurrency() / rankCount, 1);
+        std::string error;
+        const auto abort = [&error, &transport]() {
+            std::fprintf(stderr, "rank %d: %s\n", transport.getRank(), error.c_str());
+            return 1;
+        };
+
+        const auto setupStart = Clock::now();
+        auto scenario = config.scenario;
+        scenario.gravity = config.parameters.gravity;
+        physics::DistributedSimulation simulation(transport, config.parameters, threads);
+        simulation.setRebalanceThreshold(config.rebalanceThreshold);
+        // Same seed on every rank, each keeps its own region
+        simulation.setBodies(ScenarioGenerator::generate(scenario));
+        const auto setupSeconds = std::chrono::duration<double>(Clock::now() - setupStart).count();
+        for (size_t i = 0; i < config.warmupSteps; ++i) {
+            if (!simulation.step(config.dt, &error)) {
+                return abort();
+            }
+        }
+
+        PhaseStats build, force, exchange, integrate, total;
+        RankSummary summary {};
+        const auto sentStart = transport.getSentBytes();
+        const auto rebalancesStart = simulation.getRebalanceCount();
+        const auto runStart = Clock::now();
+        for (size_t i = 0; i < config.steps; ++i) {
+            const auto stepStart = Clock::now();
+            if (!simulation.step(config.dt, &error)) {
+                return abort();
+            }
+            total.add(std::chrono::duration<double>(Clock::now() - stepStart).count());
+
+            const auto& stats = simulation.getLastStepStats();
+            build.add(stats.buildSeconds);
+            force.add(stats.forceSeconds);
+            exchange.add(stats.exchangeSeconds);
+            integrate.add(stats.integrateSeconds);
+            summary.exportedParticles += stats.exportedParticles;
+            summary.importedParticles += stats.importedParticles;
+            summary.migratedBodies += stats.migratedBodies;
+        }
+        const auto wallSeconds = std::chrono::duration<double>(Clock::now() - runStart).count();
+        summary.buildSeconds = build.total;
+        summary.forceSeconds = force.total;
+        summary.exchangeSeconds = exchange.total;
+        summary.integrateSeconds = integrate.total;
+        summary.bodies = simulation.getBodies().size();
+        summary.sentBytes = transport.getSentBytes() - sentStart;
+
+        Transport::Message message(sizeof(RankSummary));
+        std::memcpy(message.data(), &summary, sizeof(RankSummary));
+        std::vector<Transport::Message> messages;
+        physics::BodyStore gathered;
+        if (!transport.allGather(message, messages, &error) || (config.accuracySamples > 0 && !simulation.gather(gathered, &error))) {
+            return abort();
+        }
+        if (transport.getRank() != 0) {
+            return 0;
+        }
+        std::vector<RankSummary> summaries(rankCount);
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            std::memcpy(&summaries[rank], messages[rank].data(), sizeof(RankSummary));
+        }
+        ThreadPool pool(threads);
+        const auto accuracy = measureGatheredAccuracy(gathered, config.parameters, config.accuracySamples, pool);
+
+        double forceTotal = 0.0, forceMax = 0.0;
+        uint64_t bodyCount = 0;
+        for (const auto& rank : summaries) {
+            forceTotal += rank.forceSeconds;
+            forceMax = std::max(forceMax, rank.forceSeconds);
+            bodyCount += rank.bodies;
+        }
+
+        // Phases are those of rank 0, the per rank totals show the balance
+        std::printf("{\n");
+        std::printf("  \"scenario\": {\"distribution\": \"%s\", \"bodies\": %zu, \"seed\": %llu, \"steps\": %zu, \"warmup\": %zu, \"dt\": %g},\n",
+                    ScenarioGenerator::distributionName(config.scenario.distribution), config.scenario.bodyCount,
+                    static_cast<unsigned long long>(config.scenario.seed), config.steps, config.warmupSteps, config.dt);
+        std::printf("  \"tree\": {\"theta\": %g, \"order\": \"%s\", \"softening\": %g, \"bucket\": %u},\n",
+                    config.parameters.theta, physics::expansionOrderName(config.parameters.expansionOrder),
+                    config.parameters.softening, config.parameters.leafBucketSize);
+        std::printf("  \"distributed\": {\"ranks\": %d, \"transport\": \"shared-memory\", \"ring_bytes\": %zu, \"rebalance_threshold\": %g, \"rebalances\": %u},\n",
+                    rankCount, config.ringBytes, config.rebalanceThreshold, simulation.getRebalanceCount() - rebalancesStart);
+        std::printf("  \"threads_per_rank\": %zu,\n", threads);
+        std::printf("  \"setup_s\": %.6f,\n", setupSeconds);
+        std::printf("  \"wall_s\": %.6f,\n", wallSeconds);
+        std::printf("  \"phases\": {\n");
+        printPhase("build", build, config.steps, false);
+        printPhase("force", force, config.steps, false);
+        printPhase("exchange", exchange, config.steps, false);
+        printPhase("integrate", integrate, config.steps, false);
+        printPhase("step", total, config.steps, true);
+        std::printf("  },\n");
+        std::printf("  \"ranks\": [\n");
+        const auto steps = std::max<size_t>(config.steps, 1);
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            const auto& entry = summaries[rank];
+            std::printf("    {\"rank\": %d, \"bodies\": %llu, \"build_s\": %.6f, \"force_s\": %.6f, \"exchange_s\": %.6f, \"integrate_s\": %.6f, "
+                        "\"exported_per_step\": %.1f, \"imported_per_step\": %.1f, \"migrated\": %llu, \"sent_bytes\": %llu}%s\n",
+                        rank, static_cast<unsigned long long>(entry.bodies), entry.buildSeconds, entry.forceSeconds,
+                        entry.exchangeSeconds, entry.integrateSeconds,
+                        static_cast<double>(entry.exportedParticles) / steps, static_cast<double>(entry.importedParticles) / steps,
+                        static_cast<unsigned long long>(entry.migratedBodies), static_cast<unsigned long long>(entry.sentBytes),
+                        rank + 1 < rankCount ? "," : "");
+        }
+        std::printf("  ],\n");
+        std::printf("  \"force_imbalance\": %.4f,\n", forceTotal > 0 ? forceMax / (forceTotal / rankCount) : 1.0);
+        if (accuracy.samples > 0) {
+            std::printf("  \"force_error\": {\"samples\": %zu, \"rms\": %.6e, \"max\": %.6e},\n",
+                        accuracy.samples, accuracy.rmsRelativeError, accuracy.maxRelativeError);
+        }
+        std::printf("  \"steps_per_s\": %.3f,\n", wallSeconds > 0 ? config.steps / wallSeconds : 0.0);
+        std::printf("  \"final_bodies\": %llu,\n", static_cast<unsigned long long>(bodyCount));
+        std::printf("  \"peak_rss_bytes\": %zu\n", getPeakRssBytes());
+        std::printf("}\n");
+        return 0;
+    }
+
+    // Forks a process per extra rank, all talking through one shared memory segment
+    int runDistributed(const BenchConfig& config) {
+        if (config.engine != physics::ForceEngine::BarnesHut || config.collisions != physics::CollisionPolicy::Ignore ||
+            config.integrator != physics::Integrator::Leapfrog || config.maxTimeBin != 0) {
+            std::fprintf(stderr, "--ranks runs the Barnes-Hut engine with a global leapfrog step and no collisions\n");
+            return 1;
+        }
+        if (config.treeBackend != physics::TreeBackend::Arena || config.treeBuild != physics::TreeBuildMode::MortonBulk ||
+            config.kernel != physics::ForceKernel::Vectorized) {
+            std::fprintf(stderr, "--ranks always builds Morton sorted arena trees with vectorized lists\n");
+            return 1;
+        }
+        if (config.parameters.expansionOrder != physics::ExpansionOrder::Monopole) {
+            // Exported tree nodes carry mass and centre only
+            std::fprintf(stderr, "--ranks exchanges monopole tree nodes, --order quadrupole is not supported\n");
+            return 1;
+        }
+        if (config.deterministic) {
+            // Imported tree cells and the domain split both change with the rank count
+            std::fprintf(stderr, "--deterministic covers thread counts within one process, not --ranks\n");
+            return 1;
+        }
+#if defined(_WIN32)
+        std::fprintf(stderr, "--ranks needs fork(), not available on Windows\n");
+        return 1;
+#else
+        // Created before any thread exists, children open it again by name
+        const auto name = "gravity-bench-" + std::to_string(getpid());
+        SharedMemoryTransport transport;
+        std::string error;
+        if (!transport.create(name, config.ranks, config.ringBytes, &error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        std::fflush(stdout);
+        std::vector<pid_t> children;
+        for (auto rank = 1; rank < config.ranks; ++rank) {
+            const auto pid = fork();
+            if (pid == 0) {
+                // The inherited transport would remove the segment on destruction, leave without unwinding
+                SharedMemoryTransport child;
+                auto status = 1;
+                if (child.open(name, rank, &error)) {
+                    status = runRank(config, child);
+                }
+                else {
+                    std::fprintf(stderr, "rank %d: %s\n", rank, error.c_str());
+                }
+                std::fflush(stdout);
+                std::fflush(stderr);
+                std::_Exit(status);
+            }
+            if (pid < 0) {
+                std::fprintf(stderr, "cannot fork rank %d\n", rank);
+                break;
+            }
+            children.push_back(pid);
+        }
+
+        auto status = static_cast<int>(children.size()) + 1 == config.ranks ? runRank(config, transport) : 1;
+        for (const auto pid : children) {
+            int childStatus = 0;
+            if (waitpid(pid, &childStatus, 0) < 0 || !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0) {
+                status = 1;
+            }
+        }
+        return status;
+#endif
+    }
+}
+
+//------------------------------------------------------------------------------------
+// Headless benchmark: fixed scenario, timed steps, JSON report on stdout
+//------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    if (!parseArguments(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (config.ranks > 1) {
+        return runDistributed(config);
+    }
+
+    // Setup
+    //--------------------------------------------------------------------------------------
+    using Clock = std::chrono::steady_clock;
+    const auto setupStart = Clock::now();
+    config.scenario.gravity = config.parameters.gravity;
+    physics::NBodySimulation simulation(config.scenario.area, config.parameters);
+    simulation.setThreadCount(config.threads);
+    simulation.setCollisionPolicy(config.collisions);
+    simulation.setIntegrator(config.integrator);
+    simulation.setMaxTimeBin(config.maxTimeBin);
+    simulation.setTimeStepAccuracy(config.timeStepAccuracy);
+    simulation.setForceEngine(config.engine);
+    simulation.setTreeBackend(config.treeBackend);
+    simulation.setTreeBuildMode(config.treeBuild);
+    simulation.setForceKernel(config.kernel);
+    simulation.setTreeUpdateMode(config.treeUpdate);
+    simulation.setRefitThreshold(config.refitThreshold);
+    simulation.setDeterministic(config.deterministic);
+    simulation.setBodies(ScenarioGenerator::generate(config.scenario, &simulation.getThreadPool()));
+    const auto setupSeconds = std::chrono::duration<double>(Clock::now() - setupStart).count();
+
+    for (size_t i = 0; i < config.warmupSteps; ++i) {
+        simulation.step(config.dt);
+        simulation.clearRetiredBodies();
+    }
+    const auto initialEnergy = simulation.measureEnergy();
+
+    // Measured steps
+    //--------------------------------------------------------------------------------------
+    PhaseStats build, force, integrate, collide, total;
+    size_t contacts = 0;
+    uint64_t forceEvaluations = 0, substeps = 0;
+    uint64_t treeRebuilds = 0, treeRefits = 0, migratedBodies = 0, refitBodies = 0;
+    uint64_t interactions = 0;
+    size_t retired = 0, maxRetired = 0;
+    auto& profiler = Profiler::instance();
+    profiler.setThreadName("bench");
+    profiler.setEnabled(!config.tracePath.empty());
+    const auto countersStart = profiler.getCounters();
+    simulation.getThreadPool().resetStats();
+    const auto runStart = Clock::now();
+    for (size_t i = 0; i < config.steps; ++i) {
+        const auto stepStart = Clock::now();
+        simulation.step(config.dt);
+        total.add(std::chrono::duration<double>(Clock::now() - stepStart).count());
+
+        const auto& timings = simulation.getLastStepTimings();
+        build.add(timings.buildSeconds);
+        force.add(timings.forceSeconds);
+        integrate.add(timings.integrateSeconds);
+        collide.add(timings.collisionSeconds);
+        contacts += simulation.getCollisionStats().contacts;
+        interactions += timings.interactions;
+        forceEvaluations += timings.forceEvaluations;
+        substeps += timings.substeps;
+        treeRebuilds += timings.treeRebuilds;
+        treeRefits += timings.treeRefits;
+        migratedBodies += timings.migratedBodies;
+        refitBodies += timings.refitBodies;
+        // Totals are kept by the simulation, the bodies themselves are not needed here
+        retired += simulation.getLastStepRetiredCount();
+        maxRetired = std::max(maxRetired, simulation.getLastStepRetiredCount());
+        simulation.clearRetiredBodies();
+    }
+    const auto wallSeconds = std::chrono::duration<double>(Clock::now() - runStart).count();
+    // Before the energy and accuracy passes add work of their own
+    const auto workerStats = simulation.getThreadPool().getWorkerStats();
+    // Only the measured steps go into the trace and the counters
+    profiler.setEnabled(false);
+    auto counters = profiler.getCounters();
+    for (size_t c = 0; c < counters.size(); ++c) {
+        counters[c] -= countersStart[c];
+    }
+    if (!config.tracePath.empty()) {
+        std::string error;
+        if (!profiler.writeChromeTrace(config.tracePath, &error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+        }
+    }
+    const auto finalEnergy = simulation.measureEnergy();
+    const auto accuracy = simulation.measureForceAccuracy(config.accuracySamples);
+    const auto kernels = config.compareKernels ? simulation.compareForceKernels() : physics::KernelComparison {};
+
+    // Tree error over theta with the direct engine as ground truth, on the final bodies
+    std::vector<physics::ForceAccuracy> sweep;
+    if (!config.accuracyThetas.empty()) {
+        simulation.setForceEngine(physics::ForceEngine::BarnesHut);
+        auto parameters = config.parameters;
+        for (const auto theta : config.accuracyThetas) {
+            parameters.theta = theta;
+            simulation.setParameters(parameters);
+            sweep.push_back(simulation.measureAgainstDirect());
+        }
+    }
+
+    // Report
+    //--------------------------------------------------------------------------------------
+    std::printf("{\n");
+    std::printf("  \"scenario\": {\"distribution\": \"%s\", \"bodies\": %zu, \"seed\": %llu, \"steps\": %zu, \"warmup\": %zu, \"dt\": %g, \"collisions\": \"%s\", \"integrator\": \"%s\", \"time_bins\": %u, \"eta\": %g},\n",
+                ScenarioGenerator::distributionName(config.scenario.distribution), config.scenario.bodyCount,
+                static_cast<unsigned long long>(config.scenario.seed), config.steps, config.warmupSteps, config.dt,
+                physics::collisionPolicyName(config.collisions), physics::integratorName(config.integrator),
+                config.maxTimeBin, config.timeStepAccuracy);
+    std::printf("  \"tree\": {\"engine\": \"%s\", \"backend\": \"%s\", \"build\": \"%s\", \"kernel\": \"%s\", \"theta\": %g, \"opening\": \"%s\", \"alpha\": %g, \"order\": \"%s\", "
+                "\"multipole_order\": %u, \"acceptance\": %g, \"softening\": %g, \"bucket\": %u, \"bounds\": \"%s\"},\n",
+                physics::forceEngineName(config.engine), physics::treeBackendName(config.treeBackend),
+                physics::treeBuildModeName(config.treeBuild), physics::forceKernelName(config.kernel), config.parameters.theta,
+                physics::openingCriterionName(config.parameters.openingCriterion), config.parameters.forceAccuracy,
+                physics::expansionOrderName(config.parameters.expansionOrder), config.parameters.multipoleOrder,
+                config.parameters.multipoleAcceptance, config.parameters.softening, config.parameters.leafBucketSize,
+                physics::boundaryModeName(config.parameters.boundaryMode));
+    std::printf("  \"threads\": %zu,\n", simulation.getThreadPool().getThreadCount());
+    std::printf("  \"workers\": [");
+    for (size_t w = 0; w < workerStats.size(); ++w) {
+        std::printf("%s{\"busy_ms\": %.3f, \"idle_ms\": %.3f, \"tasks\": %llu, \"steals\": %llu}", w > 0 ? ", " : "",
+                    workerStats[w].busySeconds * 1e3, workerStats[w].idleSeconds * 1e3,
+                    static_cast<unsigned long long>(workerStats[w].tasks), static_cast<unsigned long long>(workerStats[w].steals));
+    }
+    std::printf("],\n");
+    std::printf("  \"deterministic\": %s,\n", simulation.isDeterministic() ? "true" : "false");
+    std::printf("  \"kernel_isa\": \"%s\",\n", physics::kernelIsaName(simulation.getKernelIsa()));
+    std::printf("  \"setup_s\": %.6f,\n", setupSeconds);
+    std::printf("  \"wall_s\": %.6f,\n", wallSeconds);
+    std::printf("  \"phases\": {\n");
+    printPhase("build", build, config.steps, false);
+    printPhase("force", force, config.steps, false);
+    printPhase("integrate", integrate, config.steps, false);
+    printPhase("collide", collide, config.steps, false);
+    printPhase("step", total, config.steps, true);
+    std::printf("  },\n");
+    std::printf("  \"interactions\": %llu,\n", static_cast<unsigned long long>(interactions));
+    std::printf("  \"interactions_per_s\": %.1f,\n", force.total > 0 ? interactions / force.total : 0.0);
+    std::printf("  \"steps_per_s\": %.3f,\n", wallSeconds > 0 ? config.steps / wallSeconds : 0.0);
+    std::printf("  \"final_bodies\": %zu,\n", simulation.getBodies().size());
+    std::printf("  \"substeps\": %llu,\n", static_cast<unsigned long long>(substeps));
+    std::printf("  \"force_evaluations\": %llu,\n", static_cast<unsigned long long>(forceEvaluations));
+    std::printf("  \"tree_update\": {\"mode\": \"%s\", \"threshold\": %g, \"rebuilds\": %llu, \"refits\": %llu, \"migration_rate\": %.6e},\n",
+                physics::treeUpdateModeName(config.treeUpdate), config.refitThreshold,
+                static_cast<unsigned long long>(treeRebuilds), static_cast<unsigned long long>(treeRefits),
+                refitBodies > 0 ? static_cast<double>(migratedBodies) / refitBodies : 0.0);
+#if GRAVITY_PROFILE_COUNTERS
+    std::printf("  \"tree_counters\": {");
+    for (size_t c = 0; c < counters.size(); ++c) {
+        std::printf("\"%s_per_step\": %.1f, ", profileCounterName(static_cast<ProfileCounter>(c)),
+                    config.steps > 0 ? static_cast<double>(counters[c]) / config.steps : 0.0);
+    }
+    const auto gauges = profiler.getGauges();
+    std::printf("\"%s\": %llu, \"%s\": %llu},\n",
+                profileGaugeName(ProfileGauge::TreeNodes), static_cast<unsigned long long>(gauges[static_cast<size_t>(ProfileGauge::TreeNodes)]),
+                profileGaugeName(ProfileGauge::TreeDepth), static_cast<unsigned long long>(gauges[static_cast<size_t>(ProfileGauge::TreeDepth)]));
+#endif
+    std::printf("  \"energy\": {\"initial\": %.9g, \"final\": %.9g, \"relative_drift\": %.6e},\n",
+                initialEnergy.total, finalEnergy.total, finalEnergy.relativeDrift);
+    if (accuracy.samples > 0) {
+        std::printf("  \"force_error\": {\"samples\": %zu, \"rms\": %.6e, \"max\": %.6e, \"interactions_per_body\": %.1f},\n",
+                    accuracy.samples, accuracy.rmsRelativeError, accuracy.maxRelativeError,
+                    static_cast<double>(accuracy.interactions) / accuracy.samples);
+    }
+    if (config.compareKernels) {
+        std::printf("  \"kernel_comparison\": {\"isa\": \"%s\", \"max_kernel_error\": %.6e, \"max_path_error\": %.6e, \"rms_path_error\": %.6e},\n",
+                    physics::kernelIsaName(kernels.isa), kernels.maxKernelError, kernels.maxRelativeError, kernels.rmsRelativeError);
+    }
+    if (!sweep.empty()) {
+        std::printf("  \"accuracy_sweep\": [\n");
+        for (size_t i = 0; i < sweep.size(); ++i) {
+            std::printf("    {\"theta\": %g, \"rms\": %.6e, \"max\": %.6e, \"interactions_per_body\": %.1f}%s\n",
+                        config.accuracyThetas[i], sweep[i].rmsRelativeError, sweep[i].maxRelativeError,
+                        sweep[i].samples > 0 ? static_cast<double>(sweep[i].interactions) / sweep[i].samples : 0.0,
+                        i + 1 < sweep.size() ? "," : "");
+        }
+        std::printf("  ],\n");
+    }
+    std::printf("  \"contacts\": %zu,\n", contacts);
+    std::printf("  \"merged\": %zu,\n", simulation.getTotalMergedCount());
+    std::printf("  \"escaped\": %zu,\n", simulation.getTotalRetiredCount() - simulation.getTotalMergedCount());
+    std::printf("  \"retired_per_step\": {\"mean\": %.3f, \"max\": %zu},\n",
+                config.steps > 0 ? static_cast<double>(retired) / config.steps : 0.0, maxRetired);
+    std::printf("  \"state_hash\": \"%016llx\",\n", static_cast<unsigned long long>(hashBodies(simulation.getBodies())));
+    std::printf("  \"peak_rss_bytes\": %zu\n", getPeakRssBytes());
+    std::printf("}\n");
+
+    return 0;
+}
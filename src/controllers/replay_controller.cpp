@@ -0,0 +1,95 @@
+#include "replay_controller.h"
+
+#include <algorithm>
+#include <string>
+
+bool ReplayController::open(const std::string& path, std::string* error) {
+    if (!m_reader.open(path, error)) {
+        return false;
+    }
+    if (m_reader.getFrameCount() == 0) {
+        if (error) {
+            *error = path + " contains no frames";
+        }
+        return false;
+    }
+
+    const auto& header = m_reader.getHeader();
+    const auto frameSeconds = header.dt * header.stepInterval;
+    m_frameSeconds = frameSeconds > 0.0f ? frameSeconds : 1.0f / 60.0f;
+    restart();
+    return true;
+}
+
+void ReplayController::restart() {
+    m_reader.readFrame(0, m_current);
+    m_next = m_current;
+    m_nextIndex = 0;
+    advance();
+    m_phase = 0.0f;
+    m_lastRenderTime = std::chrono::steady_clock::now();
+    buildSnapshot();
+}
+
+bool ReplayController::advance() {
+    if (m_nextIndex + 1 >= m_reader.getFrameCount()) {
+        return false;
+    }
+    std::swap(m_current, m_next);
+    ++m_nextIndex;
+    return m_reader.readFrame(m_nextIndex, m_next);
+}
+
+void ReplayController::buildSnapshot() {
+    m_snapshot.positions.clear();
+    m_snapshot.previousPositions.clear();
+    m_snapshot.appearances.clear();
+
+    // Both frames are in id order, bodies missing from m_current appear without moving
+    size_t previous = 0;
+    for (size_t i = 0; i < m_next.ids.size(); ++i) {
+        const auto id = m_next.ids[i];
+        while (previous < m_current.ids.size() && m_current.ids[previous] < id) {
+            ++previous;
+        }
+        const auto found = previous < m_current.ids.size() && m_current.ids[previous] == id;
+        m_snapshot.positions.push_back(m_next.positions[i]);
+        m_snapshot.previousPositions.push_back(found ? m_current.positions[previous] : m_next.positions[i]);
+        m_snapshot.appearances.push_back(BodyAppearance {});
+    }
+    m_snapshot.stepIndex = m_next.stepIndex;
+}
+
+void ReplayController::render(const ViewCamera& camera) {
+    ClearBackground(BLACK);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!m_paused) {
+        m_phase += std::chrono::duration<float>(now - m_lastRenderTime).count();
+    }
+    m_lastRenderTime = now;
+
+    auto moved = false;
+    while (m_phase >= m_frameSeconds) {
+        if (!advance()) {
+            m_phase = m_frameSeconds;
+            break;
+        }
+        m_phase -= m_frameSeconds;
+        moved = true;
+    }
+    if (moved) {
+        buildSnapshot();
+    }
+
+    if (!m_renderer) {
+        m_renderer = std::make_unique<BatchRenderer>();
+    }
+    const auto alpha = std::min(m_phase / m_frameSeconds, 1.0f);
+    m_renderer->draw(m_snapshot, alpha, m_renderMode, camera);
+
+    std::string header = "Replay of " + std::to_string(m_snapshot.size()) + " bodies, frame "
+        + std::to_string(m_nextIndex + 1) + "/" + std::to_string(m_reader.getFrameCount())
+        + " (step " + std::to_string(m_snapshot.stepIndex) + ", " + renderModeName(m_renderMode) + (m_paused ? ", paused)" : ")");
+    DrawText(header.c_str(), 10, 10, 20, GREEN);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "io/trajectory.h"
+#include "graphics/render_snapshot.h"
+#include "graphics/batch_renderer.h"
+#include "graphics/view_camera.h"
+
+#include <glm/vec2.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+
+// Plays a recorded trajectory instead of running the simulation.
+// Everything happens on the render thread: frames are decoded from the mapped file and
+// bodies are interpolated by id between two consecutive frames.
+class ReplayController {
+
+public:
+    ReplayController() = default;
+    ReplayController(const ReplayController&) = delete;
+    ReplayController& operator=(const ReplayController&) = delete;
+
+    bool open(const std::string& path, std::string* error = nullptr);
+    void render(const ViewCamera& camera);
+
+    void setRenderMode(RenderMode mode) { m_renderMode = mode; }
+    RenderMode getRenderMode() const { return m_renderMode; }
+    void togglePause() { m_paused = !m_paused; }
+    // Jump back to the first frame
+    void restart();
+
+private:
+    // Move to the next frame pair, returns false at the end of the recording
+    bool advance();
+    void buildSnapshot();
+
+    TrajectoryReader m_reader;
+    TrajectoryFrame m_current;
+    TrajectoryFrame m_next;
+    size_t m_nextIndex {0};
+    float m_frameSeconds {1.0f / 60.0f};    // Simulated time between two frames, played in real time
+    float m_phase {0.0f};                   // Seconds since m_current
+    bool m_paused {false};
+    std::chrono::steady_clock::time_point m_lastRenderTime {};
+
+    RenderSnapshot m_snapshot;
+    RenderMode m_renderMode {RenderMode::Auto};
+    std::unique_ptr<BatchRenderer> m_renderer;
+};
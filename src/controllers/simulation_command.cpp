@@ -0,0 +1,59 @@
+#include "simulation_command.h"
+
+const char* simulationParameterName(SimulationParameter parameter) {
+    switch (parameter) {
+        case SimulationParameter::Theta: return "theta";
+        case SimulationParameter::Softening: return "softening";
+        case SimulationParameter::Gravity: return "gravity";
+    }
+    return "unknown";
+}
+
+bool parseSimulationParameter(const std::string& name, SimulationParameter& parameter) {
+    for (auto candidate : {SimulationParameter::Theta, SimulationParameter::Softening, SimulationParameter::Gravity}) {
+        if (name == simulationParameterName(candidate)) {
+            parameter = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+SimulationCommand SimulationCommand::spawnBody(glm::vec2 position, glm::vec2 velocity, float mass, float radius, Color color) {
+    SimulationCommand command;
+    command.type = SimulationCommandType::SpawnBody;
+    command.position = position;
+    command.velocity = velocity;
+    command.mass = mass;
+    command.radius = radius;
+    command.color = color;
+    return command;
+}
+
+SimulationCommand SimulationCommand::spawnCluster(glm::vec2 center, glm::vec2 velocity, float radius, uint32_t count, uint64_t seed, Color color) {
+    SimulationCommand command;
+    command.type = SimulationCommandType::SpawnCluster;
+    command.position = center;
+    command.velocity = velocity;
+    command.radius = radius;
+    command.count = count;
+    command.seed = seed;
+    command.color = color;
+    return command;
+}
+
+SimulationCommand SimulationCommand::deleteInRadius(glm::vec2 center, float radius) {
+    SimulationCommand command;
+    command.type = SimulationCommandType::DeleteInRadius;
+    command.position = center;
+    command.radius = radius;
+    return command;
+}
+
+SimulationCommand SimulationCommand::setParameter(SimulationParameter parameter, float value) {
+    SimulationCommand command;
+    command.type = SimulationCommandType::SetParameter;
+    command.parameter = parameter;
+    command.value = value;
+    return command;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "graphics/drawable_body.h"
+
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <string>
+
+enum class SimulationCommandType {
+    SpawnBody,
+    SpawnCluster,       // Rotating Plummer disk, generated on the simulation thread
+    DeleteInRadius,
+    SetParameter
+};
+
+// Physical parameters a SetParameter command can change
+enum class SimulationParameter {
+    Theta,
+    Softening,
+    Gravity
+};
+
+const char* simulationParameterName(SimulationParameter parameter);
+// Return false for an unknown name
+bool parseSimulationParameter(const std::string& name, SimulationParameter& parameter);
+
+// Change to the running simulation, posted from any thread and applied by the simulation
+// thread before its next step. Fields a type does not use are ignored.
+struct SimulationCommand {
+    SimulationCommandType type {SimulationCommandType::SpawnBody};
+    glm::vec2 position {0.0f, 0.0f};    // Body, cluster or deletion center
+    glm::vec2 velocity {0.0f, 0.0f};    // Body velocity, bulk velocity of a cluster
+    float mass {0.0f};
+    float radius {0.0f};                // Body radius, cluster or deletion radius
+    Color color {WHITE};                // Of the body or all cluster bodies
+    uint32_t count {0};                 // Cluster bodies
+    uint64_t seed {0};                  // Cluster layout
+    SimulationParameter parameter {SimulationParameter::Theta};
+    float value {0.0f};
+
+    static SimulationCommand spawnBody(glm::vec2 position, glm::vec2 velocity, float mass, float radius, Color color);
+    static SimulationCommand spawnCluster(glm::vec2 center, glm::vec2 velocity, float radius, uint32_t count, uint64_t seed, Color color);
+    static SimulationCommand deleteInRadius(glm::vec2 center, float radius);
+    static SimulationCommand setParameter(SimulationParameter parameter, float value);
+};
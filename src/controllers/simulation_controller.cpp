@@ -1,52 +1,438 @@
 #include "simulation_controller.h"
 #include "physics/nbody_simulation.h"
-#include "graphics/drawable_body.h"
+#include "base/thread_pool.h"
+#include "utils/bodies_holder.h"
+#include "utils/scenario_generator.h"
+#include "io/checkpoint.h"
 
-SimulationController::SimulationController(glm::vec2 visualArea, std::vector<std::shared_ptr<DrawableBody>>& bodies)
-    : m_simulation(std::make_unique<physics::NBodySimulation>(visualArea))
-    , m_bodies(std::move(bodies)) {
-    for (auto body : m_bodies) {
-        m_simulation->addBodie(std::static_pointer_cast<physics::Body>(body));
-    }
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <string>
+
+namespace {
+    const auto OVERLAY_REFRESH_INTERVAL = std::chrono::milliseconds(500);
+    // Phase statistics cover the events of the last second
+    const auto OVERLAY_WINDOW = std::chrono::seconds(1);
+    // Small scenes are drawn body by body, a tree would not save anything
+    const size_t RENDER_TREE_MIN_BODIES = 4096;
+    // Bodies per render tree leaf, the finest level the renderer culls at
+    const size_t RENDER_LEAF_BUCKET_SIZE = 32;
+}
+
+SimulationController::SimulationController(glm::vec2 visualArea, BodiesHolder&& bodies)
+    : m_visualArea(visualArea)
+    , m_simulation(std::make_unique<physics::NBodySimulation>(visualArea))
+    , m_appearances(std::move(bodies.getAppearances())) {
+    m_simulation->setBodies(std::move(bodies.getStore()));
+    // Only mass and center of mass are drawn
+    physics::SimulationParameters renderTreeParameters;
+    renderTreeParameters.expansionOrder = physics::ExpansionOrder::Monopole;
+    renderTreeParameters.leafBucketSize = RENDER_LEAF_BUCKET_SIZE;
+    m_renderTree.setParameters(renderTreeParameters);
+    // First frame has something to show before the worker thread runs
+    publishSnapshot();
+    m_snapshots.acquire();
 }
 
 void SimulationController::start(float dt) {
     m_running = true;
-    m_workerThread = std::thread([this, dt]() mutable {
-        std::chrono::high_resolution_clock::time_point lastFrameTimePoint = std::chrono::high_resolution_clock::now();
-        float realDt = dt;
-        while (m_running) {
-            // Update
-            const auto now = std::chrono::high_resolution_clock::now();
-	        realDt = static_cast<float>(std::chrono::duration_cast<std::chrono::milliseconds>(now - lastFrameTimePoint).count()) / 1000;
-
-            if (realDt >= dt) {
-                lastFrameTimePoint = now;
-                update(dt);
-            }
-        }
+    m_workerThread = std::thread([this, dt]() {
+        Profiler::instance().setThreadName("simulation");
+        m_scheduler.run(dt, m_running, [this, dt]() { update(dt); });
     });
 }
 
 void SimulationController::stop() {
     m_running = false;
+    m_scheduler.wake();
     if(m_workerThread.joinable()) {
         m_workerThread.join();
+        const auto kernels = m_simulation->compareForceKernels();
+        TraceLog(LOG_INFO, "Force kernels (%s): max error %g against scalar evaluation, grouped path max %g, rms %g against the per-body walk",
+                 physics::kernelIsaName(kernels.isa), kernels.maxKernelError, kernels.maxRelativeError, kernels.rmsRelativeError);
+        const auto workerStats = m_simulation->getThreadPool().getWorkerStats();
+        for (size_t w = 0; w < workerStats.size(); ++w) {
+            TraceLog(LOG_INFO, "Worker %zu: busy %.1f ms, idle %.1f ms, %llu tasks, %llu steals", w,
+                     workerStats[w].busySeconds * 1e3, workerStats[w].idleSeconds * 1e3,
+                     static_cast<unsigned long long>(workerStats[w].tasks), static_cast<unsigned long long>(workerStats[w].steals));
+        }
     }
 }
 
 void SimulationController::update(float dt) {
+    PROFILE_SCOPE("update");
+    applyCommands();
+    m_simulation->setCollisionPolicy(m_collisionPolicy);
     m_simulation->step(dt);
+    ++m_stepIndex;
+    m_simulationTime += dt;
+
+    // Nothing refers to retired bodies after this, their ids get reused by later spawns
+    for (const auto& retired : m_simulation->getRetiredBodies()) {
+        if (retired.reason == physics::RetireReason::Merged) {
+            ++m_mergedCount;
+        }
+        else if (retired.reason == physics::RetireReason::Escaped) {
+            ++m_escapedCount;
+        }
+    }
+    m_simulation->clearRetiredBodies();
+
+    saveRequestedCheckpoint();
+    {
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        if (m_recorder) {
+            m_recorder->submit(m_stepIndex, m_simulation->getBodies());
+        }
+    }
+
+    publishSnapshot();
 }
 
-void SimulationController::render() {
-    ClearBackground(BLACK);
+void SimulationController::applyCommands() {
+    SimulationCommand command;
+    while (m_commands.pop(command)) {
+        switch (command.type) {
+            case SimulationCommandType::SpawnBody: {
+                const auto id = m_simulation->addBodie(command.position, command.velocity, command.mass, command.radius);
+                setAppearance(id, BodyAppearance {command.radius, command.color});
+                break;
+            }
+            case SimulationCommandType::SpawnCluster: {
+                // Generated into a reused store and appended in one batch
+                m_spawnBatch.clear();
+                ScenarioGenerator::addCluster(m_spawnBatch, command.count, command.position, command.velocity, command.radius,
+                                              command.seed, m_simulation->getParameters().gravity);
+                m_spawnedIds.clear();
+                m_simulation->addBodies(m_spawnBatch, m_spawnedIds);
+                for (size_t i = 0; i < m_spawnedIds.size(); ++i) {
+                    setAppearance(m_spawnedIds[i], BodyAppearance {m_spawnBatch.radius[i], command.color});
+                }
+                break;
+            }
+            case SimulationCommandType::DeleteInRadius:
+                m_simulation->removeBodiesInRadius(command.position, command.radius);
+                break;
+            case SimulationCommandType::SetParameter:
+                applyParameter(command.parameter, command.value);
+                break;
+        }
+    }
+}
+
+void SimulationController::applyParameter(SimulationParameter parameter, float value) {
+    auto parameters = m_simulation->getParameters();
+    switch (parameter) {
+        case SimulationParameter::Theta: parameters.theta = value; break;
+        case SimulationParameter::Softening: parameters.softening = value; break;
+        case SimulationParameter::Gravity: parameters.gravity = value; break;
+    }
+    m_simulation->setParameters(parameters);
+    TraceLog(LOG_INFO, "Parameter %s set to %g", simulationParameterName(parameter), value);
+}
+
+void SimulationController::setAppearance(uint32_t id, const BodyAppearance& appearance) {
+    if (id >= m_appearances.size()) {
+        m_appearances.resize(id + 1);
+    }
+    m_appearances[id] = appearance;
+    // A reused id must not be interpolated from the body that had it before
+    if (id < m_lastStepById.size()) {
+        m_lastStepById[id] = UINT64_MAX;
+    }
+}
 
-    for (auto body : m_bodies) {
-        if (body->isActive()) {
-            body->draw();
+void SimulationController::requestCheckpoint(const std::string& path) {
+    std::lock_guard<std::mutex> lock(m_ioMutex);
+    m_checkpointPath = path;
+}
+
+void SimulationController::saveRequestedCheckpoint() {
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        path.swap(m_checkpointPath);
+    }
+    if (path.empty()) {
+        return;
+    }
+
+    const auto& bodies = m_simulation->getBodies();
+    std::vector<uint32_t> colors(bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        std::memcpy(&colors[i], &m_appearances[bodies.id[i]].color, sizeof(uint32_t));
+    }
+    CheckpointInfo info;
+    info.stepIndex = m_stepIndex;
+    info.simulationTime = m_simulationTime;
+    info.area = m_visualArea;
+
+    std::string error;
+    if (saveCheckpoint(path, bodies, colors, info, &error)) {
+        TraceLog(LOG_INFO, "Checkpoint of %zu bodies saved to %s", bodies.size(), path.c_str());
+    }
+    else {
+        TraceLog(LOG_WARNING, "Checkpoint failed: %s", error.c_str());
+    }
+}
+
+bool SimulationController::startRecording(const std::string& path, const TrajectoryWriter::Options& options, std::string* error) {
+    auto recorder = std::make_unique<TrajectoryWriter>();
+    if (!recorder->open(path, options, error)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_ioMutex);
+    m_recorder = std::move(recorder);
+    return true;
+}
+
+void SimulationController::stopRecording() {
+    std::unique_ptr<TrajectoryWriter> recorder;
+    {
+        std::lock_guard<std::mutex> lock(m_ioMutex);
+        recorder.swap(m_recorder);
+    }
+    if (recorder) {
+        recorder->close();
+        TraceLog(LOG_INFO, "Trajectory recorded: %llu frames, %llu dropped, %llu bytes",
+                 static_cast<unsigned long long>(recorder->getWrittenFrames()),
+                 static_cast<unsigned long long>(recorder->getDroppedFrames()),
+                 static_cast<unsigned long long>(recorder->getWrittenBytes()));
+    }
+}
+
+void SimulationController::publishSnapshot() {
+    const auto& bodies = m_simulation->getBodies();
+    const auto idCapacity = bodies.getIdCapacity();
+    if (m_lastPositionById.size() < idCapacity) {
+        m_lastPositionById.resize(idCapacity);
+        m_lastStepById.resize(idCapacity, UINT64_MAX);
+    }
+
+    auto& snapshot = m_snapshots.getWriteBuffer();
+    snapshot.positions.clear();
+    snapshot.previousPositions.clear();
+    snapshot.appearances.clear();
+    m_snapshotMasses.clear();
+    auto totalMass = 0.0f;
+    auto maxRadius = 0.0f;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        if (!bodies.active[i]) {
+            continue;
+        }
+        const auto id = bodies.id[i];
+        const auto position = bodies.position(i);
+        // Bodies that were not in the previous snapshot (spawned, id reused) do not move
+        const auto previous = m_stepIndex > 0 && m_lastStepById[id] == m_stepIndex - 1 ? m_lastPositionById[id] : position;
+        snapshot.positions.push_back(position);
+        snapshot.previousPositions.push_back(previous);
+        // Radius is physical state, it grows when bodies merge
+        snapshot.appearances.push_back(BodyAppearance {bodies.radius[i], m_appearances[id].color});
+        m_snapshotMasses.push_back(bodies.mass[i]);
+        totalMass += bodies.mass[i];
+        maxRadius = std::max(maxRadius, bodies.radius[i]);
+        m_lastPositionById[id] = position;
+        m_lastStepById[id] = m_stepIndex;
+    }
+    snapshot.meanMass = snapshot.size() > 0 ? totalMass / snapshot.size() : 0.0f;
+    snapshot.maxRadius = maxRadius;
+    buildRenderTree(snapshot);
+
+    const auto now = std::chrono::steady_clock::now();
+    snapshot.stepInterval = m_stepIndex > 0 ? std::chrono::duration<float>(now - m_lastPublishTime).count() : 0.0f;
+    snapshot.publishTime = now;
+    snapshot.stepIndex = m_stepIndex;
+    snapshot.escapedCount = m_escapedCount;
+    snapshot.mergedCount = m_mergedCount;
+    m_lastPublishTime = now;
+
+    m_snapshots.publish();
+}
+
+void SimulationController::buildRenderTree(RenderSnapshot& snapshot) {
+    snapshot.nodes.clear();
+    const auto count = snapshot.size();
+    if (count < RENDER_TREE_MIN_BODIES) {
+        return;
+    }
+    PROFILE_SCOPE("render tree");
+
+    // Square root cell around the bodies
+    auto low = snapshot.positions.front();
+    auto high = low;
+    for (const auto& position : snapshot.positions) {
+        low = glm::vec2(std::min(low.x, position.x), std::min(low.y, position.y));
+        high = glm::vec2(std::max(high.x, position.x), std::max(high.y, position.y));
+    }
+    // Padded so coincident bodies still get a cell of nonzero size
+    const auto halfDimension = std::max(high.x - low.x, high.y - low.y) * 0.5f + 1.0f;
+    const AABB boundary((low + high) * 0.5f, halfDimension);
+
+    // Bulk build wants the bodies in Morton order. Between steps the simulation workers are idle.
+    auto& pool = m_simulation->getThreadPool();
+    auto& bodies = m_renderBodies;
+    bodies.x.resize(count);
+    bodies.y.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        bodies.x[i] = snapshot.positions[i].x;
+        bodies.y[i] = snapshot.positions[i].y;
+    }
+    m_renderOrder.sort(bodies.x, bodies.y, boundary, &pool);
+    const auto& order = m_renderOrder.getOrder();
+    bodies.mass.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        bodies.x[i] = snapshot.positions[order[i]].x;
+        bodies.y[i] = snapshot.positions[order[i]].y;
+        bodies.mass[i] = m_snapshotMasses[order[i]];
+    }
+    m_renderTree.build(boundary, m_renderOrder.getKeys(), bodies, &pool);
+
+    m_renderTreeOrder.clear();
+    snapshot.nodes.resize(1);
+    exportRenderNode(0, 0, snapshot);
+
+    // Bodies of every node become one contiguous range
+    m_positionScratch.resize(count);
+    m_previousPositionScratch.resize(count);
+    m_appearanceScratch.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const auto from = m_renderTreeOrder[i];
+        m_positionScratch[i] = snapshot.positions[from];
+        m_previousPositionScratch[i] = snapshot.previousPositions[from];
+        m_appearanceScratch[i] = snapshot.appearances[from];
+    }
+    snapshot.positions.swap(m_positionScratch);
+    snapshot.previousPositions.swap(m_previousPositionScratch);
+    snapshot.appearances.swap(m_appearanceScratch);
+}
+
+void SimulationController::exportRenderNode(int32_t treeIndex, size_t nodeIndex, RenderSnapshot& snapshot) {
+    const auto& treeNode = m_renderTree.getNode(treeIndex);
+    const auto begin = static_cast<uint32_t>(m_renderTreeOrder.size());
+    float red = 0.0f, green = 0.0f, blue = 0.0f, alpha = 0.0f;
+    auto firstChild = physics::BHArenaTree::INVALID_INDEX;
+
+    if (treeNode.isDivided()) {
+        // Children are contiguous, reserve them before descending
+        firstChild = static_cast<int32_t>(snapshot.nodes.size());
+        snapshot.nodes.resize(snapshot.nodes.size() + 4);
+        for (auto child = 0; child < 4; ++child) {
+            exportRenderNode(treeNode.firstChild + child, firstChild + child, snapshot);
+            const auto& childNode = snapshot.nodes[firstChild + child];
+            const auto weight = static_cast<float>(childNode.end - childNode.begin);
+            red += childNode.color.r * weight;
+            green += childNode.color.g * weight;
+            blue += childNode.color.b * weight;
+            alpha += childNode.color.a * weight;
+        }
+    }
+    else {
+        const auto& order = m_renderOrder.getOrder();
+        for (auto body = treeNode.firstBody; body != physics::BHArenaTree::INVALID_INDEX; body = m_renderTree.getNextBody(body)) {
+            const auto index = order[body];
+            m_renderTreeOrder.push_back(index);
+            const auto& color = snapshot.appearances[index].color;
+            red += color.r;
+            green += color.g;
+            blue += color.b;
+            alpha += color.a;
         }
     }
-    std::string header = "Gravity simulation for " + std::to_string(m_bodies.size()) + " bodies";
+
+    const auto end = static_cast<uint32_t>(m_renderTreeOrder.size());
+    const auto scale = end > begin ? 1.0f / (end - begin) : 0.0f;
+    auto& node = snapshot.nodes[nodeIndex];
+    node.center = treeNode.boundary.center;
+    node.halfDimension = treeNode.boundary.halfDimension;
+    node.centerOfMass = treeNode.centerOfMass;
+    node.mass = treeNode.totalMass;
+    node.color = Color {static_cast<unsigned char>(red * scale), static_cast<unsigned char>(green * scale),
+                        static_cast<unsigned char>(blue * scale), static_cast<unsigned char>(alpha * scale)};
+    node.begin = begin;
+    node.end = end;
+    node.firstChild = firstChild;
+}
+
+void SimulationController::render(const ViewCamera& camera) {
+    PROFILE_SCOPE("render");
+    ClearBackground(BLACK);
+
+    m_snapshots.acquire();
+    const auto& snapshot = m_snapshots.getReadBuffer();
+    const auto alpha = m_interpolation ? snapshot.interpolationFactor(std::chrono::steady_clock::now()) : 1.0f;
+    if (!m_renderer) {
+        m_renderer = std::make_unique<BatchRenderer>();
+    }
+    const RenderMode renderMode = m_renderMode;
+    m_renderer->draw(snapshot, alpha, renderMode, camera);
+
+    std::string header = "Gravity simulation for " + std::to_string(snapshot.size()) + " bodies"
+        + " (" + std::to_string(snapshot.escapedCount) + " escaped, " + std::to_string(snapshot.mergedCount) + " merged, " + renderModeName(renderMode) + ")";
     DrawText(header.c_str(), 10, 10, 20, GREEN);
+
+    // Achieved pace against the requested one
+    const auto rate = m_scheduler.getRate();
+    char pace[128];
+    if (m_scheduler.getMode() == ScheduleMode::FixedRate) {
+        std::snprintf(pace, sizeof(pace), "%.2fx real time (target %.2fx), %.0f steps/s, %llu steps skipped", rate.timeScale,
+                      m_scheduler.getTimeScale(), rate.stepsPerSecond, static_cast<unsigned long long>(rate.skippedSteps));
+    }
+    else {
+        std::snprintf(pace, sizeof(pace), "%.2fx real time (as fast as possible), %.0f steps/s", rate.timeScale, rate.stepsPerSecond);
+    }
+    DrawText(pace, 10, 34, 16, GREEN);
+
+    if (m_profilerOverlay) {
+        drawProfilerOverlay(snapshot.stepIndex);
+    }
+}
+
+void SimulationController::setProfilerOverlay(bool enabled) {
+    m_profilerOverlay = enabled;
+    m_overlayLines.clear();
+    m_overlayRefreshTime = {};
+    Profiler::instance().setEnabled(enabled);
+}
+
+void SimulationController::drawProfilerOverlay(uint64_t stepIndex) {
+    // Copying the rings is not free, refresh the text a few times per second only
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_overlayRefreshTime >= OVERLAY_REFRESH_INTERVAL) {
+        auto& profiler = Profiler::instance();
+        const auto window = std::chrono::duration_cast<std::chrono::nanoseconds>(OVERLAY_WINDOW).count();
+        const auto end = Profiler::now();
+        const auto since = end > static_cast<uint64_t>(window) ? end - window : 0;
+
+        m_overlayLines.clear();
+        char line[128];
+        for (const auto& phase : profiler.summarize(since)) {
+            std::snprintf(line, sizeof(line), "%-12s %7.2f ms  max %7.2f ms", phase.name, phase.meanMilliseconds, phase.maxMilliseconds);
+            m_overlayLines.emplace_back(line);
+        }
+#if GRAVITY_PROFILE_COUNTERS
+        // Counters are totals, show them per step over the refresh interval
+        const auto counters = profiler.getCounters();
+        const auto steps = stepIndex > m_overlayStepIndex ? stepIndex - m_overlayStepIndex : 0;
+        for (size_t c = 0; c < counters.size() && steps > 0; ++c) {
+            std::snprintf(line, sizeof(line), "%-24s %12llu / step", profileCounterName(static_cast<ProfileCounter>(c)),
+                          static_cast<unsigned long long>((counters[c] - m_overlayCounters[c]) / steps));
+            m_overlayLines.emplace_back(line);
+        }
+        const auto gauges = profiler.getGauges();
+        std::snprintf(line, sizeof(line), "tree %llu nodes, depth %llu", static_cast<unsigned long long>(gauges[static_cast<size_t>(ProfileGauge::TreeNodes)]),
+                      static_cast<unsigned long long>(gauges[static_cast<size_t>(ProfileGauge::TreeDepth)]));
+        m_overlayLines.emplace_back(line);
+        m_overlayCounters = counters;
+#endif
+        m_overlayStepIndex = stepIndex;
+        m_overlayRefreshTime = now;
+    }
+
+    auto y = 54;
+    for (const auto& line : m_overlayLines) {
+        DrawText(line.c_str(), 10, y, 16, GREEN);
+        y += 18;
+    }
 }
\ No newline at end of file
@@ -1,32 +1,127 @@
 #pragma once
 
 #include "physics/nbody_simulation.h"
+#include "physics/bh_arena_tree.h"
+#include "physics/morton_order.h"
+#include "graphics/drawable_body.h"
+#include "graphics/render_snapshot.h"
+#include "graphics/batch_renderer.h"
+#include "graphics/view_camera.h"
+#include "base/mpsc_queue.h"
+#include "base/profiler.h"
+#include "base/triple_buffer.h"
+#include "io/trajectory.h"
+#include "simulation_command.h"
+#include "step_scheduler.h"
 
 #include <glm/vec2.hpp>
 #include <vector>
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
 
-class DrawableBody;
+class BodiesHolder;
 
 class SimulationController {
 
 public:
-    explicit SimulationController(glm::vec2 visualArea, std::vector<std::shared_ptr<DrawableBody>>& bodies);
+    explicit SimulationController(glm::vec2 visualArea, BodiesHolder&& bodies);
     SimulationController(const SimulationController&) = delete;
     SimulationController& operator=(const SimulationController&) = delete;
     ~SimulationController() = default;
 
     void start(float dt = 0.0f);
     void stop();
-    void render();
+    void render(const ViewCamera& camera);
+    // Blend the last two snapshots so motion stays smooth when sim and display rates differ
+    void setInterpolation(bool enabled) { m_interpolation = enabled; }
+    void setRenderMode(RenderMode mode) { m_renderMode = mode; }
+    RenderMode getRenderMode() const { return m_renderMode; }
+    // Phase timings and tree counters under the header, turns the profiler on while shown
+    void setProfilerOverlay(bool enabled);
+    bool getProfilerOverlay() const { return m_profilerOverlay; }
+    // Pacing of the worker thread, see StepScheduler; any thread
+    void setScheduleMode(ScheduleMode mode) { m_scheduler.setMode(mode); }
+    ScheduleMode getScheduleMode() const { return m_scheduler.getMode(); }
+    void setTimeScale(float timeScale) { m_scheduler.setTimeScale(timeScale); }
+    float getTimeScale() const { return m_scheduler.getTimeScale(); }
+    ScheduleRate getScheduleRate() const { return m_scheduler.getRate(); }
+    // Any thread, never waits for the simulation; applied by the worker thread before the next step
+    void post(SimulationCommand command) { m_commands.push(std::move(command)); }
+    // Applied by the worker thread before the next step
+    void setCollisionPolicy(physics::CollisionPolicy policy) { m_collisionPolicy = policy; }
+    physics::CollisionPolicy getCollisionPolicy() const { return m_collisionPolicy; }
+    // Before start() only, the worker thread owns the simulation afterwards
+    void setIntegrator(physics::Integrator integrator) { m_simulation->setIntegrator(integrator); }
+    physics::Integrator getIntegrator() const { return m_simulation->getIntegrator(); }
+    // Saved by the worker thread once the current step is complete
+    void requestCheckpoint(const std::string& path);
+    // Append every options.stepInterval-th step to a trajectory file until stopRecording()
+    bool startRecording(const std::string& path, const TrajectoryWriter::Options& options, std::string* error = nullptr);
+    void stopRecording();
 
 private:
     void update(float dt);
+    // Worker thread only: run every posted command
+    void applyCommands();
+    void applyParameter(SimulationParameter parameter, float value);
+    void setAppearance(uint32_t id, const BodyAppearance& appearance);
+    // Worker thread only: copy the current state into the snapshot buffer and publish it
+    void publishSnapshot();
+    // Worker thread only: quadtree over the snapshot bodies for culling and level of detail,
+    // reorders the snapshot arrays so every node covers a contiguous range
+    void buildRenderTree(RenderSnapshot& snapshot);
+    void exportRenderNode(int32_t treeIndex, size_t nodeIndex, RenderSnapshot& snapshot);
+    // Worker thread only
+    void saveRequestedCheckpoint();
+    // Render thread only
+    void drawProfilerOverlay(uint64_t stepIndex);
 
+    glm::vec2 m_visualArea;
     std::unique_ptr<physics::NBodySimulation> m_simulation;
-    std::vector<std::shared_ptr<DrawableBody>> m_bodies;
+    std::vector<BodyAppearance> m_appearances;     // Indexed by body id
     std::atomic_bool m_running {false};
+    std::atomic_bool m_interpolation {true};
+    std::atomic<RenderMode> m_renderMode {RenderMode::Auto};
+    std::atomic<physics::CollisionPolicy> m_collisionPolicy {physics::CollisionPolicy::Merge};
     std::thread m_workerThread;
+    StepScheduler m_scheduler;
+    MpscQueue<SimulationCommand> m_commands;
+
+    // Owned by the worker thread
+    TripleBuffer<RenderSnapshot> m_snapshots;
+    std::vector<glm::vec2> m_lastPositionById;
+    std::vector<uint64_t> m_lastStepById;
+    uint64_t m_stepIndex {0};
+    std::chrono::steady_clock::time_point m_lastPublishTime {};
+    size_t m_escapedCount {0};
+    size_t m_mergedCount {0};
+    double m_simulationTime {0.0};
+    physics::BodyStore m_spawnBatch;               // Cluster bodies, reused between spawns
+    std::vector<uint32_t> m_spawnedIds;
+    // Render tree, built from the snapshot since the physics tree changes under the render thread
+    std::vector<float> m_snapshotMasses;
+    physics::BodyStore m_renderBodies;              // Only positions and masses, in Morton order
+    physics::MortonOrder m_renderOrder;
+    physics::BHArenaTree m_renderTree {AABB(glm::vec2(0.0f, 0.0f), 1.0f)};
+    std::vector<uint32_t> m_renderTreeOrder;        // Snapshot index of every body in tree order
+    std::vector<glm::vec2> m_positionScratch;
+    std::vector<glm::vec2> m_previousPositionScratch;
+    std::vector<BodyAppearance> m_appearanceScratch;
+
+    // Checkpoint and trajectory requests from the UI thread
+    std::mutex m_ioMutex;
+    std::string m_checkpointPath;
+    std::unique_ptr<TrajectoryWriter> m_recorder;
+
+    // Owned by the render thread, created on the first render() once the GL context exists
+    std::unique_ptr<BatchRenderer> m_renderer;
+    bool m_profilerOverlay {false};
+    std::vector<std::string> m_overlayLines;
+    std::chrono::steady_clock::time_point m_overlayRefreshTime {};
+    uint64_t m_overlayStepIndex {0};
+    Profiler::Counters m_overlayCounters {};
 };
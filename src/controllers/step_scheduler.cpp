@@ -0,0 +1,122 @@
+#include "step_scheduler.h"
+
+#include <algorithm>
+
+namespace {
+    // Achieved rates are averaged over this much wall time
+    const auto RATE_WINDOW = std::chrono::milliseconds(500);
+}
+
+const char* scheduleModeName(ScheduleMode mode) {
+    switch (mode) {
+        case ScheduleMode::FixedRate: return "fixed";
+        case ScheduleMode::AsFastAsPossible: return "fast";
+    }
+    return "unknown";
+}
+
+bool parseScheduleMode(const std::string& name, ScheduleMode& mode) {
+    for (auto candidate : {ScheduleMode::FixedRate, ScheduleMode::AsFastAsPossible}) {
+        if (name == scheduleModeName(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void StepScheduler::setMode(ScheduleMode mode) {
+    m_mode = mode;
+    wake();
+}
+
+void StepScheduler::setTimeScale(float timeScale) {
+    m_timeScale = std::max(timeScale, 0.0f);
+    wake();
+}
+
+ScheduleRate StepScheduler::getRate() const {
+    std::lock_guard<std::mutex> lock(m_rateMutex);
+    return m_rate;
+}
+
+void StepScheduler::wake() {
+    {
+        std::lock_guard<std::mutex> lock(m_wakeMutex);
+        m_wakeRequested = true;
+    }
+    m_wakeCondition.notify_all();
+}
+
+void StepScheduler::run(float dt, const std::atomic_bool& running, const StepFunction& step) {
+    auto last = Clock::now();
+    double accumulator = 0.0;           // Simulated seconds owed to the simulation
+    m_windowStart = last;
+    m_windowSteps = 0;
+    m_windowSimulatedSeconds = 0.0;
+    m_skippedSteps = 0;
+
+    while (running) {
+        // Without a step size there is nothing to pace
+        if (m_mode == ScheduleMode::AsFastAsPossible || dt <= 0.0f) {
+            step();
+            last = Clock::now();
+            accumulator = 0.0;
+            updateRate(1, dt, last);
+            continue;
+        }
+
+        const auto now = Clock::now();
+        const auto timeScale = m_timeScale.load();
+        accumulator += std::chrono::duration<double>(now - last).count() * timeScale;
+        last = now;
+
+        auto steps = static_cast<uint64_t>(accumulator / dt);
+        const auto maxSteps = std::max<uint64_t>(m_maxCatchUpSteps, 1);
+        if (steps > maxSteps) {
+            // Too far behind to catch up, drop the backlog instead of falling further behind
+            m_skippedSteps += steps - maxSteps;
+            accumulator -= static_cast<double>(steps - maxSteps) * dt;
+            steps = maxSteps;
+        }
+        for (uint64_t s = 0; s < steps && running; ++s) {
+            step();
+            accumulator -= dt;
+        }
+        updateRate(steps, dt, Clock::now());
+        if (steps > 0) {
+            // Time spent stepping goes into the accumulator on the next pass
+            continue;
+        }
+
+        // Sleep until the next step is due; a mode, scale or stop change wakes us early
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        const auto woken = [this, &running]() { return m_wakeRequested || !running; };
+        if (timeScale > 0.0f) {
+            const auto wait = std::chrono::duration<double>((dt - accumulator) / timeScale);
+            m_wakeCondition.wait_until(lock, now + std::chrono::duration_cast<Clock::duration>(wait), woken);
+        }
+        else {
+            // Paused, still come back once a window so the rate drops to zero
+            m_wakeCondition.wait_until(lock, now + RATE_WINDOW, woken);
+        }
+        m_wakeRequested = false;
+    }
+}
+
+void StepScheduler::updateRate(uint64_t steps, float dt, Clock::time_point now) {
+    m_windowSteps += steps;
+    m_windowSimulatedSeconds += static_cast<double>(steps) * dt;
+    const auto elapsed = std::chrono::duration<double>(now - m_windowStart).count();
+    if (now - m_windowStart < RATE_WINDOW) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_rateMutex);
+    m_rate.stepsPerSecond = static_cast<float>(m_windowSteps / elapsed);
+    m_rate.timeScale = static_cast<float>(m_windowSimulatedSeconds / elapsed);
+    m_rate.skippedSteps = m_skippedSteps;
+    m_windowStart = now;
+    m_windowSteps = 0;
+    m_windowSimulatedSeconds = 0.0;
+}
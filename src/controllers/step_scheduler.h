@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+// How the simulation thread paces its steps
+enum class ScheduleMode {
+    FixedRate,          // Steps of dt follow wall time times the time scale, the thread sleeps in between
+    AsFastAsPossible    // Steps run back to back, for batch runs
+};
+
+const char* scheduleModeName(ScheduleMode mode);
+// Return false for an unknown name
+bool parseScheduleMode(const std::string& name, ScheduleMode& mode);
+
+// Pace achieved over the last measurement window
+struct ScheduleRate {
+    float stepsPerSecond {0.0f};
+    float timeScale {0.0f};             // Simulated seconds per wall second
+    uint64_t skippedSteps {0};          // Steps dropped by the catch-up cap since run() started
+};
+
+// Fixed timestep scheduler.
+// In FixedRate mode wall time, scaled by the time scale, feeds an accumulator that is drained
+// in steps of dt; between steps the thread sleeps until the accumulator holds the next one.
+// When steps take longer than dt, at most maxCatchUpSteps run back to back and the rest of
+// the backlog is dropped, so a slow simulation runs slower than real time instead of falling
+// further behind.
+class StepScheduler {
+
+public:
+    using StepFunction = std::function<void()>;
+
+    static constexpr uint32_t DEFAULT_MAX_CATCH_UP_STEPS = 4;
+
+    // Any thread, a sleeping run() picks the change up right away
+    void setMode(ScheduleMode mode);
+    ScheduleMode getMode() const { return m_mode; }
+    // Simulated seconds per wall second in FixedRate mode, 0 pauses
+    void setTimeScale(float timeScale);
+    float getTimeScale() const { return m_timeScale; }
+    void setMaxCatchUpSteps(uint32_t steps) { m_maxCatchUpSteps = steps; }
+    ScheduleRate getRate() const;
+
+    // Call step every dt of scaled wall time until running turns false; set it false, then
+    // call wake() to end a sleeping run()
+    void run(float dt, const std::atomic_bool& running, const StepFunction& step);
+    void wake();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Count steps into the rate window and publish the rate once the window is full
+    void updateRate(uint64_t steps, float dt, Clock::time_point now);
+
+    std::atomic<ScheduleMode> m_mode {ScheduleMode::FixedRate};
+    std::atomic<float> m_timeScale {1.0f};
+    std::atomic<uint32_t> m_maxCatchUpSteps {DEFAULT_MAX_CATCH_UP_STEPS};
+
+    std::mutex m_wakeMutex;
+    std::condition_variable m_wakeCondition;
+    bool m_wakeRequested {false};       // Guarded by m_wakeMutex
+
+    // Rate window, owned by the run() thread
+    Clock::time_point m_windowStart {};
+    uint64_t m_windowSteps {0};
+    double m_windowSimulatedSeconds {0.0};
+    uint64_t m_skippedSteps {0};
+
+    mutable std::mutex m_rateMutex;
+    ScheduleRate m_rate;
+};
@@ -0,0 +1,193 @@
+#include "ensemble_runner.h"
+#include "io/checkpoint.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <thread>
+
+namespace {
+    bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    // Rough cost of a run for the largest-first order, a tree step is about n log n
+    double estimateCost(const EnsembleRun& run) {
+        const auto bodies = static_cast<double>(run.scenario.bodyCount);
+        return bodies * std::log2(bodies + 2.0) * static_cast<double>(run.steps);
+    }
+
+    std::string describeRun(const EnsembleRun& run) {
+        char text[512];
+        std::snprintf(text, sizeof(text),
+            "\"distribution\": \"%s\", \"bodies\": %zu, \"seed\": %llu, \"steps\": %zu, \"dt\": %g, \"gravity\": %g, "
+            "\"softening\": %g, \"theta\": %g, \"opening\": \"%s\", \"alpha\": %g, \"order\": \"%s\", \"bucket\": %u, "
+            "\"engine\": \"%s\", \"integrator\": \"%s\", \"collisions\": \"%s\"",
+            ScenarioGenerator::distributionName(run.scenario.distribution), run.scenario.bodyCount,
+            static_cast<unsigned long long>(run.scenario.seed), run.steps, run.dt, run.parameters.gravity,
+            run.parameters.softening, run.parameters.theta, physics::openingCriterionName(run.parameters.openingCriterion),
+            run.parameters.forceAccuracy, physics::expansionOrderName(run.parameters.expansionOrder), run.parameters.leafBucketSize,
+            physics::forceEngineName(run.engine), physics::integratorName(run.integrator), physics::collisionPolicyName(run.collisions));
+        return text;
+    }
+
+    std::string snapshotName(size_t index) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "run-%05zu.grv", index);
+        return name;
+    }
+}
+
+EnsembleRunner::EnsembleRunner(const EnsembleOptions& options)
+    : m_options(options)
+    , m_threadPool(std::make_shared<ThreadPool>(options.threads > 0 ? options.threads : std::thread::hardware_concurrency())) {}
+
+EnsembleRunner::~EnsembleRunner() {
+    if (m_runsFile) {
+        std::fclose(m_runsFile);
+    }
+    if (m_metricsFile) {
+        std::fclose(m_metricsFile);
+    }
+}
+
+bool EnsembleRunner::run(const std::vector<EnsembleRun>& runs, std::string* error) {
+    std::error_code directoryError;
+    std::filesystem::create_directories(m_options.outputDirectory, directoryError);
+    if (directoryError) {
+        return fail(error, "cannot create " + m_options.outputDirectory + ": " + directoryError.message());
+    }
+    const std::filesystem::path directory(m_options.outputDirectory);
+    for (auto* file : {m_runsFile, m_metricsFile}) {
+        if (file) {
+            std::fclose(file);
+        }
+    }
+    m_runsFile = std::fopen((directory / "runs.jsonl").string().c_str(), "w");
+    m_metricsFile = std::fopen((directory / "metrics.jsonl").string().c_str(), "w");
+    if (!m_runsFile || !m_metricsFile) {
+        return fail(error, "cannot write to " + m_options.outputDirectory);
+    }
+
+    std::vector<const EnsembleRun*> wide, narrow;
+    for (const auto& run : runs) {
+        (run.scenario.bodyCount >= m_options.wideBodyCount ? wide : narrow).push_back(&run);
+    }
+    // Longest runs first, so the last ones to finish are short and the tail stays small
+    std::stable_sort(narrow.begin(), narrow.end(), [](const EnsembleRun* a, const EnsembleRun* b) { return estimateCost(*a) > estimateCost(*b); });
+
+    m_stats = EnsembleStats {};
+    m_stats.runs = runs.size();
+    m_stats.wideRuns = wide.size();
+    m_finishedRuns = 0;
+    m_totalRuns = runs.size();
+    std::atomic<size_t> failed {0};
+    const auto start = std::chrono::steady_clock::now();
+
+    // Called from outside the pool, every step is spread over all workers
+    for (const auto* run : wide) {
+        if (!runOne(*run, true)) {
+            ++failed;
+        }
+    }
+
+    // One lane per worker, each pulling the next run until none is left
+    std::atomic<size_t> next {0};
+    m_threadPool->parallelFor(m_threadPool->getThreadCount(), 1, [this, &narrow, &next, &failed](size_t, size_t, size_t) {
+        for (auto i = next++; i < narrow.size(); i = next++) {
+            if (!runOne(*narrow[i], false)) {
+                ++failed;
+            }
+        }
+    });
+
+    m_stats.failedRuns = failed;
+    m_stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_stats.simulationsPerHour = m_stats.wallSeconds > 0 ? (runs.size() - m_stats.failedRuns) * 3600.0 / m_stats.wallSeconds : 0.0;
+    std::fflush(m_runsFile);
+    std::fflush(m_metricsFile);
+    return true;
+}
+
+bool EnsembleRunner::runOne(const EnsembleRun& run, bool wide) {
+    const auto start = std::chrono::steady_clock::now();
+    auto scenario = run.scenario;
+    scenario.gravity = run.parameters.gravity;
+    physics::NBodySimulation simulation(scenario.area, run.parameters, m_threadPool);
+    simulation.setForceEngine(run.engine);
+    simulation.setIntegrator(run.integrator);
+    simulation.setCollisionPolicy(run.collisions);
+    simulation.setDeterministic(m_options.deterministic);
+    simulation.setBodies(ScenarioGenerator::generate(scenario, m_threadPool.get()));
+
+    char line[512];
+    size_t retired = 0;
+    const auto sample = [this, &run, &simulation, &line, &retired](size_t step) {
+        const auto energy = simulation.measureEnergy();
+        std::snprintf(line, sizeof(line), "{\"run\": %zu, \"step\": %zu, \"time\": %g, \"bodies\": %zu, \"retired\": %zu, \"energy\": %.9g, \"relative_drift\": %.6e}",
+                      run.index, step, step * static_cast<double>(run.dt), simulation.getBodies().size(), retired, energy.total, energy.relativeDrift);
+        writeLine(m_metricsFile, line);
+        retired = 0;
+        return energy;
+    };
+
+    const auto initialEnergy = sample(0);
+    uint64_t interactions = 0;
+    for (size_t step = 1; step <= run.steps; ++step) {
+        simulation.step(run.dt);
+        interactions += simulation.getLastStepTimings().interactions;
+        // Merged and escaped totals are kept by the simulation, the retired bodies are not needed
+        retired += simulation.getLastStepRetiredCount();
+        simulation.clearRetiredBodies();
+        if (m_options.metricsEvery > 0 && step % m_options.metricsEvery == 0 && step < run.steps) {
+            sample(step);
+        }
+    }
+    const auto finalEnergy = sample(run.steps);
+    const auto simulateSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string snapshot;
+    std::string snapshotError;
+    auto snapshotWritten = true;
+    if (m_options.snapshots) {
+        CheckpointInfo info;
+        info.stepIndex = run.steps;
+        info.simulationTime = run.steps * static_cast<double>(run.dt);
+        info.area = scenario.area;
+        snapshot = snapshotName(run.index);
+        const auto path = std::filesystem::path(m_options.outputDirectory) / snapshot;
+        snapshotWritten = saveCheckpoint(path.string(), simulation.getBodies(), {}, info, &snapshotError);
+    }
+
+    const auto bodies = simulation.getBodies().size();
+    const auto merged = simulation.getTotalMergedCount();
+    const auto escaped = simulation.getTotalRetiredCount() - merged;
+    const auto snapshotField = !m_options.snapshots ? std::string("null") : snapshotWritten ? "\"" + snapshot + "\"" : std::string("null");
+    std::snprintf(line, sizeof(line),
+        "\"lane\": \"%s\", \"wall_s\": %.6f, \"steps_per_s\": %.3f, \"interactions\": %llu, \"final_bodies\": %zu, "
+        "\"merged\": %zu, \"escaped\": %zu, \"initial_energy\": %.9g, \"final_energy\": %.9g, \"relative_drift\": %.6e, \"snapshot\": ",
+        wide ? "wide" : "narrow", simulateSeconds, simulateSeconds > 0 ? run.steps / simulateSeconds : 0.0,
+        static_cast<unsigned long long>(interactions), bodies, merged, escaped, initialEnergy.total, finalEnergy.total,
+        finalEnergy.relativeDrift);
+    writeLine(m_runsFile, "{\"run\": " + std::to_string(run.index) + ", " + describeRun(run) + ", " + line + snapshotField + "}");
+
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    ++m_finishedRuns;
+    std::fprintf(stderr, "[%zu/%zu] run %zu: %zu bodies, %zu steps in %.2f s%s%s\n", m_finishedRuns, m_totalRuns, run.index,
+                 run.scenario.bodyCount, run.steps, simulateSeconds, snapshotWritten ? "" : ", snapshot failed: ", snapshotError.c_str());
+    return snapshotWritten;
+}
+
+void EnsembleRunner::writeLine(std::FILE* file, const std::string& line) {
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    std::fputs(line.c_str(), file);
+    std::fputc('\n', file);
+    // Results of finished runs survive a crash or an interrupted sweep
+    std::fflush(file);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "sweep_spec.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+struct EnsembleOptions {
+    std::string outputDirectory {"ensemble"};
+    size_t threads {0};                 // Workers of the shared pool, 0 for all cores
+    size_t wideBodyCount {100000};      // Runs from this size on get the whole pool, one after another
+    size_t metricsEvery {0};            // Steps between energy samples in metrics.jsonl, 0 for first and last only
+    bool snapshots {true};              // Final bodies of every run as a checkpoint
+    bool deterministic {false};         // Same results for any thread count, see NBodySimulation::setDeterministic()
+};
+
+struct EnsembleStats {
+    size_t runs {0};
+    size_t wideRuns {0};
+    size_t failedRuns {0};
+    double wallSeconds {0.0};
+    double simulationsPerHour {0.0};
+};
+
+// Runs the simulations of a sweep on one shared thread pool.
+// Wide runs go first, one at a time, each step spread over every worker. The narrow ones
+// follow with one simulation per worker, largest first: a worker takes the next run as soon as
+// its current one ends, and once no run is left, idle workers steal step tasks of the runs still
+// going. Every simulation is independent of the others, so throughput is what this optimizes.
+// As runs finish, each appends a line to runs.jsonl and writes run-NNNNN.grv, a checkpoint the
+// sandbox can --load; metrics.jsonl receives energy samples while they run.
+class EnsembleRunner {
+
+public:
+    explicit EnsembleRunner(const EnsembleOptions& options = EnsembleOptions {});
+    ~EnsembleRunner();
+    EnsembleRunner(const EnsembleRunner&) = delete;
+    EnsembleRunner& operator=(const EnsembleRunner&) = delete;
+
+    // Returns false when the output cannot be written; failed snapshots only count in the stats
+    bool run(const std::vector<EnsembleRun>& runs, std::string* error = nullptr);
+    const EnsembleStats& getStats() const { return m_stats; }
+    const ThreadPool& getThreadPool() const { return *m_threadPool; }
+
+private:
+    // Returns false if the run's snapshot could not be written
+    bool runOne(const EnsembleRun& run, bool wide);
+    // Whole lines under one lock, so concurrent runs never interleave
+    void writeLine(std::FILE* file, const std::string& line);
+
+    EnsembleOptions m_options;
+    std::shared_ptr<ThreadPool> m_threadPool;
+    std::FILE* m_runsFile {nullptr};
+    std::FILE* m_metricsFile {nullptr};
+    std::mutex m_outputMutex;
+    size_t m_finishedRuns {0};
+    size_t m_totalRuns {0};
+    EnsembleStats m_stats;
+};
@@ -0,0 +1,119 @@
+#include "ensemble_runner.h"
+#include "sweep_spec.h"
+#include "base/thread_pool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+    struct EnsembleConfig {
+        std::string sweepPath;
+        EnsembleOptions options;
+        bool dryRun {false};
+    };
+
+    void printUsage(const char* program) {
+        std::fprintf(stderr,
+            "usage: %s --sweep FILE [options]\n"
+            "  --sweep FILE        parameter sweep, one 'key = value, value' or 'key = first..last' per line\n"
+            "  --output DIR        runs.jsonl, metrics.jsonl and run snapshots (default ensemble)\n"
+            "  --threads N         workers of the shared pool, 0 for all cores (default 0)\n"
+            "  --wide-bodies N     runs with at least N bodies use every worker, one at a time (default 100000)\n"
+            "  --metrics-every N   steps between energy samples, 0 for the first and last step only (default 0)\n"
+            "  --no-snapshots      skip the final checkpoint of every run\n"
+            "  --deterministic     bit-identical runs for any thread count, the direct engine does twice the work\n"
+            "  --dry-run           list the runs of the sweep and exit\n",
+            program);
+    }
+
+    bool parseArguments(int argc, char** argv, EnsembleConfig& config) {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option = argv[i];
+            if (option == "--no-snapshots") {
+                config.options.snapshots = false;
+                continue;
+            }
+            if (option == "--deterministic") {
+                config.options.deterministic = true;
+                continue;
+            }
+            if (option == "--dry-run") {
+                config.dryRun = true;
+                continue;
+            }
+            if (option == "--help" || option == "-h" || i + 1 >= argc) {
+                return false;
+            }
+            const char* value = argv[++i];
+            if (option == "--sweep") {
+                config.sweepPath = value;
+            }
+            else if (option == "--output") {
+                config.options.outputDirectory = value;
+            }
+            else if (option == "--threads") {
+                config.options.threads = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--wide-bodies") {
+                config.options.wideBodyCount = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--metrics-every") {
+                config.options.metricsEvery = std::strtoull(value, nullptr, 10);
+            }
+            else {
+                std::fprintf(stderr, "unknown option '%s'\n", option.c_str());
+                return false;
+            }
+        }
+        return !config.sweepPath.empty();
+    }
+}
+
+//------------------------------------------------------------------------------------
+// Headless ensemble: every run of a parameter sweep, results streamed to disk
+//------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    EnsembleConfig config;
+    if (!parseArguments(argc, argv, config)) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    SweepSpec sweep;
+    std::string error;
+    if (!sweep.load(config.sweepPath, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    const auto runs = sweep.expand();
+    if (config.dryRun) {
+        for (const auto& run : runs) {
+            std::printf("{\"run\": %zu, \"distribution\": \"%s\", \"bodies\": %zu, \"seed\": %llu, \"steps\": %zu, \"dt\": %g, \"softening\": %g, \"theta\": %g}\n",
+                        run.index, ScenarioGenerator::distributionName(run.scenario.distribution), run.scenario.bodyCount,
+                        static_cast<unsigned long long>(run.scenario.seed), run.steps, run.dt, run.parameters.softening, run.parameters.theta);
+        }
+        return 0;
+    }
+
+    EnsembleRunner runner(config.options);
+    if (!runner.run(runs, &error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    const auto& stats = runner.getStats();
+    std::printf("{\n");
+    std::printf("  \"sweep\": \"%s\",\n", config.sweepPath.c_str());
+    std::printf("  \"output\": \"%s\",\n", config.options.outputDirectory.c_str());
+    std::printf("  \"threads\": %zu,\n", runner.getThreadPool().getThreadCount());
+    std::printf("  \"runs\": %zu,\n", stats.runs);
+    std::printf("  \"wide_runs\": %zu,\n", stats.wideRuns);
+    std::printf("  \"failed_runs\": %zu,\n", stats.failedRuns);
+    std::printf("  \"wall_s\": %.3f,\n", stats.wallSeconds);
+    std::printf("  \"simulations_per_hour\": %.1f\n", stats.simulationsPerHour);
+    std::printf("}\n");
+    return stats.failedRuns == 0 ? 0 : 1;
+}
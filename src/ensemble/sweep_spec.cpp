@@ -0,0 +1,213 @@
+#include "sweep_spec.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+    bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    // A range expands into this many runs at most, a typo should not sweep a billion seeds
+    const uint64_t MAX_RANGE_VALUES = 100000;
+
+    std::string trim(const std::string& text) {
+        const auto first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos) {
+            return {};
+        }
+        const auto last = text.find_last_not_of(" \t\r");
+        return text.substr(first, last - first + 1);
+    }
+
+    bool parseUnsigned(const std::string& text, uint64_t& value) {
+        if (text.empty() || text.front() == '-') {
+            return false;
+        }
+        char* end = nullptr;
+        value = std::strtoull(text.c_str(), &end, 10);
+        return *end == '\0';
+    }
+
+    bool parseFloat(const std::string& text, float& value) {
+        if (text.empty()) {
+            return false;
+        }
+        char* end = nullptr;
+        value = std::strtof(text.c_str(), &end);
+        return *end == '\0';
+    }
+
+    const char* const KEYS[] = {"distribution", "bodies", "seed", "steps", "dt", "gravity", "softening", "theta",
+                                "opening", "alpha", "order", "bucket", "engine", "integrator", "collisions"};
+
+    bool isKey(const std::string& key) {
+        for (const auto* candidate : KEYS) {
+            if (key == candidate) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool isIntegerKey(const std::string& key) {
+        return key == "bodies" || key == "seed" || key == "steps" || key == "bucket";
+    }
+}
+
+bool SweepSpec::load(const std::string& path, std::string* error) {
+    std::ifstream file(path);
+    if (!file) {
+        return fail(error, "cannot open " + path);
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    if (!parse(text.str(), error)) {
+        return fail(error, path + ": " + (error ? *error : std::string()));
+    }
+    return true;
+}
+
+bool SweepSpec::parse(const std::string& text, std::string* error) {
+    m_axes.clear();
+    std::istringstream lines(text);
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(lines, line); ++lineNumber) {
+        const auto where = "line " + std::to_string(lineNumber) + ": ";
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        const auto equals = line.find('=');
+        if (equals == std::string::npos) {
+            return fail(error, where + "expected key = values");
+        }
+
+        Axis axis;
+        axis.key = trim(line.substr(0, equals));
+        if (!isKey(axis.key)) {
+            return fail(error, where + "unknown key '" + axis.key + "'");
+        }
+        for (const auto& other : m_axes) {
+            if (other.key == axis.key) {
+                return fail(error, where + "'" + axis.key + "' given twice");
+            }
+        }
+        std::istringstream values(line.substr(equals + 1));
+        std::string value;
+        while (std::getline(values, value, ',')) {
+            value = trim(value);
+            const auto dots = value.find("..");
+            if (dots != std::string::npos && isIntegerKey(axis.key)) {
+                uint64_t first = 0, last = 0;
+                if (!parseUnsigned(trim(value.substr(0, dots)), first) || !parseUnsigned(trim(value.substr(dots + 2)), last) ||
+                    last < first || last - first >= MAX_RANGE_VALUES) {
+                    return fail(error, where + "bad range '" + value + "'");
+                }
+                for (auto v = first; v <= last; ++v) {
+                    axis.values.push_back(std::to_string(v));
+                }
+                continue;
+            }
+            // Check every value now rather than halfway through the ensemble
+            EnsembleRun probe;
+            if (!apply(axis.key, value, probe)) {
+                return fail(error, where + "bad value '" + value + "' for '" + axis.key + "'");
+            }
+            axis.values.push_back(value);
+        }
+        if (axis.values.empty()) {
+            return fail(error, where + "'" + axis.key + "' has no values");
+        }
+        m_axes.push_back(std::move(axis));
+    }
+    return true;
+}
+
+size_t SweepSpec::getRunCount() const {
+    size_t count = 1;
+    for (const auto& axis : m_axes) {
+        count *= axis.values.size();
+    }
+    return count;
+}
+
+std::vector<EnsembleRun> SweepSpec::expand() const {
+    std::vector<EnsembleRun> runs(getRunCount());
+    for (size_t index = 0; index < runs.size(); ++index) {
+        auto& run = runs[index];
+        run.index = index;
+        // Mixed radix digits of the index, the last axis is the lowest digit
+        auto remainder = index;
+        for (auto axis = m_axes.rbegin(); axis != m_axes.rend(); ++axis) {
+            apply(axis->key, axis->values[remainder % axis->values.size()], run);
+            remainder /= axis->values.size();
+        }
+    }
+    return runs;
+}
+
+bool SweepSpec::apply(const std::string& key, const std::string& value, EnsembleRun& run) {
+    uint64_t integer = 0;
+    float number = 0.0f;
+    auto& parameters = run.parameters;
+    if (key == "distribution") {
+        return ScenarioGenerator::parseDistribution(value, run.scenario.distribution);
+    }
+    if (key == "bodies" && parseUnsigned(value, integer) && integer > 0) {
+        run.scenario.bodyCount = integer;
+        return true;
+    }
+    if (key == "seed" && parseUnsigned(value, integer)) {
+        run.scenario.seed = integer;
+        return true;
+    }
+    if (key == "steps" && parseUnsigned(value, integer)) {
+        run.steps = integer;
+        return true;
+    }
+    if (key == "bucket" && parseUnsigned(value, integer) && integer > 0) {
+        parameters.leafBucketSize = static_cast<uint32_t>(integer);
+        return true;
+    }
+    if (key == "dt" && parseFloat(value, number) && number > 0.0f) {
+        run.dt = number;
+        return true;
+    }
+    if (key == "gravity" && parseFloat(value, number)) {
+        parameters.gravity = number;
+        return true;
+    }
+    if (key == "softening" && parseFloat(value, number) && number >= 0.0f) {
+        parameters.softening = number;
+        return true;
+    }
+    if (key == "theta" && parseFloat(value, number) && number > 0.0f) {
+        parameters.theta = number;
+        return true;
+    }
+    if (key == "alpha" && parseFloat(value, number) && number > 0.0f) {
+        parameters.forceAccuracy = number;
+        return true;
+    }
+    if (key == "opening") {
+        return physics::parseOpeningCriterion(value, parameters.openingCriterion);
+    }
+    if (key == "order") {
+        return physics::parseExpansionOrder(value, parameters.expansionOrder);
+    }
+    if (key == "engine") {
+        return physics::parseForceEngine(value, run.engine);
+    }
+    if (key == "integrator") {
+        return physics::parseIntegrator(value, run.integrator);
+    }
+    if (key == "collisions") {
+        return physics::parseCollisionPolicy(value, run.collisions);
+    }
+    return false;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "physics/collision_solver.h"
+#include "physics/nbody_simulation.h"
+#include "physics/simulation_parameters.h"
+#include "utils/scenario_generator.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Everything one simulation of an ensemble needs, run from start to end without a window
+struct EnsembleRun {
+    size_t index {0};
+    ScenarioConfig scenario;
+    physics::SimulationParameters parameters;
+    physics::ForceEngine engine {physics::ForceEngine::BarnesHut};
+    physics::Integrator integrator {physics::Integrator::Leapfrog};
+    physics::CollisionPolicy collisions {physics::CollisionPolicy::Ignore};
+    float dt {0.01f};
+    size_t steps {1000};
+};
+
+// Parameter sweep read from a text file, one key per line:
+//
+//   # two distributions, eight seeds each, three opening angles
+//   distribution = plummer, galaxies
+//   seed = 1..8
+//   theta = 0.4, 0.7, 1.0
+//   steps = 2000
+//
+// A key takes a comma separated list, integer keys also take first..last ranges. The runs are
+// the cartesian product of all lists, the last key varying fastest; keys left out keep the
+// defaults of EnsembleRun. Keys: distribution, bodies, seed, steps, dt, gravity, softening,
+// theta, opening, alpha, order, bucket, engine, integrator, collisions.
+class SweepSpec {
+
+public:
+    bool load(const std::string& path, std::string* error = nullptr);
+    bool parse(const std::string& text, std::string* error = nullptr);
+
+    // Runs in sweep order, index set
+    std::vector<EnsembleRun> expand() const;
+    size_t getRunCount() const;
+
+    // Set one key of a run from its text form, false for an unknown key or a bad value
+    static bool apply(const std::string& key, const std::string& value, EnsembleRun& run);
+
+private:
+    struct Axis {
+        std::string key;
+        std::vector<std::string> values;
+    };
+
+    std::vector<Axis> m_axes;
+};
@@ -0,0 +1,273 @@
+#include "batch_renderer.h"
+
+#include <rlgl.h>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const int DISC_TEXTURE_SIZE = 64;
+    // Quads emitted between batch limit checks, well below the default rlgl buffer
+    const size_t QUADS_PER_CHUNK = 1024;
+    // Bodies smaller than this many pixels collapse to a single pixel
+    const float MIN_SPRITE_RADIUS = 0.5f;
+    // Nodes narrower than this many pixels on screen are drawn as one splat
+    const float LOD_NODE_PIXELS = 2.0f;
+    // Splat of a node holding one average body, grows with the square root of the node mass
+    const float SPLAT_PIXEL_RADIUS = 0.5f;
+    const float MAX_SPLAT_PIXEL_RADIUS = 4.0f;
+    // Interpolated positions trail the ones the tree was built from, keep nodes this close to the screen
+    const float CULL_MARGIN_PIXELS = 16.0f;
+
+    glm::vec2 interpolate(const RenderSnapshot& snapshot, size_t index, float alpha) {
+        return snapshot.previousPositions[index] + (snapshot.positions[index] - snapshot.previousPositions[index]) * alpha;
+    }
+}
+
+const char* renderModeName(RenderMode mode) {
+    switch (mode) {
+        case RenderMode::Circles: return "circles";
+        case RenderMode::Batched: return "batched";
+        case RenderMode::Density: return "density";
+        case RenderMode::Auto: return "auto";
+    }
+    return "unknown";
+}
+
+BatchRenderer::BatchRenderer() {
+    // White anti-aliased disc, tinted per body through the vertex color
+    auto image = GenImageColor(DISC_TEXTURE_SIZE, DISC_TEXTURE_SIZE, BLANK);
+    auto* pixels = static_cast<Color*>(image.data);
+    const auto center = DISC_TEXTURE_SIZE / 2.0f;
+    const auto radius = center - 1.0f;
+    for (int y = 0; y < DISC_TEXTURE_SIZE; ++y) {
+        for (int x = 0; x < DISC_TEXTURE_SIZE; ++x) {
+            const auto distance = std::hypot(x + 0.5f - center, y + 0.5f - center);
+            const auto coverage = std::clamp(radius - distance + 0.5f, 0.0f, 1.0f);
+            pixels[y * DISC_TEXTURE_SIZE + x] = Color {255, 255, 255, static_cast<unsigned char>(coverage * 255)};
+        }
+    }
+    m_discTexture = LoadTextureFromImage(image);
+    UnloadImage(image);
+    SetTextureFilter(m_discTexture, TEXTURE_FILTER_BILINEAR);
+}
+
+BatchRenderer::~BatchRenderer() {
+    UnloadTexture(m_discTexture);
+    if (m_densityTexture.id != 0) {
+        UnloadTexture(m_densityTexture);
+    }
+}
+
+void BatchRenderer::draw(const RenderSnapshot& snapshot, float alpha, RenderMode mode, const ViewCamera& camera) {
+    selectVisible(snapshot, camera);
+    if (mode == RenderMode::Auto) {
+        const auto pixelCount = static_cast<size_t>(GetScreenWidth()) * static_cast<size_t>(GetScreenHeight());
+        mode = m_spriteCount > pixelCount ? RenderMode::Density : RenderMode::Batched;
+    }
+
+    switch (mode) {
+        case RenderMode::Circles: drawCircles(snapshot, alpha, camera); break;
+        case RenderMode::Density: drawDensity(snapshot, alpha, camera); break;
+        default: drawBatched(snapshot, alpha, camera); break;
+    }
+}
+
+void BatchRenderer::selectVisible(const RenderSnapshot& snapshot, const ViewCamera& camera) {
+    camera.getVisibleArea(m_visibleMin, m_visibleMax);
+    m_ranges.clear();
+    m_splats.clear();
+    if (snapshot.nodes.empty()) {
+        m_ranges.emplace_back(0, static_cast<uint32_t>(snapshot.size()));
+        m_spriteCount = snapshot.size();
+        return;
+    }
+
+    const auto zoom = camera.getZoom();
+    // Bodies reach out of their cell by their radius
+    const auto margin = snapshot.maxRadius + CULL_MARGIN_PIXELS / zoom;
+    m_spriteCount = 0;
+    m_stack.assign(1, 0);
+    while (!m_stack.empty()) {
+        const auto index = m_stack.back();
+        m_stack.pop_back();
+        const auto& node = snapshot.nodes[index];
+        if (node.begin == node.end) {
+            continue;
+        }
+        const auto reach = node.halfDimension + margin;
+        if (node.center.x + reach < m_visibleMin.x || node.center.x - reach > m_visibleMax.x
+            || node.center.y + reach < m_visibleMin.y || node.center.y - reach > m_visibleMax.y) {
+            continue;
+        }
+
+        if (node.end - node.begin > 1 && node.halfDimension * 2.0f * zoom < LOD_NODE_PIXELS) {
+            m_splats.push_back(index);
+            ++m_spriteCount;
+        }
+        else if (node.firstChild < 0) {
+            m_ranges.emplace_back(node.begin, node.end);
+            m_spriteCount += node.end - node.begin;
+        }
+        else {
+            for (auto child = 4; child-- > 0; ) {
+                m_stack.push_back(static_cast<uint32_t>(node.firstChild + child));
+            }
+        }
+    }
+}
+
+float BatchRenderer::splatPixelRadius(const RenderSnapshot& snapshot, const RenderNode& node) const {
+    const auto weight = snapshot.meanMass > 0.0f ? node.mass / snapshot.meanMass : static_cast<float>(node.end - node.begin);
+    return std::clamp(SPLAT_PIXEL_RADIUS * std::sqrt(weight), MIN_SPRITE_RADIUS, MAX_SPLAT_PIXEL_RADIUS);
+}
+
+bool BatchRenderer::isVisible(glm::vec2 position, float reach) const {
+    return position.x + reach >= m_visibleMin.x && position.x - reach <= m_visibleMax.x
+        && position.y + reach >= m_visibleMin.y && position.y - reach <= m_visibleMax.y;
+}
+
+void BatchRenderer::drawCircles(const RenderSnapshot& snapshot, float alpha, const ViewCamera& camera) {
+    const auto pixel = 1.0f / camera.getZoom();
+    BeginMode2D(camera.getCamera());
+    for (const auto& [begin, end] : m_ranges) {
+        for (auto i = begin; i < end; ++i) {
+            const auto position = interpolate(snapshot, i, alpha);
+            if (isVisible(position, snapshot.appearances[i].radius)) {
+                DrawableBody(position, snapshot.appearances[i]).draw();
+            }
+        }
+    }
+    for (const auto index : m_splats) {
+        const auto& node = snapshot.nodes[index];
+        DrawCircleV(Vector2 {node.centerOfMass.x, node.centerOfMass.y}, splatPixelRadius(snapshot, node) * pixel, node.color);
+    }
+    EndMode2D();
+}
+
+void BatchRenderer::drawBatched(const RenderSnapshot& snapshot, float alpha, const ViewCamera& camera) {
+    // One screen pixel in world units
+    const auto pixel = 1.0f / camera.getZoom();
+    size_t quads = 0;
+    auto emit = [this, &quads, pixel](glm::vec2 position, float r, const Color& color) {
+        if (quads % QUADS_PER_CHUNK == 0) {
+            if (quads > 0) {
+                rlEnd();
+                rlSetTexture(0);
+            }
+            rlCheckRenderBatchLimit(static_cast<int>(4 * QUADS_PER_CHUNK));
+            rlSetTexture(m_discTexture.id);
+            rlBegin(RL_QUADS);
+        }
+        ++quads;
+        rlColor4ub(color.r, color.g, color.b, color.a);
+
+        if (r < MIN_SPRITE_RADIUS * pixel) {
+            // One pixel sampled from the opaque middle of the disc
+            const auto half = 0.5f * pixel;
+            rlTexCoord2f(0.5f, 0.5f);
+            rlVertex2f(position.x - half, position.y - half);
+            rlVertex2f(position.x - half, position.y + half);
+            rlVertex2f(position.x + half, position.y + half);
+            rlVertex2f(position.x + half, position.y - half);
+            return;
+        }
+
+        rlTexCoord2f(0.0f, 0.0f);
+        rlVertex2f(position.x - r, position.y - r);
+        rlTexCoord2f(0.0f, 1.0f);
+        rlVertex2f(position.x - r, position.y + r);
+        rlTexCoord2f(1.0f, 1.0f);
+        rlVertex2f(position.x + r, position.y + r);
+        rlTexCoord2f(1.0f, 0.0f);
+        rlVertex2f(position.x + r, position.y - r);
+    };
+
+    BeginMode2D(camera.getCamera());
+    for (const auto& [begin, end] : m_ranges) {
+        for (auto i = begin; i < end; ++i) {
+            const auto position = interpolate(snapshot, i, alpha);
+            const auto& appearance = snapshot.appearances[i];
+            if (isVisible(position, appearance.radius)) {
+                emit(position, appearance.radius, appearance.color);
+            }
+        }
+    }
+    for (const auto index : m_splats) {
+        const auto& node = snapshot.nodes[index];
+        emit(node.centerOfMass, splatPixelRadius(snapshot, node) * pixel, node.color);
+    }
+    if (quads > 0) {
+        rlEnd();
+        rlSetTexture(0);
+    }
+    EndMode2D();
+}
+
+void BatchRenderer::drawDensity(const RenderSnapshot& snapshot, float alpha, const ViewCamera& camera) {
+    const auto width = GetScreenWidth();
+    const auto height = GetScreenHeight();
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+
+    if (m_densityTexture.width != width || m_densityTexture.height != height) {
+        if (m_densityTexture.id != 0) {
+            UnloadTexture(m_densityTexture);
+        }
+        auto image = GenImageColor(width, height, BLANK);
+        m_densityTexture = LoadTextureFromImage(image);
+        UnloadImage(image);
+    }
+
+    const auto pixelCount = static_cast<size_t>(width) * static_cast<size_t>(height);
+    m_density.assign(pixelCount * 4, 0.0f);
+    m_densityPixels.resize(pixelCount);
+
+    // Splat every body into its pixel: color sum and hit count
+    float maxCount = 0.0f;
+    auto accumulate = [this, &maxCount, &camera, width, height](glm::vec2 position, const Color& color, float count) {
+        const auto screen = camera.worldToScreen(position);
+        const auto px = static_cast<int>(std::floor(screen.x));
+        const auto py = static_cast<int>(std::floor(screen.y));
+        if (px < 0 || py < 0 || px >= width || py >= height) {
+            return;
+        }
+        auto* texel = &m_density[(static_cast<size_t>(py) * width + px) * 4];
+        texel[0] += color.r * count;
+        texel[1] += color.g * count;
+        texel[2] += color.b * count;
+        texel[3] += count;
+        maxCount = std::max(maxCount, texel[3]);
+    };
+    for (const auto& [begin, end] : m_ranges) {
+        for (auto i = begin; i < end; ++i) {
+            accumulate(interpolate(snapshot, i, alpha), snapshot.appearances[i].color, 1.0f);
+        }
+    }
+    // A node below the pixel size lands in one or two pixels anyway, it counts for all its bodies
+    for (const auto index : m_splats) {
+        const auto& node = snapshot.nodes[index];
+        accumulate(node.centerOfMass, node.color, static_cast<float>(node.end - node.begin));
+    }
+
+    // Log tone mapping, mean color scaled by relative density
+    const auto logMax = std::log1p(maxCount);
+    for (size_t p = 0; p < pixelCount; ++p) {
+        const auto* texel = &m_density[p * 4];
+        if (texel[3] == 0.0f) {
+            m_densityPixels[p] = BLANK;
+            continue;
+        }
+        const auto brightness = logMax > 0 ? std::log1p(texel[3]) / logMax : 1.0f;
+        const auto scale = brightness / texel[3];
+        m_densityPixels[p] = Color {
+            static_cast<unsigned char>(texel[0] * scale),
+            static_cast<unsigned char>(texel[1] * scale),
+            static_cast<unsigned char>(texel[2] * scale),
+            255
+        };
+    }
+
+    UpdateTexture(m_densityTexture, m_densityPixels.data());
+    DrawTexture(m_densityTexture, 0, 0, WHITE);
+}
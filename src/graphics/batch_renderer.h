@@ -0,0 +1,58 @@
+#pragma once
+
+#include "render_snapshot.h"
+#include "view_camera.h"
+
+#include <raylib.h>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+enum class RenderMode {
+    Circles,        // One DrawCircleV per body, tessellated on the CPU
+    Batched,        // Textured quads streamed through one rlgl batch
+    Density,        // Per-pixel accumulation uploaded as one texture
+    Auto            // Batched, or Density once bodies outnumber pixels
+};
+
+const char* renderModeName(RenderMode mode);
+
+// Draws a whole snapshot at once instead of body by body.
+// With a render tree in the snapshot, nodes outside the view are skipped and nodes smaller
+// than a couple of pixels on screen are drawn as one splat at their center of mass.
+// Owns GPU resources, so it has to be created and destroyed on the thread
+// that owns the GL context, after InitWindow().
+class BatchRenderer {
+
+public:
+    BatchRenderer();
+    BatchRenderer(const BatchRenderer&) = delete;
+    BatchRenderer& operator=(const BatchRenderer&) = delete;
+    ~BatchRenderer();
+
+    // alpha blends previousPositions (0) to positions (1)
+    void draw(const RenderSnapshot& snapshot, float alpha, RenderMode mode, const ViewCamera& camera);
+
+private:
+    // Fill m_ranges and m_splats from the render tree
+    void selectVisible(const RenderSnapshot& snapshot, const ViewCamera& camera);
+    // Screen radius of a splat, grows with the node mass
+    float splatPixelRadius(const RenderSnapshot& snapshot, const RenderNode& node) const;
+    bool isVisible(glm::vec2 position, float reach) const;
+    void drawCircles(const RenderSnapshot& snapshot, float alpha, const ViewCamera& camera);
+    void drawBatched(const RenderSnapshot& snapshot, float alpha, const ViewCamera& camera);
+    void drawDensity(const RenderSnapshot& snapshot, float alpha, const ViewCamera& camera);
+
+    Texture2D m_discTexture;
+    Texture2D m_densityTexture {};
+    std::vector<float> m_density;           // Accumulated R, G, B and count per pixel
+    std::vector<Color> m_densityPixels;
+
+    // Per frame selection
+    glm::vec2 m_visibleMin {0.0f, 0.0f};            // World area on screen
+    glm::vec2 m_visibleMax {0.0f, 0.0f};
+    std::vector<std::pair<uint32_t, uint32_t>> m_ranges;    // Snapshot bodies drawn one by one
+    std::vector<uint32_t> m_splats;                 // Nodes drawn as one sprite
+    std::vector<uint32_t> m_stack;
+    size_t m_spriteCount {0};
+};
@@ -1,16 +1,10 @@
 #include "drawable_body.h"
-#include <algorithm>
 
-DrawableBody::DrawableBody(glm::vec2 pos, glm::vec2 vel, float mass, float radius, Color color)
-    : physics::Body(pos, vel, mass)
-    , m_radius(radius)
-    , m_color(color) {
+DrawableBody::DrawableBody(glm::vec2 position, const BodyAppearance& appearance)
+    : m_position(position)
+    , m_appearance(&appearance) {
 }
 
-DrawableBody::~DrawableBody() {
-
-}
-    
-void DrawableBody::draw() {
-    DrawCircleV({m_position.x, m_position.y}, m_radius, m_color);
+void DrawableBody::draw() const {
+    DrawCircleV({m_position.x, m_position.y}, m_appearance->radius, m_appearance->color);
 }
@@ -1,18 +1,25 @@
 #pragma once
 
-#include "physics/body.h"
+#include <glm/vec2.hpp>
 #include <raylib.h>
 
-class DrawableBody : public physics::Body {
+// Rendering attributes, kept apart from the physics state and indexed by body id
+struct BodyAppearance {
+    float radius {1.0f};
+    Color color {WHITE};
+};
+
+// Lightweight view of a body to draw: a position and its appearance
+class DrawableBody {
 
 public:
-    explicit DrawableBody(glm::vec2 pos, glm::vec2 vel, float mass, float radius, Color color);
-    virtual ~DrawableBody();
+    explicit DrawableBody(glm::vec2 position, const BodyAppearance& appearance);
 
-    virtual void draw();
-    float getRadius() const { return m_radius; }
+    void draw() const;
+    glm::vec2 position() const { return m_position; }
+    float getRadius() const { return m_appearance->radius; }
 protected:
-    Color m_color {WHITE};
-    float m_radius {1.0f};
+    glm::vec2 m_position;
+    const BodyAppearance* m_appearance;
 
 };
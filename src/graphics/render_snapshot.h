@@ -0,0 +1,49 @@
+#pragma once
+
+#include "drawable_body.h"
+
+#include <glm/vec2.hpp>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Quadtree cell over the snapshot bodies, for culling and level of detail
+struct RenderNode {
+    glm::vec2 center;               // Square cell
+    float halfDimension;
+    glm::vec2 centerOfMass;
+    float mass;
+    Color color;                    // Mean color of the bodies below
+    uint32_t begin;                 // Bodies of the subtree are [begin, end) of the snapshot arrays
+    uint32_t end;
+    int32_t firstChild;             // Children NW, NE, SW, SE from here on, -1 for a leaf
+};
+
+// Everything the render thread needs from one simulation step.
+// Arrays are dense, one entry per active body.
+struct RenderSnapshot {
+    std::vector<glm::vec2> positions;
+    std::vector<glm::vec2> previousPositions;   // Same body in the previous snapshot
+    std::vector<BodyAppearance> appearances;
+    // Root first; when present the body arrays are in tree order. Empty draws every body.
+    std::vector<RenderNode> nodes;
+    float meanMass {0.0f};                      // Mass of an average body, the unit of node splats
+    float maxRadius {0.0f};                     // Largest body, how far bodies reach out of their node
+
+    uint64_t stepIndex {0};
+    size_t escapedCount {0};
+    size_t mergedCount {0};
+    std::chrono::steady_clock::time_point publishTime {};
+    float stepInterval {0.0f};                  // Wall seconds since the previous snapshot
+
+    size_t size() const { return positions.size(); }
+
+    // Progress from previousPositions to positions for a frame drawn at 'now'
+    float interpolationFactor(std::chrono::steady_clock::time_point now) const {
+        if (stepInterval <= 0.0f) {
+            return 1.0f;
+        }
+        const auto elapsed = std::chrono::duration<float>(now - publishTime).count();
+        return elapsed <= 0.0f ? 0.0f : (elapsed >= stepInterval ? 1.0f : elapsed / stepInterval);
+    }
+};
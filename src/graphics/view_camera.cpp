@@ -0,0 +1,56 @@
+#include "view_camera.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // View scale per wheel notch
+    const float ZOOM_STEP = 1.25f;
+}
+
+void ViewCamera::handleInput() {
+    const auto wheel = GetMouseWheelMove();
+    if (wheel != 0.0f) {
+        const auto mouse = GetMousePosition();
+        zoomAt(glm::vec2(mouse.x, mouse.y), std::pow(ZOOM_STEP, wheel));
+    }
+    if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) || IsMouseButtonDown(MOUSE_BUTTON_MIDDLE)) {
+        const auto delta = GetMouseDelta();
+        pan(glm::vec2(delta.x, delta.y));
+    }
+    if (IsKeyPressed(KEY_ZERO)) {
+        reset();
+    }
+}
+
+void ViewCamera::zoomAt(glm::vec2 screenPoint, float factor) {
+    // Pin the world point under the cursor by making it the camera target
+    const auto world = screenToWorld(screenPoint);
+    m_camera.offset = Vector2 {screenPoint.x, screenPoint.y};
+    m_camera.target = Vector2 {world.x, world.y};
+    m_camera.zoom = std::clamp(m_camera.zoom * factor, MIN_ZOOM, MAX_ZOOM);
+}
+
+void ViewCamera::pan(glm::vec2 screenDelta) {
+    m_camera.target.x -= screenDelta.x / m_camera.zoom;
+    m_camera.target.y -= screenDelta.y / m_camera.zoom;
+}
+
+void ViewCamera::reset() {
+    m_camera = Camera2D {{0.0f, 0.0f}, {0.0f, 0.0f}, 0.0f, 1.0f};
+}
+
+glm::vec2 ViewCamera::worldToScreen(glm::vec2 world) const {
+    return glm::vec2((world.x - m_camera.target.x) * m_camera.zoom + m_camera.offset.x,
+                     (world.y - m_camera.target.y) * m_camera.zoom + m_camera.offset.y);
+}
+
+glm::vec2 ViewCamera::screenToWorld(glm::vec2 screen) const {
+    return glm::vec2((screen.x - m_camera.offset.x) / m_camera.zoom + m_camera.target.x,
+                     (screen.y - m_camera.offset.y) / m_camera.zoom + m_camera.target.y);
+}
+
+void ViewCamera::getVisibleArea(glm::vec2& min, glm::vec2& max) const {
+    min = screenToWorld(glm::vec2(0.0f, 0.0f));
+    max = screenToWorld(glm::vec2(static_cast<float>(GetScreenWidth()), static_cast<float>(GetScreenHeight())));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <raylib.h>
+#include <glm/vec2.hpp>
+
+// Zoom and pan of the view over the simulation, without rotation.
+// Unzoomed and unpanned, world coordinates are screen pixels.
+class ViewCamera {
+
+public:
+    static constexpr float MIN_ZOOM = 1.0f / 64;
+    static constexpr float MAX_ZOOM = 4096.0f;
+
+    // Mouse wheel zooms about the cursor, right or middle drag pans, 0 resets. Once per frame.
+    void handleInput();
+    // Scale the view by factor, the world point under screenPoint stays there
+    void zoomAt(glm::vec2 screenPoint, float factor);
+    void pan(glm::vec2 screenDelta);
+    void reset();
+
+    const Camera2D& getCamera() const { return m_camera; }
+    float getZoom() const { return m_camera.zoom; }
+    glm::vec2 worldToScreen(glm::vec2 world) const;
+    glm::vec2 screenToWorld(glm::vec2 screen) const;
+    // World rectangle covered by the screen
+    void getVisibleArea(glm::vec2& min, glm::vec2& max) const;
+
+private:
+    Camera2D m_camera {{0.0f, 0.0f}, {0.0f, 0.0f}, 0.0f, 1.0f};
+};
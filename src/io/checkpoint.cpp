@@ -0,0 +1,153 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <type_traits>
+
+namespace {
+    const char CHECKPOINT_MAGIC[8] = {'G', 'R', 'V', 'C', 'K', 'P', 'T', '\0'};
+    const uint64_t ARRAY_ALIGNMENT = 64;
+
+    bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    uint64_t alignUp(uint64_t offset) {
+        return (offset + ARRAY_ALIGNMENT - 1) & ~(ARRAY_ALIGNMENT - 1);
+    }
+}
+
+bool saveCheckpoint(const std::string& path, const physics::BodyStore& bodies, const std::vector<uint32_t>& colors,
+                    const CheckpointInfo& info, std::string* error) {
+    const auto count = bodies.size();
+    const auto withColors = colors.size() == count && count > 0;
+
+    CheckpointHeader header {};
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.headerSize = sizeof(CheckpointHeader);
+    header.endianTag = CHECKPOINT_ENDIAN_TAG;
+    header.flags = withColors ? CHECKPOINT_HAS_COLOR : 0;
+    header.bodyCount = count;
+    header.stepIndex = info.stepIndex;
+    header.simulationTime = info.simulationTime;
+    header.areaWidth = info.area.x;
+    header.areaHeight = info.area.y;
+    header.idCapacity = bodies.getIdCapacity();
+
+    // Every array is 4 bytes per body
+    const void* arrays[] = {
+        bodies.x.data(), bodies.y.data(), bodies.vx.data(), bodies.vy.data(),
+        bodies.mass.data(), bodies.radius.data(), bodies.id.data(), withColors ? colors.data() : nullptr
+    };
+    auto offset = alignUp(sizeof(CheckpointHeader));
+    for (size_t a = 0; a < static_cast<size_t>(CheckpointArray::Count); ++a) {
+        header.arrayOffsets[a] = offset;
+        if (arrays[a]) {
+            offset = alignUp(offset + count * sizeof(uint32_t));
+        }
+    }
+
+    const auto temporaryPath = path + ".tmp";
+    auto* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file) {
+        return fail(error, "cannot create " + temporaryPath);
+    }
+
+    static const uint8_t padding[ARRAY_ALIGNMENT] = {};
+    uint64_t written = 0;
+    auto write = [file, &written](const void* data, size_t bytes) {
+        const auto ok = bytes == 0 || std::fwrite(data, 1, bytes, file) == bytes;
+        written += bytes;
+        return ok;
+    };
+    auto ok = write(&header, sizeof(header));
+    for (size_t a = 0; a < static_cast<size_t>(CheckpointArray::Count) && ok; ++a) {
+        if (!arrays[a]) {
+            continue;
+        }
+        ok = write(padding, header.arrayOffsets[a] - written) && write(arrays[a], count * sizeof(uint32_t));
+    }
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::remove(temporaryPath.c_str());
+        return fail(error, "cannot write " + temporaryPath);
+    }
+
+    std::error_code renameError;
+    std::filesystem::rename(temporaryPath, path, renameError);
+    if (renameError) {
+        std::remove(temporaryPath.c_str());
+        return fail(error, "cannot replace " + path + ": " + renameError.message());
+    }
+    return true;
+}
+
+bool CheckpointReader::open(const std::string& path, std::string* error) {
+    m_header = nullptr;
+    if (!m_file.open(path, error)) {
+        return false;
+    }
+
+    if (m_file.size() < sizeof(CheckpointHeader)) {
+        return fail(error, path + " is too small for a checkpoint");
+    }
+    const auto* header = reinterpret_cast<const CheckpointHeader*>(m_file.data());
+    if (std::memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0) {
+        return fail(error, path + " is not a checkpoint");
+    }
+    if (header->endianTag != CHECKPOINT_ENDIAN_TAG) {
+        return fail(error, path + " was written on a machine with different byte order");
+    }
+    if (header->version != CHECKPOINT_VERSION || header->headerSize < sizeof(CheckpointHeader)) {
+        return fail(error, path + " has unsupported version " + std::to_string(header->version));
+    }
+
+    const auto arrayBytes = header->bodyCount * sizeof(uint32_t);
+    for (size_t a = 0; a < static_cast<size_t>(CheckpointArray::Count); ++a) {
+        if (a == static_cast<size_t>(CheckpointArray::Color) && !(header->flags & CHECKPOINT_HAS_COLOR)) {
+            continue;
+        }
+        const auto offset = header->arrayOffsets[a];
+        if (offset % ARRAY_ALIGNMENT != 0 || offset > m_file.size() || m_file.size() - offset < arrayBytes) {
+            return fail(error, path + " is truncated");
+        }
+    }
+
+    m_header = header;
+    return true;
+}
+
+CheckpointInfo CheckpointReader::getInfo() const {
+    CheckpointInfo info;
+    info.stepIndex = m_header->stepIndex;
+    info.simulationTime = m_header->simulationTime;
+    info.area = glm::vec2(m_header->areaWidth, m_header->areaHeight);
+    return info;
+}
+
+void CheckpointReader::restore(physics::BodyStore& bodies) const {
+    const auto count = size();
+    bodies.clear();
+    auto copy = [this, count](auto& values, CheckpointArray array) {
+        using T = typename std::decay_t<decltype(values)>::value_type;
+        const auto* source = getArray<T>(array);
+        values.assign(source, source + count);
+    };
+    copy(bodies.x, CheckpointArray::X);
+    copy(bodies.y, CheckpointArray::Y);
+    copy(bodies.vx, CheckpointArray::VX);
+    copy(bodies.vy, CheckpointArray::VY);
+    copy(bodies.mass, CheckpointArray::Mass);
+    copy(bodies.radius, CheckpointArray::Radius);
+    copy(bodies.id, CheckpointArray::Id);
+    bodies.fx.assign(count, 0.0f);
+    bodies.fy.assign(count, 0.0f);
+    bodies.active.assign(count, 1);
+    bodies.timeBin.assign(count, 0);
+    bodies.restoreIds(m_header->idCapacity);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "physics/body_store.h"
+#include "base/mapped_file.h"
+
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Arrays of a checkpoint, one entry per body slot, each starting on a 64 byte boundary
+enum class CheckpointArray : uint32_t {
+    X, Y,               // float
+    VX, VY,             // float
+    Mass,               // float
+    Radius,             // float
+    Id,                 // uint32_t
+    Color,              // uint32_t RGBA, bytes in memory order r, g, b, a
+    Count
+};
+
+// Version 1 layout. Readers accept larger headerSize values so fields can be appended.
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t endianTag;                 // CHECKPOINT_ENDIAN_TAG as written by the producer
+    uint32_t flags;
+    uint64_t bodyCount;
+    uint64_t stepIndex;
+    double simulationTime;
+    float areaWidth;
+    float areaHeight;
+    uint32_t idCapacity;                // Ids below this one may be in use, the rest are free
+    uint32_t reserved;
+    uint64_t arrayOffsets[static_cast<size_t>(CheckpointArray::Count)];
+};
+
+inline constexpr uint32_t CHECKPOINT_VERSION = 1;
+inline constexpr uint32_t CHECKPOINT_ENDIAN_TAG = 0x01020304;
+inline constexpr uint32_t CHECKPOINT_HAS_COLOR = 1u << 0;
+
+struct CheckpointInfo {
+    uint64_t stepIndex {0};
+    double simulationTime {0.0};
+    glm::vec2 area {0.0f, 0.0f};
+};
+
+// Write every slot of the store; colors (RGBA per slot) is optional and may be empty.
+// The file is written next to path and renamed over it once complete.
+bool saveCheckpoint(const std::string& path, const physics::BodyStore& bodies, const std::vector<uint32_t>& colors,
+                    const CheckpointInfo& info, std::string* error = nullptr);
+
+// Memory mapped checkpoint. The arrays are read in place, restore() copies each of them
+// into the store with one bulk copy.
+class CheckpointReader {
+
+public:
+    bool open(const std::string& path, std::string* error = nullptr);
+
+    const CheckpointHeader& getHeader() const { return *m_header; }
+    size_t size() const { return static_cast<size_t>(m_header->bodyCount); }
+    bool hasColors() const { return (m_header->flags & CHECKPOINT_HAS_COLOR) != 0; }
+    CheckpointInfo getInfo() const;
+
+    template<typename T>
+    const T* getArray(CheckpointArray array) const {
+        return reinterpret_cast<const T*>(m_file.data() + m_header->arrayOffsets[static_cast<size_t>(array)]);
+    }
+
+    // Replace the content of the store, ids and the id allocator included
+    void restore(physics::BodyStore& bodies) const;
+
+private:
+    MappedFile m_file;
+    const CheckpointHeader* m_header {nullptr};
+};
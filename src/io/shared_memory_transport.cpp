@@ -0,0 +1,254 @@
+#include "shared_memory_transport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    const uint64_t SEGMENT_MAGIC = 0x4752565452414e53ull;     // "GRVTRANS"
+    const size_t CACHE_LINE_BYTES = 64;
+    const size_t MIN_RING_BYTES = 4096;
+
+    struct SegmentHeader {
+        std::atomic<uint64_t> magic;        // Stored last by the creator, the segment is ready once it matches
+        uint32_t rankCount;
+        uint32_t reserved;
+        uint64_t ringBytes;
+    };
+    const size_t HEADER_BYTES = (sizeof(SegmentHeader) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+
+    bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = MIN_RING_BYTES;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+}
+
+// Head and tail on separate cache lines, the two processes never write the same line
+struct SharedMemoryTransport::Ring {
+    alignas(CACHE_LINE_BYTES) std::atomic<uint64_t> head;   // Bytes ever written, moved by the sender
+    alignas(CACHE_LINE_BYTES) std::atomic<uint64_t> tail;   // Bytes ever read, moved by the receiver
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared rings need address free atomics");
+
+size_t SharedMemoryTransport::segmentSize(int rankCount, size_t ringBytes) {
+    const auto rings = static_cast<size_t>(rankCount) * static_cast<size_t>(rankCount);
+    return HEADER_BYTES + rings * (sizeof(Ring) + ringBytes);
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() {
+    close();
+}
+
+bool SharedMemoryTransport::create(const std::string& name, int rankCount, size_t ringBytes, std::string* error) {
+    close();
+    if (name.empty()) {
+        return fail(error, "shared memory needs a name");
+    }
+    if (rankCount < 1) {
+        return fail(error, "a transport needs at least one rank");
+    }
+    ringBytes = roundUpToPowerOfTwo(ringBytes);
+    if (!map(name, segmentSize(rankCount, ringBytes), true, error)) {
+        return false;
+    }
+    m_owner = true;
+    m_rank = 0;
+    m_rankCount = rankCount;
+    m_ringBytes = ringBytes;
+
+    for (auto from = 0; from < rankCount; ++from) {
+        for (auto to = 0; to < rankCount; ++to) {
+            new (&ring(from, to)) Ring {};
+        }
+    }
+    auto* header = new (m_data) SegmentHeader {};
+    header->rankCount = static_cast<uint32_t>(rankCount);
+    header->ringBytes = ringBytes;
+    header->magic.store(SEGMENT_MAGIC, std::memory_order_release);
+    return true;
+}
+
+bool SharedMemoryTransport::open(const std::string& name, int rank, std::string* error) {
+    close();
+    if (name.empty()) {
+        return fail(error, "shared memory needs a name");
+    }
+    // The header tells how large the whole segment is
+    if (!map(name, HEADER_BYTES, false, error)) {
+        return false;
+    }
+    auto* header = reinterpret_cast<SegmentHeader*>(m_data);
+    if (header->magic.load(std::memory_order_acquire) != SEGMENT_MAGIC) {
+        close();
+        return fail(error, "shared memory " + name + " is not a transport segment");
+    }
+    const auto rankCount = static_cast<int>(header->rankCount);
+    const auto ringBytes = static_cast<size_t>(header->ringBytes);
+    if (rank < 0 || rank >= rankCount) {
+        close();
+        return fail(error, "rank " + std::to_string(rank) + " outside the " + std::to_string(rankCount) + " ranks of " + name);
+    }
+    close();
+    if (!map(name, segmentSize(rankCount, ringBytes), false, error)) {
+        return false;
+    }
+    m_rank = rank;
+    m_rankCount = rankCount;
+    m_ringBytes = ringBytes;
+    return true;
+}
+
+SharedMemoryTransport::Ring& SharedMemoryTransport::ring(int from, int to) const {
+    const auto index = static_cast<size_t>(from) * static_cast<size_t>(m_rankCount) + static_cast<size_t>(to);
+    return *reinterpret_cast<Ring*>(m_data + HEADER_BYTES + index * (sizeof(Ring) + m_ringBytes));
+}
+
+uint8_t* SharedMemoryTransport::ringData(int from, int to) const {
+    return reinterpret_cast<uint8_t*>(&ring(from, to)) + sizeof(Ring);
+}
+
+size_t SharedMemoryTransport::write(int rank, const uint8_t* data, size_t size) {
+    auto& target = ring(m_rank, rank);
+    const auto head = target.head.load(std::memory_order_relaxed);
+    const auto tail = target.tail.load(std::memory_order_acquire);
+    const auto count = std::min<size_t>(size, m_ringBytes - static_cast<size_t>(head - tail));
+    if (count == 0) {
+        return 0;
+    }
+    auto* buffer = ringData(m_rank, rank);
+    const auto offset = static_cast<size_t>(head) & (m_ringBytes - 1);
+    const auto first = std::min(count, m_ringBytes - offset);
+    std::memcpy(buffer + offset, data, first);
+    std::memcpy(buffer, data + first, count - first);
+    target.head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+size_t SharedMemoryTransport::read(int rank, uint8_t* data, size_t size) {
+    auto& source = ring(rank, m_rank);
+    const auto tail = source.tail.load(std::memory_order_relaxed);
+    const auto head = source.head.load(std::memory_order_acquire);
+    const auto count = std::min<size_t>(size, static_cast<size_t>(head - tail));
+    if (count == 0) {
+        return 0;
+    }
+    const auto* buffer = ringData(rank, m_rank);
+    const auto offset = static_cast<size_t>(tail) & (m_ringBytes - 1);
+    const auto first = std::min(count, m_ringBytes - offset);
+    std::memcpy(data, buffer + offset, first);
+    std::memcpy(data + first, buffer, count - first);
+    source.tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+#if defined(_WIN32)
+
+bool SharedMemoryTransport::map(const std::string& name, size_t size, bool create, std::string* error) {
+    const auto objectName = "Local\\" + name;
+    HANDLE mapping;
+    if (create) {
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                                     static_cast<DWORD>(size), objectName.c_str());
+        if (mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+            CloseHandle(mapping);
+            return fail(error, "shared memory " + name + " already exists");
+        }
+    }
+    else {
+        mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, objectName.c_str());
+    }
+    if (!mapping) {
+        return fail(error, "cannot open shared memory " + name);
+    }
+    auto* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!data) {
+        CloseHandle(mapping);
+        return fail(error, "cannot map shared memory " + name);
+    }
+    m_mapping = mapping;
+    m_data = static_cast<uint8_t*>(data);
+    m_size = size;
+    m_name = name;
+    return true;
+}
+
+void SharedMemoryTransport::close() {
+    // The mapping object goes away with its last handle, there is no name to remove
+    if (m_data) {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+    }
+    m_data = nullptr;
+    m_mapping = nullptr;
+    m_size = 0;
+    m_owner = false;
+}
+
+#else
+
+bool SharedMemoryTransport::map(const std::string& name, size_t size, bool create, std::string* error) {
+    // POSIX names are a single path component with a leading slash
+    const auto objectName = name.front() == '/' ? name : "/" + name;
+    const auto descriptor = shm_open(objectName.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+    if (descriptor < 0) {
+        return fail(error, create ? "cannot create shared memory " + name : "cannot open shared memory " + name);
+    }
+    struct stat status {};
+    if (create ? ftruncate(descriptor, static_cast<off_t>(size)) != 0
+               : fstat(descriptor, &status) != 0 || static_cast<size_t>(status.st_size) < size) {
+        ::close(descriptor);
+        if (create) {
+            shm_unlink(objectName.c_str());
+        }
+        return fail(error, "cannot size shared memory " + name);
+    }
+    auto* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    // The mapping keeps its own reference to the object
+    ::close(descriptor);
+    if (data == MAP_FAILED) {
+        if (create) {
+            shm_unlink(objectName.c_str());
+        }
+        return fail(error, "cannot map shared memory " + name);
+    }
+    m_data = static_cast<uint8_t*>(data);
+    m_size = size;
+    m_name = objectName;
+    return true;
+}
+
+void SharedMemoryTransport::close() {
+    if (m_data) {
+        munmap(m_data, m_size);
+        if (m_owner) {
+            shm_unlink(m_name.c_str());
+        }
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_owner = false;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "transport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Transport between processes on one machine through a named shared memory segment.
+// The segment holds a single producer, single consumer byte ring for every ordered pair of
+// ranks: the sender only moves the ring head, the receiver only moves the tail, both with
+// release stores, so neither side ever locks.
+// One process creates the segment and is rank 0, the others open it by name with their rank;
+// processes forked after create() open it again rather than using the inherited object.
+class SharedMemoryTransport : public Transport {
+
+public:
+    static constexpr size_t DEFAULT_RING_BYTES = 1 << 20;
+
+    SharedMemoryTransport() = default;
+    SharedMemoryTransport(const SharedMemoryTransport&) = delete;
+    SharedMemoryTransport& operator=(const SharedMemoryTransport&) = delete;
+    ~SharedMemoryTransport() override;
+
+    // ringBytes is rounded up to a power of two. Fails if the name is taken.
+    bool create(const std::string& name, int rankCount, size_t ringBytes = DEFAULT_RING_BYTES, std::string* error = nullptr);
+    bool open(const std::string& name, int rank, std::string* error = nullptr);
+    // The creator also removes the name
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    int getRank() const override { return m_rank; }
+    int getRankCount() const override { return m_rankCount; }
+    size_t write(int rank, const uint8_t* data, size_t size) override;
+    size_t read(int rank, uint8_t* data, size_t size) override;
+
+private:
+    struct Ring;
+
+    static size_t segmentSize(int rankCount, size_t ringBytes);
+    bool map(const std::string& name, size_t size, bool create, std::string* error);
+    Ring& ring(int from, int to) const;
+    uint8_t* ringData(int from, int to) const;
+
+    uint8_t* m_data {nullptr};
+    size_t m_size {0};
+    std::string m_name;
+    bool m_owner {false};
+    int m_rank {0};
+    int m_rankCount {0};
+    size_t m_ringBytes {0};
+#if defined(_WIN32)
+    void* m_mapping {nullptr};
+#endif
+};
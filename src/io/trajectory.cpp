@@ -0,0 +1,417 @@
+#include "trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+    const char TRAJECTORY_MAGIC[8] = {'G', 'R', 'V', 'T', 'R', 'A', 'J', '\0'};
+    const uint32_t TRAJECTORY_ENDIAN_TAG = 0x01020304;
+    const float QUANTIZED16_MAX = 65535.0f;
+
+    bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    template<typename T>
+    void append(std::vector<uint8_t>& buffer, const T* values, size_t count) {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(values);
+        buffer.insert(buffer.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    void appendVarint(std::vector<uint8_t>& buffer, uint32_t value) {
+        while (value >= 0x80) {
+            buffer.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint32_t zigzag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    int32_t unzigzag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    // Returns false past the end of the payload
+    bool readVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (data == end) {
+                return false;
+            }
+            const auto byte = *data++;
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void resizeDeltaState(std::vector<int32_t>& lastX, std::vector<int32_t>& lastY, std::vector<uint64_t>& lastFrame, uint32_t id) {
+        if (id >= lastFrame.size()) {
+            lastX.resize(id + 1, 0);
+            lastY.resize(id + 1, 0);
+            lastFrame.resize(id + 1, 0);
+        }
+    }
+}
+
+const char* trajectoryEncodingName(TrajectoryEncoding encoding) {
+    switch (encoding) {
+        case TrajectoryEncoding::Float32: return "float32";
+        case TrajectoryEncoding::Quantized16: return "quantized16";
+        case TrajectoryEncoding::Delta: return "delta";
+    }
+    return "unknown";
+}
+
+bool parseTrajectoryEncoding(const std::string& name, TrajectoryEncoding& encoding) {
+    for (auto candidate : {TrajectoryEncoding::Float32, TrajectoryEncoding::Quantized16, TrajectoryEncoding::Delta}) {
+        if (name == trajectoryEncodingName(candidate)) {
+            encoding = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// TrajectoryWriter
+//--------------------------------------------------------------------------------------
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+bool TrajectoryWriter::open(const std::string& path, const Options& options, std::string* error) {
+    close();
+    m_file = std::fopen(path.c_str(), "wb");
+    if (!m_file) {
+        return fail(error, "cannot create " + path);
+    }
+
+    m_options = options;
+    m_options.stepInterval = std::max(m_options.stepInterval, 1u);
+    m_options.keyframeInterval = std::max(m_options.keyframeInterval, 1u);
+    m_options.bufferCount = std::max<size_t>(m_options.bufferCount, 1);
+
+    TrajectoryHeader header {};
+    std::memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic));
+    header.version = TRAJECTORY_VERSION;
+    header.headerSize = sizeof(TrajectoryHeader);
+    header.endianTag = TRAJECTORY_ENDIAN_TAG;
+    header.encoding = m_options.encoding;
+    header.stepInterval = m_options.stepInterval;
+    header.keyframeInterval = m_options.keyframeInterval;
+    header.dt = m_options.dt;
+    header.quantum = m_options.quantum;
+    header.areaWidth = m_options.area.x;
+    header.areaHeight = m_options.area.y;
+    if (std::fwrite(&header, sizeof(header), 1, m_file) != 1) {
+        std::fclose(m_file);
+        m_file = nullptr;
+        return fail(error, "cannot write " + path);
+    }
+
+    m_frames.assign(m_options.bufferCount, Frame {});
+    m_free.clear();
+    m_ready.clear();
+    for (auto& frame : m_frames) {
+        m_free.push_back(&frame);
+    }
+    m_lastX.clear();
+    m_lastY.clear();
+    m_lastFrame.clear();
+    m_frameNumber = 0;
+    m_writtenFrames = 0;
+    m_droppedFrames = 0;
+    m_writtenBytes = sizeof(header);
+    m_closing = false;
+    m_thread = std::thread(&TrajectoryWriter::writerLoop, this);
+    return true;
+}
+
+void TrajectoryWriter::close() {
+    if (!m_file) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing = true;
+    }
+    m_condition.notify_one();
+    m_thread.join();
+    std::fclose(m_file);
+    m_file = nullptr;
+}
+
+bool TrajectoryWriter::submit(uint64_t stepIndex, const physics::BodyStore& bodies) {
+    if (!m_file || stepIndex % m_options.stepInterval != 0) {
+        return true;
+    }
+
+    Frame* frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free.empty()) {
+            frame = m_free.front();
+            m_free.pop_front();
+        }
+    }
+    if (!frame) {
+        ++m_droppedFrames;
+        return false;
+    }
+
+    // Buffers keep their capacity, this is a plain copy once they reached the body count
+    frame->stepIndex = stepIndex;
+    frame->ids.assign(bodies.id.begin(), bodies.id.end());
+    frame->x.assign(bodies.x.begin(), bodies.x.end());
+    frame->y.assign(bodies.y.begin(), bodies.y.end());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready.push_back(frame);
+    }
+    m_condition.notify_one();
+    return true;
+}
+
+void TrajectoryWriter::writerLoop() {
+    while (true) {
+        Frame* frame = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return !m_ready.empty() || m_closing; });
+            if (m_ready.empty()) {
+                return;
+            }
+            frame = m_ready.front();
+            m_ready.pop_front();
+        }
+
+        encode(*frame);
+        if (std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) == m_buffer.size()) {
+            m_writtenBytes += m_buffer.size();
+            ++m_writtenFrames;
+        }
+        else {
+            ++m_droppedFrames;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(frame);
+    }
+}
+
+void TrajectoryWriter::encode(Frame& frame) {
+    const auto count = frame.ids.size();
+    m_order.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        m_order[i] = i;
+    }
+    std::sort(m_order.begin(), m_order.end(), [&frame](uint32_t a, uint32_t b) { return frame.ids[a] < frame.ids[b]; });
+
+    TrajectoryFrameHeader header {};
+    header.bodyCount = static_cast<uint32_t>(count);
+    header.stepIndex = frame.stepIndex;
+    const auto keyframe = m_frameNumber % m_options.keyframeInterval == 0;
+    header.flags = keyframe ? TRAJECTORY_KEYFRAME : 0;
+
+    m_buffer.clear();
+    m_buffer.resize(sizeof(header));
+    switch (m_options.encoding) {
+        case TrajectoryEncoding::Float32:
+            for (const auto i : m_order) append(m_buffer, &frame.ids[i], 1);
+            for (const auto i : m_order) append(m_buffer, &frame.x[i], 1);
+            for (const auto i : m_order) append(m_buffer, &frame.y[i], 1);
+            break;
+
+        case TrajectoryEncoding::Quantized16: {
+            float minX = std::numeric_limits<float>::max(), minY = minX;
+            float maxX = std::numeric_limits<float>::lowest(), maxY = maxX;
+            for (uint32_t i = 0; i < count; ++i) {
+                minX = std::min(minX, frame.x[i]);
+                minY = std::min(minY, frame.y[i]);
+                maxX = std::max(maxX, frame.x[i]);
+                maxY = std::max(maxY, frame.y[i]);
+            }
+            header.originX = count > 0 ? minX : 0.0f;
+            header.originY = count > 0 ? minY : 0.0f;
+            header.extentX = count > 0 ? maxX - minX : 0.0f;
+            header.extentY = count > 0 ? maxY - minY : 0.0f;
+            const auto scaleX = header.extentX > 0.0f ? QUANTIZED16_MAX / header.extentX : 0.0f;
+            const auto scaleY = header.extentY > 0.0f ? QUANTIZED16_MAX / header.extentY : 0.0f;
+
+            for (const auto i : m_order) append(m_buffer, &frame.ids[i], 1);
+            for (const auto i : m_order) {
+                const auto q = static_cast<uint16_t>(std::lround((frame.x[i] - header.originX) * scaleX));
+                append(m_buffer, &q, 1);
+            }
+            for (const auto i : m_order) {
+                const auto q = static_cast<uint16_t>(std::lround((frame.y[i] - header.originY) * scaleY));
+                append(m_buffer, &q, 1);
+            }
+            break;
+        }
+
+        case TrajectoryEncoding::Delta: {
+            // Deltas refer to the same id in the previous written frame, anything else is absolute
+            uint32_t previousId = 0;
+            for (const auto i : m_order) {
+                const auto id = frame.ids[i];
+                resizeDeltaState(m_lastX, m_lastY, m_lastFrame, id);
+                const auto qx = static_cast<int32_t>(std::lround(frame.x[i] / m_options.quantum));
+                const auto qy = static_cast<int32_t>(std::lround(frame.y[i] / m_options.quantum));
+                const auto continued = !keyframe && m_lastFrame[id] == m_frameNumber;
+                appendVarint(m_buffer, id - previousId);
+                appendVarint(m_buffer, zigzag(continued ? qx - m_lastX[id] : qx));
+                appendVarint(m_buffer, zigzag(continued ? qy - m_lastY[id] : qy));
+                m_lastX[id] = qx;
+                m_lastY[id] = qy;
+                m_lastFrame[id] = m_frameNumber + 1;
+                previousId = id;
+            }
+            break;
+        }
+    }
+
+    header.frameBytes = static_cast<uint32_t>(m_buffer.size());
+    std::memcpy(m_buffer.data(), &header, sizeof(header));
+    ++m_frameNumber;
+}
+
+// TrajectoryReader
+//--------------------------------------------------------------------------------------
+
+bool TrajectoryReader::open(const std::string& path, std::string* error) {
+    m_header = nullptr;
+    m_frameOffsets.clear();
+    m_decodedFrame = SIZE_MAX;
+    if (!m_file.open(path, error)) {
+        return false;
+    }
+
+    if (m_file.size() < sizeof(TrajectoryHeader)) {
+        return fail(error, path + " is too small for a trajectory");
+    }
+    const auto* header = reinterpret_cast<const TrajectoryHeader*>(m_file.data());
+    if (std::memcmp(header->magic, TRAJECTORY_MAGIC, sizeof(header->magic)) != 0) {
+        return fail(error, path + " is not a trajectory");
+    }
+    if (header->endianTag != TRAJECTORY_ENDIAN_TAG) {
+        return fail(error, path + " was written on a machine with different byte order");
+    }
+    if (header->version != TRAJECTORY_VERSION || header->headerSize < sizeof(TrajectoryHeader)) {
+        return fail(error, path + " has unsupported version " + std::to_string(header->version));
+    }
+
+    // A frame cut short by a crash ends the index
+    size_t offset = header->headerSize;
+    while (m_file.size() - offset >= sizeof(TrajectoryFrameHeader)) {
+        TrajectoryFrameHeader frame;
+        std::memcpy(&frame, m_file.data() + offset, sizeof(frame));
+        if (frame.frameBytes < sizeof(frame) || frame.frameBytes > m_file.size() - offset) {
+            break;
+        }
+        m_frameOffsets.push_back(offset);
+        offset += frame.frameBytes;
+    }
+
+    m_header = header;
+    return true;
+}
+
+bool TrajectoryReader::readFrame(size_t index, TrajectoryFrame& frame) {
+    if (index >= m_frameOffsets.size()) {
+        return false;
+    }
+    if (m_header->encoding != TrajectoryEncoding::Delta || m_decodedFrame + 1 == index) {
+        return decode(index, frame);
+    }
+
+    // Delta frames need their predecessors, start over from the keyframe
+    auto keyframe = index - index % m_header->keyframeInterval;
+    for (; keyframe < index; ++keyframe) {
+        if (!decode(keyframe, frame)) {
+            return false;
+        }
+    }
+    return decode(index, frame);
+}
+
+bool TrajectoryReader::decode(size_t index, TrajectoryFrame& frame) {
+    const auto* data = m_file.data() + m_frameOffsets[index];
+    TrajectoryFrameHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const auto* payload = data + sizeof(header);
+    const auto* end = data + header.frameBytes;
+    const auto count = static_cast<size_t>(header.bodyCount);
+
+    frame.stepIndex = header.stepIndex;
+    frame.ids.resize(count);
+    frame.positions.resize(count);
+    m_decodedFrame = SIZE_MAX;
+
+    switch (m_header->encoding) {
+        case TrajectoryEncoding::Float32: {
+            if (static_cast<size_t>(end - payload) < count * 12) {
+                return false;
+            }
+            std::memcpy(frame.ids.data(), payload, count * sizeof(uint32_t));
+            for (size_t i = 0; i < count; ++i) {
+                std::memcpy(&frame.positions[i].x, payload + (count + i) * sizeof(float), sizeof(float));
+                std::memcpy(&frame.positions[i].y, payload + (2 * count + i) * sizeof(float), sizeof(float));
+            }
+            break;
+        }
+
+        case TrajectoryEncoding::Quantized16: {
+            if (static_cast<size_t>(end - payload) < count * 8) {
+                return false;
+            }
+            std::memcpy(frame.ids.data(), payload, count * sizeof(uint32_t));
+            const auto* qx = payload + count * sizeof(uint32_t);
+            const auto* qy = qx + count * sizeof(uint16_t);
+            for (size_t i = 0; i < count; ++i) {
+                uint16_t x, y;
+                std::memcpy(&x, qx + i * sizeof(uint16_t), sizeof(x));
+                std::memcpy(&y, qy + i * sizeof(uint16_t), sizeof(y));
+                frame.positions[i] = glm::vec2(header.originX + x / QUANTIZED16_MAX * header.extentX,
+                                               header.originY + y / QUANTIZED16_MAX * header.extentY);
+            }
+            break;
+        }
+
+        case TrajectoryEncoding::Delta: {
+            const auto keyframe = (header.flags & TRAJECTORY_KEYFRAME) != 0;
+            uint32_t id = 0;
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t gap, dx, dy;
+                if (!readVarint(payload, end, gap) || !readVarint(payload, end, dx) || !readVarint(payload, end, dy)) {
+                    return false;
+                }
+                id += gap;
+                resizeDeltaState(m_lastX, m_lastY, m_lastFrame, id);
+                const auto continued = !keyframe && m_lastFrame[id] == index;
+                const auto qx = unzigzag(dx) + (continued ? m_lastX[id] : 0);
+                const auto qy = unzigzag(dy) + (continued ? m_lastY[id] : 0);
+                m_lastX[id] = qx;
+                m_lastY[id] = qy;
+                m_lastFrame[id] = index + 1;
+                frame.ids[i] = id;
+                frame.positions[i] = glm::vec2(qx * m_header->quantum, qy * m_header->quantum);
+            }
+            break;
+        }
+    }
+
+    m_decodedFrame = index;
+    return true;
+}
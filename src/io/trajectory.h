@@ -0,0 +1,147 @@
+#pragma once
+
+#include "physics/body_store.h"
+#include "base/mapped_file.h"
+
+#include <glm/vec2.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How positions are stored in a trajectory frame. Bodies are always written in id order.
+enum class TrajectoryEncoding : uint32_t {
+    Float32,        // Exact: ids and float positions, 12 bytes per body
+    Quantized16,    // 16 bit positions inside the frame bounds, 8 bytes per body
+    Delta           // Positions on a fixed grid of 'quantum' units, stored as varint differences to the
+                    // previous frame, ids as varint gaps; a keyframe every keyframeInterval frames
+};
+
+const char* trajectoryEncodingName(TrajectoryEncoding encoding);
+bool parseTrajectoryEncoding(const std::string& name, TrajectoryEncoding& encoding);
+
+struct TrajectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t endianTag;
+    TrajectoryEncoding encoding;
+    uint32_t stepInterval;          // Simulation steps between two frames
+    uint32_t keyframeInterval;
+    float dt;
+    float quantum;
+    float areaWidth;
+    float areaHeight;
+};
+
+// Every frame starts with this, followed by frameBytes - sizeof(TrajectoryFrameHeader) payload bytes
+struct TrajectoryFrameHeader {
+    uint32_t frameBytes;
+    uint32_t bodyCount;
+    uint64_t stepIndex;
+    uint32_t flags;                 // TRAJECTORY_KEYFRAME
+    float originX, originY;         // Quantized16 frame bounds
+    float extentX, extentY;
+};
+
+inline constexpr uint32_t TRAJECTORY_VERSION = 1;
+inline constexpr uint32_t TRAJECTORY_KEYFRAME = 1u << 0;
+
+// One decoded frame, bodies in id order
+struct TrajectoryFrame {
+    uint64_t stepIndex {0};
+    std::vector<uint32_t> ids;
+    std::vector<glm::vec2> positions;
+};
+
+// Appends frames from a background thread. submit() only copies positions into a free
+// buffer; when the writer falls behind and no buffer is free the frame is dropped rather
+// than stalling the step loop.
+class TrajectoryWriter {
+
+public:
+    struct Options {
+        TrajectoryEncoding encoding {TrajectoryEncoding::Delta};
+        uint32_t stepInterval {10};
+        uint32_t keyframeInterval {64};
+        float quantum {1.0f / 64.0f};
+        size_t bufferCount {4};
+        float dt {0.0f};
+        glm::vec2 area {0.0f, 0.0f};
+    };
+
+    TrajectoryWriter() = default;
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+    ~TrajectoryWriter();
+
+    bool open(const std::string& path, const Options& options, std::string* error = nullptr);
+    // Writes the queued frames and joins the writer thread
+    void close();
+    bool isOpen() const { return m_file != nullptr; }
+
+    // Step loop side: queue the state if stepIndex is on the interval, returns false if it was dropped
+    bool submit(uint64_t stepIndex, const physics::BodyStore& bodies);
+
+    uint64_t getWrittenFrames() const { return m_writtenFrames; }
+    uint64_t getDroppedFrames() const { return m_droppedFrames; }
+    uint64_t getWrittenBytes() const { return m_writtenBytes; }
+
+private:
+    struct Frame {
+        uint64_t stepIndex;
+        std::vector<uint32_t> ids;
+        std::vector<float> x, y;
+    };
+
+    void writerLoop();
+    void encode(Frame& frame);
+
+    Options m_options;
+    std::FILE* m_file {nullptr};
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_closing {false};
+    std::vector<Frame> m_frames;
+    std::deque<Frame*> m_free;
+    std::deque<Frame*> m_ready;
+
+    // Writer thread only
+    std::vector<uint32_t> m_order;
+    std::vector<uint8_t> m_buffer;
+    std::vector<int32_t> m_lastX, m_lastY;          // Delta state per id
+    std::vector<uint64_t> m_lastFrame;              // Frame number + 1 that last held the id
+    uint64_t m_frameNumber {0};
+
+    std::atomic<uint64_t> m_writtenFrames {0};
+    std::atomic<uint64_t> m_droppedFrames {0};
+    std::atomic<uint64_t> m_writtenBytes {0};
+};
+
+// Memory mapped trajectory. Frames are indexed when the file is opened; sequential reads
+// continue the delta state, random access decodes from the closest keyframe.
+class TrajectoryReader {
+
+public:
+    bool open(const std::string& path, std::string* error = nullptr);
+
+    const TrajectoryHeader& getHeader() const { return *m_header; }
+    size_t getFrameCount() const { return m_frameOffsets.size(); }
+    bool readFrame(size_t index, TrajectoryFrame& frame);
+
+private:
+    bool decode(size_t index, TrajectoryFrame& frame);
+
+    MappedFile m_file;
+    const TrajectoryHeader* m_header {nullptr};
+    std::vector<size_t> m_frameOffsets;
+    std::vector<int32_t> m_lastX, m_lastY;
+    std::vector<uint64_t> m_lastFrame;
+    size_t m_decodedFrame {SIZE_MAX};
+};
@@ -0,0 +1,118 @@
+#include "transport.h"
+
+#include <cstring>
+#include <thread>
+
+namespace {
+    bool fail(std::string* error, const std::string& message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+
+    // Every message goes out as a 64-bit payload length followed by the payload
+    const size_t LENGTH_BYTES = sizeof(uint64_t);
+}
+
+bool Transport::exchange(const std::vector<Message>& outgoing, std::vector<Message>& incoming, std::string* error) {
+    const auto rankCount = getRankCount();
+    const auto self = getRank();
+    if (static_cast<int>(outgoing.size()) != rankCount) {
+        return fail(error, "exchange needs one message per rank");
+    }
+    incoming.resize(rankCount);
+    incoming[self] = outgoing[self];
+
+    // Per peer progress, counted over length prefix and payload together
+    struct Progress {
+        uint8_t sendLength[LENGTH_BYTES];
+        uint8_t receiveLength[LENGTH_BYTES];
+        size_t sent {0};
+        size_t received {0};
+        size_t receiveTotal {LENGTH_BYTES};     // Known once the length prefix is in
+    };
+    std::vector<Progress> progress(rankCount);
+    size_t pending = 0;
+    for (auto rank = 0; rank < rankCount; ++rank) {
+        if (rank == self) {
+            continue;
+        }
+        const uint64_t length = outgoing[rank].size();
+        std::memcpy(progress[rank].sendLength, &length, LENGTH_BYTES);
+        pending += 2;
+    }
+
+    auto lastProgress = std::chrono::steady_clock::now();
+    while (pending > 0) {
+        auto moved = false;
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            if (rank == self) {
+                continue;
+            }
+            auto& peer = progress[rank];
+            const auto& message = outgoing[rank];
+            const auto sendTotal = LENGTH_BYTES + message.size();
+            if (peer.sent < sendTotal) {
+                size_t written;
+                if (peer.sent < LENGTH_BYTES) {
+                    written = write(rank, peer.sendLength + peer.sent, LENGTH_BYTES - peer.sent);
+                }
+                else {
+                    written = write(rank, message.data() + (peer.sent - LENGTH_BYTES), sendTotal - peer.sent);
+                }
+                peer.sent += written;
+                moved |= written > 0;
+                if (peer.sent == sendTotal) {
+                    m_sentBytes += message.size();
+                    --pending;
+                }
+            }
+
+            if (peer.received < peer.receiveTotal) {
+                size_t taken;
+                if (peer.received < LENGTH_BYTES) {
+                    taken = read(rank, peer.receiveLength + peer.received, LENGTH_BYTES - peer.received);
+                    if (peer.received + taken == LENGTH_BYTES) {
+                        uint64_t length;
+                        std::memcpy(&length, peer.receiveLength, LENGTH_BYTES);
+                        incoming[rank].resize(length);
+                        peer.receiveTotal = LENGTH_BYTES + length;
+                    }
+                }
+                else {
+                    taken = read(rank, incoming[rank].data() + (peer.received - LENGTH_BYTES), peer.receiveTotal - peer.received);
+                }
+                peer.received += taken;
+                moved |= taken > 0;
+                if (peer.received == peer.receiveTotal) {
+                    --pending;
+                }
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if (moved) {
+            lastProgress = now;
+            continue;
+        }
+        if (now - lastProgress > m_timeout) {
+            for (auto rank = 0; rank < rankCount; ++rank) {
+                if (rank != self && (progress[rank].received < progress[rank].receiveTotal || progress[rank].sent < LENGTH_BYTES + outgoing[rank].size())) {
+                    return fail(error, "rank " + std::to_string(self) + " timed out waiting for rank " + std::to_string(rank));
+                }
+            }
+        }
+        // Peers are separate processes, give them the core while their side catches up
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+bool Transport::allGather(const Message& message, std::vector<Message>& messages, std::string* error) {
+    m_gatherOutgoing.resize(getRankCount());
+    for (auto& outgoing : m_gatherOutgoing) {
+        outgoing = message;
+    }
+    return exchange(m_gatherOutgoing, messages, error);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Message passing between the ranks of a distributed run.
+// An implementation provides one non-blocking byte stream per ordered pair of ranks;
+// length-prefixed messages and the collective exchanges are built on top of them here.
+// Every rank has to take part in every collective call, in the same order.
+class Transport {
+
+public:
+    using Message = std::vector<uint8_t>;
+
+    virtual ~Transport() = default;
+
+    virtual int getRank() const = 0;
+    virtual int getRankCount() const = 0;
+    // Append up to size bytes to the stream towards rank, returns how many it took
+    virtual size_t write(int rank, const uint8_t* data, size_t size) = 0;
+    // Take up to size bytes from the stream coming from rank, returns how many there were
+    virtual size_t read(int rank, uint8_t* data, size_t size) = 0;
+
+    // Collective: send outgoing[r] to every rank r and receive incoming[r] from it, the own slot
+    // is copied. All streams make progress together, so messages larger than the stream buffers
+    // cannot deadlock. Returns false when a peer stays silent for longer than the timeout.
+    bool exchange(const std::vector<Message>& outgoing, std::vector<Message>& incoming, std::string* error = nullptr);
+    // Collective: every rank receives the message of every rank
+    bool allGather(const Message& message, std::vector<Message>& messages, std::string* error = nullptr);
+
+    void setTimeout(std::chrono::milliseconds timeout) { m_timeout = timeout; }
+    // Payload bytes sent to other ranks by the collectives so far
+    uint64_t getSentBytes() const { return m_sentBytes; }
+
+private:
+    std::chrono::milliseconds m_timeout {60000};
+    uint64_t m_sentBytes {0};
+    std::vector<Message> m_gatherOutgoing;
+};
@@ -1,13 +1,133 @@
 #include <raylib.h>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <string>
 #include "utils/bodies_generator.h"
 #include "controllers/simulation_controller.h"
-#include "graphics/drawable_body.h"
+#include "controllers/replay_controller.h"
+#include "base/profiler.h"
+
+namespace {
+
+    const float MIN_TIME_SCALE = 1.0f / 64;
+    const float MAX_TIME_SCALE = 64.0f;
+    const float MIN_THETA = 0.1f;
+    const float MAX_THETA = 2.0f;
+    const float THETA_STEP = 0.1f;
+
+    // Mouse spawning; sizes on screen, so they follow the zoom
+    const float SPAWN_MASS = 1000.0f;
+    const float SPAWN_RADIUS = 3.0f;
+    const uint32_t CLUSTER_BODIES = 2000;
+    const float CLUSTER_SCREEN_RADIUS = 60.0f;
+    const float ERASER_SCREEN_RADIUS = 20.0f;
+
+    struct LaunchOptions {
+        std::string checkpoint;             // --load: start from a saved scene
+        std::string record;                 // --record: trajectory output
+        std::string replay;                 // --replay: play a trajectory instead of simulating
+        std::string trace;                  // --trace: Chrome trace-event JSON written on exit
+        uint64_t seed {std::random_device {}()};    // --seed: initial scene and spawned clusters
+        physics::Integrator integrator {physics::Integrator::Leapfrog};    // --integrator
+        ScheduleMode schedule {ScheduleMode::FixedRate};
+        float timeScale {1.0f};
+        TrajectoryWriter::Options recording;
+    };
+
+    bool parseArguments(int argc, char** argv, LaunchOptions& options) {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            const std::string option = argv[i];
+            const char* value = argv[i + 1];
+            if (option == "--load") {
+                options.checkpoint = value;
+            }
+            else if (option == "--record") {
+                options.record = value;
+            }
+            else if (option == "--record-every") {
+                options.recording.stepInterval = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            }
+            else if (option == "--record-encoding") {
+                if (!parseTrajectoryEncoding(value, options.recording.encoding)) {
+                    TraceLog(LOG_ERROR, "Unknown trajectory encoding '%s'", value);
+                    return false;
+                }
+            }
+            else if (option == "--replay") {
+                options.replay = value;
+            }
+            else if (option == "--schedule") {
+                if (!parseScheduleMode(value, options.schedule)) {
+                    TraceLog(LOG_ERROR, "Unknown schedule mode '%s'", value);
+                    return false;
+                }
+            }
+            else if (option == "--time-scale") {
+                options.timeScale = std::strtof(value, nullptr);
+            }
+            else if (option == "--trace") {
+                options.trace = value;
+            }
+            else if (option == "--seed") {
+                options.seed = std::strtoull(value, nullptr, 10);
+            }
+            else if (option == "--integrator") {
+                if (!physics::parseIntegrator(value, options.integrator)) {
+                    TraceLog(LOG_ERROR, "Unknown integrator '%s'", value);
+                    return false;
+                }
+            }
+            else {
+                TraceLog(LOG_ERROR, "Unknown option '%s'", option.c_str());
+                return false;
+            }
+        }
+        return argc % 2 == 1;
+    }
+
+    // Replay loop: no simulation, frames come from the trajectory file
+    int runReplay(const std::string& path) {
+        ReplayController replay;
+        std::string error;
+        if (!replay.open(path, &error)) {
+            TraceLog(LOG_ERROR, "%s", error.c_str());
+            return 1;
+        }
+
+        ViewCamera camera;
+        while (!WindowShouldClose()) {
+            camera.handleInput();
+            if (IsKeyPressed(KEY_R)) {
+                const auto mode = (static_cast<int>(replay.getRenderMode()) + 1) % 4;
+                replay.setRenderMode(static_cast<RenderMode>(mode));
+            }
+            if (IsKeyPressed(KEY_SPACE)) {
+                replay.togglePause();
+            }
+            if (IsKeyPressed(KEY_HOME)) {
+                replay.restart();
+            }
+
+            BeginDrawing();
+            replay.render(camera);
+            EndDrawing();
+        }
+        return 0;
+    }
+}
 
 //------------------------------------------------------------------------------------
 // Program main entry point
 //------------------------------------------------------------------------------------
-int main(void)
+int main(int argc, char** argv)
 {
+    LaunchOptions options;
+    if (!parseArguments(argc, argv, options)) {
+        TraceLog(LOG_ERROR, "usage: %s [--load checkpoint] [--record trajectory [--record-every N] [--record-encoding float32|quantized16|delta]] [--replay trajectory] [--trace trace.json] [--schedule fixed|fast] [--time-scale F] [--seed N] [--integrator euler|leapfrog|yoshida4]", argv[0]);
+        return 1;
+    }
+
     // Initialization
     //--------------------------------------------------------------------------------------
     const int screenWidth = 1010;
@@ -18,32 +138,139 @@ int main(void)
 
     SetTargetFPS(60);               // Set our game to run at 60 frames-per-second
 
+    Profiler::instance().setThreadName("render");
+    if (!options.trace.empty()) {
+        Profiler::instance().setEnabled(true);
+    }
+
+    if (!options.replay.empty()) {
+        const auto status = runReplay(options.replay);
+        CloseWindow();
+        return status;
+    }
+
     // Setup
     //--------------------------------------------------------------------------------------
-    auto bodies = BodiesGenerator::generateRandomBodies(10000, screenWidth, screenHeight);
+    const float dt = 0.01f;
+    BodiesHolder bodies;
+    std::string error;
+    if (!options.checkpoint.empty() && !bodies.loadCheckpoint(options.checkpoint, nullptr, &error)) {
+        TraceLog(LOG_ERROR, "%s", error.c_str());
+        CloseWindow();
+        return 1;
+    }
+    if (options.checkpoint.empty()) {
+        bodies = BodiesGenerator::generateRandomBodies(10000, screenWidth, screenHeight, options.seed);
 
-    // Add a couple of heave bodies
-    auto bigBody = std::make_shared<DrawableBody>(glm::vec2(0.5 * screenWidth, 0.5 * screenHeight), glm::vec2(0,0), 100000, 7, GOLD);
-    auto anotherBigBody = std::make_shared<DrawableBody>(glm::vec2(0.5 * screenWidth + 100, 0.5 * screenHeight + 100), glm::vec2(20,-10), 10000, 4, RED);
-    bodies.push_back(anotherBigBody);
-    bodies.push_back(bigBody);
+        // Add a couple of heave bodies
+        bodies.add(glm::vec2(0.5 * screenWidth + 100, 0.5 * screenHeight + 100), glm::vec2(20,-10), 10000, 4, RED);
+        bodies.add(glm::vec2(0.5 * screenWidth, 0.5 * screenHeight), glm::vec2(0,0), 100000, 7, GOLD);
+    }
 
     // Inintialize and start simulation
-    auto simulation = std::make_unique<SimulationController>(glm::vec2(screenWidth, screenHeight), bodies);
-    simulation->start(0.01);
+    auto simulation = std::make_unique<SimulationController>(glm::vec2(screenWidth, screenHeight), std::move(bodies));
+    if (!options.record.empty()) {
+        options.recording.dt = dt;
+        options.recording.area = glm::vec2(screenWidth, screenHeight);
+        if (!simulation->startRecording(options.record, options.recording, &error)) {
+            TraceLog(LOG_WARNING, "%s", error.c_str());
+        }
+    }
+    simulation->setScheduleMode(options.schedule);
+    simulation->setTimeScale(options.timeScale);
+    simulation->setIntegrator(options.integrator);
+    simulation->start(dt);
 
     // Main game loop
     //--------------------------------------------------------------------------------------
+    ViewCamera camera;
+    std::mt19937_64 clusterSeeds(options.seed);
+    auto theta = physics::SimulationParameters {}.theta;
     while (!WindowShouldClose())    // Detect window close button or ESC key
     {
+        // Input
+        //--------------------------------------------------------------------------------------
+        // Wheel zoom, right drag pan, 0 resets the view
+        camera.handleInput();
+
+        // Click spawns a body, shift click a cluster, control drag erases; all posted to the
+        // simulation thread, which applies them before its next step
+        const auto mouse = GetMousePosition();
+        const auto cursor = camera.screenToWorld(glm::vec2(mouse.x, mouse.y));
+        const auto shift = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT);
+        const auto control = IsKeyDown(KEY_LEFT_CONTROL) || IsKeyDown(KEY_RIGHT_CONTROL);
+        if (control && IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+            simulation->post(SimulationCommand::deleteInRadius(cursor, ERASER_SCREEN_RADIUS / camera.getZoom()));
+        }
+        else if (shift && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+            simulation->post(SimulationCommand::spawnCluster(cursor, glm::vec2(0.0f, 0.0f), CLUSTER_SCREEN_RADIUS / camera.getZoom(),
+                                                             CLUSTER_BODIES, clusterSeeds(), SKYBLUE));
+        }
+        else if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+            simulation->post(SimulationCommand::spawnBody(cursor, glm::vec2(0.0f, 0.0f), SPAWN_MASS, SPAWN_RADIUS, YELLOW));
+        }
+
+        if (IsKeyPressed(KEY_LEFT_BRACKET) || IsKeyPressed(KEY_RIGHT_BRACKET)) {
+            // Trade force accuracy for speed
+            theta = std::clamp(theta + (IsKeyPressed(KEY_RIGHT_BRACKET) ? THETA_STEP : -THETA_STEP), MIN_THETA, MAX_THETA);
+            simulation->post(SimulationCommand::setParameter(SimulationParameter::Theta, theta));
+        }
+
+        if (IsKeyPressed(KEY_R)) {
+            // Cycle circles -> batched -> density -> auto
+            const auto mode = (static_cast<int>(simulation->getRenderMode()) + 1) % 4;
+            simulation->setRenderMode(static_cast<RenderMode>(mode));
+        }
+
+        if (IsKeyPressed(KEY_C)) {
+            // Cycle ignore -> merge -> elastic
+            const auto policy = (static_cast<int>(simulation->getCollisionPolicy()) + 1) % 3;
+            simulation->setCollisionPolicy(static_cast<physics::CollisionPolicy>(policy));
+        }
+
+        if (IsKeyPressed(KEY_F5)) {
+            simulation->requestCheckpoint("checkpoint.grv");
+        }
+
+        if (IsKeyPressed(KEY_F)) {
+            // Toggle real time pacing and batch speed
+            const auto fast = simulation->getScheduleMode() == ScheduleMode::FixedRate;
+            simulation->setScheduleMode(fast ? ScheduleMode::AsFastAsPossible : ScheduleMode::FixedRate);
+        }
+
+        if (IsKeyPressed(KEY_EQUAL) || IsKeyPressed(KEY_MINUS)) {
+            // Double or halve the time scale
+            const auto factor = IsKeyPressed(KEY_EQUAL) ? 2.0f : 0.5f;
+            simulation->setTimeScale(std::clamp(simulation->getTimeScale() * factor, MIN_TIME_SCALE, MAX_TIME_SCALE));
+        }
+
+        if (IsKeyPressed(KEY_F3)) {
+            simulation->setProfilerOverlay(!simulation->getProfilerOverlay());
+            // Keep recording for the trace file after the overlay is closed
+            if (!options.trace.empty()) {
+                Profiler::instance().setEnabled(true);
+            }
+        }
+
         // Draw
         //--------------------------------------------------------------------------------------
         BeginDrawing();
-        simulation->render();
+        simulation->render(camera);
         EndDrawing();
     }
 
     simulation->stop();
+    simulation->stopRecording();
+    if (!options.trace.empty()) {
+        if (Profiler::instance().writeChromeTrace(options.trace, &error)) {
+            TraceLog(LOG_INFO, "Trace written to %s", options.trace.c_str());
+        }
+        else {
+            TraceLog(LOG_WARNING, "%s", error.c_str());
+        }
+    }
+    // Release GPU resources while the context is still alive
+    simulation.reset();
 
     // De-Initialization
     //--------------------------------------------------------------------------------------
@@ -0,0 +1,537 @@
+#include "bh_arena_tree.h"
+#include "morton_order.h"
+#include "base/profiler.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace physics {
+
+    // Below this many bodies a serial build is faster than splitting it up
+    const size_t PARALLEL_BUILD_MIN_BODIES = 4096;
+    // Level whose nodes root the concurrently built subtrees (up to 4^3 = 64 of them)
+    const int PARALLEL_SPLIT_LEVEL = 3;
+    // Refit only checks a bounding box per body, use large tasks
+    const size_t REFIT_TASK_SIZE = 4096;
+    // A body stays in its leaf while inside the leaf cell grown by this factor. Leaf bodies are
+    // summed directly, only the opening distance of the leaf and its ancestors sees the overhang
+    const float REFIT_LEAF_LOOSENESS = 2.0f;
+
+    BHArenaTree::BHArenaTree(const AABB& boundary) {
+        reset(boundary);
+    }
+
+    void BHArenaTree::reset(const AABB& boundary) {
+        // clear() keeps the capacity, so steady-state rebuilds never touch the allocator
+        m_nodes.clear();
+        m_nodes.emplace_back(boundary);
+        m_leavesIndexed = false;
+        m_migratedSinceBuild = 0;
+    }
+
+    bool BHArenaTree::insert(int32_t bodyIndex, const BodyStore& bodies) {
+        if (!getBoundary().containsPoint(bodies.position(bodyIndex))) {
+            return false;
+        }
+
+        m_bodies = &bodies;
+        if (m_nextBody.size() < bodies.size()) {
+            m_nextBody.resize(bodies.size(), INVALID_INDEX);
+        }
+        insertFrom(m_nodes, 0, bodyIndex);
+        return true;
+    }
+
+    void BHArenaTree::updateMassProperties() {
+        accumulateMass(m_nodes, 0, m_nodes.size());
+    }
+
+    bool BHArenaTree::refit(const BodyStore& bodies, size_t maxMigrated, size_t& migrated, ThreadPool* pool) {
+        migrated = 0;
+        m_bodies = &bodies;
+        if (!m_leavesIndexed || m_leafOf.size() != bodies.size()) {
+            indexLeaves(bodies.size());
+        }
+
+        // Read only pass, bodies still inside their (loose) leaf stay where they are
+        const auto workerCount = pool ? pool->getThreadCount() : 1;
+        m_workerMigrants.resize(std::max(m_workerMigrants.size(), workerCount));
+        for (auto& migrants : m_workerMigrants) {
+            migrants.clear();
+        }
+        auto follow = [this, &bodies](size_t begin, size_t end, size_t worker) {
+            for (auto i = begin; i < end; ++i) {
+                const auto leaf = m_leafOf[i];
+                if (leaf == INVALID_INDEX || !AABB(m_nodes[leaf].boundary.center, m_nodes[leaf].boundary.halfDimension * REFIT_LEAF_LOOSENESS).containsPoint(bodies.position(i))) {
+                    m_workerMigrants[worker].push_back(static_cast<int32_t>(i));
+                }
+            }
+        };
+        if (pool) {
+            pool->parallelFor(bodies.size(), REFIT_TASK_SIZE, follow);
+        }
+        else {
+            follow(0, bodies.size(), 0);
+        }
+
+        // Insertion order decides the order of bodies in a leaf and so the order their forces are
+        // summed in; which worker found a migrant depends on the thread count, the index does not
+        m_migrants.clear();
+        for (const auto& migrants : m_workerMigrants) {
+            m_migrants.insert(m_migrants.end(), migrants.begin(), migrants.end());
+        }
+        std::sort(m_migrants.begin(), m_migrants.end());
+        migrated = m_migrants.size();
+        for (const auto body : m_migrants) {
+            if (!getBoundary().containsPoint(bodies.position(body))) {
+                return false;
+            }
+        }
+        if (m_migratedSinceBuild + migrated > maxMigrated) {
+            return false;
+        }
+        m_migratedSinceBuild += migrated;
+
+        for (const auto body : m_migrants) {
+            if (m_leafOf[body] != INVALID_INDEX) {
+                unlinkBody(m_nodes[m_leafOf[body]], body);
+            }
+            insertFrom(m_nodes, 0, body);
+        }
+
+        if (migrated > 0) {
+            indexLeaves(bodies.size());
+        }
+        updateMassProperties();
+        return true;
+    }
+
+    void BHArenaTree::indexLeaves(size_t bodyCount) {
+        m_leafOf.assign(bodyCount, INVALID_INDEX);
+        for (size_t index = 0; index < m_nodes.size(); ++index) {
+            for (auto body = m_nodes[index].firstBody; body != INVALID_INDEX; body = m_nextBody[body]) {
+                if (static_cast<size_t>(body) < bodyCount) {
+                    m_leafOf[body] = static_cast<int32_t>(index);
+                }
+            }
+        }
+        m_leavesIndexed = true;
+    }
+
+    void BHArenaTree::insertFrom(std::vector<Node>& nodes, int32_t nodeIndex, int32_t bodyIndex) {
+        const auto bucketSize = static_cast<int32_t>(getBucketSize());
+        while (true) {
+            if (!nodes[nodeIndex].isDivided()) {
+                if (nodes[nodeIndex].bodyCount < bucketSize || nodes[nodeIndex].depth >= MAX_DEPTH) {
+                    linkBody(nodes[nodeIndex], bodyIndex);
+                    return;
+                }
+
+                // Full bucket, push its bodies one level down; a child can take them all
+                subdivide(nodes, nodeIndex);
+                auto moved = nodes[nodeIndex].firstBody;
+                nodes[nodeIndex].firstBody = INVALID_INDEX;
+                nodes[nodeIndex].bodyCount = 0;
+                while (moved != INVALID_INDEX) {
+                    const auto next = m_nextBody[moved];
+                    linkBody(nodes[childFor(nodes[nodeIndex], m_bodies->position(moved))], moved);
+                    moved = next;
+                }
+            }
+
+            nodeIndex = childFor(nodes[nodeIndex], m_bodies->position(bodyIndex));
+        }
+    }
+
+    void BHArenaTree::linkBody(Node& leaf, int32_t bodyIndex) {
+        m_nextBody[bodyIndex] = leaf.firstBody;
+        leaf.firstBody = bodyIndex;
+        ++leaf.bodyCount;
+    }
+
+    void BHArenaTree::unlinkBody(Node& leaf, int32_t bodyIndex) {
+        if (leaf.firstBody == bodyIndex) {
+            leaf.firstBody = m_nextBody[bodyIndex];
+            --leaf.bodyCount;
+            return;
+        }
+        for (auto body = leaf.firstBody; body != INVALID_INDEX; body = m_nextBody[body]) {
+            if (m_nextBody[body] == bodyIndex) {
+                m_nextBody[body] = m_nextBody[bodyIndex];
+                --leaf.bodyCount;
+                return;
+            }
+        }
+    }
+
+    void BHArenaTree::accumulateMass(std::vector<Node>& nodes, size_t first, size_t last) const {
+        const auto quadrupole = m_parameters.expansionOrder == ExpansionOrder::Quadrupole;
+        const auto offsetAware = m_parameters.openingCriterion == OpeningCriterion::CenterOfMassOffset;
+        const auto inverseTheta = 1.0f / m_parameters.theta;
+
+        for (auto index = last; index-- > first; ) {
+            auto& node = nodes[index];
+            if (!node.isDivided()) {
+                accumulateBucket(node);
+            }
+            else {
+                auto totalMass = 0.0f;
+                glm::vec2 weightedPosition {0.0f, 0.0f};
+                for (auto child = 0; child < 4; ++child) {
+                    const auto& childNode = nodes[node.firstChild + child];
+                    totalMass += childNode.totalMass;
+                    weightedPosition += childNode.centerOfMass * childNode.totalMass;
+                }
+                node.totalMass = totalMass;
+                node.centerOfMass = totalMass > 0 ? weightedPosition / totalMass : glm::vec2(0.0f, 0.0f);
+
+                // Children moments shifted to the new center (parallel axis theorem)
+                if (quadrupole) {
+                    node.qxx = node.qxy = node.qyy = 0.0f;
+                    for (auto child = 0; child < 4; ++child) {
+                        const auto& childNode = nodes[node.firstChild + child];
+                        const auto offset = childNode.centerOfMass - node.centerOfMass;
+                        node.qxx += childNode.qxx + childNode.totalMass * (2.0f * offset.x * offset.x - offset.y * offset.y);
+                        node.qxy += childNode.qxy + childNode.totalMass * 3.0f * offset.x * offset.y;
+                        node.qyy += childNode.qyy + childNode.totalMass * (2.0f * offset.y * offset.y - offset.x * offset.x);
+                    }
+                }
+            }
+
+            node.openingDistance = node.boundary.getWidth() * inverseTheta;
+            if (offsetAware && node.totalMass > 0) {
+                const auto offset = node.centerOfMass - node.boundary.center;
+                node.openingDistance += std::sqrt(offset.x * offset.x + offset.y * offset.y);
+            }
+        }
+    }
+
+    void BHArenaTree::accumulateBucket(Node& leaf) const {
+        const auto& bodies = *m_bodies;
+        auto totalMass = 0.0f;
+        glm::vec2 weightedPosition {0.0f, 0.0f};
+        for (auto body = leaf.firstBody; body != INVALID_INDEX; body = m_nextBody[body]) {
+            totalMass += bodies.mass[body];
+            weightedPosition += bodies.position(body) * bodies.mass[body];
+        }
+        leaf.totalMass = totalMass;
+        leaf.centerOfMass = totalMass > 0 ? weightedPosition / totalMass : glm::vec2(0.0f, 0.0f);
+        if (leaf.bodyCount == 1) {
+            // Exact position, a rounded one would no longer cancel the self-interaction
+            leaf.centerOfMass = bodies.position(leaf.firstBody);
+        }
+
+        leaf.qxx = leaf.qxy = leaf.qyy = 0.0f;
+        if (m_parameters.expansionOrder == ExpansionOrder::Quadrupole && leaf.bodyCount > 1) {
+            for (auto body = leaf.firstBody; body != INVALID_INDEX; body = m_nextBody[body]) {
+                const auto offset = bodies.position(body) - leaf.centerOfMass;
+                leaf.qxx += bodies.mass[body] * (2.0f * offset.x * offset.x - offset.y * offset.y);
+                leaf.qxy += bodies.mass[body] * 3.0f * offset.x * offset.y;
+                leaf.qyy += bodies.mass[body] * (2.0f * offset.y * offset.y - offset.x * offset.x);
+            }
+        }
+    }
+
+    bool BHArenaTree::accepts(const Node& node, float distance, const glm::vec2& targetMin, const glm::vec2& targetMax, float referenceAcceleration) const {
+        if (m_parameters.openingCriterion != OpeningCriterion::RelativeForce || referenceAcceleration <= 0) {
+            return distance > node.openingDistance;
+        }
+
+        // The error estimate only holds outside the node, open it for targets inside
+        const auto& boundary = node.boundary;
+        if (targetMax.x >= boundary.center.x - boundary.halfDimension && targetMin.x <= boundary.center.x + boundary.halfDimension
+            && targetMax.y >= boundary.center.y - boundary.halfDimension && targetMin.y <= boundary.center.y + boundary.halfDimension) {
+            return false;
+        }
+        const auto width = boundary.getWidth();
+        const auto distanceSq = distance * distance;
+        return m_parameters.gravity * node.totalMass * width * width <= m_parameters.forceAccuracy * referenceAcceleration * distanceSq * distanceSq;
+    }
+
+    void BHArenaTree::build(const AABB& boundary, const std::vector<uint64_t>& keys, const BodyStore& bodies, ThreadPool* pool) {
+        reset(boundary);
+        m_subtrees.clear();
+        m_bodies = &bodies;
+        if (m_nextBody.size() < bodies.size()) {
+            m_nextBody.resize(bodies.size(), INVALID_INDEX);
+        }
+
+        const auto parallel = pool && pool->getThreadCount() > 1 && keys.size() >= PARALLEL_BUILD_MIN_BODIES;
+        buildRange(m_nodes, 0, 0, static_cast<int32_t>(keys.size()), 0, parallel ? PARALLEL_SPLIT_LEVEL : -1, keys, bodies);
+
+        const auto topNodeCount = m_nodes.size();
+        if (!m_subtrees.empty()) {
+            buildSubtrees(keys, bodies, *pool);
+        }
+        // Subtrees are complete, finish the serial top of the tree
+        accumulateMass(m_nodes, 0, topNodeCount);
+    }
+
+    int32_t BHArenaTree::getMaxDepth() const {
+        int32_t depth = 0;
+        for (const auto& node : m_nodes) {
+            depth = std::max(depth, node.depth);
+        }
+        return depth;
+    }
+
+    void BHArenaTree::buildRange(std::vector<Node>& nodes, int32_t nodeIndex, int32_t begin, int32_t end, int level, int splitLevel,
+                                 const std::vector<uint64_t>& keys, const BodyStore& bodies) {
+        if (end - begin == 0) {
+            return;
+        }
+
+        // Sorted bodies of one leaf are contiguous, link them in order
+        if (static_cast<size_t>(end - begin) <= getBucketSize() || nodes[nodeIndex].depth >= MAX_DEPTH) {
+            auto& leaf = nodes[nodeIndex];
+            leaf.firstBody = begin;
+            leaf.bodyCount = end - begin;
+            for (auto i = begin; i < end; ++i) {
+                m_nextBody[i] = i + 1 < end ? i + 1 : INVALID_INDEX;
+            }
+            return;
+        }
+
+        if (level == splitLevel) {
+            m_subtrees.push_back(Subtree {nodeIndex, begin, end, level});
+            return;
+        }
+
+        // Key resolution exhausted, separate the remaining bodies geometrically
+        if (level == MortonOrder::LEVELS) {
+            for (auto i = begin; i < end; ++i) {
+                insertFrom(nodes, nodeIndex, i);
+            }
+            return;
+        }
+
+        subdivide(nodes, nodeIndex);
+
+        // Bodies of one quadrant form a contiguous run of the sorted range
+        auto childBegin = begin;
+        for (auto child = 0; child < 4; ++child) {
+            const auto childEnd = static_cast<int32_t>(std::partition_point(keys.begin() + childBegin, keys.begin() + end,
+                [level, child](uint64_t key) { return MortonOrder::quadrant(key, level) == child; }) - keys.begin());
+            buildRange(nodes, nodes[nodeIndex].firstChild + child, childBegin, childEnd, level + 1, splitLevel, keys, bodies);
+            childBegin = childEnd;
+        }
+    }
+
+    void BHArenaTree::buildSubtrees(const std::vector<uint64_t>& keys, const BodyStore& bodies, ThreadPool& pool) {
+        const auto subtreeCount = m_subtrees.size();
+        if (m_subtreeNodes.size() < subtreeCount) {
+            m_subtreeNodes.resize(subtreeCount);
+        }
+
+        // Build every subtree into its own pool, rooted at local node 0
+        pool.parallelFor(subtreeCount, 1, [this, &keys, &bodies](size_t begin, size_t end, size_t) {
+            for (auto s = begin; s < end; ++s) {
+                const auto& subtree = m_subtrees[s];
+                auto& nodes = m_subtreeNodes[s];
+                nodes.clear();
+                nodes.emplace_back(m_nodes[subtree.root].boundary, m_nodes[subtree.root].depth);
+                buildRange(nodes, 0, subtree.begin, subtree.end, subtree.level, -1, keys, bodies);
+                accumulateMass(nodes, 0, nodes.size());
+            }
+        });
+
+        // Splice: local node 0 replaces the root, the rest is appended as one block per subtree
+        m_subtreeOffsets.resize(subtreeCount);
+        auto totalNodes = m_nodes.size();
+        for (size_t s = 0; s < subtreeCount; ++s) {
+            m_subtreeOffsets[s] = totalNodes;
+            totalNodes += m_subtreeNodes[s].size() - 1;
+        }
+        m_nodes.resize(totalNodes, Node(getBoundary()));
+
+        pool.parallelFor(subtreeCount, 1, [this](size_t begin, size_t end, size_t) {
+            for (auto s = begin; s < end; ++s) {
+                const auto& nodes = m_subtreeNodes[s];
+                const auto offset = static_cast<int32_t>(m_subtreeOffsets[s]) - 1;
+                auto relocate = [offset](Node node) {
+                    if (node.isDivided()) {
+                        node.firstChild += offset;
+                    }
+                    return node;
+                };
+
+                m_nodes[m_subtrees[s].root] = relocate(nodes[0]);
+                for (size_t i = 1; i < nodes.size(); ++i) {
+                    m_nodes[offset + i] = relocate(nodes[i]);
+                }
+            }
+        });
+    }
+
+    void BHArenaTree::subdivide(std::vector<Node>& nodes, int32_t nodeIndex) {
+        const auto boundary = nodes[nodeIndex].boundary;
+        const auto childHalfDim = boundary.halfDimension / 2.0f;
+        const auto firstChild = static_cast<int32_t>(nodes.size());
+        const auto depth = nodes[nodeIndex].depth + 1;
+
+        nodes.emplace_back(AABB(glm::vec2(boundary.center.x - childHalfDim, boundary.center.y - childHalfDim), childHalfDim), depth);
+        nodes.emplace_back(AABB(glm::vec2(boundary.center.x + childHalfDim, boundary.center.y - childHalfDim), childHalfDim), depth);
+        nodes.emplace_back(AABB(glm::vec2(boundary.center.x - childHalfDim, boundary.center.y + childHalfDim), childHalfDim), depth);
+        nodes.emplace_back(AABB(glm::vec2(boundary.center.x + childHalfDim, boundary.center.y + childHalfDim), childHalfDim), depth);
+
+        nodes[nodeIndex].firstChild = firstChild;
+    }
+
+    int32_t BHArenaTree::childFor(const Node& node, const glm::vec2& position) {
+        // Same tie-breaking as QuadtreeNode::insertToChild: points on a split line go to NW first
+        const auto east = position.x > node.boundary.center.x ? 1 : 0;
+        const auto south = position.y > node.boundary.center.y ? 2 : 0;
+        return node.firstChild + east + south;
+    }
+
+    glm::vec2 BHArenaTree::computeForce(int32_t targetIndex, const glm::vec2& position, float mass, float referenceAcceleration) const {
+        glm::vec2 force {0.0f, 0.0f};
+        computeForce(0, targetIndex, position, mass, referenceAcceleration, force);
+        return force;
+    }
+
+    void BHArenaTree::computeForce(int32_t nodeIndex, int32_t targetIndex, const glm::vec2& position, float mass, float referenceAcceleration, glm::vec2& force) const {
+        const auto& node = m_nodes[nodeIndex];
+        PROFILE_COUNT(NodeVisits, 1);
+        if (!node.isDivided() && !node.hasBody()) {
+            return;
+        }
+
+        const auto r = node.centerOfMass - position;
+        const auto distanceSq = r.x * r.x + r.y * r.y;
+        // A single body leaf is always summed directly
+        const auto approximable = node.isDivided() || node.bodyCount > 1;
+        if (approximable && accepts(node, std::sqrt(distanceSq), position, position, referenceAcceleration)) {
+            addApproximateForce(node, r, distanceSq, mass, force);
+            PROFILE_COUNT(ApproximateInteractions, 1);
+            return;
+        }
+
+        if (node.isDivided()) {
+            for (auto child = 0; child < 4; ++child) {
+                computeForce(node.firstChild + child, targetIndex, position, mass, referenceAcceleration, force);
+            }
+            return;
+        }
+
+        // Leaf bucket, skipping self-interaction
+        PROFILE_COUNT(DirectInteractions, node.bodyCount);
+        for (auto body = node.firstBody; body != INVALID_INDEX; body = m_nextBody[body]) {
+            if (body == targetIndex) continue;
+
+            const auto bodyR = m_bodies->position(body) - position;
+            const auto bodyDistanceSq = bodyR.x * bodyR.x + bodyR.y * bodyR.y;
+            if (bodyDistanceSq == 0) continue;
+
+            const float distance = std::sqrt(bodyDistanceSq + m_parameters.softening);
+            const auto forceMag = m_parameters.gravity * mass * m_bodies->mass[body] / bodyDistanceSq;
+            force += forceMag * bodyR / distance;
+        }
+    }
+
+    void BHArenaTree::addApproximateForce(const Node& node, const glm::vec2& r, float distanceSq, float mass, glm::vec2& force) const {
+        const auto distance = std::sqrt(distanceSq);
+        if (node.totalMass > 0) {
+            const auto forceMag = m_parameters.gravity * mass * node.totalMass / distanceSq;
+            force += forceMag * r / distance;
+        }
+        if (m_parameters.expansionOrder == ExpansionOrder::Quadrupole) {
+            const auto invDistance5 = 1.0f / (distanceSq * distanceSq * distance);
+            const glm::vec2 qr(node.qxx * r.x + node.qxy * r.y, node.qxy * r.x + node.qyy * r.y);
+            const auto rqr = r.x * qr.x + r.y * qr.y;
+            force += m_parameters.gravity * mass * invDistance5 * (2.5f * rqr / distanceSq * r - qr);
+        }
+    }
+
+    float BHArenaTree::computePotential(int32_t targetIndex, const glm::vec2& position) const {
+        return computePotential(0, targetIndex, position);
+    }
+
+    float BHArenaTree::computePotential(int32_t nodeIndex, int32_t targetIndex, const glm::vec2& position) const {
+        const auto& node = m_nodes[nodeIndex];
+        if (!node.isDivided() && !node.hasBody()) {
+            return 0.0f;
+        }
+
+        const auto r = node.centerOfMass - position;
+        const auto distanceSq = r.x * r.x + r.y * r.y;
+        const auto approximable = node.isDivided() || node.bodyCount > 1;
+        if (approximable && accepts(node, std::sqrt(distanceSq), position, position, 0.0f)) {
+            return approximatePotential(node, r, distanceSq);
+        }
+
+        float potential = 0.0f;
+        if (node.isDivided()) {
+            for (auto child = 0; child < 4; ++child) {
+                potential += computePotential(node.firstChild + child, targetIndex, position);
+            }
+            return potential;
+        }
+
+        // Potential of the softened pair force G * m * M / (d * sqrt(d^2 + s))
+        const auto softening = std::sqrt(m_parameters.softening);
+        for (auto body = node.firstBody; body != INVALID_INDEX; body = m_nextBody[body]) {
+            const auto bodyR = m_bodies->position(body) - position;
+            const auto bodyDistanceSq = bodyR.x * bodyR.x + bodyR.y * bodyR.y;
+            if (body == targetIndex || bodyDistanceSq == 0) continue;
+
+            potential -= m_parameters.gravity * m_bodies->mass[body] / softening * std::asinh(softening / std::sqrt(bodyDistanceSq));
+        }
+        return potential;
+    }
+
+    float BHArenaTree::approximatePotential(const Node& node, const glm::vec2& r, float distanceSq) const {
+        const auto distance = std::sqrt(distanceSq);
+        auto potential = node.totalMass > 0 ? -m_parameters.gravity * node.totalMass / distance : 0.0f;
+        if (m_parameters.expansionOrder == ExpansionOrder::Quadrupole) {
+            const auto rqr = r.x * (node.qxx * r.x + node.qxy * r.y) + r.y * (node.qxy * r.x + node.qyy * r.y);
+            potential -= 0.5f * m_parameters.gravity * rqr / (distanceSq * distanceSq * distance);
+        }
+        return potential;
+    }
+
+    void BHArenaTree::collectInteractions(const glm::vec2& groupMin, const glm::vec2& groupMax, InteractionList& list, float referenceAcceleration) const {
+        collectInteractions(0, groupMin, groupMax, referenceAcceleration, list);
+    }
+
+    void BHArenaTree::collectInteractions(int32_t nodeIndex, const glm::vec2& groupMin, const glm::vec2& groupMax, float referenceAcceleration, InteractionList& list) const {
+        const auto& node = m_nodes[nodeIndex];
+        PROFILE_COUNT(NodeVisits, 1);
+        if (!node.isDivided() && node.bodyCount == 1) {
+            list.add(m_bodies->position(node.firstBody), m_bodies->mass[node.firstBody], m_parameters.softening);
+            PROFILE_COUNT(DirectInteractions, 1);
+            return;
+        }
+        if (node.totalMass <= 0) {
+            return;
+        }
+
+        // Distance from the center of mass to the nearest point of the group box
+        const auto dx = std::max({groupMin.x - node.centerOfMass.x, 0.0f, node.centerOfMass.x - groupMax.x});
+        const auto dy = std::max({groupMin.y - node.centerOfMass.y, 0.0f, node.centerOfMass.y - groupMax.y});
+        const auto distance = std::sqrt(dx * dx + dy * dy);
+
+        if (accepts(node, distance, groupMin, groupMax, referenceAcceleration)) {
+            if (m_parameters.expansionOrder == ExpansionOrder::Quadrupole) {
+                list.addQuadrupole(node.centerOfMass, node.totalMass, node.qxx, node.qxy, node.qyy);
+            }
+            else {
+                list.add(node.centerOfMass, node.totalMass, 0.0f);
+            }
+            PROFILE_COUNT(ApproximateInteractions, 1);
+        }
+        else if (node.isDivided()) {
+            for (auto child = 0; child < 4; ++child) {
+                collectInteractions(node.firstChild + child, groupMin, groupMax, referenceAcceleration, list);
+            }
+        }
+        else {
+            for (auto body = node.firstBody; body != INVALID_INDEX; body = m_nextBody[body]) {
+                list.add(m_bodies->position(body), m_bodies->mass[body], m_parameters.softening);
+            }
+            PROFILE_COUNT(DirectInteractions, node.bodyCount);
+        }
+    }
+
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "body_store.h"
+#include "force_kernels.h"
+#include "simulation_parameters.h"
+#include "base/quadtree.h"
+
+#include <glm/vec2.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+namespace physics {
+
+// Pointer-free Barnes-Hut quadtree.
+// All nodes live in one flat pool that keeps its capacity between rebuilds,
+// children are addressed by index and leaves reference bodies by their index
+// in the simulation body list. A leaf holds a bucket of up to leafBucketSize bodies,
+// linked through a per body next index; leaves at MAX_DEPTH take any number of bodies,
+// so coincident bodies stop subdividing there.
+class BHArenaTree {
+
+public:
+    static constexpr int32_t INVALID_INDEX = -1;
+    // Below this, child cells stop being representable in float for any practical root size
+    static constexpr int32_t MAX_DEPTH = 24;
+
+    struct Node {
+        AABB boundary;
+        glm::vec2 centerOfMass {0.0f, 0.0f};
+        float totalMass {0.0f};
+        float qxx {0.0f}, qxy {0.0f}, qyy {0.0f};  // Quadrupole about the center of mass, see InteractionList
+        float openingDistance {0.0f};           // Accepted beyond this distance from the center of mass
+        int32_t firstChild {INVALID_INDEX};     // Children NW, NE, SW, SE are stored contiguously
+        int32_t firstBody {INVALID_INDEX};      // Head of the leaf bucket, see getNextBody()
+        int32_t bodyCount {0};                  // Bodies in the leaf bucket
+        int32_t depth {0};
+
+        Node(const AABB& boundary, int32_t depth = 0) : boundary(boundary), depth(depth) {}
+        bool isDivided() const { return firstChild != INVALID_INDEX; }
+        bool hasBody() const { return bodyCount > 0; }
+    };
+
+    explicit BHArenaTree(const AABB& boundary);
+
+    // Takes effect with the next build or updateMassProperties()
+    void setParameters(const SimulationParameters& parameters) { m_parameters = parameters; }
+    const SimulationParameters& getParameters() const { return m_parameters; }
+
+    // Drop all nodes but keep the pool memory for the next build
+    void reset(const AABB& boundary);
+    // Only links the body into the tree, call updateMassProperties() once all bodies are in.
+    // Every insert must use the same store, the tree reads positions and masses from it
+    bool insert(int32_t bodyIndex, const BodyStore& bodies);
+    // Upward pass over the whole tree, leaf buckets included
+    void updateMassProperties();
+    // Bulk build from bodies already permuted into Morton order (see MortonOrder),
+    // body i has key keys[i]. With a pool, the subtrees below PARALLEL_SPLIT_LEVEL
+    // and their upward passes run concurrently.
+    void build(const AABB& boundary, const std::vector<uint64_t>& keys, const BodyStore& bodies, ThreadPool* pool = nullptr);
+    // Follow bodies that moved since the tree was built: bodies still inside their leaf stay,
+    // the others are unlinked and inserted again from the root, then mass properties are refit.
+    // Bodies must keep their indices. Returns false without linking anything when more than
+    // maxMigrated bodies left their leaf since the last build, or one left the root; the tree
+    // then needs a rebuild.
+    // migrated receives the bodies that left their leaf on this call.
+    bool refit(const BodyStore& bodies, size_t maxMigrated, size_t& migrated, ThreadPool* pool = nullptr);
+    // Bodies moved to another leaf by refit() since the last build or reset
+    size_t getMigratedSinceBuild() const { return m_migratedSinceBuild; }
+
+    // referenceAcceleration is the magnitude used by OpeningCriterion::RelativeForce, usually the
+    // acceleration of the previous evaluation; 0 falls back to the geometric criterion
+    glm::vec2 computeForce(int32_t targetIndex, const glm::vec2& position, float mass, float referenceAcceleration = 0.0f) const;
+    // Gravitational potential per unit mass at position, same expansion as computeForce
+    float computePotential(int32_t targetIndex, const glm::vec2& position) const;
+    // Gather the nodes and leaf bodies acting on every target inside [groupMin, groupMax].
+    // A node is accepted only if the opening criterion holds for the nearest point of the group,
+    // referenceAcceleration should be the smallest one of the group.
+    void collectInteractions(const glm::vec2& groupMin, const glm::vec2& groupMax, InteractionList& list, float referenceAcceleration = 0.0f) const;
+
+    const AABB& getBoundary() const { return m_nodes.front().boundary; }
+    const Node& getNode(int32_t index) const { return m_nodes[index]; }
+    // Next body of the same leaf bucket, INVALID_INDEX at the end
+    int32_t getNextBody(int32_t bodyIndex) const { return m_nextBody[bodyIndex]; }
+    size_t getNodeCount() const { return m_nodes.size(); }
+    // Deepest node, a walk over the pool
+    int32_t getMaxDepth() const;
+    size_t getCapacity() const { return m_nodes.capacity(); }
+
+private:
+    // Range of sorted bodies below the serial top of the tree, built on its own
+    struct Subtree {
+        int32_t root;
+        int32_t begin;
+        int32_t end;
+        int level;
+    };
+
+    // Descend from nodeIndex and link the body into a leaf, splitting full buckets on the way
+    void insertFrom(std::vector<Node>& nodes, int32_t nodeIndex, int32_t bodyIndex);
+    void linkBody(Node& leaf, int32_t bodyIndex);
+    void unlinkBody(Node& leaf, int32_t bodyIndex);
+    size_t getBucketSize() const { return std::max<size_t>(m_parameters.leafBucketSize, 1); }
+    static void subdivide(std::vector<Node>& nodes, int32_t nodeIndex);
+    static int32_t childFor(const Node& node, const glm::vec2& position);
+    // Children always come after their parent, so a reverse sweep is a bottom-up pass
+    void accumulateMass(std::vector<Node>& nodes, size_t first, size_t last) const;
+    void accumulateBucket(Node& leaf) const;
+    // Monopole and quadrupole of an accepted node
+    void addApproximateForce(const Node& node, const glm::vec2& r, float distanceSq, float mass, glm::vec2& force) const;
+    float approximatePotential(const Node& node, const glm::vec2& r, float distanceSq) const;
+    // Opening criterion for targets inside [targetMin, targetMax], distance from the center of mass
+    bool accepts(const Node& node, float distance, const glm::vec2& targetMin, const glm::vec2& targetMax, float referenceAcceleration) const;
+    // Ranges reaching splitLevel are recorded as subtrees instead of being built
+    void buildRange(std::vector<Node>& nodes, int32_t nodeIndex, int32_t begin, int32_t end, int level, int splitLevel,
+                    const std::vector<uint64_t>& keys, const BodyStore& bodies);
+    void buildSubtrees(const std::vector<uint64_t>& keys, const BodyStore& bodies, ThreadPool& pool);
+    void computeForce(int32_t nodeIndex, int32_t targetIndex, const glm::vec2& position, float mass, float referenceAcceleration, glm::vec2& force) const;
+    float computePotential(int32_t nodeIndex, int32_t targetIndex, const glm::vec2& position) const;
+    void collectInteractions(int32_t nodeIndex, const glm::vec2& groupMin, const glm::vec2& groupMax, float referenceAcceleration, InteractionList& list) const;
+
+    // Leaf of every body, filled on demand by refit()
+    void indexLeaves(size_t bodyCount);
+
+    SimulationParameters m_parameters;
+    const BodyStore* m_bodies {nullptr};
+    std::vector<Node> m_nodes;
+    std::vector<int32_t> m_nextBody;        // Per body, the next body of its leaf bucket
+    std::vector<int32_t> m_leafOf;
+    bool m_leavesIndexed {false};
+    std::vector<std::vector<int32_t>> m_workerMigrants;
+    std::vector<int32_t> m_migrants;        // Migrants of every worker, sorted by index
+    size_t m_migratedSinceBuild {0};
+    std::vector<Subtree> m_subtrees;
+    std::vector<std::vector<Node>> m_subtreeNodes;
+    std::vector<size_t> m_subtreeOffsets;
+};
+
+}
@@ -1,52 +1,72 @@
 #include "body.h"
-#include <random>
 
 namespace physics {
 
-Body::Body(glm::vec2 _pos, glm::vec2 _vel, float _mass) 
-        : m_position(_pos)
-        , m_velocity(_vel)
-        , m_mass(_mass)
-        , m_active(true) {
+Body::Body(BodyStore& store, size_t index)
+        : m_store(&store)
+        , m_index(index) {
 
 }
 
 void Body::setPosition(glm::vec2 position) {
-    m_position = position;
+    m_store->x[m_index] = position.x;
+    m_store->y[m_index] = position.y;
 }
 
 void Body::setVelocity(glm::vec2 velocity) {
-    m_velocity = velocity;
+    m_store->vx[m_index] = velocity.x;
+    m_store->vy[m_index] = velocity.y;
 }
 
 void Body::setActive(bool active) {
-    m_active = active;
+    m_store->active[m_index] = active ? 1 : 0;
+}
+
+void Body::setRadius(float radius) {
+    m_store->radius[m_index] = radius;
 }
 
 glm::vec2 Body::position() const {
-    return m_position;
+    return m_store->position(m_index);
+}
+
+glm::vec2 Body::velocity() const {
+    return m_store->velocity(m_index);
 }
 
 glm::vec2 Body::force() const { 
-    return m_force;
+    return m_store->force(m_index);
 }
 
 void Body::addForce(const glm::vec2& _force) {
-    m_force += _force;
+    m_store->fx[m_index] += _force.x;
+    m_store->fy[m_index] += _force.y;
 }
 
 float Body::mass() const {
-   return m_mass;
+   return m_store->mass[m_index];
+}
+
+float Body::radius() const {
+   return m_store->radius[m_index];
 }
 
 bool Body::isActive() const {
-    return m_active;
+    return m_store->active[m_index] != 0;
+}
+
+uint32_t Body::id() const {
+    return m_store->id[m_index];
 }
 
 void Body::update(float dt) {
-    m_position += m_velocity * dt;
-    m_velocity += (m_force / m_mass) * dt;
-    m_force = {0.0f, 0.0f};
+    const auto mass = m_store->mass[m_index];
+    m_store->x[m_index] += m_store->vx[m_index] * dt;
+    m_store->y[m_index] += m_store->vy[m_index] * dt;
+    m_store->vx[m_index] += (m_store->fx[m_index] / mass) * dt;
+    m_store->vy[m_index] += (m_store->fy[m_index] / mass) * dt;
+    m_store->fx[m_index] = 0.0f;
+    m_store->fy[m_index] = 0.0f;
 }
 
 }
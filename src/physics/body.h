@@ -1,35 +1,40 @@
 #pragma once
 
+#include "body_store.h"
+
 #include <glm/vec2.hpp>
 
 namespace physics {
 
+// Lightweight view of one body slot in a BodyStore.
+// A view is only valid until the store is reordered or compacted.
 class Body {
 
 public:
-    explicit Body(glm::vec2 pos, glm::vec2 vel, float mass);
-    virtual ~Body() = default;
-    virtual void update(float dt);
+    explicit Body(BodyStore& store, size_t index);
+    void update(float dt);
 
     void setPosition(glm::vec2 position);
     void setVelocity(glm::vec2 velocity);
     void setActive(bool active);
+    void setRadius(float radius);
     glm::vec2 position() const;
+    glm::vec2 velocity() const;
     glm::vec2 force() const;
     float mass() const;
+    float radius() const;
     bool isActive() const;
+    size_t index() const { return m_index; }
+    uint32_t id() const;
     void addForce(const glm::vec2& force);
     bool operator==(const Body& other) const {
-        return m_position == other.m_position
-            && m_mass == other.m_mass;
+        return m_store == other.m_store
+            && m_index == other.m_index;
     }
 
 protected:
-    glm::vec2 m_position;
-    glm::vec2 m_velocity;
-    glm::vec2 m_force;
-    float m_mass;
-    bool m_active;
+    BodyStore* m_store;
+    size_t m_index;
 };
 
 }
@@ -0,0 +1,132 @@
+#include "body_store.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+
+namespace physics {
+
+    namespace {
+        const size_t PERMUTE_TASK_SIZE = 4096;
+
+        template<typename T>
+        void permuteArray(std::vector<T>& values, std::vector<T>& scratch, const std::vector<uint32_t>& order, ThreadPool* pool) {
+            scratch.resize(values.size());
+            auto gather = [&values, &scratch, &order](size_t begin, size_t end, size_t) {
+                for (auto i = begin; i < end; ++i) {
+                    scratch[i] = values[order[i]];
+                }
+            };
+            if (pool) {
+                pool->parallelFor(order.size(), PERMUTE_TASK_SIZE, gather);
+            }
+            else {
+                gather(0, order.size(), 0);
+            }
+            values.swap(scratch);
+        }
+    }
+
+    void BodyStore::reserve(size_t count) {
+        for (auto* values : {&x, &y, &vx, &vy, &fx, &fy, &mass, &radius}) {
+            values->reserve(count);
+        }
+        active.reserve(count);
+        timeBin.reserve(count);
+        id.reserve(count);
+    }
+
+    void BodyStore::clear() {
+        for (auto* values : {&x, &y, &vx, &vy, &fx, &fy, &mass, &radius}) {
+            values->clear();
+        }
+        active.clear();
+        timeBin.clear();
+        id.clear();
+        m_freeIds.clear();
+        m_nextId = 0;
+    }
+
+    uint32_t BodyStore::add(glm::vec2 position, glm::vec2 velocity, float bodyMass, float bodyRadius) {
+        x.push_back(position.x);
+        y.push_back(position.y);
+        vx.push_back(velocity.x);
+        vy.push_back(velocity.y);
+        fx.push_back(0.0f);
+        fy.push_back(0.0f);
+        mass.push_back(bodyMass);
+        radius.push_back(bodyRadius);
+        active.push_back(1);
+        timeBin.push_back(0);
+
+        auto bodyId = m_nextId;
+        if (!m_freeIds.empty()) {
+            bodyId = m_freeIds.back();
+            m_freeIds.pop_back();
+        }
+        else {
+            ++m_nextId;
+        }
+        id.push_back(bodyId);
+        return bodyId;
+    }
+
+    size_t BodyStore::removeInactive(std::vector<RetiredBody>& retired, RetireReason reason) {
+        const auto count = size();
+        const auto first = static_cast<size_t>(std::find(active.begin(), active.end(), 0) - active.begin());
+        if (first == count) {
+            return 0;
+        }
+
+        for (auto i = first; i < count; ++i) {
+            if (!active[i]) {
+                retired.push_back(RetiredBody {id[i], position(i), velocity(i), mass[i], radius[i], reason});
+                m_freeIds.push_back(id[i]);
+            }
+        }
+
+        // Stable compaction, one streaming pass per array; the mask itself goes last
+        auto compact = [this, first, count](auto& values) {
+            auto write = first;
+            for (auto read = first; read < count; ++read) {
+                if (active[read]) {
+                    values[write++] = values[read];
+                }
+            }
+            values.resize(write);
+        };
+        for (auto* values : {&x, &y, &vx, &vy, &fx, &fy, &mass, &radius}) {
+            compact(*values);
+        }
+        compact(id);
+        compact(timeBin);
+        compact(active);
+        return count - size();
+    }
+
+    void BodyStore::restoreIds(uint32_t idCapacity) {
+        for (const auto bodyId : id) {
+            idCapacity = std::max(idCapacity, bodyId + 1);
+        }
+        std::vector<uint8_t> used(idCapacity, 0);
+        for (const auto bodyId : id) {
+            used[bodyId] = 1;
+        }
+        m_freeIds.clear();
+        for (auto bodyId = idCapacity; bodyId-- > 0;) {
+            if (!used[bodyId]) {
+                m_freeIds.push_back(bodyId);
+            }
+        }
+        m_nextId = idCapacity;
+    }
+
+    void BodyStore::permute(const std::vector<uint32_t>& order, ThreadPool* pool) {
+        for (auto* values : {&x, &y, &vx, &vy, &fx, &fy, &mass, &radius}) {
+            permuteArray(*values, m_floatScratch, order, pool);
+        }
+        permuteArray(active, m_activeScratch, order, pool);
+        permuteArray(timeBin, m_activeScratch, order, pool);
+        permuteArray(id, m_idScratch, order, pool);
+    }
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+namespace physics {
+
+enum class RetireReason : uint8_t {
+    Escaped,        // Left the simulation boundary
+    Merged,         // Absorbed by another body in a collision
+    Deleted         // Removed on request, see NBodySimulation::removeBodiesInRadius()
+};
+
+// Last state of a body removed from the store
+struct RetiredBody {
+    uint32_t id;
+    glm::vec2 position;
+    glm::vec2 velocity;
+    float mass;
+    float radius;
+    RetireReason reason;
+};
+
+// Structure-of-arrays storage for all simulated bodies.
+// Hot loops iterate the arrays by index; Body is only a view into one slot.
+// Slots get reordered (Morton sort) and compacted, the id of a body stays the same
+// and is used to look up per-body data kept outside the simulation (e.g. appearance).
+class BodyStore {
+
+public:
+    std::vector<float> x, y;
+    std::vector<float> vx, vy;
+    std::vector<float> fx, fy;
+    std::vector<float> mass;
+    std::vector<float> radius;          // Collision radius
+    std::vector<uint8_t> active;
+    std::vector<uint8_t> timeBin;       // Block time step level, the body steps with dt / 2^timeBin
+    std::vector<uint32_t> id;
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+    void reserve(size_t count);
+    void clear();
+
+    // Append a body and return its id, ids of removed bodies are reused
+    uint32_t add(glm::vec2 position, glm::vec2 velocity, float mass, float radius = 0.0f);
+    // Remove every inactive body in one stable pass, returns the number removed
+    size_t removeInactive(std::vector<RetiredBody>& retired, RetireReason reason = RetireReason::Escaped);
+    // After the arrays were filled directly: ids below idCapacity no body uses become free
+    void restoreIds(uint32_t idCapacity);
+    // Reorder all arrays so that slot i receives the body from slot order[i]
+    void permute(const std::vector<uint32_t>& order, ThreadPool* pool = nullptr);
+
+    glm::vec2 position(size_t index) const { return {x[index], y[index]}; }
+    glm::vec2 velocity(size_t index) const { return {vx[index], vy[index]}; }
+    glm::vec2 force(size_t index) const { return {fx[index], fy[index]}; }
+    // Upper bound of ids in use, for arrays indexed by id
+    uint32_t getIdCapacity() const { return m_nextId; }
+
+private:
+    std::vector<float> m_floatScratch;
+    std::vector<uint8_t> m_activeScratch;
+    std::vector<uint32_t> m_idScratch;
+    std::vector<uint32_t> m_freeIds;
+    uint32_t m_nextId {0};
+};
+
+}
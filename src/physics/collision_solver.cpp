@@ -0,0 +1,325 @@
+#include "collision_solver.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace physics {
+
+    namespace {
+        const size_t GRID_TASK_SIZE = 4096;
+        const size_t PAIR_TASK_SIZE = 512;
+        // Bodies wider than this many mean radii stay out of the grid
+        const float LARGE_RADIUS_FACTOR = 2.0f;
+        // Upper bound of grid cells per body, the cells grow when bodies are spread thin
+        const uint64_t MAX_CELLS_PER_BODY = 4;
+        const uint32_t LARGE_BODY = std::numeric_limits<uint32_t>::max();
+
+        void run(ThreadPool* pool, size_t count, size_t grainSize, const ThreadPool::RangeFunction& function) {
+            if (pool) {
+                pool->parallelFor(count, grainSize, function);
+            }
+            else {
+                function(0, count, 0);
+            }
+        }
+    }
+
+    const char* collisionPolicyName(CollisionPolicy policy) {
+        switch (policy) {
+            case CollisionPolicy::Ignore: return "ignore";
+            case CollisionPolicy::Merge: return "merge";
+            case CollisionPolicy::Elastic: return "elastic";
+        }
+        return "unknown";
+    }
+
+    bool parseCollisionPolicy(const std::string& name, CollisionPolicy& policy) {
+        for (auto candidate : {CollisionPolicy::Ignore, CollisionPolicy::Merge, CollisionPolicy::Elastic}) {
+            if (name == collisionPolicyName(candidate)) {
+                policy = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void CollisionSolver::resolve(BodyStore& bodies, ThreadPool* pool) {
+        m_stats = CollisionStats {};
+        if (m_policy == CollisionPolicy::Ignore || bodies.size() < 2) {
+            return;
+        }
+
+        m_workers.resize(pool ? pool->getThreadCount() : 1);
+        buildGrid(bodies, pool);
+        findPairs(bodies, pool);
+
+        // Resolve in index order so the outcome does not depend on the thread count
+        m_pairs.clear();
+        for (auto& worker : m_workers) {
+            m_pairs.insert(m_pairs.end(), worker.pairs.begin(), worker.pairs.end());
+            m_stats.candidates += worker.candidates;
+        }
+        std::sort(m_pairs.begin(), m_pairs.end());
+        m_stats.contacts = m_pairs.size();
+
+        for (const auto& [a, b] : m_pairs) {
+            if (m_policy == CollisionPolicy::Merge) {
+                mergePair(bodies, a, b);
+            }
+            else {
+                bouncePair(bodies, a, b);
+            }
+        }
+    }
+
+    void CollisionSolver::buildGrid(const BodyStore& bodies, ThreadPool* pool) {
+        const auto count = bodies.size();
+
+        // Bounds reduced per worker, the radius sum per block of bodies: a floating point sum
+        // split by worker would change in the last bits with the thread count
+        for (auto& worker : m_workers) {
+            worker.minX = worker.minY = std::numeric_limits<float>::max();
+            worker.maxX = worker.maxY = std::numeric_limits<float>::lowest();
+        }
+        m_radiusSums.assign((count + GRID_TASK_SIZE - 1) / GRID_TASK_SIZE, 0.0);
+        run(pool, count, GRID_TASK_SIZE, [this, &bodies](size_t begin, size_t end, size_t workerIndex) {
+            auto& worker = m_workers[workerIndex];
+            for (auto i = begin; i < end; ++i) {
+                worker.minX = std::min(worker.minX, bodies.x[i]);
+                worker.minY = std::min(worker.minY, bodies.y[i]);
+                worker.maxX = std::max(worker.maxX, bodies.x[i]);
+                worker.maxY = std::max(worker.maxY, bodies.y[i]);
+                m_radiusSums[i / GRID_TASK_SIZE] += bodies.radius[i];
+            }
+        });
+
+        float minX = std::numeric_limits<float>::max(), minY = minX;
+        float maxX = std::numeric_limits<float>::lowest(), maxY = maxX;
+        for (const auto& worker : m_workers) {
+            minX = std::min(minX, worker.minX);
+            minY = std::min(minY, worker.minY);
+            maxX = std::max(maxX, worker.maxX);
+            maxY = std::max(maxY, worker.maxY);
+        }
+        const auto radiusSum = std::accumulate(m_radiusSums.begin(), m_radiusSums.end(), 0.0);
+
+        // A regular body is at most largeRadius wide, so two overlapping ones sit in neighbouring cells
+        m_largeRadius = static_cast<float>(radiusSum / count) * LARGE_RADIUS_FACTOR;
+        const auto largeRadius = m_largeRadius;
+        const auto maxCells = MAX_CELLS_PER_BODY * count + 1;
+        const auto extent = std::max(maxX - minX, maxY - minY);
+        m_cellSize = std::max({2.0f * largeRadius, extent / static_cast<float>(maxCells), std::numeric_limits<float>::min()});
+        uint64_t columns, rows;
+        do {
+            columns = static_cast<uint64_t>((maxX - minX) / m_cellSize) + 1;
+            rows = static_cast<uint64_t>((maxY - minY) / m_cellSize) + 1;
+            if (columns * rows > maxCells) {
+                m_cellSize *= 2.0f;
+            }
+        } while (columns * rows > maxCells);
+        m_originX = minX;
+        m_originY = minY;
+        m_columns = static_cast<uint32_t>(columns);
+        m_rows = static_cast<uint32_t>(rows);
+        const auto cellCount = m_columns * m_rows;
+
+        m_bodyCells.resize(count);
+        run(pool, count, GRID_TASK_SIZE, [this, &bodies, largeRadius](size_t begin, size_t end, size_t) {
+            for (auto i = begin; i < end; ++i) {
+                if (bodies.radius[i] > largeRadius) {
+                    m_bodyCells[i] = LARGE_BODY;
+                    continue;
+                }
+                const auto column = cellCoordinate(bodies.x[i] - m_originX, m_columns);
+                const auto row = cellCoordinate(bodies.y[i] - m_originY, m_rows);
+                m_bodyCells[i] = row * m_columns + column;
+            }
+        });
+
+        // Counting sort: count, inclusive prefix sum, then fill every cell back to front
+        m_cellStart.assign(cellCount + 1, 0);
+        m_largeBodies.clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            if (m_bodyCells[i] == LARGE_BODY) {
+                m_largeBodies.push_back(i);
+            }
+            else {
+                ++m_cellStart[m_bodyCells[i]];
+            }
+        }
+        for (uint32_t c = 1; c < cellCount; ++c) {
+            m_cellStart[c] += m_cellStart[c - 1];
+        }
+        const auto gridCount = static_cast<uint32_t>(count - m_largeBodies.size());
+        m_cellStart[cellCount] = gridCount;
+        m_cellBodies.resize(gridCount);
+        for (auto i = static_cast<uint32_t>(count); i-- > 0;) {
+            const auto cell = m_bodyCells[i];
+            if (cell != LARGE_BODY) {
+                m_cellBodies[--m_cellStart[cell]] = i;
+            }
+        }
+    }
+
+    void CollisionSolver::findPairs(const BodyStore& bodies, ThreadPool* pool) {
+        for (auto& worker : m_workers) {
+            worker.pairs.clear();
+            worker.candidates = 0;
+        }
+
+        // Every grid body looks at the rest of its own cell and at the four neighbours ahead of
+        // it (E, SW, S, SE), which visits each pair of neighbouring cells exactly once
+        run(pool, m_cellBodies.size(), PAIR_TASK_SIZE, [this, &bodies](size_t begin, size_t end, size_t workerIndex) {
+            auto& worker = m_workers[workerIndex];
+            for (auto slot = begin; slot < end; ++slot) {
+                const auto body = m_cellBodies[slot];
+                const auto cell = m_bodyCells[body];
+                const auto column = cell % m_columns;
+                const auto row = cell / m_columns;
+
+                testCell(bodies, body, cell, static_cast<uint32_t>(slot + 1), worker.pairs, worker.candidates);
+                if (column + 1 < m_columns) {
+                    testCell(bodies, body, cell + 1, m_cellStart[cell + 1], worker.pairs, worker.candidates);
+                }
+                if (row + 1 < m_rows) {
+                    const auto below = cell + m_columns;
+                    if (column > 0) {
+                        testCell(bodies, body, below - 1, m_cellStart[below - 1], worker.pairs, worker.candidates);
+                    }
+                    testCell(bodies, body, below, m_cellStart[below], worker.pairs, worker.candidates);
+                    if (column + 1 < m_columns) {
+                        testCell(bodies, body, below + 1, m_cellStart[below + 1], worker.pairs, worker.candidates);
+                    }
+                }
+            }
+        });
+
+        // Large bodies scan every grid cell their radius, plus the widest regular body, reaches
+        run(pool, m_largeBodies.size(), 1, [this, &bodies](size_t begin, size_t end, size_t workerIndex) {
+            auto& worker = m_workers[workerIndex];
+            for (auto i = begin; i < end; ++i) {
+                const auto body = m_largeBodies[i];
+                const auto reach = bodies.radius[body] + m_largeRadius;
+                const auto firstColumn = cellCoordinate(bodies.x[body] - reach - m_originX, m_columns);
+                const auto lastColumn = cellCoordinate(bodies.x[body] + reach - m_originX, m_columns);
+                const auto firstRow = cellCoordinate(bodies.y[body] - reach - m_originY, m_rows);
+                const auto lastRow = cellCoordinate(bodies.y[body] + reach - m_originY, m_rows);
+                for (auto row = firstRow; row <= lastRow; ++row) {
+                    for (auto column = firstColumn; column <= lastColumn; ++column) {
+                        const auto cell = row * m_columns + column;
+                        testCell(bodies, body, cell, m_cellStart[cell], worker.pairs, worker.candidates);
+                    }
+                }
+            }
+        });
+
+        // Large against large: sweep along x, only bodies whose x extents overlap are tested
+        std::sort(m_largeBodies.begin(), m_largeBodies.end(), [&bodies](uint32_t a, uint32_t b) {
+            return bodies.x[a] - bodies.radius[a] < bodies.x[b] - bodies.radius[b];
+        });
+        auto& worker = m_workers.front();
+        for (size_t i = 0; i < m_largeBodies.size(); ++i) {
+            const auto a = m_largeBodies[i];
+            const auto right = bodies.x[a] + bodies.radius[a];
+            for (auto j = i + 1; j < m_largeBodies.size(); ++j) {
+                const auto b = m_largeBodies[j];
+                if (bodies.x[b] - bodies.radius[b] > right) {
+                    break;
+                }
+                testPair(bodies, a, b, worker.pairs, worker.candidates);
+            }
+        }
+    }
+
+    uint32_t CollisionSolver::cellCoordinate(float offset, uint32_t cells) const {
+        if (offset <= 0.0f) {
+            return 0;
+        }
+        return std::min(static_cast<uint32_t>(std::min(offset / m_cellSize, static_cast<float>(cells))), cells - 1);
+    }
+
+    void CollisionSolver::testCell(const BodyStore& bodies, uint32_t body, uint32_t cell, uint32_t firstSlot, std::vector<Pair>& pairs, size_t& candidates) const {
+        const auto lastSlot = m_cellStart[cell + 1];
+        for (auto slot = firstSlot; slot < lastSlot; ++slot) {
+            testPair(bodies, body, m_cellBodies[slot], pairs, candidates);
+        }
+    }
+
+    void CollisionSolver::testPair(const BodyStore& bodies, uint32_t a, uint32_t b, std::vector<Pair>& pairs, size_t& candidates) const {
+        ++candidates;
+        const auto dx = bodies.x[b] - bodies.x[a];
+        const auto dy = bodies.y[b] - bodies.y[a];
+        const auto reach = bodies.radius[a] + bodies.radius[b];
+        if (dx * dx + dy * dy < reach * reach) {
+            pairs.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+
+    void CollisionSolver::mergePair(BodyStore& bodies, uint32_t a, uint32_t b) {
+        // Earlier merges this step may have absorbed one of them already
+        if (!bodies.active[a] || !bodies.active[b]) {
+            return;
+        }
+
+        const auto survivor = bodies.mass[a] >= bodies.mass[b] ? a : b;
+        const auto absorbed = survivor == a ? b : a;
+        const auto massA = bodies.mass[survivor];
+        const auto massB = bodies.mass[absorbed];
+        const auto total = massA + massB;
+
+        // Mass weighted center and momentum conserving velocity, area conserving radius
+        bodies.x[survivor] = (bodies.x[survivor] * massA + bodies.x[absorbed] * massB) / total;
+        bodies.y[survivor] = (bodies.y[survivor] * massA + bodies.y[absorbed] * massB) / total;
+        bodies.vx[survivor] = (bodies.vx[survivor] * massA + bodies.vx[absorbed] * massB) / total;
+        bodies.vy[survivor] = (bodies.vy[survivor] * massA + bodies.vy[absorbed] * massB) / total;
+        bodies.fx[survivor] += bodies.fx[absorbed];
+        bodies.fy[survivor] += bodies.fy[absorbed];
+        bodies.radius[survivor] = std::hypot(bodies.radius[survivor], bodies.radius[absorbed]);
+        bodies.mass[survivor] = total;
+        bodies.active[absorbed] = 0;
+        ++m_stats.merged;
+    }
+
+    void CollisionSolver::bouncePair(BodyStore& bodies, uint32_t a, uint32_t b) {
+        auto nx = bodies.x[b] - bodies.x[a];
+        auto ny = bodies.y[b] - bodies.y[a];
+        const auto distance = std::hypot(nx, ny);
+        if (distance > 0.0f) {
+            nx /= distance;
+            ny /= distance;
+        }
+        else {
+            // Coincident centers, any axis separates them
+            nx = 1.0f;
+            ny = 0.0f;
+        }
+
+        const auto massA = bodies.mass[a];
+        const auto massB = bodies.mass[b];
+        const auto total = massA + massB;
+
+        // Exchange the normal velocity component only while the bodies approach each other
+        const auto approach = (bodies.vx[b] - bodies.vx[a]) * nx + (bodies.vy[b] - bodies.vy[a]) * ny;
+        if (approach < 0.0f) {
+            const auto impulse = 2.0f * approach / total;
+            bodies.vx[a] += impulse * massB * nx;
+            bodies.vy[a] += impulse * massB * ny;
+            bodies.vx[b] -= impulse * massA * nx;
+            bodies.vy[b] -= impulse * massA * ny;
+        }
+
+        // Push apart along the normal, the lighter body moves more
+        const auto overlap = bodies.radius[a] + bodies.radius[b] - distance;
+        if (overlap > 0.0f) {
+            bodies.x[a] -= nx * overlap * massB / total;
+            bodies.y[a] -= ny * overlap * massB / total;
+            bodies.x[b] += nx * overlap * massA / total;
+            bodies.y[b] += ny * overlap * massA / total;
+        }
+        ++m_stats.bounced;
+    }
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "body_store.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+namespace physics {
+
+// What happens to two overlapping bodies
+enum class CollisionPolicy {
+    Ignore,         // Bodies pass through each other, no detection at all
+    Merge,          // The lighter body is absorbed, mass and momentum are conserved
+    Elastic         // Bodies bounce off each other and are pushed apart
+};
+
+const char* collisionPolicyName(CollisionPolicy policy);
+// Returns false for an unknown name
+bool parseCollisionPolicy(const std::string& name, CollisionPolicy& policy);
+
+struct CollisionStats {
+    size_t candidates {0};      // Pairs tested by the narrow phase
+    size_t contacts {0};        // Overlapping pairs found
+    size_t merged {0};
+    size_t bounced {0};
+};
+
+// Broad phase on a uniform grid with cells sorted by counting sort, rebuilt every step.
+// Cells are as wide as the largest regular body so overlaps are only searched in the
+// neighbouring cells. Bodies far bigger than average (merge products) are kept out of the
+// grid instead of inflating the cell size; they scan the cells they cover and are swept
+// against each other along x.
+// All buffers are kept between steps, a step allocates only while the body count grows.
+class CollisionSolver {
+
+public:
+    void setPolicy(CollisionPolicy policy) { m_policy = policy; }
+    CollisionPolicy getPolicy() const { return m_policy; }
+
+    // Find and resolve overlaps. Merged bodies are only flagged inactive, the caller
+    // removes them from the store.
+    void resolve(BodyStore& bodies, ThreadPool* pool = nullptr);
+    const CollisionStats& getLastStats() const { return m_stats; }
+
+private:
+    using Pair = std::pair<uint32_t, uint32_t>;
+
+    void buildGrid(const BodyStore& bodies, ThreadPool* pool);
+    void findPairs(const BodyStore& bodies, ThreadPool* pool);
+    // Clamped grid column or row of an offset from the grid origin
+    uint32_t cellCoordinate(float offset, uint32_t cells) const;
+    void testCell(const BodyStore& bodies, uint32_t body, uint32_t cell, uint32_t firstSlot, std::vector<Pair>& pairs, size_t& candidates) const;
+    void testPair(const BodyStore& bodies, uint32_t a, uint32_t b, std::vector<Pair>& pairs, size_t& candidates) const;
+    void mergePair(BodyStore& bodies, uint32_t a, uint32_t b);
+    void bouncePair(BodyStore& bodies, uint32_t a, uint32_t b);
+
+    struct WorkerState {
+        float minX, minY, maxX, maxY;
+        size_t candidates;
+        std::vector<Pair> pairs;
+    };
+
+    CollisionPolicy m_policy {CollisionPolicy::Ignore};
+    CollisionStats m_stats;
+
+    // Grid, rebuilt every step
+    float m_originX {0.0f};
+    float m_originY {0.0f};
+    float m_cellSize {1.0f};
+    float m_largeRadius {0.0f};             // Bodies with a bigger radius stay out of the grid
+    std::vector<double> m_radiusSums;       // Partial sums per grid task, added in index order
+    uint32_t m_columns {0};
+    uint32_t m_rows {0};
+    std::vector<uint32_t> m_bodyCells;      // Cell of every body, LARGE_BODY for bodies kept out of the grid
+    std::vector<uint32_t> m_cellStart;      // Prefix sum, slots of cell c are [m_cellStart[c], m_cellStart[c + 1])
+    std::vector<uint32_t> m_cellBodies;     // Body indices ordered by cell
+    std::vector<uint32_t> m_largeBodies;
+
+    std::vector<WorkerState> m_workers;
+    std::vector<Pair> m_pairs;
+};
+
+}
@@ -0,0 +1,136 @@
+#include "direct_solver.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+
+namespace physics {
+
+    // Interaction lists are padded to the widest SIMD kernel
+    const size_t SOURCE_LIST_PADDING = 8;
+    // Reduction and target subsets are cheap per body, use large tasks
+    const size_t BODY_TASK_SIZE = 1024;
+    const size_t TARGET_TASK_SIZE = 16;
+
+    void DirectSolver::computeForces(KernelIsa isa, const BodyStore& bodies, float* fx, float* fy, ThreadPool* pool) {
+        const auto count = bodies.size();
+        m_interactions = count > 0 ? static_cast<uint64_t>(count) * (count - 1) : 0;
+        if (count == 0) {
+            return;
+        }
+
+        if (m_deterministic) {
+            // Tiles are fixed ranges of bodies whoever runs them, each body sums its sources in list order
+            collectSources(bodies);
+            auto targetTiles = [this, isa, fx, fy, &bodies](size_t begin, size_t end, size_t) {
+                computeOneWay(isa, bodies, begin, end, fx, fy);
+            };
+            if (pool) {
+                pool->parallelFor(count, TILE_SIZE, targetTiles);
+            }
+            else {
+                targetTiles(0, count, 0);
+            }
+            return;
+        }
+
+        const auto tiles = static_cast<uint32_t>((count + TILE_SIZE - 1) / TILE_SIZE);
+        m_tilePairs.clear();
+        for (uint32_t i = 0; i < tiles; ++i) {
+            for (auto j = i; j < tiles; ++j) {
+                m_tilePairs.push_back(TilePair {i, j});
+            }
+        }
+
+        const auto workerCount = pool ? pool->getThreadCount() : 1;
+        m_workerFx.resize(workerCount);
+        m_workerFy.resize(workerCount);
+        for (size_t w = 0; w < workerCount; ++w) {
+            m_workerFx[w].assign(count, 0.0f);
+            m_workerFy[w].assign(count, 0.0f);
+        }
+
+        auto tileTasks = [this, isa, count, &bodies](size_t begin, size_t end, size_t worker) {
+            auto* accX = m_workerFx[worker].data();
+            auto* accY = m_workerFy[worker].data();
+            const auto gravity = m_parameters.gravity;
+            const auto softening = m_parameters.softening;
+            for (auto p = begin; p < end; ++p) {
+                const auto targetBegin = m_tilePairs[p].target * TILE_SIZE;
+                const auto targetEnd = std::min(targetBegin + TILE_SIZE, count);
+                const auto sourceBegin = m_tilePairs[p].source * TILE_SIZE;
+                const auto sourceEnd = std::min(sourceBegin + TILE_SIZE, count);
+
+                if (targetBegin != sourceBegin) {
+                    evaluateMutualInteractions(isa, gravity, softening,
+                        &bodies.x[targetBegin], &bodies.y[targetBegin], &bodies.mass[targetBegin], targetEnd - targetBegin,
+                        &accX[targetBegin], &accY[targetBegin],
+                        &bodies.x[sourceBegin], &bodies.y[sourceBegin], &bodies.mass[sourceBegin], sourceEnd - sourceBegin,
+                        &accX[sourceBegin], &accY[sourceBegin]);
+                    continue;
+                }
+                // Diagonal tile, each body against the ones after it
+                for (auto i = targetBegin; i + 1 < targetEnd; ++i) {
+                    evaluateMutualInteractions(isa, gravity, softening,
+                        &bodies.x[i], &bodies.y[i], &bodies.mass[i], 1, &accX[i], &accY[i],
+                        &bodies.x[i + 1], &bodies.y[i + 1], &bodies.mass[i + 1], targetEnd - i - 1,
+                        &accX[i + 1], &accY[i + 1]);
+                }
+            }
+        };
+
+        auto reduce = [this, fx, fy, workerCount](size_t begin, size_t end, size_t) {
+            for (size_t w = 0; w < workerCount; ++w) {
+                const auto* accX = m_workerFx[w].data();
+                const auto* accY = m_workerFy[w].data();
+                for (auto i = begin; i < end; ++i) {
+                    fx[i] += accX[i];
+                    fy[i] += accY[i];
+                }
+            }
+        };
+
+        if (pool) {
+            pool->parallelFor(m_tilePairs.size(), 1, tileTasks);
+            pool->parallelFor(count, BODY_TASK_SIZE, reduce);
+        }
+        else {
+            tileTasks(0, m_tilePairs.size(), 0);
+            reduce(0, count, 0);
+        }
+    }
+
+    void DirectSolver::computeForces(KernelIsa isa, const BodyStore& bodies, const uint32_t* targets, size_t count,
+                                     float* fx, float* fy, ThreadPool* pool) {
+        m_interactions = static_cast<uint64_t>(count) * bodies.size();
+        collectSources(bodies);
+
+        // Too few targets for the third law to pay off, the shared list is read only
+        auto targetTasks = [this, isa, targets, fx, fy, &bodies](size_t begin, size_t end, size_t) {
+            for (auto k = begin; k < end; ++k) {
+                const auto i = targets[k];
+                computeOneWay(isa, bodies, i, i + 1, fx, fy);
+            }
+        };
+        if (pool) {
+            pool->parallelFor(count, TARGET_TASK_SIZE, targetTasks);
+        }
+        else {
+            targetTasks(0, count, 0);
+        }
+    }
+
+    void DirectSolver::computeOneWay(KernelIsa isa, const BodyStore& bodies, size_t begin, size_t end, float* fx, float* fy) {
+        // The zero distance self pair is masked by the kernel
+        evaluateInteractions(isa, m_sources, m_parameters.gravity, &bodies.x[begin], &bodies.y[begin], &bodies.mass[begin], end - begin,
+                             &fx[begin], &fy[begin]);
+    }
+
+    void DirectSolver::collectSources(const BodyStore& bodies) {
+        m_sources.clear();
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            m_sources.add(bodies.position(i), bodies.mass[i], m_parameters.softening);
+        }
+        m_sources.pad(SOURCE_LIST_PADDING);
+    }
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "body_store.h"
+#include "force_kernels.h"
+#include "simulation_parameters.h"
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+namespace physics {
+
+// Exact O(n^2) summation of the softened pair force, the reference for the approximate engines
+// and the fastest choice for a few thousand bodies since it needs no tree.
+//
+// Bodies are cut into tiles that fit in L1; every tile pair (I, J) with I <= J is one task
+// and evaluates each body pair once, writing the reaction with Newton's third law. Tasks add
+// into per worker force arrays, summed into the result at the end.
+//
+// Which worker gets a tile pair, and so the order forces are added in, depends on the
+// thread count. The deterministic mode gives that up: every tile of targets sums the
+// whole body list one way, twice the work but the same bits for any number of threads.
+class DirectSolver {
+
+public:
+    static constexpr size_t TILE_SIZE = 512;
+
+    void setParameters(const SimulationParameters& parameters) { m_parameters = parameters; }
+    void setDeterministic(bool deterministic) { m_deterministic = deterministic; }
+    bool isDeterministic() const { return m_deterministic; }
+
+    // Add the force on every body to fx, fy
+    void computeForces(KernelIsa isa, const BodyStore& bodies, float* fx, float* fy, ThreadPool* pool = nullptr);
+    // Add the force on the listed bodies only, one way against all bodies
+    void computeForces(KernelIsa isa, const BodyStore& bodies, const uint32_t* targets, size_t count,
+                       float* fx, float* fy, ThreadPool* pool = nullptr);
+
+    // Target-source pairs of the last call, twice the evaluated pairs for a full pass
+    uint64_t getLastInteractions() const { return m_interactions; }
+
+private:
+    struct TilePair {
+        uint32_t target;
+        uint32_t source;
+    };
+
+    // One way pass of targets [begin, end) against m_sources
+    void computeOneWay(KernelIsa isa, const BodyStore& bodies, size_t begin, size_t end, float* fx, float* fy);
+    void collectSources(const BodyStore& bodies);
+
+    SimulationParameters m_parameters;
+    bool m_deterministic {false};
+    std::vector<TilePair> m_tilePairs;
+    std::vector<std::vector<float>> m_workerFx, m_workerFy;
+    InteractionList m_sources;              // All bodies, for target subsets and the deterministic mode
+    uint64_t m_interactions {0};
+};
+
+}
@@ -0,0 +1,497 @@
+#include "distributed_simulation.h"
+#include "base/profiler.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <thread>
+
+namespace physics {
+
+    // Integration is a cheap streaming loop, use large tasks
+    const size_t DISTRIBUTED_INTEGRATION_TASK_SIZE = 4096;
+    // Consecutive (Morton ordered) bodies sharing one interaction list, as in NBodySimulation
+    const size_t INTERACTION_GROUP_SIZE = 16;
+    // Interaction lists are padded to the widest SIMD kernel
+    const size_t INTERACTION_LIST_PADDING = 8;
+    // Bodies per force task, small enough for dense regions to be shared out by stealing
+    const size_t DISTRIBUTED_FORCE_TASK_SIZE = 4 * INTERACTION_GROUP_SIZE;
+    // Root headroom and smallest half extent, as for the single process tree
+    const float SOURCE_BOUNDARY_MARGIN = 0.05f;
+    const float MIN_SOURCE_HALF_DIMENSION = 1.0f;
+
+    namespace {
+        bool fail(std::string* error, const std::string& message) {
+            if (error) {
+                *error = message;
+            }
+            return false;
+        }
+
+        // Adds the lifetime of the scope to one of the step timings
+        class ScopedPhase {
+
+        public:
+            ScopedPhase(const char* name, double& seconds) : m_seconds(seconds), m_start(std::chrono::steady_clock::now()), m_profile(name) {}
+            ~ScopedPhase() { m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count(); }
+
+        private:
+            double& m_seconds;
+            std::chrono::steady_clock::time_point m_start;
+            ProfileScope m_profile;
+        };
+
+        // Wire formats, all ranks run the same binary so structs are copied as they are
+        struct RankBounds {
+            float minX, minY, maxX, maxY;
+        };
+
+        struct Particle {
+            float x, y, mass;
+        };
+
+        struct BodyRecord {
+            float x, y, vx, vy, fx, fy, mass, radius;
+            uint32_t id;
+        };
+
+        struct LoadReport {
+            double forceSeconds;
+            uint64_t bodyCount;
+        };
+
+        struct WeightedSample {
+            float x, y, weight;
+        };
+
+        template<typename T>
+        void append(Transport::Message& message, const T& value) {
+            const auto offset = message.size();
+            message.resize(offset + sizeof(T));
+            std::memcpy(message.data() + offset, &value, sizeof(T));
+        }
+
+        template<typename T>
+        bool recordCount(const Transport::Message& message, size_t& count) {
+            count = message.size() / sizeof(T);
+            return message.size() % sizeof(T) == 0;
+        }
+
+        template<typename T>
+        T recordAt(const Transport::Message& message, size_t index) {
+            T value;
+            std::memcpy(&value, message.data() + index * sizeof(T), sizeof(T));
+            return value;
+        }
+
+        BodyRecord recordOf(const BodyStore& bodies, size_t i) {
+            return {bodies.x[i], bodies.y[i], bodies.vx[i], bodies.vy[i], bodies.fx[i], bodies.fy[i], bodies.mass[i], bodies.radius[i], bodies.id[i]};
+        }
+
+        void appendBody(BodyStore& bodies, const BodyRecord& record) {
+            bodies.x.push_back(record.x);
+            bodies.y.push_back(record.y);
+            bodies.vx.push_back(record.vx);
+            bodies.vy.push_back(record.vy);
+            bodies.fx.push_back(record.fx);
+            bodies.fy.push_back(record.fy);
+            bodies.mass.push_back(record.mass);
+            bodies.radius.push_back(record.radius);
+            bodies.active.push_back(1);
+            bodies.timeBin.push_back(0);
+            bodies.id.push_back(record.id);
+        }
+
+        // Square cell around all positions, the tree and the Morton keys assume one
+        AABB fitBoundary(const std::vector<float>& x, const std::vector<float>& y) {
+            glm::vec2 minimum(std::numeric_limits<float>::max());
+            glm::vec2 maximum(std::numeric_limits<float>::lowest());
+            for (size_t i = 0; i < x.size(); ++i) {
+                minimum = glm::vec2(std::min(minimum.x, x[i]), std::min(minimum.y, y[i]));
+                maximum = glm::vec2(std::max(maximum.x, x[i]), std::max(maximum.y, y[i]));
+            }
+            const auto center = (minimum + maximum) * 0.5f;
+            const auto halfDimension = std::max(maximum.x - minimum.x, maximum.y - minimum.y) / 2;
+            return AABB(center, std::max(halfDimension * (1.0f + SOURCE_BOUNDARY_MARGIN), MIN_SOURCE_HALF_DIMENSION));
+        }
+
+        // Every stride-th body, weighted by the bodies it stands for
+        void sampleBodies(const BodyStore& bodies, size_t sampleCount, float weightPerBody, std::vector<DomainDecomposition::Sample>& samples) {
+            if (bodies.empty() || sampleCount == 0) {
+                return;
+            }
+            const auto stride = std::max<size_t>(bodies.size() / sampleCount, 1);
+            for (size_t i = 0; i < bodies.size(); i += stride) {
+                const auto represented = std::min(stride, bodies.size() - i);
+                samples.push_back({bodies.position(i), weightPerBody * static_cast<float>(represented)});
+            }
+        }
+    }
+
+    DistributedSimulation::DistributedSimulation(Transport& transport, const SimulationParameters& parameters, size_t threadCount)
+        : m_transport(transport)
+        , m_parameters(parameters)
+        , m_threadPool(std::make_unique<ThreadPool>(threadCount == 0 ? std::thread::hardware_concurrency() : threadCount))
+        , m_localTree(AABB(glm::vec2(0.0f), MIN_SOURCE_HALF_DIMENSION))
+        , m_sourceTree(AABB(glm::vec2(0.0f), MIN_SOURCE_HALF_DIMENSION))
+        , m_kernelIsa(detectKernelIsa()) {
+        m_interactionLists.resize(m_threadPool->getThreadCount());
+        m_localTree.setParameters(m_parameters);
+        m_sourceTree.setParameters(m_parameters);
+    }
+
+    DistributedSimulation::~DistributedSimulation() = default;
+
+    void DistributedSimulation::setBodies(const BodyStore& bodies) {
+        // Same bodies and the same samples on every rank, so all ranks agree on the split
+        std::vector<DomainDecomposition::Sample> samples;
+        sampleBodies(bodies, REBALANCE_SAMPLES, 1.0f, samples);
+        m_decomposition.split(samples, m_transport.getRankCount());
+
+        m_bodies.clear();
+        const auto rank = m_transport.getRank();
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            if (m_decomposition.findRank(bodies.position(i)) == rank) {
+                appendBody(m_bodies, recordOf(bodies, i));
+                m_bodies.fx.back() = 0.0f;
+                m_bodies.fy.back() = 0.0f;
+            }
+        }
+        m_forcesValid = false;
+        m_stepsSinceRebalance = 0;
+    }
+
+    bool DistributedSimulation::step(float dt, std::string* error) {
+        m_lastStepStats = DistributedStepStats {};
+        if (!m_forcesValid && !computeForces(error)) {
+            return false;
+        }
+
+        kick(dt / 2);
+        drift(dt);
+        m_forcesValid = false;
+        if (!migrate(error) || !computeForces(error)) {
+            return false;
+        }
+        kick(dt / 2);
+
+        ++m_stepsSinceRebalance;
+        if (!balance(error)) {
+            return false;
+        }
+        m_lastStepStats.localBodies = m_bodies.size();
+        return true;
+    }
+
+    bool DistributedSimulation::computeForces(std::string* error) {
+        if (!exchangeLocallyEssentialTrees(error)) {
+            return false;
+        }
+        buildSourceTree();
+
+        // Local bodies are in Z order, so consecutive ones share an interaction list
+        ScopedPhase phase("force", m_lastStepStats.forceSeconds);
+        if (m_sources.empty()) {
+            return true;
+        }
+        m_threadPool->parallelFor(m_bodies.size(), DISTRIBUTED_FORCE_TASK_SIZE, [this](size_t begin, size_t end, size_t worker) {
+            auto& list = m_interactionLists[worker];
+            for (auto groupBegin = begin; groupBegin < end; groupBegin += INTERACTION_GROUP_SIZE) {
+                const auto groupEnd = std::min(groupBegin + INTERACTION_GROUP_SIZE, end);
+                glm::vec2 groupMin = m_bodies.position(groupBegin);
+                glm::vec2 groupMax = groupMin;
+                for (auto i = groupBegin + 1; i < groupEnd; ++i) {
+                    groupMin = glm::vec2(std::min(groupMin.x, m_bodies.x[i]), std::min(groupMin.y, m_bodies.y[i]));
+                    groupMax = glm::vec2(std::max(groupMax.x, m_bodies.x[i]), std::max(groupMax.y, m_bodies.y[i]));
+                }
+
+                list.clear();
+                m_sourceTree.collectInteractions(groupMin, groupMax, list);
+                list.pad(INTERACTION_LIST_PADDING);
+                std::fill(m_bodies.fx.begin() + groupBegin, m_bodies.fx.begin() + groupEnd, 0.0f);
+                std::fill(m_bodies.fy.begin() + groupBegin, m_bodies.fy.begin() + groupEnd, 0.0f);
+                evaluateInteractions(m_kernelIsa, list, m_parameters.gravity,
+                                     &m_bodies.x[groupBegin], &m_bodies.y[groupBegin], &m_bodies.mass[groupBegin], groupEnd - groupBegin,
+                                     &m_bodies.fx[groupBegin], &m_bodies.fy[groupBegin]);
+            }
+        });
+        m_forcesValid = true;
+        return true;
+    }
+
+    bool DistributedSimulation::exchangeLocallyEssentialTrees(std::string* error) {
+        const auto rankCount = m_transport.getRankCount();
+        const auto self = m_transport.getRank();
+
+        {
+            ScopedPhase phase("tree build", m_lastStepStats.buildSeconds);
+            if (!m_bodies.empty()) {
+                // Z order keeps the local tree build linear and the later walks cache friendly
+                const auto boundary = fitBoundary(m_bodies.x, m_bodies.y);
+                m_localOrder.sort(m_bodies.x, m_bodies.y, boundary, m_threadPool.get());
+                m_bodies.permute(m_localOrder.getOrder(), m_threadPool.get());
+                m_localTree.build(boundary, m_localOrder.getKeys(), m_bodies, m_threadPool.get());
+            }
+        }
+
+        RankBounds bounds {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                           std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+        for (size_t i = 0; i < m_bodies.size(); ++i) {
+            bounds.minX = std::min(bounds.minX, m_bodies.x[i]);
+            bounds.minY = std::min(bounds.minY, m_bodies.y[i]);
+            bounds.maxX = std::max(bounds.maxX, m_bodies.x[i]);
+            bounds.maxY = std::max(bounds.maxY, m_bodies.y[i]);
+        }
+        Transport::Message message;
+        append(message, bounds);
+        if (!allGather(message, error)) {
+            return false;
+        }
+        m_rankMin.assign(rankCount, glm::vec2(0.0f));
+        m_rankMax.assign(rankCount, glm::vec2(0.0f));
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            if (m_incoming[rank].size() != sizeof(RankBounds)) {
+                return fail(error, "malformed bounds from rank " + std::to_string(rank));
+            }
+            const auto remote = recordAt<RankBounds>(m_incoming[rank], 0);
+            m_rankMin[rank] = glm::vec2(remote.minX, remote.minY);
+            m_rankMax[rank] = glm::vec2(remote.maxX, remote.maxY);
+        }
+
+        // Everything a body anywhere in the remote box needs from here, at the remote's own accuracy
+        m_outgoing.assign(rankCount, Transport::Message {});
+        size_t exported = 0;
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            const auto emptyRemote = m_rankMin[rank].x > m_rankMax[rank].x;
+            if (rank == self || emptyRemote || m_bodies.empty()) {
+                continue;
+            }
+            m_exportList.clear();
+            m_localTree.collectInteractions(m_rankMin[rank], m_rankMax[rank], m_exportList);
+            auto& outgoing = m_outgoing[rank];
+            outgoing.reserve(m_exportList.size() * sizeof(Particle));
+            for (size_t i = 0; i < m_exportList.x.size(); ++i) {
+                append(outgoing, Particle {m_exportList.x[i], m_exportList.y[i], m_exportList.mass[i]});
+            }
+            const auto& quadrupoles = m_exportList.quadrupoles;
+            for (size_t i = 0; i < quadrupoles.size(); ++i) {
+                append(outgoing, Particle {quadrupoles.x[i], quadrupoles.y[i], quadrupoles.mass[i]});
+            }
+            exported += m_exportList.size();
+        }
+        m_lastStepStats.exportedParticles += exported;
+        if (!exchange(error)) {
+            return false;
+        }
+
+        m_sourceX.assign(m_bodies.x.begin(), m_bodies.x.end());
+        m_sourceY.assign(m_bodies.y.begin(), m_bodies.y.end());
+        m_sourceMass.assign(m_bodies.mass.begin(), m_bodies.mass.end());
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            if (rank == self) {
+                continue;
+            }
+            size_t count = 0;
+            if (!recordCount<Particle>(m_incoming[rank], count)) {
+                return fail(error, "malformed tree export from rank " + std::to_string(rank));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                const auto particle = recordAt<Particle>(m_incoming[rank], i);
+                m_sourceX.push_back(particle.x);
+                m_sourceY.push_back(particle.y);
+                m_sourceMass.push_back(particle.mass);
+            }
+            m_lastStepStats.importedParticles += count;
+        }
+        return true;
+    }
+
+    void DistributedSimulation::buildSourceTree() {
+        ScopedPhase phase("tree build", m_lastStepStats.buildSeconds);
+        const auto count = m_sourceX.size();
+        m_sources.clear();
+        if (count == 0) {
+            return;
+        }
+
+        // The tree only reads positions and masses, the other arrays stay empty
+        const auto boundary = fitBoundary(m_sourceX, m_sourceY);
+        m_sourceOrder.sort(m_sourceX, m_sourceY, boundary, m_threadPool.get());
+        const auto& order = m_sourceOrder.getOrder();
+        m_sources.x.resize(count);
+        m_sources.y.resize(count);
+        m_sources.mass.resize(count);
+        m_threadPool->parallelFor(count, DISTRIBUTED_INTEGRATION_TASK_SIZE, [this, &order](size_t begin, size_t end, size_t) {
+            for (auto s = begin; s < end; ++s) {
+                const auto from = order[s];
+                m_sources.x[s] = m_sourceX[from];
+                m_sources.y[s] = m_sourceY[from];
+                m_sources.mass[s] = m_sourceMass[from];
+            }
+        });
+        m_sourceTree.build(boundary, m_sourceOrder.getKeys(), m_sources, m_threadPool.get());
+    }
+
+    bool DistributedSimulation::migrate(std::string* error) {
+        const auto rankCount = m_transport.getRankCount();
+        const auto self = m_transport.getRank();
+        m_outgoing.assign(rankCount, Transport::Message {});
+        size_t migrated = 0;
+        for (size_t i = 0; i < m_bodies.size(); ++i) {
+            const auto owner = m_decomposition.findRank(m_bodies.position(i));
+            if (owner != self) {
+                append(m_outgoing[owner], recordOf(m_bodies, i));
+                m_bodies.active[i] = 0;
+                ++migrated;
+            }
+        }
+        if (!exchange(error)) {
+            return false;
+        }
+
+        if (migrated > 0) {
+            m_bodies.removeInactive(m_migrated);
+            m_migrated.clear();
+        }
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            if (rank == self) {
+                continue;
+            }
+            size_t count = 0;
+            if (!recordCount<BodyRecord>(m_incoming[rank], count)) {
+                return fail(error, "malformed bodies from rank " + std::to_string(rank));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                appendBody(m_bodies, recordAt<BodyRecord>(m_incoming[rank], i));
+            }
+        }
+        m_lastStepStats.migratedBodies += migrated;
+        return true;
+    }
+
+    bool DistributedSimulation::balance(std::string* error) {
+        const auto rankCount = m_transport.getRankCount();
+        Transport::Message message;
+        append(message, LoadReport {m_lastStepStats.forceSeconds, m_bodies.size()});
+        if (!allGather(message, error)) {
+            return false;
+        }
+
+        double total = 0.0;
+        double slowest = 0.0;
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            if (m_incoming[rank].size() != sizeof(LoadReport)) {
+                return fail(error, "malformed load report from rank " + std::to_string(rank));
+            }
+            const auto report = recordAt<LoadReport>(m_incoming[rank], 0);
+            total += report.forceSeconds;
+            slowest = std::max(slowest, report.forceSeconds);
+        }
+        // Every rank saw the same reports, so all take the same branch
+        const auto mean = total / rankCount;
+        if (m_rebalanceThreshold <= 0.0f || m_stepsSinceRebalance < MIN_REBALANCE_INTERVAL || mean <= 0.0 ||
+            slowest / mean - 1.0 <= m_rebalanceThreshold) {
+            return true;
+        }
+
+        // A body weighs its rank's mean force time, so the cuts even out time rather than count
+        std::vector<DomainDecomposition::Sample> samples;
+        const auto weightPerBody = m_bodies.empty() ? 0.0f : static_cast<float>(m_lastStepStats.forceSeconds / m_bodies.size());
+        sampleBodies(m_bodies, REBALANCE_SAMPLES / rankCount, weightPerBody, samples);
+        message.clear();
+        for (const auto& sample : samples) {
+            append(message, WeightedSample {sample.position.x, sample.position.y, sample.weight});
+        }
+        if (!allGather(message, error)) {
+            return false;
+        }
+
+        // Concatenated in rank order, identical on every rank
+        samples.clear();
+        for (auto rank = 0; rank < rankCount; ++rank) {
+            size_t count = 0;
+            if (!recordCount<WeightedSample>(m_incoming[rank], count)) {
+                return fail(error, "malformed samples from rank " + std::to_string(rank));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                const auto sample = recordAt<WeightedSample>(m_incoming[rank], i);
+                samples.push_back({glm::vec2(sample.x, sample.y), sample.weight});
+            }
+        }
+        m_decomposition.split(samples, rankCount);
+        // Forces travel with the bodies, they stay valid
+        if (!migrate(error)) {
+            return false;
+        }
+        m_stepsSinceRebalance = 0;
+        ++m_rebalanceCount;
+        m_lastStepStats.rebalanced = true;
+        return true;
+    }
+
+    bool DistributedSimulation::gather(BodyStore& bodies, std::string* error) {
+        m_outgoing.assign(m_transport.getRankCount(), Transport::Message {});
+        auto& outgoing = m_outgoing[0];
+        outgoing.reserve(m_bodies.size() * sizeof(BodyRecord));
+        for (size_t i = 0; i < m_bodies.size(); ++i) {
+            append(outgoing, recordOf(m_bodies, i));
+        }
+        if (!exchange(error)) {
+            return false;
+        }
+
+        bodies.clear();
+        if (m_transport.getRank() != 0) {
+            return true;
+        }
+        for (size_t rank = 0; rank < m_incoming.size(); ++rank) {
+            size_t count = 0;
+            if (!recordCount<BodyRecord>(m_incoming[rank], count)) {
+                return fail(error, "malformed bodies from rank " + std::to_string(rank));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                appendBody(bodies, recordAt<BodyRecord>(m_incoming[rank], i));
+            }
+        }
+
+        std::vector<uint32_t> order(bodies.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [&bodies](uint32_t a, uint32_t b) { return bodies.id[a] < bodies.id[b]; });
+        bodies.permute(order);
+        bodies.restoreIds(bodies.empty() ? 0 : bodies.id.back() + 1);
+        return true;
+    }
+
+    void DistributedSimulation::kick(float dt) {
+        ScopedPhase phase("integrate", m_lastStepStats.integrateSeconds);
+        m_threadPool->parallelFor(m_bodies.size(), DISTRIBUTED_INTEGRATION_TASK_SIZE, [this, dt](size_t begin, size_t end, size_t) {
+            for (auto i = begin; i < end; ++i) {
+                m_bodies.vx[i] += m_bodies.fx[i] / m_bodies.mass[i] * dt;
+                m_bodies.vy[i] += m_bodies.fy[i] / m_bodies.mass[i] * dt;
+            }
+        });
+    }
+
+    void DistributedSimulation::drift(float dt) {
+        ScopedPhase phase("integrate", m_lastStepStats.integrateSeconds);
+        m_threadPool->parallelFor(m_bodies.size(), DISTRIBUTED_INTEGRATION_TASK_SIZE, [this, dt](size_t begin, size_t end, size_t) {
+            for (auto i = begin; i < end; ++i) {
+                m_bodies.x[i] += m_bodies.vx[i] * dt;
+                m_bodies.y[i] += m_bodies.vy[i] * dt;
+            }
+        });
+    }
+
+    bool DistributedSimulation::exchange(std::string* error) {
+        ScopedPhase phase("exchange", m_lastStepStats.exchangeSeconds);
+        return m_transport.exchange(m_outgoing, m_incoming, error);
+    }
+
+    bool DistributedSimulation::allGather(const Transport::Message& message, std::string* error) {
+        ScopedPhase phase("exchange", m_lastStepStats.exchangeSeconds);
+        return m_transport.allGather(message, m_incoming, error);
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "bh_arena_tree.h"
+#include "body_store.h"
+#include "domain_decomposition.h"
+#include "force_kernels.h"
+#include "morton_order.h"
+#include "simulation_parameters.h"
+#include "io/transport.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+namespace physics {
+
+// Timings and traffic of one rank over the last step
+struct DistributedStepStats {
+    double buildSeconds {0.0};          // Local and combined tree builds
+    double forceSeconds {0.0};          // Force walks of the local bodies, the cost rebalancing evens out
+    double exchangeSeconds {0.0};       // Waiting for and copying messages, imbalance shows up here
+    double integrateSeconds {0.0};
+    size_t localBodies {0};
+    size_t exportedParticles {0};       // Pseudo-particles sent, summed over the other ranks
+    size_t importedParticles {0};
+    size_t migratedBodies {0};          // Bodies handed to other ranks
+    bool rebalanced {false};
+};
+
+// One rank of a simulation split across processes.
+// Bodies are divided between ranks by a DomainDecomposition. For the forces, every rank builds a
+// tree of its own bodies and exports to each other rank the nodes and bodies that the Barnes-Hut
+// criterion needs for any point inside that rank's bounding box, its locally essential tree.
+// Imported pseudo-particles go into a second tree together with the local bodies, and groups of
+// local bodies collect their interaction lists from that tree. Exported nodes act as point
+// masses, the quadrupole of a remote node is not carried over. Bodies leaving their region move
+// to the owner after every drift, and the regions are split again from measured force times
+// once the slowest rank falls behind.
+// Leapfrog integration with a global step, no collisions; the RelativeForce criterion acts as Geometric.
+// Every method but the getters is collective: all ranks call it in the same order.
+class DistributedSimulation {
+
+public:
+    static constexpr float DEFAULT_REBALANCE_THRESHOLD = 0.1f;
+    // Rebalancing moves bodies around, give the previous split time to pay off
+    static constexpr uint32_t MIN_REBALANCE_INTERVAL = 10;
+    // Positions all ranks sample together to place the cuts
+    static constexpr size_t REBALANCE_SAMPLES = 16384;
+
+    // 0 threads selects std::thread::hardware_concurrency()
+    DistributedSimulation(Transport& transport, const SimulationParameters& parameters = SimulationParameters {}, size_t threadCount = 0);
+    ~DistributedSimulation();
+    DistributedSimulation(const DistributedSimulation&) = delete;
+    DistributedSimulation& operator=(const DistributedSimulation&) = delete;
+
+    // Every rank passes the same bodies and keeps those of its region, regions split by body count.
+    // Local bodies keep their ids
+    void setBodies(const BodyStore& bodies);
+    bool step(float dt, std::string* error = nullptr);
+    // Split again when the slowest rank's force time exceeds the mean by this fraction, 0 never does
+    void setRebalanceThreshold(float threshold) { m_rebalanceThreshold = threshold; }
+    float getRebalanceThreshold() const { return m_rebalanceThreshold; }
+
+    // Local bodies, force arrays hold the forces of the last evaluation
+    const BodyStore& getBodies() const { return m_bodies; }
+    const DistributedStepStats& getLastStepStats() const { return m_lastStepStats; }
+    uint32_t getRebalanceCount() const { return m_rebalanceCount; }
+    const Transport& getTransport() const { return m_transport; }
+    const ThreadPool& getThreadPool() const { return *m_threadPool; }
+
+    // Forces of the current positions, without moving anything
+    bool computeForces(std::string* error = nullptr);
+    // Rank 0 receives the bodies of all ranks in id order, forces included; the others get none
+    bool gather(BodyStore& bodies, std::string* error = nullptr);
+
+private:
+    // Share bounding boxes, then send every rank the part of the local tree it needs
+    bool exchangeLocallyEssentialTrees(std::string* error);
+    void buildSourceTree();
+    // Hand bodies outside this rank's region to their owners
+    bool migrate(std::string* error);
+    // Share force times, split again if they drifted apart
+    bool balance(std::string* error);
+    void kick(float dt);
+    void drift(float dt);
+    // Timed collectives, the time goes into exchangeSeconds
+    bool exchange(std::string* error);
+    bool allGather(const Transport::Message& message, std::string* error);
+
+    Transport& m_transport;
+    SimulationParameters m_parameters;
+    std::unique_ptr<ThreadPool> m_threadPool;
+    DomainDecomposition m_decomposition;
+    BodyStore m_bodies;
+    bool m_forcesValid {false};
+
+    // Local tree, the source of the exports
+    MortonOrder m_localOrder;
+    BHArenaTree m_localTree;
+    InteractionList m_exportList;
+    // Local bodies followed by imported pseudo-particles, as gathered
+    std::vector<float> m_sourceX, m_sourceY, m_sourceMass;
+    // The same in Morton order, only positions and masses, walked by the local bodies
+    MortonOrder m_sourceOrder;
+    BodyStore m_sources;
+    BHArenaTree m_sourceTree;
+    KernelIsa m_kernelIsa;
+    std::vector<InteractionList> m_interactionLists;    // One per worker
+    // Bounding box of the bodies of every rank, an empty rank has min above max
+    std::vector<glm::vec2> m_rankMin, m_rankMax;
+
+    std::vector<Transport::Message> m_outgoing;
+    std::vector<Transport::Message> m_incoming;
+    std::vector<RetiredBody> m_migrated;
+
+    float m_rebalanceThreshold {DEFAULT_REBALANCE_THRESHOLD};
+    uint32_t m_stepsSinceRebalance {0};
+    uint32_t m_rebalanceCount {0};
+    DistributedStepStats m_lastStepStats;
+};
+
+}
@@ -0,0 +1,80 @@
+#include "domain_decomposition.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace physics {
+
+    DomainDecomposition::DomainDecomposition() {
+        m_cuts.push_back(Cut {0, 0.0f, -1, -1, 0});
+    }
+
+    void DomainDecomposition::split(std::vector<Sample>& samples, int rankCount) {
+        m_rankCount = std::max(rankCount, 1);
+        m_cuts.clear();
+        splitRange(samples, 0, samples.size(), 0, m_rankCount);
+    }
+
+    int DomainDecomposition::findRank(const glm::vec2& position) const {
+        auto index = 0;
+        while (m_cuts[index].rank < 0) {
+            const auto& cut = m_cuts[index];
+            index = position[cut.axis] < cut.value ? cut.low : cut.high;
+        }
+        return m_cuts[index].rank;
+    }
+
+    int32_t DomainDecomposition::splitRange(std::vector<Sample>& samples, size_t begin, size_t end, int firstRank, int rankCount) {
+        const auto index = static_cast<int32_t>(m_cuts.size());
+        m_cuts.push_back(Cut {0, 0.0f, -1, -1, rankCount == 1 ? firstRank : -1});
+        if (rankCount == 1) {
+            return index;
+        }
+
+        const auto lowRanks = rankCount / 2;
+        auto axis = 0;
+        size_t middle = begin;
+        float value = std::numeric_limits<float>::max();    // Without samples everything goes low
+        if (end > begin) {
+            glm::vec2 low(std::numeric_limits<float>::max());
+            glm::vec2 high(std::numeric_limits<float>::lowest());
+            auto totalWeight = 0.0;
+            for (auto i = begin; i < end; ++i) {
+                const auto& position = samples[i].position;
+                low = glm::vec2(std::min(low.x, position.x), std::min(low.y, position.y));
+                high = glm::vec2(std::max(high.x, position.x), std::max(high.y, position.y));
+                totalWeight += samples[i].weight;
+            }
+            axis = high.y - low.y > high.x - low.x ? 1 : 0;
+            const auto other = 1 - axis;
+            // Ties broken on the other axis, so every rank sorts identically
+            std::sort(samples.begin() + begin, samples.begin() + end, [axis, other](const Sample& a, const Sample& b) {
+                return a.position[axis] < b.position[axis] || (a.position[axis] == b.position[axis] && a.position[other] < b.position[other]);
+            });
+
+            // First sample past the low share of the weight
+            const auto target = totalWeight * lowRanks / rankCount;
+            auto weight = 0.0;
+            middle = begin;
+            while (middle < end && weight + samples[middle].weight <= target) {
+                weight += samples[middle].weight;
+                ++middle;
+            }
+            if (middle == end) {
+                value = std::numeric_limits<float>::max();
+            }
+            else if (middle == begin) {
+                value = samples[begin].position[axis];
+            }
+            else {
+                value = 0.5f * (samples[middle - 1].position[axis] + samples[middle].position[axis]);
+            }
+        }
+
+        const auto low = splitRange(samples, begin, middle, firstRank, lowRanks);
+        const auto high = splitRange(samples, middle, end, firstRank + lowRanks, rankCount - lowRanks);
+        m_cuts[index] = Cut {axis, value, low, high, -1};
+        return index;
+    }
+
+}
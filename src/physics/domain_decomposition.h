@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace physics {
+
+// Orthogonal recursive bisection of the plane into one region per rank.
+// Every split cuts the wider side of its samples at the point where the weight is divided in
+// proportion to the ranks on either side, so each rank ends up with about the same total
+// weight. Regions are unbounded on the outside: every position belongs to exactly one rank.
+// The split is deterministic, ranks given the same samples in the same order agree on it.
+class DomainDecomposition {
+
+public:
+    struct Sample {
+        glm::vec2 position;
+        float weight;                   // Expected cost of the bodies the sample stands for
+    };
+
+    // One rank owning the whole plane until split() is called
+    DomainDecomposition();
+
+    // Samples are reordered
+    void split(std::vector<Sample>& samples, int rankCount);
+    int findRank(const glm::vec2& position) const;
+    int getRankCount() const { return m_rankCount; }
+
+private:
+    struct Cut {
+        int axis;                       // 0 splits along x, 1 along y
+        float value;                    // Positions below go to low
+        int32_t low;
+        int32_t high;
+        int rank;                       // Leaf owning the region, -1 for an inner cut
+    };
+
+    int32_t splitRange(std::vector<Sample>& samples, size_t begin, size_t end, int firstRank, int rankCount);
+
+    std::vector<Cut> m_cuts;
+    int m_rankCount {1};
+};
+
+}
@@ -0,0 +1,478 @@
+#include "fmm_solver.h"
+#include "morton_order.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace physics {
+
+    // Interaction lists are padded to the widest SIMD kernel
+    const size_t DIRECT_LIST_PADDING = 8;
+
+    namespace {
+        constexpr size_t TABLE_SIZE = FmmSolver::MAX_ORDER + 1;
+
+        struct ExpansionTables {
+            double inverseFactorial[TABLE_SIZE];
+            double binomial[TABLE_SIZE][TABLE_SIZE];
+
+            ExpansionTables() {
+                inverseFactorial[0] = 1.0;
+                for (size_t n = 1; n < TABLE_SIZE; ++n) {
+                    inverseFactorial[n] = inverseFactorial[n - 1] / static_cast<double>(n);
+                }
+                for (size_t n = 0; n < TABLE_SIZE; ++n) {
+                    binomial[n][0] = 1.0;
+                    for (size_t k = 1; k < TABLE_SIZE; ++k) {
+                        binomial[n][k] = k > n ? 0.0 : binomial[n][k - 1] * static_cast<double>(n - k + 1) / static_cast<double>(k);
+                    }
+                }
+            }
+        };
+
+        const ExpansionTables& tables() {
+            static const ExpansionTables instance;
+            return instance;
+        }
+
+        // Coefficient of x^a y^b, grouped by total order a + b
+        inline size_t coefficient(uint32_t a, uint32_t b) {
+            const auto n = a + b;
+            return n * (n + 1) / 2 + b;
+        }
+
+        void powers(double value, uint32_t order, double* result) {
+            result[0] = 1.0;
+            for (uint32_t n = 1; n <= order; ++n) {
+                result[n] = result[n - 1] * value;
+            }
+        }
+
+        // Cartesian derivatives d^(a+b) / dx^a dy^b of 1/r at (x, y), a + b <= order, with the
+        // McMurchie-Davidson recurrence over auxiliary levels m:
+        //   R(m; 0, 0) = (-1)^m (2m - 1)!! / r^(2m + 1)
+        //   R(m; a, b) = x R(m + 1; a - 1, b) + (a - 1) R(m + 1; a - 2, b)    (same in y for a = 0)
+        // table holds (order + 1) levels of coefficients, level 0 is the result
+        void inverseDistanceDerivatives(double x, double y, uint32_t order, size_t coefficients, double* table) {
+            const auto invDistanceSq = 1.0 / (x * x + y * y);
+            table[0] = std::sqrt(invDistanceSq);
+            for (uint32_t m = 1; m <= order; ++m) {
+                table[m * coefficients] = -static_cast<double>(2 * m - 1) * invDistanceSq * table[(m - 1) * coefficients];
+            }
+
+            for (uint32_t n = 1; n <= order; ++n) {
+                for (uint32_t m = 0; m + n <= order; ++m) {
+                    auto* level = table + m * coefficients;
+                    const auto* next = level + coefficients;
+                    for (uint32_t b = 0; b <= n; ++b) {
+                        const auto a = n - b;
+                        if (a > 0) {
+                            level[coefficient(a, b)] = x * next[coefficient(a - 1, b)] + (a > 1 ? (a - 1) * next[coefficient(a - 2, b)] : 0.0);
+                        }
+                        else {
+                            level[coefficient(0, b)] = y * next[coefficient(0, b - 1)] + (b > 1 ? (b - 1) * next[coefficient(0, b - 2)] : 0.0);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void FmmSolver::setParameters(const SimulationParameters& parameters) {
+        m_parameters = parameters;
+        m_order = std::clamp(parameters.multipoleOrder, 1u, MAX_ORDER);
+        m_coefficients = (m_order + 1) * (m_order + 2) / 2;
+    }
+
+    // Build
+    //--------------------------------------------------------------------------------------
+
+    void FmmSolver::build(const std::vector<uint64_t>& keys, const BodyStore& bodies, ThreadPool* pool) {
+        m_bodies = &bodies;
+        m_cells.clear();
+        m_owners.clear();
+        m_topCells.clear();
+        m_stats = FmmStats {};
+        if (bodies.size() == 0) {
+            return;
+        }
+
+        buildCell(0, static_cast<int32_t>(bodies.size()), 0, 0, keys);
+        m_multipoles.assign(m_cells.size() * m_coefficients, 0.0);
+        m_ownerIndex.assign(m_cells.size(), -1);
+        for (size_t o = 0; o < m_owners.size(); ++o) {
+            m_ownerIndex[m_owners[o]] = static_cast<int32_t>(o);
+        }
+
+        // Owner subtrees are independent, the top is finished once they are done
+        auto upward = [this](size_t begin, size_t end, size_t) {
+            for (auto o = begin; o < end; ++o) {
+                const auto owner = m_owners[o];
+                for (auto cell = m_cells[owner].subtreeEnd; cell-- > owner; ) {
+                    computeMultipole(cell);
+                }
+            }
+        };
+        if (pool) {
+            pool->parallelFor(m_owners.size(), 1, upward);
+        }
+        else {
+            upward(0, m_owners.size(), 0);
+        }
+        for (auto cell = m_topCells.rbegin(); cell != m_topCells.rend(); ++cell) {
+            computeMultipole(*cell);
+        }
+
+        m_stats.nodes = m_cells.size();
+        m_stats.leaves = static_cast<size_t>(std::count_if(m_cells.begin(), m_cells.end(), [](const Cell& cell) { return cell.isLeaf(); }));
+    }
+
+    int32_t FmmSolver::buildCell(int32_t begin, int32_t end, int level, int32_t depth, const std::vector<uint64_t>& keys) {
+        const auto index = static_cast<int32_t>(m_cells.size());
+        m_cells.emplace_back();
+        m_cells[index].begin = begin;
+        m_cells[index].end = end;
+        m_cells[index].depth = depth;
+
+        // Skip levels where every body falls into the same quadrant, keys are sorted
+        while (end - begin > LEAF_SIZE && level < MortonOrder::LEVELS
+               && MortonOrder::quadrant(keys[begin], level) == MortonOrder::quadrant(keys[end - 1], level)) {
+            ++level;
+        }
+
+        // Registered before the children so both lists stay in depth first order
+        const auto split = end - begin > LEAF_SIZE && level < MortonOrder::LEVELS;
+        if (depth == OWNER_DEPTH || (!split && depth < OWNER_DEPTH)) {
+            m_owners.push_back(index);
+        }
+        else if (depth < OWNER_DEPTH) {
+            m_topCells.push_back(index);
+        }
+
+        if (split) {
+            auto childBegin = begin;
+            for (auto quadrant = 0; quadrant < 4; ++quadrant) {
+                const auto childEnd = static_cast<int32_t>(std::partition_point(keys.begin() + childBegin, keys.begin() + end,
+                    [level, quadrant](uint64_t key) { return MortonOrder::quadrant(key, level) == quadrant; }) - keys.begin());
+                if (childEnd > childBegin) {
+                    const auto child = buildCell(childBegin, childEnd, level + 1, depth + 1, keys);
+                    m_cells[index].children[m_cells[index].childCount++] = child;
+                }
+                childBegin = childEnd;
+            }
+        }
+
+        m_cells[index].subtreeEnd = static_cast<int32_t>(m_cells.size());
+        return index;
+    }
+
+    void FmmSolver::computeMultipole(int32_t index) {
+        const auto& table = tables();
+        auto& cell = m_cells[index];
+        auto* multipole = &m_multipoles[index * m_coefficients];
+        double powersX[TABLE_SIZE], powersY[TABLE_SIZE];
+
+        if (cell.isLeaf()) {
+            const auto& bodies = *m_bodies;
+            double mass = 0.0, weightedX = 0.0, weightedY = 0.0;
+            for (auto i = cell.begin; i < cell.end; ++i) {
+                mass += bodies.mass[i];
+                weightedX += static_cast<double>(bodies.mass[i]) * bodies.x[i];
+                weightedY += static_cast<double>(bodies.mass[i]) * bodies.y[i];
+            }
+            cell.mass = mass;
+            cell.centerX = mass > 0 ? weightedX / mass : bodies.x[cell.begin];
+            cell.centerY = mass > 0 ? weightedY / mass : bodies.y[cell.begin];
+
+            // P2M
+            cell.radius = 0.0;
+            for (auto i = cell.begin; i < cell.end; ++i) {
+                const auto dx = bodies.x[i] - cell.centerX;
+                const auto dy = bodies.y[i] - cell.centerY;
+                cell.radius = std::max(cell.radius, std::sqrt(dx * dx + dy * dy));
+                powers(dx, m_order, powersX);
+                powers(dy, m_order, powersY);
+                for (uint32_t n = 0; n <= m_order; ++n) {
+                    for (uint32_t b = 0; b <= n; ++b) {
+                        const auto a = n - b;
+                        multipole[coefficient(a, b)] += bodies.mass[i] * powersX[a] * table.inverseFactorial[a] * powersY[b] * table.inverseFactorial[b];
+                    }
+                }
+            }
+            return;
+        }
+
+        double mass = 0.0, weightedX = 0.0, weightedY = 0.0;
+        for (auto c = 0; c < cell.childCount; ++c) {
+            const auto& child = m_cells[cell.children[c]];
+            mass += child.mass;
+            weightedX += child.mass * child.centerX;
+            weightedY += child.mass * child.centerY;
+        }
+        cell.mass = mass;
+        cell.centerX = mass > 0 ? weightedX / mass : m_cells[cell.children[0]].centerX;
+        cell.centerY = mass > 0 ? weightedY / mass : m_cells[cell.children[0]].centerY;
+
+        // M2M: child moments shifted by the offset between the two centers
+        cell.radius = 0.0;
+        for (auto c = 0; c < cell.childCount; ++c) {
+            const auto& child = m_cells[cell.children[c]];
+            const auto* childMultipole = &m_multipoles[cell.children[c] * m_coefficients];
+            const auto dx = child.centerX - cell.centerX;
+            const auto dy = child.centerY - cell.centerY;
+            cell.radius = std::max(cell.radius, std::sqrt(dx * dx + dy * dy) + child.radius);
+            powers(dx, m_order, powersX);
+            powers(dy, m_order, powersY);
+            for (uint32_t n = 0; n <= m_order; ++n) {
+                for (uint32_t b = 0; b <= n; ++b) {
+                    const auto a = n - b;
+                    double sum = 0.0;
+                    for (uint32_t ja = 0; ja <= a; ++ja) {
+                        for (uint32_t jb = 0; jb <= b; ++jb) {
+                            sum += childMultipole[coefficient(ja, jb)]
+                                 * powersX[a - ja] * table.inverseFactorial[a - ja] * powersY[b - jb] * table.inverseFactorial[b - jb];
+                        }
+                    }
+                    multipole[coefficient(a, b)] += sum;
+                }
+            }
+        }
+    }
+
+    // Evaluation
+    //--------------------------------------------------------------------------------------
+
+    void FmmSolver::computeForces(KernelIsa isa, float* fx, float* fy, ThreadPool* pool) {
+        if (m_cells.empty()) {
+            return;
+        }
+
+        const auto workerCount = pool ? pool->getThreadCount() : 1;
+        if (m_workers.size() < workerCount) {
+            m_workers.resize(workerCount);
+        }
+        for (auto& worker : m_workers) {
+            worker.derivatives.resize((m_order + 1) * m_coefficients);
+            worker.multipoleInteractions = 0;
+            worker.bodyInteractions = 0;
+        }
+        m_stats.multipoleInteractions = 0;
+        m_stats.bodyInteractions = 0;
+        m_locals.assign(m_cells.size() * m_coefficients, 0.0);
+        m_deferred.resize(m_owners.size());
+        for (auto& pairs : m_deferred) {
+            pairs.clear();
+        }
+
+        // Walk the top of the tree, pairs whose target reaches an owner are handed to its task
+        interact(0, 0, m_workers[0], true);
+        for (const auto cell : m_topCells) {
+            for (auto c = 0; c < m_cells[cell].childCount; ++c) {
+                localToLocal(cell, m_cells[cell].children[c]);
+            }
+        }
+
+        auto ownerTasks = [this, isa, fx, fy](size_t begin, size_t end, size_t workerIndex) {
+            auto& worker = m_workers[workerIndex];
+            for (auto o = begin; o < end; ++o) {
+                const auto owner = m_owners[o];
+                worker.directPairs.clear();
+                for (const auto& pair : m_deferred[o]) {
+                    interact(pair.target, pair.source, worker, false);
+                }
+
+                // Depth first order: parents push their expansion down before children are visited
+                for (auto cell = owner; cell < m_cells[owner].subtreeEnd; ++cell) {
+                    if (m_cells[cell].isLeaf()) {
+                        localToBodies(cell, fx, fy);
+                    }
+                    for (auto c = 0; c < m_cells[cell].childCount; ++c) {
+                        localToLocal(cell, m_cells[cell].children[c]);
+                    }
+                }
+                evaluateDirect(isa, worker, fx, fy);
+            }
+        };
+        if (pool) {
+            pool->parallelFor(m_owners.size(), 1, ownerTasks);
+        }
+        else {
+            ownerTasks(0, m_owners.size(), 0);
+        }
+
+        for (const auto& worker : m_workers) {
+            m_stats.multipoleInteractions += worker.multipoleInteractions;
+            m_stats.bodyInteractions += worker.bodyInteractions;
+        }
+    }
+
+    void FmmSolver::interact(int32_t target, int32_t source, Worker& worker, bool deferred) {
+        auto& stack = worker.stack;
+        stack.clear();
+        stack.push_back(CellPair {target, source});
+
+        while (!stack.empty()) {
+            const auto pair = stack.back();
+            stack.pop_back();
+            const auto& a = m_cells[pair.target];
+            const auto& b = m_cells[pair.source];
+
+            if (deferred && isOwner(a)) {
+                m_deferred[m_ownerIndex[pair.target]].push_back(pair);
+                continue;
+            }
+
+            // A cell against itself: every pair of its children
+            if (pair.target == pair.source) {
+                if (a.isLeaf()) {
+                    worker.directPairs.push_back(pair);
+                    continue;
+                }
+                for (auto i = 0; i < a.childCount; ++i) {
+                    for (auto j = 0; j < a.childCount; ++j) {
+                        stack.push_back(CellPair {a.children[i], a.children[j]});
+                    }
+                }
+                continue;
+            }
+
+            const auto dx = a.centerX - b.centerX;
+            const auto dy = a.centerY - b.centerY;
+            if (a.radius + b.radius < m_parameters.multipoleAcceptance * std::sqrt(dx * dx + dy * dy)) {
+                multipoleToLocal(pair.target, pair.source, worker);
+                continue;
+            }
+            if (a.isLeaf() && b.isLeaf()) {
+                worker.directPairs.push_back(pair);
+                continue;
+            }
+
+            // Split the bigger cell
+            if (!a.isLeaf() && (b.isLeaf() || a.radius >= b.radius)) {
+                for (auto i = 0; i < a.childCount; ++i) {
+                    stack.push_back(CellPair {a.children[i], pair.source});
+                }
+            }
+            else {
+                for (auto j = 0; j < b.childCount; ++j) {
+                    stack.push_back(CellPair {pair.target, b.children[j]});
+                }
+            }
+        }
+    }
+
+    void FmmSolver::multipoleToLocal(int32_t target, int32_t source, Worker& worker) {
+        const auto& table = tables();
+        const auto& a = m_cells[target];
+        const auto& b = m_cells[source];
+        auto* derivatives = worker.derivatives.data();
+        inverseDistanceDerivatives(a.centerX - b.centerX, a.centerY - b.centerY, m_order, m_coefficients, derivatives);
+
+        // phi(target center + e) = -G sum_n (-1)^|n| M_n D_(n+k) e^k / k!
+        const auto* multipole = &m_multipoles[source * m_coefficients];
+        auto* local = &m_locals[target * m_coefficients];
+        for (uint32_t k = 0; k <= m_order; ++k) {
+            for (uint32_t kb = 0; kb <= k; ++kb) {
+                const auto ka = k - kb;
+                double sum = 0.0;
+                for (uint32_t n = 0; n + k <= m_order; ++n) {
+                    double orderSum = 0.0;
+                    for (uint32_t nb = 0; nb <= n; ++nb) {
+                        orderSum += multipole[coefficient(n - nb, nb)] * derivatives[coefficient(n - nb + ka, nb + kb)];
+                    }
+                    sum += (n % 2 == 0) ? orderSum : -orderSum;
+                }
+                local[coefficient(ka, kb)] -= m_parameters.gravity * table.inverseFactorial[ka] * table.inverseFactorial[kb] * sum;
+            }
+        }
+        ++worker.multipoleInteractions;
+    }
+
+    void FmmSolver::localToLocal(int32_t parent, int32_t child) {
+        const auto& table = tables();
+        const auto dx = m_cells[child].centerX - m_cells[parent].centerX;
+        const auto dy = m_cells[child].centerY - m_cells[parent].centerY;
+        double powersX[TABLE_SIZE], powersY[TABLE_SIZE];
+        powers(dx, m_order, powersX);
+        powers(dy, m_order, powersY);
+
+        const auto* parentLocal = &m_locals[parent * m_coefficients];
+        auto* childLocal = &m_locals[child * m_coefficients];
+        for (uint32_t j = 0; j <= m_order; ++j) {
+            for (uint32_t jb = 0; jb <= j; ++jb) {
+                const auto ja = j - jb;
+                double sum = 0.0;
+                for (uint32_t k = j; k <= m_order; ++k) {
+                    for (uint32_t kb = jb; kb <= k; ++kb) {
+                        const auto ka = k - kb;
+                        if (ka < ja) {
+                            continue;
+                        }
+                        sum += parentLocal[coefficient(ka, kb)] * table.binomial[ka][ja] * table.binomial[kb][jb]
+                             * powersX[ka - ja] * powersY[kb - jb];
+                    }
+                }
+                childLocal[coefficient(ja, jb)] += sum;
+            }
+        }
+    }
+
+    void FmmSolver::localToBodies(int32_t index, float* fx, float* fy) {
+        const auto& cell = m_cells[index];
+        const auto& bodies = *m_bodies;
+        const auto* local = &m_locals[index * m_coefficients];
+        double powersX[TABLE_SIZE], powersY[TABLE_SIZE];
+
+        for (auto i = cell.begin; i < cell.end; ++i) {
+            powers(bodies.x[i] - cell.centerX, m_order, powersX);
+            powers(bodies.y[i] - cell.centerY, m_order, powersY);
+            // Gradient of the local expansion, F = -m grad phi
+            double gradientX = 0.0, gradientY = 0.0;
+            for (uint32_t n = 1; n <= m_order; ++n) {
+                for (uint32_t b = 0; b <= n; ++b) {
+                    const auto a = n - b;
+                    const auto value = local[coefficient(a, b)];
+                    if (a > 0) {
+                        gradientX += value * a * powersX[a - 1] * powersY[b];
+                    }
+                    if (b > 0) {
+                        gradientY += value * b * powersX[a] * powersY[b - 1];
+                    }
+                }
+            }
+            fx[i] -= static_cast<float>(bodies.mass[i] * gradientX);
+            fy[i] -= static_cast<float>(bodies.mass[i] * gradientY);
+        }
+    }
+
+    void FmmSolver::evaluateDirect(KernelIsa isa, Worker& worker, float* fx, float* fy) {
+        const auto& bodies = *m_bodies;
+        auto& pairs = worker.directPairs;
+        std::sort(pairs.begin(), pairs.end(), [](const CellPair& a, const CellPair& b) { return a.target < b.target; });
+
+        // One interaction list per target leaf with the bodies of all its near leaves
+        for (size_t first = 0; first < pairs.size(); ) {
+            const auto target = pairs[first].target;
+            auto& list = worker.list;
+            list.clear();
+            auto last = first;
+            for (; last < pairs.size() && pairs[last].target == target; ++last) {
+                const auto& source = m_cells[pairs[last].source];
+                for (auto i = source.begin; i < source.end; ++i) {
+                    list.add(bodies.position(i), bodies.mass[i], m_parameters.softening);
+                }
+            }
+
+            const auto& cell = m_cells[target];
+            const auto count = static_cast<size_t>(cell.end - cell.begin);
+            worker.bodyInteractions += list.size() * count;
+            list.pad(DIRECT_LIST_PADDING);
+            evaluateInteractions(isa, list, m_parameters.gravity,
+                                 &bodies.x[cell.begin], &bodies.y[cell.begin], &bodies.mass[cell.begin], count,
+                                 &fx[cell.begin], &fy[cell.begin]);
+            first = last;
+        }
+    }
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "body_store.h"
+#include "force_kernels.h"
+#include "simulation_parameters.h"
+
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+namespace physics {
+
+struct FmmStats {
+    size_t nodes {0};
+    size_t leaves {0};
+    uint64_t multipoleInteractions {0};     // M2L cell pairs
+    uint64_t bodyInteractions {0};          // Body pairs evaluated directly by P2P
+};
+
+// Fast multipole solver for the softened 1/r^2 force on the quadtree of Morton sorted bodies.
+// Expansions are Cartesian Taylor series of 1/r about each cell's center of mass up to
+// multipoleOrder (P2M, M2M, M2L, L2L, L2P); a dual-tree walk decides for every cell pair
+// between M2L and direct P2P. Cost grows as O(n) for a fixed order and acceptance.
+//
+// Each cell pair interacts one way, target cells below the top OWNER_DEPTH levels belong to one
+// task, so all writes of a task stay inside its own subtree and no locking is needed.
+class FmmSolver {
+
+public:
+    static constexpr uint32_t MAX_ORDER = 8;
+
+    void setParameters(const SimulationParameters& parameters);
+
+    // Bodies must be in the order of keys (see MortonOrder), with keys[i] the key of body i
+    void build(const std::vector<uint64_t>& keys, const BodyStore& bodies, ThreadPool* pool = nullptr);
+    // Add the force on every body to fx, fy; uses the bodies passed to the last build()
+    void computeForces(KernelIsa isa, float* fx, float* fy, ThreadPool* pool = nullptr);
+
+    const FmmStats& getLastStats() const { return m_stats; }
+
+private:
+    struct Cell {
+        double centerX {0.0};               // Center of mass, the expansion center
+        double centerY {0.0};
+        double radius {0.0};                // Farthest body from the center
+        double mass {0.0};
+        int32_t begin {0};                  // Bodies [begin, end) in Morton order
+        int32_t end {0};
+        int32_t subtreeEnd {0};             // Cells are stored depth first, the subtree is [index, subtreeEnd)
+        int32_t children[4] {-1, -1, -1, -1};
+        int32_t childCount {0};
+        int32_t depth {0};
+
+        bool isLeaf() const { return childCount == 0; }
+    };
+
+    // Pair evaluated later, when the target belongs to an owner task
+    struct CellPair {
+        int32_t target;
+        int32_t source;
+    };
+
+    // Per task scratch
+    struct Worker {
+        std::vector<CellPair> stack;
+        std::vector<CellPair> directPairs;
+        std::vector<double> derivatives;    // Derivatives of 1/r, (order + 1) auxiliary levels
+        InteractionList list;
+        uint64_t multipoleInteractions {0};
+        uint64_t bodyInteractions {0};
+    };
+
+    int32_t buildCell(int32_t begin, int32_t end, int level, int32_t depth, const std::vector<uint64_t>& keys);
+    // P2M for leaves, M2M from the children otherwise
+    void computeMultipole(int32_t cell);
+    // Dual tree walk; with deferred, pairs reaching an owner are queued instead of resolved
+    void interact(int32_t target, int32_t source, Worker& worker, bool deferred);
+    bool isOwner(const Cell& cell) const { return cell.depth == OWNER_DEPTH || (cell.isLeaf() && cell.depth < OWNER_DEPTH); }
+    void multipoleToLocal(int32_t target, int32_t source, Worker& worker);
+    void localToLocal(int32_t parent, int32_t child);
+    void localToBodies(int32_t cell, float* fx, float* fy);
+    void evaluateDirect(KernelIsa isa, Worker& worker, float* fx, float* fy);
+
+    static constexpr int32_t LEAF_SIZE = 32;
+    static constexpr int32_t OWNER_DEPTH = 3;
+
+    SimulationParameters m_parameters;
+    uint32_t m_order {4};
+    size_t m_coefficients {15};             // (order + 1)(order + 2) / 2 per expansion
+
+    const BodyStore* m_bodies {nullptr};
+    std::vector<Cell> m_cells;
+    std::vector<double> m_multipoles;       // m_coefficients per cell
+    std::vector<double> m_locals;
+    std::vector<int32_t> m_owners;
+    std::vector<int32_t> m_ownerIndex;      // Per cell, index in m_owners or -1
+    std::vector<int32_t> m_topCells;        // Inner cells above the owners, depth first
+    std::vector<std::vector<CellPair>> m_deferred;  // Per owner
+    std::vector<Worker> m_workers;
+    FmmStats m_stats;
+};
+
+}
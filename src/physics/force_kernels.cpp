@@ -0,0 +1,437 @@
+#include "force_kernels.h"
+
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define GRAVITY_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace physics {
+
+    // InteractionList
+    //--------------------------------------------------------------------------------------
+
+    void InteractionList::clear() {
+        x.clear();
+        y.clear();
+        mass.clear();
+        softening.clear();
+        for (auto* values : {&quadrupoles.x, &quadrupoles.y, &quadrupoles.mass, &quadrupoles.qxx, &quadrupoles.qxy, &quadrupoles.qyy}) {
+            values->clear();
+        }
+    }
+
+    void InteractionList::add(const glm::vec2& position, float sourceMass, float sourceSoftening) {
+        x.push_back(position.x);
+        y.push_back(position.y);
+        mass.push_back(sourceMass);
+        softening.push_back(sourceSoftening);
+    }
+
+    void InteractionList::addQuadrupole(const glm::vec2& position, float sourceMass, float qxx, float qxy, float qyy) {
+        quadrupoles.x.push_back(position.x);
+        quadrupoles.y.push_back(position.y);
+        quadrupoles.mass.push_back(sourceMass);
+        quadrupoles.qxx.push_back(qxx);
+        quadrupoles.qxy.push_back(qxy);
+        quadrupoles.qyy.push_back(qyy);
+    }
+
+    void InteractionList::pad(size_t width) {
+        while (x.size() % width != 0) {
+            add(glm::vec2(0.0f, 0.0f), 0.0f, 0.0f);
+        }
+        while (quadrupoles.size() % width != 0) {
+            addQuadrupole(glm::vec2(0.0f, 0.0f), 0.0f, 0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    // Kernels
+    //--------------------------------------------------------------------------------------
+
+    namespace {
+
+        void evaluateScalar(const InteractionList& sources, float gravity, const float* x, const float* y, const float* mass, size_t count,
+                            float* fx, float* fy) {
+            const auto sourceCount = sources.x.size();
+            const auto& quadrupoles = sources.quadrupoles;
+            for (size_t t = 0; t < count; ++t) {
+                float accX = 0.0f;
+                float accY = 0.0f;
+                for (size_t s = 0; s < sourceCount; ++s) {
+                    const auto rx = sources.x[s] - x[t];
+                    const auto ry = sources.y[s] - y[t];
+                    const auto distanceSq = rx * rx + ry * ry;
+                    if (distanceSq == 0) continue;
+
+                    const auto scale = sources.mass[s] / (distanceSq * std::sqrt(distanceSq + sources.softening[s]));
+                    accX += scale * rx;
+                    accY += scale * ry;
+                }
+                for (size_t s = 0; s < quadrupoles.size(); ++s) {
+                    const auto rx = quadrupoles.x[s] - x[t];
+                    const auto ry = quadrupoles.y[s] - y[t];
+                    const auto distanceSq = rx * rx + ry * ry;
+                    if (distanceSq == 0) continue;
+
+                    const auto invDistanceSq = 1.0f / distanceSq;
+                    const auto invDistance3 = invDistanceSq / std::sqrt(distanceSq);
+                    const auto invDistance5 = invDistance3 * invDistanceSq;
+                    const auto qrx = quadrupoles.qxx[s] * rx + quadrupoles.qxy[s] * ry;
+                    const auto qry = quadrupoles.qxy[s] * rx + quadrupoles.qyy[s] * ry;
+                    const auto rqr = rx * qrx + ry * qry;
+                    const auto radial = quadrupoles.mass[s] * invDistance3 + 2.5f * rqr * invDistance5 * invDistanceSq;
+                    accX += radial * rx - invDistance5 * qrx;
+                    accY += radial * ry - invDistance5 * qry;
+                }
+                fx[t] += gravity * mass[t] * accX;
+                fy[t] += gravity * mass[t] * accY;
+            }
+        }
+
+        // Pair force factor G * m_t * m_s / (d^2 * sqrt(d^2 + softening)), reaction written to the source arrays
+        struct MutualArrays {
+            const float* x;
+            const float* y;
+            const float* mass;
+            float* fx;
+            float* fy;
+        };
+
+        void evaluateMutualRange(float gravity, float softening, const MutualArrays& targets, size_t t,
+                                 const MutualArrays& sources, size_t begin, size_t end, float& accX, float& accY) {
+            const auto targetScale = gravity * targets.mass[t];
+            for (auto s = begin; s < end; ++s) {
+                const auto rx = sources.x[s] - targets.x[t];
+                const auto ry = sources.y[s] - targets.y[t];
+                const auto distanceSq = rx * rx + ry * ry;
+                if (distanceSq == 0) continue;
+
+                const auto scale = sources.mass[s] / (distanceSq * std::sqrt(distanceSq + softening));
+                accX += scale * rx;
+                accY += scale * ry;
+                sources.fx[s] -= targetScale * scale * rx;
+                sources.fy[s] -= targetScale * scale * ry;
+            }
+        }
+
+        void evaluateMutualScalar(float gravity, float softening, const MutualArrays& targets, size_t count,
+                                  const MutualArrays& sources, size_t sourceCount) {
+            for (size_t t = 0; t < count; ++t) {
+                float accX = 0.0f;
+                float accY = 0.0f;
+                evaluateMutualRange(gravity, softening, targets, t, sources, 0, sourceCount, accX, accY);
+                targets.fx[t] += gravity * targets.mass[t] * accX;
+                targets.fy[t] += gravity * targets.mass[t] * accY;
+            }
+        }
+
+#ifdef GRAVITY_X86_KERNELS
+
+        __attribute__((target("sse2")))
+        float horizontalSum(__m128 v) {
+            const auto high = _mm_movehl_ps(v, v);
+            const auto sum = _mm_add_ps(v, high);
+            return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+        }
+
+        __attribute__((target("sse2")))
+        void evaluateSSE(const InteractionList& sources, float gravity, const float* x, const float* y, const float* mass, size_t count,
+                         float* fx, float* fy) {
+            const auto sourceCount = sources.x.size();
+            const auto& quadrupoles = sources.quadrupoles;
+            const auto fiveHalves = _mm_set1_ps(2.5f);
+            const auto zero = _mm_setzero_ps();
+            const auto half = _mm_set1_ps(0.5f);
+            const auto threeHalves = _mm_set1_ps(1.5f);
+            const auto two = _mm_set1_ps(2.0f);
+
+            for (size_t t = 0; t < count; ++t) {
+                const auto tx = _mm_set1_ps(x[t]);
+                const auto ty = _mm_set1_ps(y[t]);
+                auto accX = _mm_setzero_ps();
+                auto accY = _mm_setzero_ps();
+
+                for (size_t s = 0; s < sourceCount; s += 4) {
+                    const auto rx = _mm_sub_ps(_mm_loadu_ps(&sources.x[s]), tx);
+                    const auto ry = _mm_sub_ps(_mm_loadu_ps(&sources.y[s]), ty);
+                    const auto distanceSq = _mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry));
+                    const auto mask = _mm_cmpgt_ps(distanceSq, zero);
+
+                    // 1/sqrt(d^2 + eps) and 1/d^2, each refined with one Newton step
+                    const auto softened = _mm_add_ps(distanceSq, _mm_loadu_ps(&sources.softening[s]));
+                    auto invDistance = _mm_rsqrt_ps(softened);
+                    invDistance = _mm_mul_ps(invDistance, _mm_sub_ps(threeHalves,
+                        _mm_mul_ps(_mm_mul_ps(half, softened), _mm_mul_ps(invDistance, invDistance))));
+                    auto invDistanceSq = _mm_rcp_ps(distanceSq);
+                    invDistanceSq = _mm_mul_ps(invDistanceSq, _mm_sub_ps(two, _mm_mul_ps(distanceSq, invDistanceSq)));
+
+                    auto scale = _mm_mul_ps(_mm_loadu_ps(&sources.mass[s]), _mm_mul_ps(invDistance, invDistanceSq));
+                    scale = _mm_and_ps(scale, mask);
+                    accX = _mm_add_ps(accX, _mm_mul_ps(scale, rx));
+                    accY = _mm_add_ps(accY, _mm_mul_ps(scale, ry));
+                }
+
+                for (size_t s = 0; s < quadrupoles.size(); s += 4) {
+                    const auto rx = _mm_sub_ps(_mm_loadu_ps(&quadrupoles.x[s]), tx);
+                    const auto ry = _mm_sub_ps(_mm_loadu_ps(&quadrupoles.y[s]), ty);
+                    const auto distanceSq = _mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry));
+                    const auto mask = _mm_cmpgt_ps(distanceSq, zero);
+
+                    auto invDistance = _mm_rsqrt_ps(distanceSq);
+                    invDistance = _mm_mul_ps(invDistance, _mm_sub_ps(threeHalves,
+                        _mm_mul_ps(_mm_mul_ps(half, distanceSq), _mm_mul_ps(invDistance, invDistance))));
+                    invDistance = _mm_and_ps(invDistance, mask);
+                    const auto invDistanceSq = _mm_mul_ps(invDistance, invDistance);
+                    const auto invDistance3 = _mm_mul_ps(invDistanceSq, invDistance);
+                    const auto invDistance5 = _mm_mul_ps(invDistance3, invDistanceSq);
+
+                    const auto qxy = _mm_loadu_ps(&quadrupoles.qxy[s]);
+                    const auto qrx = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&quadrupoles.qxx[s]), rx), _mm_mul_ps(qxy, ry));
+                    const auto qry = _mm_add_ps(_mm_mul_ps(qxy, rx), _mm_mul_ps(_mm_loadu_ps(&quadrupoles.qyy[s]), ry));
+                    const auto rqr = _mm_add_ps(_mm_mul_ps(rx, qrx), _mm_mul_ps(ry, qry));
+                    const auto radial = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&quadrupoles.mass[s]), invDistance3),
+                                                   _mm_mul_ps(_mm_mul_ps(fiveHalves, rqr), _mm_mul_ps(invDistance5, invDistanceSq)));
+                    accX = _mm_add_ps(accX, _mm_sub_ps(_mm_mul_ps(radial, rx), _mm_mul_ps(invDistance5, qrx)));
+                    accY = _mm_add_ps(accY, _mm_sub_ps(_mm_mul_ps(radial, ry), _mm_mul_ps(invDistance5, qry)));
+                }
+                fx[t] += gravity * mass[t] * horizontalSum(accX);
+                fy[t] += gravity * mass[t] * horizontalSum(accY);
+            }
+        }
+
+        __attribute__((target("avx2,fma")))
+        float horizontalSum(__m256 v) {
+            const auto sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            const auto high = _mm_movehl_ps(sum, sum);
+            const auto sum2 = _mm_add_ps(sum, high);
+            return _mm_cvtss_f32(_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, 1)));
+        }
+
+        __attribute__((target("avx2,fma")))
+        void evaluateAVX2(const InteractionList& sources, float gravity, const float* x, const float* y, const float* mass, size_t count,
+                          float* fx, float* fy) {
+            const auto sourceCount = sources.x.size();
+            const auto& quadrupoles = sources.quadrupoles;
+            const auto fiveHalves = _mm256_set1_ps(2.5f);
+            const auto zero = _mm256_setzero_ps();
+            const auto half = _mm256_set1_ps(0.5f);
+            const auto threeHalves = _mm256_set1_ps(1.5f);
+            const auto two = _mm256_set1_ps(2.0f);
+
+            for (size_t t = 0; t < count; ++t) {
+                const auto tx = _mm256_set1_ps(x[t]);
+                const auto ty = _mm256_set1_ps(y[t]);
+                auto accX = _mm256_setzero_ps();
+                auto accY = _mm256_setzero_ps();
+
+                for (size_t s = 0; s < sourceCount; s += 8) {
+                    const auto rx = _mm256_sub_ps(_mm256_loadu_ps(&sources.x[s]), tx);
+                    const auto ry = _mm256_sub_ps(_mm256_loadu_ps(&sources.y[s]), ty);
+                    const auto distanceSq = _mm256_fmadd_ps(rx, rx, _mm256_mul_ps(ry, ry));
+                    const auto mask = _mm256_cmp_ps(distanceSq, zero, _CMP_GT_OQ);
+
+                    // 1/sqrt(d^2 + eps) and 1/d^2, each refined with one Newton step
+                    const auto softened = _mm256_add_ps(distanceSq, _mm256_loadu_ps(&sources.softening[s]));
+                    auto invDistance = _mm256_rsqrt_ps(softened);
+                    invDistance = _mm256_mul_ps(invDistance, _mm256_fnmadd_ps(_mm256_mul_ps(half, softened),
+                        _mm256_mul_ps(invDistance, invDistance), threeHalves));
+                    auto invDistanceSq = _mm256_rcp_ps(distanceSq);
+                    invDistanceSq = _mm256_mul_ps(invDistanceSq, _mm256_fnmadd_ps(distanceSq, invDistanceSq, two));
+
+                    auto scale = _mm256_mul_ps(_mm256_loadu_ps(&sources.mass[s]), _mm256_mul_ps(invDistance, invDistanceSq));
+                    scale = _mm256_and_ps(scale, mask);
+                    accX = _mm256_fmadd_ps(scale, rx, accX);
+                    accY = _mm256_fmadd_ps(scale, ry, accY);
+                }
+
+                for (size_t s = 0; s < quadrupoles.size(); s += 8) {
+                    const auto rx = _mm256_sub_ps(_mm256_loadu_ps(&quadrupoles.x[s]), tx);
+                    const auto ry = _mm256_sub_ps(_mm256_loadu_ps(&quadrupoles.y[s]), ty);
+                    const auto distanceSq = _mm256_fmadd_ps(rx, rx, _mm256_mul_ps(ry, ry));
+                    const auto mask = _mm256_cmp_ps(distanceSq, zero, _CMP_GT_OQ);
+
+                    auto invDistance = _mm256_rsqrt_ps(distanceSq);
+                    invDistance = _mm256_mul_ps(invDistance, _mm256_fnmadd_ps(_mm256_mul_ps(half, distanceSq),
+                        _mm256_mul_ps(invDistance, invDistance), threeHalves));
+                    invDistance = _mm256_and_ps(invDistance, mask);
+                    const auto invDistanceSq = _mm256_mul_ps(invDistance, invDistance);
+                    const auto invDistance3 = _mm256_mul_ps(invDistanceSq, invDistance);
+                    const auto invDistance5 = _mm256_mul_ps(invDistance3, invDistanceSq);
+
+                    const auto qxy = _mm256_loadu_ps(&quadrupoles.qxy[s]);
+                    const auto qrx = _mm256_fmadd_ps(_mm256_loadu_ps(&quadrupoles.qxx[s]), rx, _mm256_mul_ps(qxy, ry));
+                    const auto qry = _mm256_fmadd_ps(qxy, rx, _mm256_mul_ps(_mm256_loadu_ps(&quadrupoles.qyy[s]), ry));
+                    const auto rqr = _mm256_fmadd_ps(rx, qrx, _mm256_mul_ps(ry, qry));
+                    const auto radial = _mm256_fmadd_ps(_mm256_loadu_ps(&quadrupoles.mass[s]), invDistance3,
+                                                        _mm256_mul_ps(_mm256_mul_ps(fiveHalves, rqr), _mm256_mul_ps(invDistance5, invDistanceSq)));
+                    accX = _mm256_add_ps(accX, _mm256_fmsub_ps(radial, rx, _mm256_mul_ps(invDistance5, qrx)));
+                    accY = _mm256_add_ps(accY, _mm256_fmsub_ps(radial, ry, _mm256_mul_ps(invDistance5, qry)));
+                }
+                fx[t] += gravity * mass[t] * horizontalSum(accX);
+                fy[t] += gravity * mass[t] * horizontalSum(accY);
+            }
+        }
+
+        __attribute__((target("sse2")))
+        void evaluateMutualSSE(float gravity, float softening, const MutualArrays& targets, size_t count,
+                               const MutualArrays& sources, size_t sourceCount) {
+            const auto zero = _mm_setzero_ps();
+            const auto half = _mm_set1_ps(0.5f);
+            const auto threeHalves = _mm_set1_ps(1.5f);
+            const auto two = _mm_set1_ps(2.0f);
+            const auto eps = _mm_set1_ps(softening);
+            const auto vectorEnd = sourceCount - sourceCount % 4;
+
+            for (size_t t = 0; t < count; ++t) {
+                const auto tx = _mm_set1_ps(targets.x[t]);
+                const auto ty = _mm_set1_ps(targets.y[t]);
+                const auto targetScale = _mm_set1_ps(gravity * targets.mass[t]);
+                auto accX = _mm_setzero_ps();
+                auto accY = _mm_setzero_ps();
+
+                for (size_t s = 0; s < vectorEnd; s += 4) {
+                    const auto rx = _mm_sub_ps(_mm_loadu_ps(&sources.x[s]), tx);
+                    const auto ry = _mm_sub_ps(_mm_loadu_ps(&sources.y[s]), ty);
+                    const auto distanceSq = _mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry));
+                    const auto mask = _mm_cmpgt_ps(distanceSq, zero);
+
+                    const auto softened = _mm_add_ps(distanceSq, eps);
+                    auto invDistance = _mm_rsqrt_ps(softened);
+                    invDistance = _mm_mul_ps(invDistance, _mm_sub_ps(threeHalves,
+                        _mm_mul_ps(_mm_mul_ps(half, softened), _mm_mul_ps(invDistance, invDistance))));
+                    auto invDistanceSq = _mm_rcp_ps(distanceSq);
+                    invDistanceSq = _mm_mul_ps(invDistanceSq, _mm_sub_ps(two, _mm_mul_ps(distanceSq, invDistanceSq)));
+
+                    auto scale = _mm_mul_ps(_mm_loadu_ps(&sources.mass[s]), _mm_mul_ps(invDistance, invDistanceSq));
+                    scale = _mm_and_ps(scale, mask);
+                    const auto pairX = _mm_mul_ps(scale, rx);
+                    const auto pairY = _mm_mul_ps(scale, ry);
+                    accX = _mm_add_ps(accX, pairX);
+                    accY = _mm_add_ps(accY, pairY);
+                    _mm_storeu_ps(&sources.fx[s], _mm_sub_ps(_mm_loadu_ps(&sources.fx[s]), _mm_mul_ps(targetScale, pairX)));
+                    _mm_storeu_ps(&sources.fy[s], _mm_sub_ps(_mm_loadu_ps(&sources.fy[s]), _mm_mul_ps(targetScale, pairY)));
+                }
+
+                auto sumX = horizontalSum(accX);
+                auto sumY = horizontalSum(accY);
+                evaluateMutualRange(gravity, softening, targets, t, sources, vectorEnd, sourceCount, sumX, sumY);
+                targets.fx[t] += gravity * targets.mass[t] * sumX;
+                targets.fy[t] += gravity * targets.mass[t] * sumY;
+            }
+        }
+
+        __attribute__((target("avx2,fma")))
+        void evaluateMutualAVX2(float gravity, float softening, const MutualArrays& targets, size_t count,
+                                const MutualArrays& sources, size_t sourceCount) {
+            const auto zero = _mm256_setzero_ps();
+            const auto half = _mm256_set1_ps(0.5f);
+            const auto threeHalves = _mm256_set1_ps(1.5f);
+            const auto two = _mm256_set1_ps(2.0f);
+            const auto eps = _mm256_set1_ps(softening);
+            const auto vectorEnd = sourceCount - sourceCount % 8;
+
+            for (size_t t = 0; t < count; ++t) {
+                const auto tx = _mm256_set1_ps(targets.x[t]);
+                const auto ty = _mm256_set1_ps(targets.y[t]);
+                const auto targetScale = _mm256_set1_ps(gravity * targets.mass[t]);
+                auto accX = _mm256_setzero_ps();
+                auto accY = _mm256_setzero_ps();
+
+                for (size_t s = 0; s < vectorEnd; s += 8) {
+                    const auto rx = _mm256_sub_ps(_mm256_loadu_ps(&sources.x[s]), tx);
+                    const auto ry = _mm256_sub_ps(_mm256_loadu_ps(&sources.y[s]), ty);
+                    const auto distanceSq = _mm256_fmadd_ps(rx, rx, _mm256_mul_ps(ry, ry));
+                    const auto mask = _mm256_cmp_ps(distanceSq, zero, _CMP_GT_OQ);
+
+                    const auto softened = _mm256_add_ps(distanceSq, eps);
+                    auto invDistance = _mm256_rsqrt_ps(softened);
+                    invDistance = _mm256_mul_ps(invDistance, _mm256_fnmadd_ps(_mm256_mul_ps(half, softened),
+                        _mm256_mul_ps(invDistance, invDistance), threeHalves));
+                    auto invDistanceSq = _mm256_rcp_ps(distanceSq);
+                    invDistanceSq = _mm256_mul_ps(invDistanceSq, _mm256_fnmadd_ps(distanceSq, invDistanceSq, two));
+
+                    auto scale = _mm256_mul_ps(_mm256_loadu_ps(&sources.mass[s]), _mm256_mul_ps(invDistance, invDistanceSq));
+                    scale = _mm256_and_ps(scale, mask);
+                    const auto pairX = _mm256_mul_ps(scale, rx);
+                    const auto pairY = _mm256_mul_ps(scale, ry);
+                    accX = _mm256_add_ps(accX, pairX);
+                    accY = _mm256_add_ps(accY, pairY);
+                    _mm256_storeu_ps(&sources.fx[s], _mm256_fnmadd_ps(targetScale, pairX, _mm256_loadu_ps(&sources.fx[s])));
+                    _mm256_storeu_ps(&sources.fy[s], _mm256_fnmadd_ps(targetScale, pairY, _mm256_loadu_ps(&sources.fy[s])));
+                }
+
+                auto sumX = horizontalSum(accX);
+                auto sumY = horizontalSum(accY);
+                evaluateMutualRange(gravity, softening, targets, t, sources, vectorEnd, sourceCount, sumX, sumY);
+                targets.fx[t] += gravity * targets.mass[t] * sumX;
+                targets.fy[t] += gravity * targets.mass[t] * sumY;
+            }
+        }
+
+#endif
+    }
+
+    KernelIsa detectKernelIsa() {
+#ifdef GRAVITY_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return KernelIsa::AVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return KernelIsa::SSE;
+        }
+#endif
+        return KernelIsa::Scalar;
+    }
+
+    const char* kernelIsaName(KernelIsa isa) {
+        switch (isa) {
+            case KernelIsa::AVX2: return "AVX2";
+            case KernelIsa::SSE: return "SSE";
+            case KernelIsa::Scalar: return "Scalar";
+        }
+        return "Unknown";
+    }
+
+    void evaluateInteractions(KernelIsa isa, const InteractionList& sources, float gravity,
+                              const float* x, const float* y, const float* mass, size_t count,
+                              float* fx, float* fy) {
+#ifdef GRAVITY_X86_KERNELS
+        // Lists are padded by the caller: 8 for AVX2, 4 for SSE
+        auto paddedTo = [&sources](size_t width) {
+            return sources.x.size() % width == 0 && sources.quadrupoles.size() % width == 0;
+        };
+        if (isa == KernelIsa::AVX2 && paddedTo(8)) {
+            evaluateAVX2(sources, gravity, x, y, mass, count, fx, fy);
+            return;
+        }
+        if (isa == KernelIsa::SSE && paddedTo(4)) {
+            evaluateSSE(sources, gravity, x, y, mass, count, fx, fy);
+            return;
+        }
+#endif
+        evaluateScalar(sources, gravity, x, y, mass, count, fx, fy);
+    }
+
+    void evaluateMutualInteractions(KernelIsa isa, float gravity, float softening,
+                                    const float* x, const float* y, const float* mass, size_t count, float* fx, float* fy,
+                                    const float* sourceX, const float* sourceY, const float* sourceMass, size_t sourceCount,
+                                    float* sourceFx, float* sourceFy) {
+        const MutualArrays targets {x, y, mass, fx, fy};
+        const MutualArrays sources {sourceX, sourceY, sourceMass, sourceFx, sourceFy};
+#ifdef GRAVITY_X86_KERNELS
+        if (isa == KernelIsa::AVX2) {
+            evaluateMutualAVX2(gravity, softening, targets, count, sources, sourceCount);
+            return;
+        }
+        if (isa == KernelIsa::SSE) {
+            evaluateMutualSSE(gravity, softening, targets, count, sources, sourceCount);
+            return;
+        }
+#endif
+        evaluateMutualScalar(gravity, softening, targets, count, sources, sourceCount);
+    }
+
+}
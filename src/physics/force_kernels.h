@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <cstddef>
+#include <vector>
+
+namespace physics {
+
+// Sources acting on a group of targets: accepted tree nodes and leaf bodies.
+// softening is the body softening for bodies and 0 for node pseudo-particles, which folds
+// the direct and the approximate Barnes-Hut formulas into one:
+//   F = G * m * M * r / (|r|^2 * sqrt(|r|^2 + softening))
+// Nodes expanded to quadrupole order go to a second set of arrays. Their moment is stored as
+// (qxx, qxy, qyy) = (2 Ixx - Iyy, 3 Ixy, 2 Iyy - Ixx) with I the second mass moment about the
+// center of mass, the in-plane part of the traceless 3D tensor, and
+//   F = G * m * (M r / |r|^3 - Q r / |r|^5 + 5/2 (r.Q r) r / |r|^7)
+struct InteractionList {
+    std::vector<float> x, y;
+    std::vector<float> mass;
+    std::vector<float> softening;
+
+    struct Quadrupoles {
+        std::vector<float> x, y;
+        std::vector<float> mass;
+        std::vector<float> qxx, qxy, qyy;
+
+        size_t size() const { return x.size(); }
+    } quadrupoles;
+
+    size_t size() const { return x.size() + quadrupoles.size(); }
+    void clear();
+    void add(const glm::vec2& position, float sourceMass, float sourceSoftening);
+    void addQuadrupole(const glm::vec2& position, float sourceMass, float qxx, float qxy, float qyy);
+    // Pad both sets with massless sources up to a multiple of width so kernels need no tail loop
+    void pad(size_t width);
+};
+
+// Instruction set used by the vectorized kernel
+enum class KernelIsa {
+    Scalar,
+    SSE,
+    AVX2
+};
+
+// Best instruction set supported by the running CPU
+KernelIsa detectKernelIsa();
+const char* kernelIsaName(KernelIsa isa);
+
+// Accumulate forces from all sources in the list onto targets [0, count).
+// Pairs at zero distance (self-interaction) are masked out.
+void evaluateInteractions(KernelIsa isa, const InteractionList& sources, float gravity,
+                          const float* x, const float* y, const float* mass, size_t count,
+                          float* fx, float* fy);
+
+// Newton's third law between two sets of bodies with one softening for every pair: the force of
+// each pair is computed once, added to the target and subtracted from the source side.
+// Arrays are read and written unaligned with a scalar tail, so no padding is needed.
+// The two sets must not overlap, pairs at zero distance are masked out.
+void evaluateMutualInteractions(KernelIsa isa, float gravity, float softening,
+                                const float* x, const float* y, const float* mass, size_t count, float* fx, float* fy,
+                                const float* sourceX, const float* sourceY, const float* sourceMass, size_t sourceCount,
+                                float* sourceFx, float* sourceFy);
+
+}
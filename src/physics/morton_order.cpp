@@ -0,0 +1,110 @@
+#include "morton_order.h"
+#include "base/thread_pool.h"
+
+#include <algorithm>
+
+namespace physics {
+
+    namespace {
+        constexpr int RADIX_BITS = 8;
+        constexpr int RADIX_BUCKETS = 1 << RADIX_BITS;
+        constexpr int KEY_BITS = 2 * MortonOrder::LEVELS;
+        constexpr size_t PARALLEL_SORT_MIN_BODIES = 16384;
+
+        // Insert a zero bit between each of the lower 21 bits
+        uint64_t spreadBits(uint64_t v) {
+            v &= 0x1fffff;
+            v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+            v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+            v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+            v = (v | (v << 2)) & 0x3333333333333333ull;
+            v = (v | (v << 1)) & 0x5555555555555555ull;
+            return v;
+        }
+    }
+
+    uint64_t MortonOrder::encode(const glm::vec2& position, const AABB& boundary) {
+        constexpr auto cells = static_cast<double>(1u << LEVELS);
+        const auto scale = cells / boundary.getWidth();
+        const auto qx = std::clamp((static_cast<double>(position.x) - boundary.getMinX()) * scale, 0.0, cells - 1);
+        const auto qy = std::clamp((static_cast<double>(position.y) - boundary.getMinY()) * scale, 0.0, cells - 1);
+        return (spreadBits(static_cast<uint64_t>(qy)) << 1) | spreadBits(static_cast<uint64_t>(qx));
+    }
+
+    void MortonOrder::sort(const std::vector<float>& x, const std::vector<float>& y, const AABB& boundary, ThreadPool* pool) {
+        const auto count = x.size();
+        m_keys.resize(count);
+        m_order.resize(count);
+        m_keysScratch.resize(count);
+        m_orderScratch.resize(count);
+
+        // Serial for small inputs, otherwise one block per worker
+        const auto blockCount = pool && count >= PARALLEL_SORT_MIN_BODIES ? pool->getThreadCount() : 1;
+        const auto blockSize = (count + blockCount - 1) / std::max<size_t>(blockCount, 1);
+        auto forEachBlock = [pool, blockCount](const auto& function) {
+            if (blockCount == 1) {
+                function(0);
+                return;
+            }
+            pool->parallelFor(blockCount, 1, [&function](size_t begin, size_t end, size_t) {
+                for (auto block = begin; block < end; ++block) {
+                    function(block);
+                }
+            });
+        };
+
+        forEachBlock([&](size_t block) {
+            const auto end = std::min(count, (block + 1) * blockSize);
+            for (auto i = block * blockSize; i < end; ++i) {
+                m_keys[i] = encode(glm::vec2(x[i], y[i]), boundary);
+                m_order[i] = static_cast<uint32_t>(i);
+            }
+        });
+
+        // LSD radix sort, stable, so equal keys keep their previous relative order
+        m_blockOffsets.resize(blockCount * RADIX_BUCKETS);
+        for (auto shift = 0; shift < KEY_BITS; shift += RADIX_BITS) {
+            forEachBlock([&](size_t block) {
+                auto* histogram = &m_blockOffsets[block * RADIX_BUCKETS];
+                std::fill(histogram, histogram + RADIX_BUCKETS, 0);
+                const auto end = std::min(count, (block + 1) * blockSize);
+                for (auto i = block * blockSize; i < end; ++i) {
+                    ++histogram[(m_keys[i] >> shift) & (RADIX_BUCKETS - 1)];
+                }
+            });
+
+            // Exclusive prefix sum, digit-major so block b scatters after blocks < b
+            size_t sum = 0;
+            auto singleDigit = false;
+            for (auto digit = 0; digit < RADIX_BUCKETS; ++digit) {
+                size_t digitCount = 0;
+                for (size_t block = 0; block < blockCount; ++block) {
+                    auto& offset = m_blockOffsets[block * RADIX_BUCKETS + digit];
+                    const auto bucketSize = offset;
+                    offset = sum;
+                    sum += bucketSize;
+                    digitCount += bucketSize;
+                }
+                singleDigit = singleDigit || digitCount == count;
+            }
+
+            // Every key has the same digit, nothing to move
+            if (singleDigit) {
+                continue;
+            }
+
+            forEachBlock([&](size_t block) {
+                auto* offsets = &m_blockOffsets[block * RADIX_BUCKETS];
+                const auto end = std::min(count, (block + 1) * blockSize);
+                for (auto i = block * blockSize; i < end; ++i) {
+                    const auto target = offsets[(m_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                    m_keysScratch[target] = m_keys[i];
+                    m_orderScratch[target] = m_order[i];
+                }
+            });
+            m_keys.swap(m_keysScratch);
+            m_order.swap(m_orderScratch);
+        }
+    }
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "base/quadtree.h"
+
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+namespace physics {
+
+// Z-curve ordering of bodies inside a square boundary.
+// Each key interleaves LEVELS bits of the quantized y and x coordinates,
+// y first, so the two bits of one level select the quadrant in the same
+// NW, NE, SW, SE order the quadtrees use.
+class MortonOrder {
+
+public:
+    static constexpr int LEVELS = 21;
+
+    static uint64_t encode(const glm::vec2& position, const AABB& boundary);
+    static int quadrant(uint64_t key, int level) { return static_cast<int>((key >> (2 * (LEVELS - 1 - level))) & 3); }
+
+    // Compute keys and radix sort them. Scratch buffers are reused between calls.
+    // With a pool, key encoding and every radix pass run in parallel blocks.
+    void sort(const std::vector<float>& x, const std::vector<float>& y, const AABB& boundary, ThreadPool* pool = nullptr);
+
+    // Original index of every body in Z order
+    const std::vector<uint32_t>& getOrder() const { return m_order; }
+    // Keys in Z order
+    const std::vector<uint64_t>& getKeys() const { return m_keys; }
+
+private:
+    std::vector<uint64_t> m_keys;
+    std::vector<uint64_t> m_keysScratch;
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_orderScratch;
+    std::vector<size_t> m_blockOffsets;       // Per block and digit scatter offsets of one radix pass
+};
+
+}
@@ -1,12 +1,147 @@
 #include "nbody_simulation.h"
-#include <future>
+#include "base/profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
 
 namespace physics {
 
-    const float G = 1.0f;//6.67430e-11;         // Gravitational constant
-    const float THETA = 1.0f;                   // Barnes-Hut opening angle
-    const float SOFT_FACTOR = 0.5f;             // Softening parameter to avoid singularities
-    const float AREA_PADDING = 10.0f;           // Compute area internal padding
+    // Consecutive (Morton ordered) bodies sharing one interaction list
+    const size_t INTERACTION_GROUP_SIZE = 16;
+    // Interaction lists are padded to the widest SIMD kernel
+    const size_t INTERACTION_LIST_PADDING = 8;
+    // Bodies per force task, small enough for dense regions to be shared out by stealing
+    const size_t FORCE_TASK_SIZE = 4 * INTERACTION_GROUP_SIZE;
+    // Integration is a cheap streaming loop, use large tasks
+    const size_t INTEGRATION_TASK_SIZE = 4096;
+    // Dynamic root headroom, relative to the half extent of the bodies, so refits survive a few steps
+    const float DYNAMIC_BOUNDARY_MARGIN = 0.05f;
+    // Smallest dynamic root half extent, for a single body or bodies that all coincide
+    const float MIN_BOUNDARY_HALF_DIMENSION = 1.0f;
+    // Largest block time step level, bins are stored in 8 bits and substeps counted in 32
+    const uint32_t MAX_TIME_BIN = 16;
+    // Yoshida fourth order weights: w1 = 1 / (2 - 2^(1/3)), w0 = -2^(1/3) * w1
+    const float YOSHIDA_OUTER_WEIGHT = 1.3512071919596578f;
+    const float YOSHIDA_INNER_WEIGHT = -1.7024143839193153f;
+
+    namespace {
+        // Adds the lifetime of the scope to one of the step timings
+        class ScopedPhase {
+
+        public:
+            // name labels the phase in the profiler, which records it only while enabled
+            ScopedPhase(const char* name, double& seconds) : m_seconds(seconds), m_start(std::chrono::steady_clock::now()), m_profile(name) {}
+            ~ScopedPhase() { m_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count(); }
+
+        private:
+            double& m_seconds;
+            std::chrono::steady_clock::time_point m_start;
+            ProfileScope m_profile;
+        };
+    }
+
+    const char* integratorName(Integrator integrator) {
+        switch (integrator) {
+            case Integrator::Euler: return "euler";
+            case Integrator::Leapfrog: return "leapfrog";
+            case Integrator::Yoshida4: return "yoshida4";
+        }
+        return "unknown";
+    }
+
+    bool parseIntegrator(const std::string& name, Integrator& integrator) {
+        for (auto candidate : {Integrator::Euler, Integrator::Leapfrog, Integrator::Yoshida4}) {
+            if (name == integratorName(candidate)) {
+                integrator = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* treeBackendName(TreeBackend backend) {
+        switch (backend) {
+            case TreeBackend::Pointer: return "pointer";
+            case TreeBackend::Arena: return "arena";
+        }
+        return "unknown";
+    }
+
+    bool parseTreeBackend(const std::string& name, TreeBackend& backend) {
+        for (auto candidate : {TreeBackend::Pointer, TreeBackend::Arena}) {
+            if (name == treeBackendName(candidate)) {
+                backend = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* treeBuildModeName(TreeBuildMode mode) {
+        switch (mode) {
+            case TreeBuildMode::Incremental: return "insert";
+            case TreeBuildMode::MortonBulk: return "morton";
+        }
+        return "unknown";
+    }
+
+    bool parseTreeBuildMode(const std::string& name, TreeBuildMode& mode) {
+        for (auto candidate : {TreeBuildMode::Incremental, TreeBuildMode::MortonBulk}) {
+            if (name == treeBuildModeName(candidate)) {
+                mode = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* treeUpdateModeName(TreeUpdateMode mode) {
+        switch (mode) {
+            case TreeUpdateMode::Rebuild: return "rebuild";
+            case TreeUpdateMode::Refit: return "refit";
+        }
+        return "unknown";
+    }
+
+    const char* forceKernelName(ForceKernel kernel) {
+        switch (kernel) {
+            case ForceKernel::Scalar: return "scalar";
+            case ForceKernel::Vectorized: return "vectorized";
+        }
+        return "unknown";
+    }
+
+    bool parseForceKernel(const std::string& name, ForceKernel& kernel) {
+        for (auto candidate : {ForceKernel::Scalar, ForceKernel::Vectorized}) {
+            if (name == forceKernelName(candidate)) {
+                kernel = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* forceEngineName(ForceEngine engine) {
+        switch (engine) {
+            case ForceEngine::BarnesHut: return "barnes-hut";
+            case ForceEngine::FastMultipole: return "fmm";
+            case ForceEngine::Direct: return "direct";
+        }
+        return "unknown";
+    }
+
+    bool parseForceEngine(const std::string& name, ForceEngine& engine) {
+        for (auto candidate : {ForceEngine::BarnesHut, ForceEngine::FastMultipole, ForceEngine::Direct}) {
+            if (name == forceEngineName(candidate)) {
+                engine = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
 
     // BHQuadtreeNode
     //--------------------------------------------------------------------------------------
@@ -35,16 +170,22 @@ namespace physics {
         }
     }
 
-    void BHQuadtreeNode::computeForce(Body& target) const {
+    void BHQuadtreeNode::computeForce(Body& target, const SimulationParameters& parameters) const {
+        PROFILE_COUNT(NodeVisits, 1);
         if (!m_divided) {
             if (!m_data) {
                 return;
             }
-            // Leaf node with single body (avoid self-interaction)
-            if (m_data && *m_data == target) {
-                return;
+            // Leaf node with single body (avoid self-interaction), or coincident ones at the depth cap
+            if (!(*m_data == target)) {
+                addDirectForce(target, *m_data, parameters);
             }
-            addDirectForce(target, *m_data);
+            for (const auto& overflow : m_overflow) {
+                if (!(*overflow.second == target)) {
+                    addDirectForce(target, *overflow.second, parameters);
+                }
+            }
+            PROFILE_COUNT(DirectInteractions, m_overflow.size() + 1);
             return;
         }
         
@@ -52,37 +193,38 @@ namespace physics {
         const auto distance = std::sqrt(r.x * r.x + r.y * r.y);
         
         // Barnes-Hut criterion: s/d < theta
-        if (m_boundary.getWidth() / distance < THETA) {
+        if (m_boundary.getWidth() / distance < parameters.theta) {
             // Treat cell as a single mass
             if (m_totalMass > 0) {
-                addApproximateForce(target, m_centerOfMass, m_totalMass, distance);
+                addApproximateForce(target, m_centerOfMass, m_totalMass, distance, parameters);
+                PROFILE_COUNT(ApproximateInteractions, 1);
             }
         } 
         else {
             // Recursively process children
-            static_cast<BHQuadtreeNode*>(m_nw.get())->computeForce(target);
-            static_cast<BHQuadtreeNode*>(m_ne.get())->computeForce(target);
-            static_cast<BHQuadtreeNode*>(m_sw.get())->computeForce(target);
-            static_cast<BHQuadtreeNode*>(m_se.get())->computeForce(target);
+            static_cast<BHQuadtreeNode*>(m_nw.get())->computeForce(target, parameters);
+            static_cast<BHQuadtreeNode*>(m_ne.get())->computeForce(target, parameters);
+            static_cast<BHQuadtreeNode*>(m_sw.get())->computeForce(target, parameters);
+            static_cast<BHQuadtreeNode*>(m_se.get())->computeForce(target, parameters);
         }
     }
 
-    void BHQuadtreeNode::addDirectForce(Body& target, const Body& source) const {
+    void BHQuadtreeNode::addDirectForce(Body& target, const Body& source, const SimulationParameters& parameters) const {
         const auto r = source.position() - target.position();
         const auto distanceSq = r.x * r.x + r.y * r.y;
         
         // Avoid division by zero and self-interaction
         if (distanceSq == 0) return;
         
-        const float distance = std::sqrt(distanceSq + SOFT_FACTOR);
-        const auto forceMag = G * target.mass() * source.mass() / distanceSq;
+        const float distance = std::sqrt(distanceSq + parameters.softening);
+        const auto forceMag = parameters.gravity * target.mass() * source.mass() / distanceSq;
         const auto forceVec = forceMag * r / distance;
         target.addForce(forceVec);
     }
 
-    void BHQuadtreeNode::addApproximateForce(Body& target, const glm::vec2& comPos, float mass, float distance) const {
+    void BHQuadtreeNode::addApproximateForce(Body& target, const glm::vec2& comPos, float mass, float distance, const SimulationParameters& parameters) const {
         const auto r = comPos - target.position();
-        const auto forceMag = G * target.mass() * mass / (distance * distance);
+        const auto forceMag = parameters.gravity * target.mass() * mass / (distance * distance);
         const auto forceVec = forceMag * r / distance;
         target.addForce(forceVec);
     }
@@ -91,101 +233,863 @@ namespace physics {
 
     // BarnesHutSimulation
     //--------------------------------------------------------------------------------------
-    NBodySimulation::NBodySimulation(glm::vec2 visualArea)
-        : m_root(std::make_unique<BHQuadtreeNode>(
-            AABB(glm::vec2(visualArea.x / 2, visualArea.y / 2), std::max(visualArea.x / 2, visualArea.y / 2) + AREA_PADDING))
-            ) {
+    NBodySimulation::NBodySimulation(glm::vec2 visualArea, const SimulationParameters& parameters, std::shared_ptr<ThreadPool> threadPool)
+        : m_visualArea(visualArea)
+        , m_parameters(parameters)
+        , m_boundary(glm::vec2(visualArea.x / 2, visualArea.y / 2), std::max(visualArea.x / 2, visualArea.y / 2) + parameters.areaPadding)
+        , m_kernelIsa(detectKernelIsa())
+        , m_root(std::make_unique<BHQuadtreeNode>(m_boundary))
+        , m_arenaTree(m_boundary) {
+        m_arenaTree.setParameters(m_parameters);
+        m_fmmSolver.setParameters(m_parameters);
+        m_directSolver.setParameters(m_parameters);
+        if (threadPool) {
+            setThreadPool(std::move(threadPool));
+        }
+        else {
+            setThreadCount(0);
+        }
+    }
 
+    void NBodySimulation::setParameters(const SimulationParameters& parameters) {
+        m_parameters = parameters;
+        m_boundary = getFixedBoundary();
+        m_arenaTree.setParameters(parameters);
+        m_fmmSolver.setParameters(parameters);
+        m_directSolver.setParameters(parameters);
+        m_forcesValid = false;
+        m_hasEnergyReference = false;
+        rebuildTree();
     }
 
-    void NBodySimulation::setBodies(std::vector<std::shared_ptr<Body>>& bodies) {
-        m_bodies = bodies;
+    void NBodySimulation::setBodies(BodyStore&& bodies) {
+        m_bodies = std::move(bodies);
+        m_forcesValid = false;
+        m_hasEnergyReference = false;
+        // The first step evaluates forces against the tree, it has to match the new bodies
+        rebuildTree();
     }
 
-    void NBodySimulation::addBodie(std::shared_ptr<Body> body) {
-        m_bodies.push_back(body);
+    uint32_t NBodySimulation::addBodie(glm::vec2 position, glm::vec2 velocity, float mass, float radius) {
+        m_forcesValid = false;
+        m_treeStale = true;
+        return m_bodies.add(position, velocity, mass, radius);
+    }
+
+    void NBodySimulation::addBodies(const BodyStore& batch, std::vector<uint32_t>& ids) {
+        if (batch.empty()) {
+            return;
+        }
+        m_forcesValid = false;
+        m_treeStale = true;
+        // Geometric growth, a run of small batches must not reallocate on every one
+        const auto required = m_bodies.size() + batch.size();
+        if (m_bodies.x.capacity() < required) {
+            m_bodies.reserve(std::max(required, 2 * m_bodies.size()));
+        }
+        ids.reserve(ids.size() + batch.size());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            ids.push_back(m_bodies.add(batch.position(i), batch.velocity(i), batch.mass[i], batch.radius[i]));
+        }
+    }
+
+    size_t NBodySimulation::removeBodiesInRadius(glm::vec2 center, float radius) {
+        const auto radiusSq = radius * radius;
+        auto found = false;
+        for (size_t i = 0; i < m_bodies.size(); ++i) {
+            const auto offset = m_bodies.position(i) - center;
+            if (offset.x * offset.x + offset.y * offset.y <= radiusSq) {
+                m_bodies.active[i] = 0;
+                found = true;
+            }
+        }
+        if (!found) {
+            return 0;
+        }
+        m_forcesValid = false;
+        m_treeStale = true;
+        return m_bodies.removeInactive(m_retiredBodies, RetireReason::Deleted);
+    }
+
+    void NBodySimulation::clearRetiredBodies() {
+        m_retiredBodies.clear();
+    }
+
+    void NBodySimulation::setThreadCount(size_t threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        setThreadPool(std::make_shared<ThreadPool>(threadCount));
+    }
+
+    void NBodySimulation::setThreadPool(std::shared_ptr<ThreadPool> threadPool) {
+        m_threadPool = std::move(threadPool);
+        m_interactionLists.resize(m_threadPool->getThreadCount());
+        m_workerInteractions.resize(m_threadPool->getThreadCount());
+    }
+
+    void NBodySimulation::setTreeBackend(TreeBackend backend) {
+        m_treeBackend = backend;
+        rebuildTree();
+    }
+
+    void NBodySimulation::setForceEngine(ForceEngine engine) {
+        m_forceEngine = engine;
+        m_forcesValid = false;
+        rebuildTree();
+    }
+
+    void NBodySimulation::setTreeUpdateMode(TreeUpdateMode mode) {
+        m_treeUpdateMode = mode;
+        rebuildTree();
+    }
+
+    void NBodySimulation::setTreeBuildMode(TreeBuildMode mode) {
+        m_treeBuildMode = mode;
+        rebuildTree();
+    }
+
+    void NBodySimulation::setIntegrator(Integrator integrator) {
+        m_integrator = integrator;
+        m_forcesValid = false;
+    }
+
+    void NBodySimulation::setMaxTimeBin(uint32_t maxTimeBin) {
+        m_maxTimeBin = std::min(maxTimeBin, MAX_TIME_BIN);
+    }
+
+    std::vector<size_t> NBodySimulation::getTimeBinOccupancy() const {
+        std::vector<size_t> occupancy(m_maxTimeBin + 1, 0);
+        for (const auto bin : m_bodies.timeBin) {
+            ++occupancy[std::min<uint32_t>(bin, m_maxTimeBin)];
+        }
+        return occupancy;
+    }
+
+    EnergyReport NBodySimulation::measureEnergy() {
+        prepareArenaTree();
+
+        // Partial sums per task rather than per worker, so they add up in the same order for
+        // any thread count. Every pair shows up twice in the potential
+        const auto taskCount = (m_bodies.size() + FORCE_TASK_SIZE - 1) / FORCE_TASK_SIZE;
+        std::vector<double> kinetic(taskCount, 0.0);
+        std::vector<double> potential(taskCount, 0.0);
+        m_threadPool->parallelFor(m_bodies.size(), FORCE_TASK_SIZE, [this, &kinetic, &potential](size_t begin, size_t end, size_t) {
+            const auto task = begin / FORCE_TASK_SIZE;
+            for (auto i = begin; i < end; ++i) {
+                const auto mass = static_cast<double>(m_bodies.mass[i]);
+                kinetic[task] += 0.5 * mass * (m_bodies.vx[i] * m_bodies.vx[i] + m_bodies.vy[i] * m_bodies.vy[i]);
+                potential[task] += 0.5 * mass * m_arenaTree.computePotential(static_cast<int32_t>(i), m_bodies.position(i));
+            }
+        });
+
+        EnergyReport report;
+        report.kinetic = std::accumulate(kinetic.begin(), kinetic.end(), 0.0);
+        report.potential = std::accumulate(potential.begin(), potential.end(), 0.0);
+        report.total = report.kinetic + report.potential;
+        if (!m_hasEnergyReference) {
+            m_referenceEnergy = report.total;
+            m_hasEnergyReference = true;
+        }
+        report.reference = m_referenceEnergy;
+        report.relativeDrift = m_referenceEnergy != 0.0 ? (report.total - m_referenceEnergy) / std::abs(m_referenceEnergy) : 0.0;
+        return report;
     }
     
     // Perform one simulation step
     void NBodySimulation::step(float dt) {
+        PROFILE_SCOPE("step");
+        m_lastStepTimings = StepTimings {};
+        m_lastStepRetiredCount = 0;
+        std::fill(m_workerInteractions.begin(), m_workerInteractions.end(), 0);
+        if (m_treeStale) {
+            // Bodies were added or removed since the last step, the first force pass needs them in the tree
+            ScopedPhase phase("tree build", m_lastStepTimings.buildSeconds);
+            rebuildTree();
+        }
+
+        switch (m_integrator) {
+            case Integrator::Euler:
+                stepEuler(dt);
+                break;
+            case Integrator::Leapfrog:
+                stepLeapfrog(dt, m_maxTimeBin);
+                break;
+            case Integrator::Yoshida4:
+                for (const auto weight : {YOSHIDA_OUTER_WEIGHT, YOSHIDA_INNER_WEIGHT, YOSHIDA_OUTER_WEIGHT}) {
+                    stepLeapfrog(weight * dt, 0);
+                }
+                break;
+        }
+
+        size_t merged;
+        {
+            ScopedPhase phase("collide", m_lastStepTimings.collisionSeconds);
+            merged = resolveCollisions();
+        }
+        if (merged > 0) {
+            // Compaction shifted the slots the tree refers to
+            ScopedPhase phase("tree build", m_lastStepTimings.buildSeconds);
+            rebuildTree();
+        }
+
+        m_lastStepTimings.interactions = std::accumulate(m_workerInteractions.begin(), m_workerInteractions.end(), uint64_t {0});
+    }
+
+    void NBodySimulation::stepEuler(float dt) {
         computeForces();
-        updatePositions(dt);
-        rebuildTree();
+        {
+            ScopedPhase phase("integrate", m_lastStepTimings.integrateSeconds);
+            updatePositions(dt);
+        }
+        retireEscaped();
+        {
+            ScopedPhase phase("tree build", m_lastStepTimings.buildSeconds);
+            updateTree();
+        }
+        // Forces belong to the positions before the drift
+        m_forcesValid = false;
+        ++m_lastStepTimings.substeps;
     }
 
-    void NBodySimulation::computeForces() {
-        auto chunks = getChunks(m_bodies, std::thread::hardware_concurrency(), 100);
-        std::vector<std::future<void>> tasks;
-        for (auto& chunk : chunks) {
-             tasks.emplace_back(std::async([this, &chunk]() ->void {
-                    for(auto it = chunk.first; it < chunk.second; ++it) {
-                        m_root->computeForce(**it);
+    void NBodySimulation::stepLeapfrog(float dt, uint32_t maxTimeBin) {
+        const auto substeps = 1u << maxTimeBin;
+        const auto substepDt = dt / static_cast<float>(substeps);
+
+        // Forces carry over from the closing kick of the previous step
+        if (!m_forcesValid) {
+            computeForces();
+            for (size_t i = 0; i < m_bodies.size(); ++i) {
+                m_bodies.timeBin[i] = selectTimeBin(i, dt, 0, maxTimeBin);
+            }
+        }
+
+        for (uint32_t substep = 0; substep < substeps; ++substep) {
+            {
+                ScopedPhase phase("integrate", m_lastStepTimings.integrateSeconds);
+                kickOpening(dt, substep, maxTimeBin);
+                drift(substepDt);
+            }
+            retireEscaped();
+            {
+                ScopedPhase phase("tree build", m_lastStepTimings.buildSeconds);
+                updateTree();
+            }
+
+            // Every bin closes on the last substep
+            const auto next = substep + 1;
+            const std::vector<uint32_t>* targets = nullptr;
+            if (next < substeps) {
+                m_activeBodies.clear();
+                for (uint32_t i = 0; i < m_bodies.size(); ++i) {
+                    if (next % (1u << (maxTimeBin - m_bodies.timeBin[i])) == 0) {
+                        m_activeBodies.push_back(i);
                     }
-                })
-            );
+                }
+                targets = &m_activeBodies;
+            }
+            computeForces(targets);
+            {
+                ScopedPhase phase("integrate", m_lastStepTimings.integrateSeconds);
+                kickClosing(dt, substep, maxTimeBin, targets);
+            }
         }
+        m_forcesValid = true;
+        m_lastStepTimings.substeps += substeps;
+    }
+
+    void NBodySimulation::kickOpening(float dt, uint32_t substep, uint32_t maxTimeBin) {
+        m_threadPool->parallelFor(m_bodies.size(), INTEGRATION_TASK_SIZE, [this, dt, substep, maxTimeBin](size_t begin, size_t end, size_t) {
+            for (auto i = begin; i < end; ++i) {
+                // Substep 0 starts every bin, bins beyond the current maximum fold into it
+                if (substep == 0) {
+                    m_bodies.timeBin[i] = static_cast<uint8_t>(std::min<uint32_t>(m_bodies.timeBin[i], maxTimeBin));
+                }
+                const auto bin = m_bodies.timeBin[i];
+                if (substep % (1u << (maxTimeBin - bin)) != 0) {
+                    continue;
+                }
+                const auto halfDt = 0.5f * dt / static_cast<float>(1u << bin);
+                m_bodies.vx[i] += (m_bodies.fx[i] / m_bodies.mass[i]) * halfDt;
+                m_bodies.vy[i] += (m_bodies.fy[i] / m_bodies.mass[i]) * halfDt;
+            }
+        });
+    }
+
+    void NBodySimulation::kickClosing(float dt, uint32_t substep, uint32_t maxTimeBin, const std::vector<uint32_t>* targets) {
+        const auto count = targets ? targets->size() : m_bodies.size();
+        m_threadPool->parallelFor(count, INTEGRATION_TASK_SIZE, [this, dt, substep, maxTimeBin, targets](size_t begin, size_t end, size_t) {
+            for (auto k = begin; k < end; ++k) {
+                const auto i = targets ? (*targets)[k] : k;
+                const auto halfDt = 0.5f * dt / static_cast<float>(1u << m_bodies.timeBin[i]);
+                m_bodies.vx[i] += (m_bodies.fx[i] / m_bodies.mass[i]) * halfDt;
+                m_bodies.vy[i] += (m_bodies.fy[i] / m_bodies.mass[i]) * halfDt;
+                m_bodies.timeBin[i] = selectTimeBin(i, dt, substep + 1, maxTimeBin);
+            }
+        });
+    }
 
-        // Wait for all async tasks to complete
-        for (auto& task : tasks) {
-            task.get();
+    uint8_t NBodySimulation::selectTimeBin(size_t index, float dt, uint32_t substep, uint32_t maxTimeBin) const {
+        uint32_t bin = 0;
+        const auto acceleration = std::hypot(m_bodies.fx[index], m_bodies.fy[index]) / m_bodies.mass[index];
+        if (acceleration > 0.0f) {
+            // Length scale of the criterion is the softening length
+            const auto idealDt = m_timeStepAccuracy * std::sqrt(std::sqrt(m_parameters.softening) / acceleration);
+            while (bin < maxTimeBin && dt / static_cast<float>(1u << bin) > idealDt) {
+                ++bin;
+            }
+        }
+        // A longer step has to start on one of its own boundaries
+        while (substep % (1u << (maxTimeBin - bin)) != 0) {
+            ++bin;
         }
+        return static_cast<uint8_t>(bin);
     }
 
-    void NBodySimulation::updatePositions(float dt) {
-        for (auto bodyIter = m_bodies.begin(); bodyIter != m_bodies.end(); /* no increment here */) {
-            // Update velocity and position
-            (*bodyIter)->update(dt);
-            
-            // Check boundaries (simple reflection)
-            if (!m_root->getBoundary().containsPoint((*bodyIter)->position())) {
-                (*bodyIter)->setActive(false);
-                bodyIter = m_bodies.erase(bodyIter);
+    void NBodySimulation::drift(float dt) {
+        // A dynamic root follows the bodies, only a fixed one makes them escape
+        const auto retireOutside = m_parameters.boundaryMode == BoundaryMode::Fixed;
+        m_threadPool->parallelFor(m_bodies.size(), INTEGRATION_TASK_SIZE, [this, dt, retireOutside](size_t begin, size_t end, size_t) {
+            for (auto i = begin; i < end; ++i) {
+                m_bodies.x[i] += m_bodies.vx[i] * dt;
+                m_bodies.y[i] += m_bodies.vy[i] * dt;
+                if (retireOutside && !m_boundary.containsPoint(m_bodies.position(i))) {
+                    m_bodies.active[i] = 0;
+                }
+            }
+        });
+    }
+
+    void NBodySimulation::computeForces(const std::vector<uint32_t>* targets) {
+        ScopedPhase phase("force", m_lastStepTimings.forceSeconds);
+        const auto count = targets ? targets->size() : m_bodies.size();
+        m_lastStepTimings.forceEvaluations += count;
+        if (m_forceEngine == ForceEngine::FastMultipole) {
+            computeMultipoleForces(targets);
+            return;
+        }
+        if (m_forceEngine == ForceEngine::Direct) {
+            computeDirectForces(targets);
+            return;
+        }
+        const auto relativeCriterion = m_parameters.openingCriterion == OpeningCriterion::RelativeForce;
+        m_referenceAccelerations.resize(m_bodies.size());
+
+        m_threadPool->parallelFor(count, FORCE_TASK_SIZE, [this, targets, relativeCriterion](size_t begin, size_t end, size_t worker) {
+            if (targets && m_treeBackend == TreeBackend::Arena && m_forceKernel == ForceKernel::Vectorized) {
+                m_workerInteractions[worker] += computeVectorizedForces(m_kernelIsa, targets->data() + begin, end - begin, m_interactionLists[worker]);
+                return;
+            }
+
+            for (auto k = begin; k < end; ++k) {
+                const auto i = targets ? (*targets)[k] : k;
+                if (relativeCriterion) {
+                    m_referenceAccelerations[i] = referenceAcceleration(i);
+                }
+                m_bodies.fx[i] = 0.0f;
+                m_bodies.fy[i] = 0.0f;
+            }
+            if (m_treeBackend == TreeBackend::Pointer) {
+                for (auto k = begin; k < end; ++k) {
+                    Body body(m_bodies, targets ? (*targets)[k] : k);
+                    m_root->computeForce(body, m_parameters);
+                }
+            }
+            else if (targets) {
+                for (auto k = begin; k < end; ++k) {
+                    computeScalarForces((*targets)[k], (*targets)[k] + 1, m_bodies.fx.data(), m_bodies.fy.data());
+                }
+            }
+            else if (m_forceKernel == ForceKernel::Vectorized) {
+                m_workerInteractions[worker] += computeVectorizedForces(m_kernelIsa, begin, end, m_interactionLists[worker], m_bodies.fx.data(), m_bodies.fy.data());
+            }
+            else {
+                computeScalarForces(begin, end, m_bodies.fx.data(), m_bodies.fy.data());
+            }
+        });
+    }
+
+    void NBodySimulation::computeMultipoleForces(const std::vector<uint32_t>* targets) {
+        const auto count = m_bodies.size();
+        auto* fx = m_bodies.fx.data();
+        auto* fy = m_bodies.fy.data();
+        if (targets) {
+            m_passFx.assign(count, 0.0f);
+            m_passFy.assign(count, 0.0f);
+            fx = m_passFx.data();
+            fy = m_passFy.data();
+        }
+        else {
+            std::fill(m_bodies.fx.begin(), m_bodies.fx.end(), 0.0f);
+            std::fill(m_bodies.fy.begin(), m_bodies.fy.end(), 0.0f);
+        }
+
+        m_fmmSolver.computeForces(m_kernelIsa, fx, fy, m_threadPool.get());
+        m_workerInteractions[0] += m_fmmSolver.getLastStats().bodyInteractions;
+
+        if (targets) {
+            for (const auto i : *targets) {
+                m_bodies.fx[i] = m_passFx[i];
+                m_bodies.fy[i] = m_passFy[i];
+            }
+        }
+    }
+
+    void NBodySimulation::computeDirectForces(const std::vector<uint32_t>* targets) {
+        if (targets) {
+            for (const auto i : *targets) {
+                m_bodies.fx[i] = 0.0f;
+                m_bodies.fy[i] = 0.0f;
+            }
+            m_directSolver.computeForces(m_kernelIsa, m_bodies, targets->data(), targets->size(), m_bodies.fx.data(), m_bodies.fy.data(), m_threadPool.get());
+        }
+        else {
+            std::fill(m_bodies.fx.begin(), m_bodies.fx.end(), 0.0f);
+            std::fill(m_bodies.fy.begin(), m_bodies.fy.end(), 0.0f);
+            m_directSolver.computeForces(m_kernelIsa, m_bodies, m_bodies.fx.data(), m_bodies.fy.data(), m_threadPool.get());
+        }
+        m_workerInteractions[0] += m_directSolver.getLastInteractions();
+    }
+
+    uint64_t NBodySimulation::computeEngineForces(float* fx, float* fy) {
+        switch (m_forceEngine) {
+            case ForceEngine::FastMultipole: {
+                m_fmmSolver.computeForces(m_kernelIsa, fx, fy, m_threadPool.get());
+                const auto& stats = m_fmmSolver.getLastStats();
+                return stats.multipoleInteractions + stats.bodyInteractions;
+            }
+            case ForceEngine::Direct:
+                m_directSolver.computeForces(m_kernelIsa, m_bodies, fx, fy, m_threadPool.get());
+                return m_directSolver.getLastInteractions();
+            case ForceEngine::BarnesHut:
+                break;
+        }
+
+        std::vector<uint64_t> interactions(m_threadPool->getThreadCount(), 0);
+        m_threadPool->parallelFor(m_bodies.size(), FORCE_TASK_SIZE, [this, fx, fy, &interactions](size_t begin, size_t end, size_t worker) {
+            if (m_forceKernel == ForceKernel::Vectorized) {
+                interactions[worker] += computeVectorizedForces(m_kernelIsa, begin, end, m_interactionLists[worker], fx, fy);
             }
             else {
-                ++bodyIter;
+                computeScalarForces(begin, end, fx, fy);
+            }
+        });
+        return std::accumulate(interactions.begin(), interactions.end(), uint64_t {0});
+    }
+
+    float NBodySimulation::referenceAcceleration(size_t index) const {
+        return std::hypot(m_bodies.fx[index], m_bodies.fy[index]) / m_bodies.mass[index];
+    }
+
+    void NBodySimulation::computeScalarForces(size_t begin, size_t end, float* fx, float* fy) const {
+        const auto relativeCriterion = m_parameters.openingCriterion == OpeningCriterion::RelativeForce;
+        for (auto i = begin; i < end; ++i) {
+            const auto reference = relativeCriterion ? m_referenceAccelerations[i] : 0.0f;
+            const auto force = m_arenaTree.computeForce(static_cast<int32_t>(i), m_bodies.position(i), m_bodies.mass[i], reference);
+            fx[i] += force.x;
+            fy[i] += force.y;
+        }
+    }
+
+    uint64_t NBodySimulation::computeVectorizedForces(KernelIsa isa, size_t begin, size_t end, InteractionList& list, float* fx, float* fy) const {
+        const auto relativeCriterion = m_parameters.openingCriterion == OpeningCriterion::RelativeForce;
+        uint64_t interactions = 0;
+        for (auto groupBegin = begin; groupBegin < end; groupBegin += INTERACTION_GROUP_SIZE) {
+            const auto groupEnd = std::min(groupBegin + INTERACTION_GROUP_SIZE, end);
+
+            glm::vec2 groupMin = m_bodies.position(groupBegin);
+            glm::vec2 groupMax = groupMin;
+            auto reference = relativeCriterion ? m_referenceAccelerations[groupBegin] : 0.0f;
+            for (auto i = groupBegin + 1; i < groupEnd; ++i) {
+                groupMin = glm::vec2(std::min(groupMin.x, m_bodies.x[i]), std::min(groupMin.y, m_bodies.y[i]));
+                groupMax = glm::vec2(std::max(groupMax.x, m_bodies.x[i]), std::max(groupMax.y, m_bodies.y[i]));
+                if (relativeCriterion) {
+                    reference = std::min(reference, m_referenceAccelerations[i]);
+                }
+            }
+
+            list.clear();
+            m_arenaTree.collectInteractions(groupMin, groupMax, list, reference);
+            interactions += list.size() * (groupEnd - groupBegin);
+            list.pad(INTERACTION_LIST_PADDING);
+            evaluateInteractions(isa, list, m_parameters.gravity,
+                                 &m_bodies.x[groupBegin], &m_bodies.y[groupBegin], &m_bodies.mass[groupBegin], groupEnd - groupBegin,
+                                 &fx[groupBegin], &fy[groupBegin]);
+        }
+        return interactions;
+    }
+
+    uint64_t NBodySimulation::computeVectorizedForces(KernelIsa isa, const uint32_t* targets, size_t count, InteractionList& list) {
+        // Scattered targets are gathered into contiguous group buffers for the kernel
+        float x[INTERACTION_GROUP_SIZE], y[INTERACTION_GROUP_SIZE], mass[INTERACTION_GROUP_SIZE];
+        float fx[INTERACTION_GROUP_SIZE], fy[INTERACTION_GROUP_SIZE];
+        const auto relativeCriterion = m_parameters.openingCriterion == OpeningCriterion::RelativeForce;
+        uint64_t interactions = 0;
+        for (size_t groupBegin = 0; groupBegin < count; groupBegin += INTERACTION_GROUP_SIZE) {
+            const auto groupSize = std::min(INTERACTION_GROUP_SIZE, count - groupBegin);
+
+            glm::vec2 groupMin = m_bodies.position(targets[groupBegin]);
+            glm::vec2 groupMax = groupMin;
+            auto reference = relativeCriterion ? referenceAcceleration(targets[groupBegin]) : 0.0f;
+            for (size_t k = 0; k < groupSize; ++k) {
+                const auto body = targets[groupBegin + k];
+                if (relativeCriterion) {
+                    reference = std::min(reference, referenceAcceleration(body));
+                }
+                x[k] = m_bodies.x[body];
+                y[k] = m_bodies.y[body];
+                mass[k] = m_bodies.mass[body];
+                fx[k] = 0.0f;
+                fy[k] = 0.0f;
+                groupMin = glm::vec2(std::min(groupMin.x, x[k]), std::min(groupMin.y, y[k]));
+                groupMax = glm::vec2(std::max(groupMax.x, x[k]), std::max(groupMax.y, y[k]));
+            }
+
+            list.clear();
+            m_arenaTree.collectInteractions(groupMin, groupMax, list, reference);
+            interactions += list.size() * groupSize;
+            list.pad(INTERACTION_LIST_PADDING);
+            evaluateInteractions(isa, list, m_parameters.gravity, x, y, mass, groupSize, fx, fy);
+
+            for (size_t k = 0; k < groupSize; ++k) {
+                m_bodies.fx[targets[groupBegin + k]] = fx[k];
+                m_bodies.fy[targets[groupBegin + k]] = fy[k];
+            }
+        }
+        return interactions;
+    }
+
+    KernelComparison NBodySimulation::compareForceKernels() {
+        prepareArenaTree();
+
+        const auto count = m_bodies.size();
+        m_referenceAccelerations.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            m_referenceAccelerations[i] = referenceAcceleration(i);
+        }
+        std::vector<float> walkFx(count, 0.0f), walkFy(count, 0.0f);
+        std::vector<float> exactFx(count, 0.0f), exactFy(count, 0.0f);
+        std::vector<float> simdFx(count, 0.0f), simdFy(count, 0.0f);
+        InteractionList list;
+        computeScalarForces(0, count, walkFx.data(), walkFy.data());
+        computeVectorizedForces(KernelIsa::Scalar, 0, count, list, exactFx.data(), exactFy.data());
+        computeVectorizedForces(m_kernelIsa, 0, count, list, simdFx.data(), simdFy.data());
+
+        auto relativeError = [](float ax, float ay, float bx, float by) {
+            const auto magnitude = std::hypot(bx, by);
+            return magnitude > 0 ? std::hypot(ax - bx, ay - by) / magnitude : 0.0f;
+        };
+
+        KernelComparison result;
+        result.isa = m_kernelIsa;
+        double sumSq = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            const auto kernelError = relativeError(simdFx[i], simdFy[i], exactFx[i], exactFy[i]);
+            const auto pathError = relativeError(simdFx[i], simdFy[i], walkFx[i], walkFy[i]);
+            result.maxKernelError = std::max(result.maxKernelError, kernelError);
+            result.maxRelativeError = std::max(result.maxRelativeError, pathError);
+            sumSq += pathError * pathError;
+        }
+        if (count > 0) {
+            result.rmsRelativeError = static_cast<float>(std::sqrt(sumSq / count));
+        }
+        return result;
+    }
+
+    ForceAccuracy NBodySimulation::measureForceAccuracy(size_t sampleCount) {
+        if (m_forceEngine == ForceEngine::BarnesHut) {
+            prepareArenaTree();
+        }
+
+        const auto count = m_bodies.size();
+        ForceAccuracy result;
+        result.samples = std::min(sampleCount, count);
+        if (result.samples == 0) {
+            return result;
+        }
+        m_referenceAccelerations.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            m_referenceAccelerations[i] = referenceAcceleration(i);
+        }
+
+        // Only Barnes-Hut evaluates one body at a time, the other engines run once for everybody
+        const auto wholePass = m_forceEngine != ForceEngine::BarnesHut;
+        uint64_t wholePassInteractions = 0;
+        if (wholePass) {
+            m_passFx.assign(count, 0.0f);
+            m_passFy.assign(count, 0.0f);
+            wholePassInteractions = computeEngineForces(m_passFx.data(), m_passFy.data());
+        }
+
+        std::vector<float> errors(result.samples, 0.0f);
+        std::vector<uint64_t> interactions(m_threadPool->getThreadCount(), 0);
+        m_threadPool->parallelFor(result.samples, 1, [this, count, wholePass, &errors, &interactions](size_t begin, size_t end, size_t worker) {
+            auto& list = m_interactionLists[worker];
+            for (auto s = begin; s < end; ++s) {
+                const auto i = s * count / errors.size();
+
+                // Direct sum with the softened pair force, in double
+                double directX = 0.0, directY = 0.0;
+                for (size_t j = 0; j < count; ++j) {
+                    const double rx = m_bodies.x[j] - m_bodies.x[i];
+                    const double ry = m_bodies.y[j] - m_bodies.y[i];
+                    const auto distanceSq = rx * rx + ry * ry;
+                    if (distanceSq == 0) continue;
+                    const auto scale = m_bodies.mass[j] / (distanceSq * std::sqrt(distanceSq + m_parameters.softening));
+                    directX += scale * rx;
+                    directY += scale * ry;
+                }
+                directX *= m_parameters.gravity * m_bodies.mass[i];
+                directY *= m_parameters.gravity * m_bodies.mass[i];
+
+                float fx = 0.0f, fy = 0.0f;
+                if (wholePass) {
+                    fx = m_passFx[i];
+                    fy = m_passFy[i];
+                    const auto magnitude = std::hypot(directX, directY);
+                    errors[s] = magnitude > 0 ? static_cast<float>(std::hypot(fx - directX, fy - directY) / magnitude) : 0.0f;
+                    continue;
+                }
+
+                // Same interaction list the vectorized path would use for this body alone
+                const auto target = static_cast<uint32_t>(i);
+                list.clear();
+                const auto reference = m_parameters.openingCriterion == OpeningCriterion::RelativeForce ? m_referenceAccelerations[i] : 0.0f;
+                m_arenaTree.collectInteractions(m_bodies.position(target), m_bodies.position(target), list, reference);
+                interactions[worker] += list.size();
+                list.pad(INTERACTION_LIST_PADDING);
+                evaluateInteractions(m_kernelIsa, list, m_parameters.gravity, &m_bodies.x[i], &m_bodies.y[i], &m_bodies.mass[i], 1, &fx, &fy);
+
+                const auto magnitude = std::hypot(directX, directY);
+                errors[s] = magnitude > 0 ? static_cast<float>(std::hypot(fx - directX, fy - directY) / magnitude) : 0.0f;
+            }
+        });
+
+        double sumSq = 0.0;
+        for (const auto error : errors) {
+            result.maxRelativeError = std::max(result.maxRelativeError, error);
+            sumSq += static_cast<double>(error) * error;
+        }
+        result.rmsRelativeError = static_cast<float>(std::sqrt(sumSq / errors.size()));
+        result.interactions = std::accumulate(interactions.begin(), interactions.end(), uint64_t {0});
+        if (wholePass) {
+            result.interactions = wholePassInteractions * result.samples / count;
+        }
+        return result;
+    }
+
+    ForceAccuracy NBodySimulation::measureAgainstDirect() {
+        const auto count = m_bodies.size();
+        ForceAccuracy result;
+        result.samples = count;
+        if (count == 0) {
+            return result;
+        }
+        if (m_forceEngine == ForceEngine::BarnesHut) {
+            prepareArenaTree();
+        }
+        m_referenceAccelerations.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            m_referenceAccelerations[i] = referenceAcceleration(i);
+        }
+
+        std::vector<float> engineFx(count, 0.0f), engineFy(count, 0.0f);
+        std::vector<float> directFx(count, 0.0f), directFy(count, 0.0f);
+        result.interactions = computeEngineForces(engineFx.data(), engineFy.data());
+        m_directSolver.computeForces(m_kernelIsa, m_bodies, directFx.data(), directFy.data(), m_threadPool.get());
+
+        double sumSq = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            const auto magnitude = std::hypot(directFx[i], directFy[i]);
+            const auto error = magnitude > 0 ? std::hypot(engineFx[i] - directFx[i], engineFy[i] - directFy[i]) / magnitude : 0.0f;
+            result.maxRelativeError = std::max(result.maxRelativeError, error);
+            sumSq += static_cast<double>(error) * error;
+        }
+        result.rmsRelativeError = static_cast<float>(std::sqrt(sumSq / count));
+        return result;
+    }
+
+    void NBodySimulation::updatePositions(float dt) {
+        // Integration sweep, bodies leaving a fixed boundary are only flagged here
+        const auto retireOutside = m_parameters.boundaryMode == BoundaryMode::Fixed;
+        m_threadPool->parallelFor(m_bodies.size(), INTEGRATION_TASK_SIZE, [this, dt, retireOutside](size_t begin, size_t end, size_t) {
+            for (auto i = begin; i < end; ++i) {
+                // Update velocity and position
+                m_bodies.x[i] += m_bodies.vx[i] * dt;
+                m_bodies.y[i] += m_bodies.vy[i] * dt;
+                m_bodies.vx[i] += (m_bodies.fx[i] / m_bodies.mass[i]) * dt;
+                m_bodies.vy[i] += (m_bodies.fy[i] / m_bodies.mass[i]) * dt;
+
+                if (retireOutside && !m_boundary.containsPoint(m_bodies.position(i))) {
+                    m_bodies.active[i] = 0;
+                }
             }
+        });
+    }
+
+    void NBodySimulation::retireEscaped() {
+        const auto escaped = m_bodies.removeInactive(m_retiredBodies);
+        if (escaped > 0) {
+            // Compaction shifted the slots the tree refers to
+            m_treeStale = true;
         }
+        m_lastStepRetiredCount += escaped;
+        m_totalRetiredCount += escaped;
+    }
+
+    size_t NBodySimulation::resolveCollisions() {
+        m_collisionSolver.resolve(m_bodies, m_threadPool.get());
+        if (m_collisionSolver.getLastStats().merged == 0) {
+            return 0;
+        }
+
+        const auto merged = m_bodies.removeInactive(m_retiredBodies, RetireReason::Merged);
+        m_lastStepRetiredCount += merged;
+        m_totalRetiredCount += merged;
+        m_totalMergedCount += merged;
+        return merged;
+    }
+
+    void NBodySimulation::updateTree() {
+        const auto refit = m_treeUpdateMode == TreeUpdateMode::Refit && !m_treeStale
+                        && m_treeBackend == TreeBackend::Arena && m_forceEngine == ForceEngine::BarnesHut;
+        if (refit) {
+            // The budget counts migrations since the last rebuild, unlinked leaves pile up until then
+            const auto maxMigrated = static_cast<size_t>(m_refitThreshold * static_cast<float>(m_bodies.size()));
+            size_t migrated = 0;
+            const auto refitted = m_arenaTree.refit(m_bodies, maxMigrated, migrated, m_threadPool.get());
+            m_lastStepTimings.migratedBodies += migrated;
+            m_lastStepTimings.refitBodies += m_bodies.size();
+            if (refitted) {
+                ++m_lastStepTimings.treeRefits;
+                return;
+            }
+        }
+        rebuildTree();
     }
 
     void NBodySimulation::rebuildTree() {
-        const auto halfDimension = m_root->getBoundary().halfDimension;
-        const auto center =m_root->getBoundary().center;
-        m_root = std::make_unique<BHQuadtreeNode>(AABB(center, halfDimension));
-        
-        for (auto& body : m_bodies) {
+        ++m_lastStepTimings.treeRebuilds;
+        m_treeStale = false;
+        updateBoundary();
+        if (m_forceEngine == ForceEngine::Direct) {
+            return;
+        }
+        if (m_forceEngine == ForceEngine::FastMultipole) {
+            // Cells are contiguous ranges of the Z curve whatever the build mode
+            sortBodiesByMortonKey();
+            m_fmmSolver.build(m_mortonOrder.getKeys(), m_bodies, m_threadPool.get());
+            return;
+        }
+
+        if (m_treeBuildMode == TreeBuildMode::MortonBulk) {
+            sortBodiesByMortonKey();
+        }
+
+        if (m_treeBackend == TreeBackend::Arena) {
+            buildArenaTree();
+            PROFILE_GAUGE(TreeNodes, m_arenaTree.getNodeCount());
+            PROFILE_GAUGE(TreeDepth, m_arenaTree.getMaxDepth());
+            return;
+        }
+
+        // Views address slots, not bodies, so they only change when the body count does
+        if (m_bodyHandles.size() != m_bodies.size()) {
+            m_bodyHandles.clear();
+            for (size_t i = 0; i < m_bodies.size(); ++i) {
+                m_bodyHandles.push_back(std::make_shared<Body>(m_bodies, i));
+            }
+        }
+
+        m_root = std::make_unique<BHQuadtreeNode>(m_boundary);
+        for (auto& body : m_bodyHandles) {
             m_root->insert(body);
         }
+#if GRAVITY_PROFILE_COUNTERS
+        size_t nodeCount = 0;
+        int depth = 0;
+        m_root->measure(nodeCount, depth);
+        PROFILE_GAUGE(TreeNodes, nodeCount);
+        PROFILE_GAUGE(TreeDepth, depth);
+#endif
     }
 
-    auto NBodySimulation::getChunks(std::vector<std::shared_ptr<Body>>& vec
-                                                                    , size_t numCores
-                                                                    , size_t minChunkSize) -> std::vector<Chunk> const {
-        std::vector<Chunk> chunks;
-        if (vec.empty() || numCores == 0 || minChunkSize == 0) {
-            return chunks;
+    void NBodySimulation::buildArenaTree() {
+        if (m_treeBuildMode == TreeBuildMode::MortonBulk) {
+            m_arenaTree.build(m_boundary, m_mortonOrder.getKeys(), m_bodies, m_threadPool.get());
+            return;
         }
 
-        const auto totalSize = vec.size();
-        auto chunkSize = std::max(minChunkSize, (totalSize + numCores - 1) / numCores);
-        chunkSize = std::max(chunkSize, minChunkSize);
-        const auto numChunks = (totalSize + chunkSize - 1) / chunkSize;
+        insertArenaTree();
+    }
 
-        auto start = vec.begin();
-        for (size_t i = 0; i < numChunks; ++i) {
-            auto end = start;
-            auto remaining = totalSize - (start - vec.begin());
-            auto currentChunkSize = std::min(chunkSize, remaining);
+    void NBodySimulation::insertArenaTree() {
+        m_arenaTree.reset(m_boundary);
+        for (size_t i = 0; i < m_bodies.size(); ++i) {
+            m_arenaTree.insert(static_cast<int32_t>(i), m_bodies);
+        }
+        m_arenaTree.updateMassProperties();
+    }
 
-            if (currentChunkSize < minChunkSize && i < numChunks - 1) {
-                currentChunkSize = minChunkSize;
-            }
+    void NBodySimulation::prepareArenaTree() {
+        if (m_forceEngine == ForceEngine::BarnesHut && m_treeBackend == TreeBackend::Arena) {
+            return;
+        }
+        // The direct engine never sorts the bodies, and sorting them here would make a
+        // measurement change the run, insert them where they are instead
+        if (m_forceEngine == ForceEngine::Direct) {
+            insertArenaTree();
+            return;
+        }
+        buildArenaTree();
+    }
+
+    AABB NBodySimulation::getFixedBoundary() const {
+        return AABB(glm::vec2(m_visualArea.x / 2, m_visualArea.y / 2), std::max(m_visualArea.x / 2, m_visualArea.y / 2) + m_parameters.areaPadding);
+    }
+
+    void NBodySimulation::updateBoundary() {
+        if (m_parameters.boundaryMode == BoundaryMode::Fixed || m_bodies.size() == 0) {
+            m_boundary = getFixedBoundary();
+            return;
+        }
 
-            std::advance(end, currentChunkSize);
-            chunks.emplace_back(start, end);
-            start = end;
+        // Per worker bounds, reduced serially afterwards
+        struct Bounds {
+            float minX {std::numeric_limits<float>::max()};
+            float minY {std::numeric_limits<float>::max()};
+            float maxX {std::numeric_limits<float>::lowest()};
+            float maxY {std::numeric_limits<float>::lowest()};
+        };
+        std::vector<Bounds> workerBounds(m_threadPool->getThreadCount());
+        m_threadPool->parallelFor(m_bodies.size(), INTEGRATION_TASK_SIZE, [this, &workerBounds](size_t begin, size_t end, size_t worker) {
+            auto bounds = workerBounds[worker];
+            for (auto i = begin; i < end; ++i) {
+                bounds.minX = std::min(bounds.minX, m_bodies.x[i]);
+                bounds.minY = std::min(bounds.minY, m_bodies.y[i]);
+                bounds.maxX = std::max(bounds.maxX, m_bodies.x[i]);
+                bounds.maxY = std::max(bounds.maxY, m_bodies.y[i]);
+            }
+            workerBounds[worker] = bounds;
+        });
 
-            if (start == vec.end()) break;
+        Bounds total;
+        for (const auto& bounds : workerBounds) {
+            total.minX = std::min(total.minX, bounds.minX);
+            total.minY = std::min(total.minY, bounds.minY);
+            total.maxX = std::max(total.maxX, bounds.maxX);
+            total.maxY = std::max(total.maxY, bounds.maxY);
         }
-        return chunks;
+
+        // Square root cell around the bodies, the tree and the Morton keys assume one
+        const glm::vec2 center((total.minX + total.maxX) / 2, (total.minY + total.maxY) / 2);
+        const auto halfDimension = std::max(total.maxX - total.minX, total.maxY - total.minY) / 2;
+        m_boundary = AABB(center, std::max(halfDimension * (1.0f + DYNAMIC_BOUNDARY_MARGIN), MIN_BOUNDARY_HALF_DIMENSION));
+    }
+
+    void NBodySimulation::sortBodiesByMortonKey() {
+        // Permute bodies into Z order so the tree leaves and the force pass walk memory linearly
+        m_mortonOrder.sort(m_bodies.x, m_bodies.y, m_boundary, m_threadPool.get());
+        m_bodies.permute(m_mortonOrder.getOrder(), m_threadPool.get());
     }
 }
@@ -1,10 +1,20 @@
 #pragma once
 
 #include "body.h"
+#include "body_store.h"
+#include "bh_arena_tree.h"
+#include "collision_solver.h"
+#include "direct_solver.h"
+#include "fmm_solver.h"
+#include "force_kernels.h"
+#include "morton_order.h"
+#include "simulation_parameters.h"
 #include "base/quadtree.h"
+#include "base/thread_pool.h"
 
-#include <vector>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace physics {
 
@@ -21,41 +31,285 @@ public:
     const std::shared_ptr<Body> getBody() const { return std::static_pointer_cast<Body>(m_data); }
     float getTotalMass() const { return m_totalMass; }
     void getCenterOfMass(float& x, float& y) const { x = m_centerOfMass.x; y = m_centerOfMass.y; }
-    void computeForce(Body& target) const;
+    // Monopole only, with the geometric criterion whatever the parameters select
+    void computeForce(Body& target, const SimulationParameters& parameters) const;
 
 private:
     virtual bool insert(const glm::vec2& point, std::shared_ptr<Body> data) override;
     void updateMassProperties(const Body& newBody);
-    void addDirectForce(Body& target, const Body& source) const;
-    void addApproximateForce(Body& target, const glm::vec2& comPos, float mass, float distance) const;
+    void addDirectForce(Body& target, const Body& source, const SimulationParameters& parameters) const;
+    void addApproximateForce(Body& target, const glm::vec2& comPos, float mass, float distance, const SimulationParameters& parameters) const;
 
     float m_totalMass {0.0};
     glm::vec2 m_centerOfMass {0.0, 0.0};
 };
 
+// Barnes-Hut tree implementation used by the simulation
+enum class TreeBackend {
+    Pointer,        // BHQuadtreeNode, heap allocated nodes holding shared_ptr<Body> views
+    Arena           // BHArenaTree, flat reusable node pool holding body indices
+};
+
+const char* treeBackendName(TreeBackend backend);
+// Returns false for an unknown name
+bool parseTreeBackend(const std::string& name, TreeBackend& backend);
+
+// How bodies are put into the tree every step
+enum class TreeBuildMode {
+    Incremental,    // Insert bodies one by one in their current order
+    MortonBulk      // Sort bodies along the Z-curve, permute them and build the tree from sorted ranges
+};
+
+const char* treeBuildModeName(TreeBuildMode mode);
+// Returns false for an unknown name
+bool parseTreeBuildMode(const std::string& name, TreeBuildMode& mode);
+
+// What happens to the arena tree between steps
+enum class TreeUpdateMode {
+    Rebuild,        // Build from scratch every time bodies move
+    Refit           // Keep the tree, move only bodies that left their leaf and refit mass properties.
+                    // Falls back to a rebuild once too many bodies migrated, or after bodies were removed
+};
+
+const char* treeUpdateModeName(TreeUpdateMode mode);
+
+// How the arena backend evaluates forces
+enum class ForceKernel {
+    Scalar,         // Walk the tree once per body, one interaction at a time
+    Vectorized      // Collect an interaction list per group of bodies and evaluate it with SIMD
+};
+
+const char* forceKernelName(ForceKernel kernel);
+// Returns false for an unknown name
+bool parseForceKernel(const std::string& name, ForceKernel& kernel);
+
+// Algorithm behind the gravity pass
+enum class ForceEngine {
+    BarnesHut,      // Per body tree walk on the selected backend and kernel
+    FastMultipole,  // FmmSolver: cell to cell expansions, always Morton sorted
+    Direct          // DirectSolver: exact O(n^2) sum, no tree is built
+};
+
+const char* forceEngineName(ForceEngine engine);
+// Returns false for an unknown name
+bool parseForceEngine(const std::string& name, ForceEngine& engine);
+
+// How positions and velocities advance over one step
+enum class Integrator {
+    Euler,          // Legacy first order: drift with the old velocity, then kick, one force pass
+    Leapfrog,       // Kick-drift-kick, second order and symplectic, one force pass with block time steps
+    Yoshida4        // Fourth order composition of three leapfrog steps, three force passes
+};
+
+const char* integratorName(Integrator integrator);
+// Returns false for an unknown name
+bool parseIntegrator(const std::string& name, Integrator& integrator);
+
+// Total energy against the reference taken by the first measurement
+struct EnergyReport {
+    double kinetic {0.0};
+    double potential {0.0};
+    double total {0.0};
+    double reference {0.0};
+    double relativeDrift {0.0};     // (total - reference) / |reference|
+};
+
+// Vectorized kernel accuracy against the scalar path
+struct KernelComparison {
+    KernelIsa isa {KernelIsa::Scalar};
+    float maxKernelError {0.0f};        // SIMD against exact scalar evaluation of the same interaction lists
+    float maxRelativeError {0.0f};      // Vectorized path against the per-body tree walk
+    float rmsRelativeError {0.0f};
+};
+
+// Tree forces against direct summation on a sample of bodies
+struct ForceAccuracy {
+    size_t samples {0};
+    float maxRelativeError {0.0f};
+    float rmsRelativeError {0.0f};
+    uint64_t interactions {0};          // Interactions the engine needed for the sampled bodies, the per body
+                                        // share of the whole pass for the engines that have no per body walk
+};
+
+// Wall time spent in each phase of the last step
+struct StepTimings {
+    double forceSeconds {0.0};
+    double integrateSeconds {0.0};
+    double collisionSeconds {0.0};
+    double buildSeconds {0.0};          // Morton sort, permutation and tree build
+    uint64_t interactions {0};          // Target-source pairs evaluated, counted by the vectorized kernel only
+    uint64_t forceEvaluations {0};      // Bodies whose force was recomputed, summed over substeps
+    uint32_t substeps {0};
+    uint32_t treeRebuilds {0};
+    uint32_t treeRefits {0};
+    uint64_t migratedBodies {0};        // Bodies that changed leaf over the refits
+    uint64_t refitBodies {0};           // Bodies followed over the refits, migratedBodies / refitBodies is the migration rate
+};
+
 class NBodySimulation {
 
 public:
-    explicit NBodySimulation(glm::vec2 visualArea);
+    // Without a pool, one worker per hardware thread is created for this simulation alone
+    explicit NBodySimulation(glm::vec2 visualArea, const SimulationParameters& parameters = SimulationParameters {},
+                             std::shared_ptr<ThreadPool> threadPool = nullptr);
     NBodySimulation(NBodySimulation&& other) noexcept;
     NBodySimulation(const NBodySimulation&) = delete;
     NBodySimulation& operator=(const NBodySimulation&) = delete;
     ~NBodySimulation() = default;
 
-    void setBodies(std::vector<std::shared_ptr<Body>>& bodies);
-    void addBodie(std::shared_ptr<Body> body);
+    // Rebuilds the tree with the new expansion, forces are recomputed by the next step
+    void setParameters(const SimulationParameters& parameters);
+    const SimulationParameters& getParameters() const { return m_parameters; }
+    void setBodies(BodyStore&& bodies);
+    // Between steps only, like every other change to the bodies
+    uint32_t addBodie(glm::vec2 position, glm::vec2 velocity, float mass, float radius = 0.0f);
+    // Append every body of batch, storage grows at most once; the new ids are appended to ids
+    void addBodies(const BodyStore& batch, std::vector<uint32_t>& ids);
+    // Retire the bodies within radius of center as Deleted, returns how many
+    size_t removeBodiesInRadius(glm::vec2 center, float radius);
+    const BodyStore& getBodies() const { return m_bodies; }
+    void setTreeBackend(TreeBackend backend);
+    TreeBackend getTreeBackend() const { return m_treeBackend; }
+    void setTreeBuildMode(TreeBuildMode mode);
+    TreeBuildMode getTreeBuildMode() const { return m_treeBuildMode; }
+    // Rebuilds the tree, forces are recomputed by the next step
+    void setForceEngine(ForceEngine engine);
+    ForceEngine getForceEngine() const { return m_forceEngine; }
+    const FmmStats& getFmmStats() const { return m_fmmSolver.getLastStats(); }
+    // Refit applies to the arena backend with the Barnes-Hut engine, the others always rebuild
+    void setTreeUpdateMode(TreeUpdateMode mode);
+    TreeUpdateMode getTreeUpdateMode() const { return m_treeUpdateMode; }
+    // Fraction of the bodies allowed to migrate between two rebuilds
+    void setRefitThreshold(float maxMigratedFraction) { m_refitThreshold = maxMigratedFraction; }
+    float getRefitThreshold() const { return m_refitThreshold; }
+    void setForceKernel(ForceKernel kernel) { m_forceKernel = kernel; }
+    ForceKernel getForceKernel() const { return m_forceKernel; }
+    KernelIsa getKernelIsa() const { return m_kernelIsa; }
+    // Evaluate the current tree with both kernels, bodies are left untouched
+    KernelComparison compareForceKernels();
+    // Forces of the selected engine on sampleCount evenly spaced bodies against O(n) direct sums each
+    ForceAccuracy measureForceAccuracy(size_t sampleCount);
+    // Forces of the selected engine on every body against the Direct engine, O(n^2)
+    ForceAccuracy measureAgainstDirect();
+    void setCollisionPolicy(CollisionPolicy policy) { m_collisionSolver.setPolicy(policy); }
+    CollisionPolicy getCollisionPolicy() const { return m_collisionSolver.getPolicy(); }
+    const CollisionStats& getCollisionStats() const { return m_collisionSolver.getLastStats(); }
+    void setIntegrator(Integrator integrator);
+    Integrator getIntegrator() const { return m_integrator; }
+    // Leapfrog block time steps: step(dt) is split into 2^maxTimeBin substeps and a body in
+    // bin k only gets its force recomputed every 2^(maxTimeBin - k) substeps. 0 is a global step.
+    void setMaxTimeBin(uint32_t maxTimeBin);
+    uint32_t getMaxTimeBin() const { return m_maxTimeBin; }
+    // eta in dt_i = eta * sqrt(softening / |a_i|), smaller is more accurate
+    void setTimeStepAccuracy(float eta) { m_timeStepAccuracy = eta; }
+    float getTimeStepAccuracy() const { return m_timeStepAccuracy; }
+    // Bodies per time bin after the last step
+    std::vector<size_t> getTimeBinOccupancy() const;
+    // Kinetic plus tree potential energy, O(n log n); the first call sets the reference
+    EnergyReport measureEnergy();
+    void resetEnergyReference() { m_hasEnergyReference = false; }
     void step(float dt);
+    const StepTimings& getLastStepTimings() const { return m_lastStepTimings; }
+
+    // Bodies removed after leaving the boundary or being merged, kept until the owner clears them
+    const std::vector<RetiredBody>& getRetiredBodies() const { return m_retiredBodies; }
+    void clearRetiredBodies();
+    size_t getLastStepRetiredCount() const { return m_lastStepRetiredCount; }
+    size_t getTotalRetiredCount() const { return m_totalRetiredCount; }
+    size_t getTotalMergedCount() const { return m_totalMergedCount; }
+
+    // Recreates the worker pool, 0 selects std::thread::hardware_concurrency()
+    void setThreadCount(size_t threadCount);
+    // Run on a pool shared with other simulations. Steps may be called from one of its workers,
+    // the step's tasks then stay on that worker unless idle workers steal them.
+    void setThreadPool(std::shared_ptr<ThreadPool> threadPool);
+    const ThreadPool& getThreadPool() const { return *m_threadPool; }
+    // Idle between steps, the thread that calls step() may borrow it in between
+    ThreadPool& getThreadPool() { return *m_threadPool; }
+    // Bit-identical runs for any thread count. Reductions, the tree build and the Barnes-Hut and
+    // multipole passes add up in a fixed order anyway; this only switches the Direct engine from
+    // third law tile pairs to one way sums, doubling its work
+    void setDeterministic(bool deterministic) { m_directSolver.setDeterministic(deterministic); }
+    bool isDeterministic() const { return m_directSolver.isDeterministic(); }
 
 private:
+    // Refit when the mode allows it, otherwise build from scratch
+    void updateTree();
     void rebuildTree();
-    void computeForces();
+    // Root box of the next build: the visual area in BoundaryMode::Fixed, the bounds of the bodies otherwise
+    void updateBoundary();
+    AABB getFixedBoundary() const;
+    // Recompute forces of all bodies, or only of the listed ones
+    void computeForces(const std::vector<uint32_t>* targets = nullptr);
+    void stepEuler(float dt);
+    void stepLeapfrog(float dt, uint32_t maxTimeBin);
+    // Half kicks of the bodies whose time step starts at substep, or ends after it
+    void kickOpening(float dt, uint32_t substep, uint32_t maxTimeBin);
+    void kickClosing(float dt, uint32_t substep, uint32_t maxTimeBin, const std::vector<uint32_t>* targets);
+    uint8_t selectTimeBin(size_t index, float dt, uint32_t substep, uint32_t maxTimeBin) const;
+    void drift(float dt);
     void updatePositions(float dt);
+    void retireEscaped();
+    // Returns the number of merged bodies
+    size_t resolveCollisions();
+    void sortBodiesByMortonKey();
+    void buildArenaTree();
+    // Build without sorting, for bodies that are not in Morton order
+    void insertArenaTree();
+    // Make the arena tree match the bodies when the step itself did not build it
+    void prepareArenaTree();
+    // A target subset still costs a full evaluation, only the targets are written back
+    void computeMultipoleForces(const std::vector<uint32_t>* targets);
+    void computeDirectForces(const std::vector<uint32_t>* targets);
+    // Forces of the selected engine on every body, added to fx, fy; the arena tree and the reference
+    // accelerations must be current. Returns the number of interactions evaluated
+    uint64_t computeEngineForces(float* fx, float* fy);
+    // |a| of the forces currently stored, the reference of the RelativeForce criterion
+    float referenceAcceleration(size_t index) const;
+    void computeScalarForces(size_t begin, size_t end, float* fx, float* fy) const;
+    // Returns the number of interactions evaluated
+    uint64_t computeVectorizedForces(KernelIsa isa, size_t begin, size_t end, InteractionList& list, float* fx, float* fy) const;
+    uint64_t computeVectorizedForces(KernelIsa isa, const uint32_t* targets, size_t count, InteractionList& list);
 
-    using Chunk = std::pair<std::vector<std::shared_ptr<Body>>::iterator, std::vector<std::shared_ptr<Body>>::iterator>;
-    auto getChunks(std::vector<std::shared_ptr<Body>>& vec, size_t numCores, size_t minChunkSize) -> std::vector<Chunk> const;
-
+    glm::vec2 m_visualArea;
+    SimulationParameters m_parameters;
+    AABB m_boundary;
+    TreeBackend m_treeBackend {TreeBackend::Arena};
+    TreeBuildMode m_treeBuildMode {TreeBuildMode::MortonBulk};
+    ForceKernel m_forceKernel {ForceKernel::Vectorized};
+    ForceEngine m_forceEngine {ForceEngine::BarnesHut};
+    TreeUpdateMode m_treeUpdateMode {TreeUpdateMode::Rebuild};
+    float m_refitThreshold {0.1f};
+    bool m_treeStale {true};                // Body slots changed since the last build, refit is not possible
+    KernelIsa m_kernelIsa;
     std::unique_ptr<BHQuadtreeNode> m_root;
-    std::vector<std::shared_ptr<Body>> m_bodies;
+    BHArenaTree m_arenaTree;
+    FmmSolver m_fmmSolver;
+    DirectSolver m_directSolver;
+    std::vector<float> m_passFx, m_passFy;    // Whole pass forces kept apart from the bodies
+    BodyStore m_bodies;
+    // Views handed to the pointer backend, one per store slot
+    std::vector<std::shared_ptr<Body>> m_bodyHandles;
+    MortonOrder m_mortonOrder;
+    std::vector<RetiredBody> m_retiredBodies;
+    size_t m_lastStepRetiredCount {0};
+    size_t m_totalRetiredCount {0};
+    size_t m_totalMergedCount {0};
+    CollisionSolver m_collisionSolver;
+    std::shared_ptr<ThreadPool> m_threadPool;
+    // One interaction list per pool worker, reused between steps
+    std::vector<InteractionList> m_interactionLists;
+    std::vector<uint64_t> m_workerInteractions;
+    StepTimings m_lastStepTimings;
+
+    Integrator m_integrator {Integrator::Leapfrog};
+    uint32_t m_maxTimeBin {0};
+    float m_timeStepAccuracy {0.2f};
+    bool m_forcesValid {false};             // fx, fy hold the forces at the current positions
+    std::vector<float> m_referenceAccelerations;    // Per slot, taken before forces are cleared
+    std::vector<uint32_t> m_activeBodies;   // Bodies closing their time step on the current substep
+    double m_referenceEnergy {0.0};
+    bool m_hasEnergyReference {false};
 };
 
 }
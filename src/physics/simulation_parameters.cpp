@@ -0,0 +1,60 @@
+#include "simulation_parameters.h"
+
+namespace physics {
+
+    const char* openingCriterionName(OpeningCriterion criterion) {
+        switch (criterion) {
+            case OpeningCriterion::Geometric: return "geometric";
+            case OpeningCriterion::CenterOfMassOffset: return "com-offset";
+            case OpeningCriterion::RelativeForce: return "relative";
+        }
+        return "unknown";
+    }
+
+    const char* expansionOrderName(ExpansionOrder order) {
+        switch (order) {
+            case ExpansionOrder::Monopole: return "monopole";
+            case ExpansionOrder::Quadrupole: return "quadrupole";
+        }
+        return "unknown";
+    }
+
+    const char* boundaryModeName(BoundaryMode mode) {
+        switch (mode) {
+            case BoundaryMode::Fixed: return "fixed";
+            case BoundaryMode::Dynamic: return "dynamic";
+        }
+        return "unknown";
+    }
+
+    bool parseOpeningCriterion(const std::string& name, OpeningCriterion& criterion) {
+        for (auto candidate : {OpeningCriterion::Geometric, OpeningCriterion::CenterOfMassOffset, OpeningCriterion::RelativeForce}) {
+            if (name == openingCriterionName(candidate)) {
+                criterion = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parseExpansionOrder(const std::string& name, ExpansionOrder& order) {
+        for (auto candidate : {ExpansionOrder::Monopole, ExpansionOrder::Quadrupole}) {
+            if (name == expansionOrderName(candidate)) {
+                order = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool parseBoundaryMode(const std::string& name, BoundaryMode& mode) {
+        for (auto candidate : {BoundaryMode::Fixed, BoundaryMode::Dynamic}) {
+            if (name == boundaryModeName(candidate)) {
+                mode = candidate;
+                return true;
+            }
+        }
+        return false;
+    }
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace physics {
+
+// When a tree node may stand in for all the bodies below it
+enum class OpeningCriterion {
+    Geometric,              // Classic Barnes-Hut: s / d < theta, d measured to the center of mass
+    CenterOfMassOffset,     // d > s / theta + delta, delta the offset of the center of mass from the node center.
+                            // Guards against nodes whose mass sits close to the target side
+    RelativeForce           // G * M * s^2 / d^4 < alpha * |a|, |a| the target acceleration of the previous
+                            // evaluation. Bodies with no previous acceleration fall back to Geometric
+};
+
+// Far field of an accepted node
+enum class ExpansionOrder {
+    Monopole,               // Total mass at the center of mass
+    Quadrupole              // Plus the second moment of the mass distribution about the center of mass
+};
+
+// Extent of the tree root
+enum class BoundaryMode {
+    Fixed,                  // Visual area plus areaPadding, bodies leaving it are retired
+    Dynamic                 // Fitted to the bodies on every rebuild, nothing escapes
+};
+
+const char* openingCriterionName(OpeningCriterion criterion);
+const char* expansionOrderName(ExpansionOrder order);
+const char* boundaryModeName(BoundaryMode mode);
+// Return false for an unknown name
+bool parseOpeningCriterion(const std::string& name, OpeningCriterion& criterion);
+bool parseExpansionOrder(const std::string& name, ExpansionOrder& order);
+bool parseBoundaryMode(const std::string& name, BoundaryMode& mode);
+
+// Physical constants and tree accuracy, all adjustable between steps
+struct SimulationParameters {
+    float gravity {1.0f};                   // Gravitational constant
+    float softening {0.5f};                 // Added to d^2 of body pairs to avoid singularities
+    float theta {1.0f};                     // Opening angle of the Geometric and CenterOfMassOffset criteria
+    float forceAccuracy {0.005f};           // alpha of the RelativeForce criterion
+    OpeningCriterion openingCriterion {OpeningCriterion::Geometric};
+    ExpansionOrder expansionOrder {ExpansionOrder::Monopole};
+    uint32_t multipoleOrder {4};            // Taylor order of the fast multipole expansions, 1 to FmmSolver::MAX_ORDER
+    float multipoleAcceptance {0.5f};       // Cells interact through expansions when rA + rB < acceptance * d
+    uint32_t leafBucketSize {8};            // Bodies per arena tree leaf before it splits: more means fewer nodes
+                                            // but more direct pairs
+    BoundaryMode boundaryMode {BoundaryMode::Dynamic};
+    float areaPadding {10.0f};              // Margin around the visual area before bodies escape, Fixed mode
+};
+
+}
@@ -1,13 +1,13 @@
 #pragma once
 
-#include <memory>
-#include <vector>
-
-class DrawableBody;
+#include "bodies_holder.h"
+#include "scenario_generator.h"
 
 class BodiesGenerator {
 
 public:
     BodiesGenerator() = delete;
-    static std::vector<std::shared_ptr<DrawableBody>> generateRandomBodies(size_t number, float areaWidth, float areaHeight);
+    static BodiesHolder generateRandomBodies(size_t number, float areaWidth, float areaHeight, uint64_t seed);
+    // Physics state from the scenario generator, drawn in white
+    static BodiesHolder generateScenario(const ScenarioConfig& config, ThreadPool* pool = nullptr);
 };
@@ -1,6 +1,47 @@
 #include "bodies_holder.h"
-#include "graphics/drawable_body.h"
+#include "io/checkpoint.h"
 
-BodiesHolder::BodiesHolder(std::vector<std::shared_ptr<DrawableBody>>&& bodies) : m_bodies(std::move(bodies)) {
-    
-}
\ No newline at end of file
+#include <cstring>
+#include <utility>
+
+void BodiesHolder::reserve(size_t count) {
+    m_store.reserve(count);
+    m_appearances.reserve(count);
+}
+
+uint32_t BodiesHolder::add(glm::vec2 pos, glm::vec2 vel, float mass, float radius, Color color) {
+    const auto id = m_store.add(pos, vel, mass, radius);
+    m_appearances.resize(id + 1);
+    m_appearances[id] = BodyAppearance {radius, color};
+    return id;
+}
+
+void BodiesHolder::assign(physics::BodyStore&& store, Color color) {
+    m_store = std::move(store);
+    m_appearances.assign(m_store.getIdCapacity(), BodyAppearance {0.0f, color});
+    for (size_t i = 0; i < m_store.size(); ++i) {
+        m_appearances[m_store.id[i]].radius = m_store.radius[i];
+    }
+}
+
+bool BodiesHolder::loadCheckpoint(const std::string& path, CheckpointInfo* info, std::string* error) {
+    CheckpointReader reader;
+    if (!reader.open(path, error)) {
+        return false;
+    }
+    reader.restore(m_store);
+
+    const auto* colors = reader.hasColors() ? reader.getArray<uint32_t>(CheckpointArray::Color) : nullptr;
+    m_appearances.assign(m_store.getIdCapacity(), BodyAppearance {});
+    for (size_t i = 0; i < m_store.size(); ++i) {
+        auto& appearance = m_appearances[m_store.id[i]];
+        appearance.radius = m_store.radius[i];
+        if (colors) {
+            std::memcpy(&appearance.color, &colors[i], sizeof(uint32_t));
+        }
+    }
+    if (info) {
+        *info = reader.getInfo();
+    }
+    return true;
+}
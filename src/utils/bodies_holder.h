@@ -1,15 +1,31 @@
 #pragma once
 
-#include <memory>
+#include "physics/body_store.h"
+#include "graphics/drawable_body.h"
+
+#include <string>
 #include <vector>
 
-class DrawableBody;
+struct CheckpointInfo;
 
+// Initial scene: physics state plus the appearance of every body, indexed by body id
 class BodiesHolder {
 
 public:
-    BodiesHolder(std::vector<std::shared_ptr<DrawableBody>>&& bodies);
+    BodiesHolder() = default;
+
+    void reserve(size_t count);
+    uint32_t add(glm::vec2 pos, glm::vec2 vel, float mass, float radius, Color color);
+    // Replace the scene with generated bodies, all drawn in one color
+    void assign(physics::BodyStore&& store, Color color);
+    size_t size() const { return m_store.size(); }
+    // Replace the scene with a saved one; bodies without a stored color are white
+    bool loadCheckpoint(const std::string& path, CheckpointInfo* info = nullptr, std::string* error = nullptr);
+
+    physics::BodyStore& getStore() { return m_store; }
+    std::vector<BodyAppearance>& getAppearances() { return m_appearances; }
     
 private:
-    std::vector<std::shared_ptr<DrawableBody>> m_bodies;
+    physics::BodyStore m_store;
+    std::vector<BodyAppearance> m_appearances;
 };
@@ -0,0 +1,197 @@
+#include "scenario_generator.h"
+#include "base/philox.h"
+#include "base/thread_pool.h"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+    const float MIN_MASS = 10.0f;
+    const float MAX_MASS = 100.0f;
+    const float MAX_RANDOM_SPEED = 10.0f;
+    const float MIN_RADIUS = 0.1f;
+    const float MAX_RADIUS = 1.0f;
+    // Below this many bodies the pool costs more than it saves
+    const size_t PARALLEL_MIN_BODIES = 16384;
+    const size_t GENERATE_TASK_SIZE = 4096;
+
+    // One Philox stream per body, keyed by its index in the scenario: a body comes out the
+    // same whichever thread generates it, so the result does not depend on the thread count
+    class ScenarioRandom {
+
+    public:
+        ScenarioRandom(uint64_t seed, size_t body) : m_stream(seed, body) {}
+
+        float uniform() { return m_stream.uniform(); }
+        float uniform(float min, float max) { return m_stream.uniform(min, max); }
+        glm::vec2 uniformVec2(float min, float max) {
+            const auto x = uniform(min, max);
+            return glm::vec2(x, uniform(min, max));
+        }
+        glm::vec2 direction() {
+            const auto angle = uniform(0.0f, glm::two_pi<float>());
+            return glm::vec2(std::cos(angle), std::sin(angle));
+        }
+
+    private:
+        PhiloxStream m_stream;
+    };
+
+    // Run body(i) for every i in [begin, end), spread over the pool for large scenarios
+    template<typename Function>
+    void forEachBody(size_t begin, size_t end, ThreadPool* pool, const Function& body) {
+        auto task = [begin, &body](size_t first, size_t last, size_t) {
+            for (auto i = begin + first; i < begin + last; ++i) {
+                body(i);
+            }
+        };
+        if (pool && end - begin >= PARALLEL_MIN_BODIES) {
+            pool->parallelFor(end - begin, GENERATE_TASK_SIZE, task);
+        }
+        else {
+            task(0, end - begin, 0);
+        }
+    }
+
+    void setBody(physics::BodyStore& bodies, size_t i, glm::vec2 position, glm::vec2 velocity, float mass, float radius) {
+        bodies.x[i] = position.x;
+        bodies.y[i] = position.y;
+        bodies.vx[i] = velocity.x;
+        bodies.vy[i] = velocity.y;
+        bodies.mass[i] = mass;
+        bodies.radius[i] = radius;
+    }
+
+    void addRandomBodies(physics::BodyStore& bodies, size_t begin, size_t end, const ScenarioConfig& config, ThreadPool* pool) {
+        const auto center = config.area / 2.0f;
+        forEachBody(begin, end, pool, [&bodies, &config, center](size_t i) {
+            ScenarioRandom random(config.seed, i);
+            glm::vec2 position;
+            if (config.distribution == Distribution::Disk) {
+                const auto radius = config.area.y / 2.0f * std::sqrt(random.uniform());
+                position = center + random.direction() * radius;
+            }
+            else {
+                position = glm::vec2(random.uniform(0.0f, config.area.x), random.uniform(0.0f, config.area.y));
+            }
+            const auto velocity = random.uniformVec2(-MAX_RANDOM_SPEED, MAX_RANDOM_SPEED);
+            const auto mass = random.uniform(MIN_MASS, MAX_MASS);
+            setBody(bodies, i, position, velocity, mass, random.uniform(MIN_RADIUS, MAX_RADIUS));
+        });
+    }
+
+    // Plummer sphere seen face on, truncated at maxRadius. Surface density falls off as
+    // (1 + R^2/a^2)^-2 and the projected mass inside R is M * R^2 / (R^2 + a^2), which
+    // inverts to R = a * sqrt(u / (1 - u)). Bodies get the circular speed of that mass.
+    void addPlummerDisk(physics::BodyStore& bodies, size_t begin, size_t end, uint64_t seed, ThreadPool* pool,
+                        glm::vec2 center, glm::vec2 bulkVelocity, float scale, float maxRadius, bool clockwise, float gravity) {
+        // Masses first, the orbital speeds need their total. Summed in index order, not per thread
+        forEachBody(begin, end, pool, [&bodies, seed](size_t i) {
+            ScenarioRandom random(seed, i);
+            bodies.mass[i] = random.uniform(MIN_MASS, MAX_MASS);
+        });
+        double totalMass = 0.0;
+        for (auto i = begin; i < end; ++i) {
+            totalMass += bodies.mass[i];
+        }
+
+        const auto scaleSq = scale * scale;
+        const auto truncatedFraction = maxRadius * maxRadius / (maxRadius * maxRadius + scaleSq);
+        const auto diskMass = static_cast<float>(totalMass);
+        forEachBody(begin, end, pool, [&](size_t i) {
+            // Same stream as the mass pass, past the mass draw
+            ScenarioRandom random(seed, i);
+            random.uniform();
+            float radius;
+            do {
+                const auto u = random.uniform();
+                radius = scale * std::sqrt(u / (1.0f - u));
+            } while (radius > maxRadius);
+
+            const auto direction = random.direction();
+            const auto enclosedMass = diskMass * radius * radius / (radius * radius + scaleSq) / truncatedFraction;
+            const auto speed = radius > 0.0f ? std::sqrt(gravity * enclosedMass / radius) : 0.0f;
+            const auto tangent = clockwise ? glm::vec2(direction.y, -direction.x) : glm::vec2(-direction.y, direction.x);
+            setBody(bodies, i, center + direction * radius, bulkVelocity + tangent * speed, bodies.mass[i],
+                    random.uniform(MIN_RADIUS, MAX_RADIUS));
+        });
+    }
+
+    // Room for count fresh bodies with ids 0 to count - 1, filled in place afterwards
+    void allocateBodies(physics::BodyStore& bodies, size_t count) {
+        bodies.clear();
+        for (auto* values : {&bodies.x, &bodies.y, &bodies.vx, &bodies.vy, &bodies.fx, &bodies.fy, &bodies.mass, &bodies.radius}) {
+            values->assign(count, 0.0f);
+        }
+        bodies.active.assign(count, 1);
+        bodies.timeBin.assign(count, 0);
+        bodies.id.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            bodies.id[i] = static_cast<uint32_t>(i);
+        }
+        bodies.restoreIds(static_cast<uint32_t>(count));
+    }
+}
+
+physics::BodyStore ScenarioGenerator::generate(const ScenarioConfig& config, ThreadPool* pool) {
+    physics::BodyStore bodies;
+    allocateBodies(bodies, config.bodyCount);
+
+    const auto center = config.area / 2.0f;
+    const auto extent = std::min(config.area.x, config.area.y) / 2.0f;
+    switch (config.distribution) {
+        case Distribution::Disk:
+        case Distribution::Uniform:
+            addRandomBodies(bodies, 0, config.bodyCount, config, pool);
+            break;
+        case Distribution::Plummer:
+            addPlummerDisk(bodies, 0, config.bodyCount, config.seed, pool, center, glm::vec2(0.0f), extent / 4.0f, extent, false, config.gravity);
+            break;
+        case Distribution::Galaxies: {
+            // Counter-rotating pair approaching on slightly offset paths
+            const auto offset = glm::vec2(config.area.x / 4.0f, extent / 8.0f);
+            const auto approach = glm::vec2(15.0f, 0.0f);
+            const auto first = config.bodyCount / 2;
+            addPlummerDisk(bodies, 0, first, config.seed, pool, center - offset, approach, extent / 10.0f, extent / 2.5f, false, config.gravity);
+            addPlummerDisk(bodies, first, config.bodyCount, config.seed, pool, center + offset, -approach, extent / 10.0f, extent / 2.5f, true, config.gravity);
+            break;
+        }
+    }
+    return bodies;
+}
+
+void ScenarioGenerator::addCluster(physics::BodyStore& bodies, size_t count, glm::vec2 center, glm::vec2 velocity,
+                                   float radius, uint64_t seed, float gravity) {
+    // Generated apart and appended, the target may reuse ids of removed bodies
+    physics::BodyStore cluster;
+    allocateBodies(cluster, count);
+    // Same concentration as the Plummer scenario
+    addPlummerDisk(cluster, 0, count, seed, nullptr, center, velocity, radius / 4.0f, radius, false, gravity);
+
+    bodies.reserve(bodies.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        bodies.add(cluster.position(i), cluster.velocity(i), cluster.mass[i], cluster.radius[i]);
+    }
+}
+
+const char* ScenarioGenerator::distributionName(Distribution distribution) {
+    switch (distribution) {
+        case Distribution::Disk: return "disk";
+        case Distribution::Plummer: return "plummer";
+        case Distribution::Galaxies: return "galaxies";
+        case Distribution::Uniform: return "uniform";
+    }
+    return "unknown";
+}
+
+bool ScenarioGenerator::parseDistribution(const std::string& name, Distribution& distribution) {
+    for (auto candidate : {Distribution::Disk, Distribution::Plummer, Distribution::Galaxies, Distribution::Uniform}) {
+        if (name == distributionName(candidate)) {
+            distribution = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "physics/body_store.h"
+
+#include <glm/vec2.hpp>
+#include <cstdint>
+#include <string>
+
+class ThreadPool;
+
+// Initial body distributions
+enum class Distribution {
+    Disk,           // Uniform disk with random velocities, the sandbox default
+    Plummer,        // Projected Plummer profile on circular orbits
+    Galaxies,       // Two rotating Plummer disks on a collision course
+    Uniform         // Uniform over the whole area with random velocities
+};
+
+struct ScenarioConfig {
+    Distribution distribution {Distribution::Disk};
+    size_t bodyCount {10000};
+    uint64_t seed {1};
+    glm::vec2 area {1010.0f, 660.0f};
+    float gravity {1.0f};           // Orbital velocities are set up for this gravitational constant
+};
+
+// Deterministic, raylib free body generation: the same config always gives the same bodies,
+// with or without a pool and whatever its thread count
+class ScenarioGenerator {
+
+public:
+    ScenarioGenerator() = delete;
+    static physics::BodyStore generate(const ScenarioConfig& config, ThreadPool* pool = nullptr);
+    // Append a rotating Plummer disk of count bodies truncated at radius, bound for the given
+    // gravitational constant and moving with velocity as a whole
+    static void addCluster(physics::BodyStore& bodies, size_t count, glm::vec2 center, glm::vec2 velocity,
+                           float radius, uint64_t seed, float gravity);
+
+    static const char* distributionName(Distribution distribution);
+    // Returns false for an unknown name
+    static bool parseDistribution(const std::string& name, Distribution& distribution);
+};